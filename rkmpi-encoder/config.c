@@ -104,6 +104,7 @@ void config_set_defaults(AppConfig *cfg) {
     cfg->autolanmode = 1;
     cfg->logging = 0;
     cfg->log_max_size = 1024;
+    cfg->stats_push_ms = 1000;
     cfg->acproxycam_flv_proxy = 0;
 
     /* Internal USB port */
@@ -125,6 +126,7 @@ void config_set_defaults(AppConfig *cfg) {
     cfg->timelapse_stream_delay = 0.05f;
     cfg->timelapse_flip_x = 0;
     cfg->timelapse_flip_y = 0;
+    cfg->timelapse_streaming = 1;
     cfg->timelapse_end_delay = 5.0f;
     strncpy(cfg->moonraker_host, "127.0.0.1", sizeof(cfg->moonraker_host) - 1);
     cfg->moonraker_port = 7125;
@@ -159,6 +161,11 @@ void config_set_defaults(AppConfig *cfg) {
     cfg->fault_detect_model_set[0] = '\0';
     cfg->fault_detect_min_free_mem = 20;
     cfg->fault_detect_pace_ms = 150;
+    cfg->fault_detect_model_cache_mb = 24;
+    cfg->fault_detect_sched_enabled = 1;
+    cfg->fault_detect_max_skip_s = 30;
+    cfg->fault_detect_cascade = 1;
+    cfg->fault_detect_roi_crop = 0;
     cfg->heatmap_enabled = 0;
     cfg->fd_beep_pattern = 0;
     cfg->fd_thresholds_json[0] = '\0';
@@ -250,6 +257,7 @@ int config_load(AppConfig *cfg, const char *path) {
     cfg->autolanmode = json_get_bool(root, "autolanmode", cfg->autolanmode);
     cfg->logging = json_get_bool(root, "logging", cfg->logging);
     cfg->log_max_size = clamp_int(json_get_int(root, "log_max_size", cfg->log_max_size), 100, 5120);
+    cfg->stats_push_ms = clamp_int(json_get_int(root, "stats_push_ms", cfg->stats_push_ms), 250, 10000);
     cfg->acproxycam_flv_proxy = json_get_bool(root, "acproxycam_flv_proxy", cfg->acproxycam_flv_proxy);
 
     /* Internal USB port */
@@ -299,6 +307,7 @@ int config_load(AppConfig *cfg, const char *path) {
         json_get_float(root, "timelapse_stream_delay", cfg->timelapse_stream_delay), 0.0f, 5.0f);
     cfg->timelapse_flip_x = json_get_bool(root, "timelapse_flip_x", cfg->timelapse_flip_x);
     cfg->timelapse_flip_y = json_get_bool(root, "timelapse_flip_y", cfg->timelapse_flip_y);
+    cfg->timelapse_streaming = json_get_bool(root, "timelapse_streaming", cfg->timelapse_streaming);
     cfg->timelapse_end_delay = clamp_float(
         json_get_float(root, "timelapse_end_delay", cfg->timelapse_end_delay), 0.0f, 30.0f);
     const char *mr_host = json_get_str(root, "moonraker_host", cfg->moonraker_host);
@@ -335,6 +344,13 @@ int config_load(AppConfig *cfg, const char *path) {
         json_get_int(root, "fault_detect_min_free_mem", cfg->fault_detect_min_free_mem), 5, 100);
     cfg->fault_detect_pace_ms = clamp_int(
         json_get_int(root, "fault_detect_pace_ms", cfg->fault_detect_pace_ms), 0, 500);
+    cfg->fault_detect_model_cache_mb = clamp_int(
+        json_get_int(root, "fault_detect_model_cache_mb", cfg->fault_detect_model_cache_mb), 0, 128);
+    cfg->fault_detect_sched_enabled = json_get_bool(root, "fault_detect_sched_enabled", cfg->fault_detect_sched_enabled);
+    cfg->fault_detect_max_skip_s = clamp_int(
+        json_get_int(root, "fault_detect_max_skip_s", cfg->fault_detect_max_skip_s), 5, 600);
+    cfg->fault_detect_cascade = json_get_bool(root, "fault_detect_cascade", cfg->fault_detect_cascade);
+    cfg->fault_detect_roi_crop = json_get_bool(root, "fault_detect_roi_crop", cfg->fault_detect_roi_crop);
     cfg->heatmap_enabled = json_get_bool(root, "heatmap_enabled", cfg->heatmap_enabled);
     cfg->fd_debug_logging = json_get_bool(root, "fd_debug_logging", cfg->fd_debug_logging);
     cfg->fd_beep_pattern = clamp_int(
@@ -516,6 +532,7 @@ int config_save(const AppConfig *cfg, const char *path) {
     json_set_bool(root, "autolanmode", cfg->autolanmode);
     json_set_bool(root, "logging", cfg->logging);
     json_set_int(root, "log_max_size", cfg->log_max_size);
+    json_set_int(root, "stats_push_ms", cfg->stats_push_ms);
     json_set_bool(root, "acproxycam_flv_proxy", cfg->acproxycam_flv_proxy);
 
     /* Internal USB port */
@@ -556,6 +573,7 @@ int config_save(const AppConfig *cfg, const char *path) {
     json_set_float(root, "timelapse_stream_delay", cfg->timelapse_stream_delay);
     json_set_bool(root, "timelapse_flip_x", cfg->timelapse_flip_x);
     json_set_bool(root, "timelapse_flip_y", cfg->timelapse_flip_y);
+    json_set_bool(root, "timelapse_streaming", cfg->timelapse_streaming);
     json_set_float(root, "timelapse_end_delay", cfg->timelapse_end_delay);
 
     /* Fault Detection */
@@ -569,6 +587,11 @@ int config_save(const AppConfig *cfg, const char *path) {
     json_set_str(root, "fault_detect_model_set", cfg->fault_detect_model_set);
     json_set_int(root, "fault_detect_min_free_mem", cfg->fault_detect_min_free_mem);
     json_set_int(root, "fault_detect_pace_ms", cfg->fault_detect_pace_ms);
+    json_set_int(root, "fault_detect_model_cache_mb", cfg->fault_detect_model_cache_mb);
+    json_set_bool(root, "fault_detect_sched_enabled", cfg->fault_detect_sched_enabled);
+    json_set_int(root, "fault_detect_max_skip_s", cfg->fault_detect_max_skip_s);
+    json_set_bool(root, "fault_detect_cascade", cfg->fault_detect_cascade);
+    json_set_bool(root, "fault_detect_roi_crop", cfg->fault_detect_roi_crop);
     json_set_bool(root, "heatmap_enabled", cfg->heatmap_enabled);
     json_set_bool(root, "fd_debug_logging", cfg->fd_debug_logging);
     json_set_int(root, "fd_beep_pattern", cfg->fd_beep_pattern);
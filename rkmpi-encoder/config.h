@@ -62,6 +62,7 @@ typedef struct {
     int autolanmode;
     int logging;
     int log_max_size;               /* Max log file size in KB (100-5120) */
+    int stats_push_ms;              /* /api/events push interval in ms (250-10000) */
     int acproxycam_flv_proxy;
 
     /* Internal USB port for camera detection */
@@ -83,6 +84,7 @@ typedef struct {
     float timelapse_stream_delay;
     int timelapse_flip_x;
     int timelapse_flip_y;
+    int timelapse_streaming;        /* Encode frames during the print (VENC) */
     float timelapse_end_delay;
     char moonraker_host[64];
     int moonraker_port;
@@ -119,6 +121,11 @@ typedef struct {
     char fault_detect_model_set[64];    /* Selected model set directory name */
     int fault_detect_min_free_mem;
     int fault_detect_pace_ms;
+    int fault_detect_model_cache_mb;    /* CMA budget for resident models (0 = off) */
+    int fault_detect_sched_enabled;     /* Skip unchanged/idle frames */
+    int fault_detect_max_skip_s;        /* Full run at least this often when skipping */
+    int fault_detect_cascade;           /* Cheapest model first, stop when decisively OK */
+    int fault_detect_roi_crop;          /* Zoom model input onto the masked bed region */
     int heatmap_enabled;                /* Spatial heatmap on fault detection */
     int fd_debug_logging;               /* Extra FD diagnostic logging (heatmap split, EMA) */
     int fd_beep_pattern;                /* Buzzer alert on fault: 0=none, 1-5=patterns */
@@ -17,6 +17,8 @@
 #include "fault_detect.h"
 #include "frame_buffer.h"
 #include "timelapse.h"
+#include "timelapse_index.h"
+#include "template_cache.h"
 #include "cJSON.h"
 #include <stdio.h>
 #include <stdlib.h>
@@ -28,6 +30,7 @@
 #include <dirent.h>
 #include <sys/socket.h>
 #include <sys/select.h>
+#include <sys/sendfile.h>
 #include <sys/stat.h>
 #include <sys/statvfs.h>
 #include <sys/wait.h>
@@ -90,9 +93,11 @@ static void send_http_response(int fd, int status_code, const char *content_type
                                 const char *extra_headers) {
     const char *status_text = "OK";
     if (status_code == 204) status_text = "No Content";
+    else if (status_code == 304) status_text = "Not Modified";
     else if (status_code == 404) status_text = "Not Found";
     else if (status_code == 400) status_text = "Bad Request";
     else if (status_code == 500) status_text = "Internal Server Error";
+    else if (status_code == 503) status_text = "Service Unavailable";
     else if (status_code == 302) status_text = "Found";
 
     char headers[1024];
@@ -124,11 +129,61 @@ static void send_json_response(int fd, int status_code, cJSON *json) {
     free(body);
 }
 
+/* Send the document in w as a JSON response */
+static void send_json_writer(int fd, int status_code, JsonWriter *w) {
+    size_t len = 0;
+    const char *body = jw_finish(w, &len);
+    if (!body) {
+        send_http_response(fd, 500, "text/plain", "JSON error", 10, NULL);
+        return;
+    }
+    send_http_response(fd, status_code, "application/json", body, len,
+                       "Access-Control-Allow-Origin: *\r\n");
+}
+
+/* Start a response in the server's reusable JSON buffer */
+static JsonWriter *json_begin(ControlServer *srv) {
+    jw_reset(&srv->json);
+    return &srv->json;
+}
+
 /* Send 404 response */
 static void send_404(int fd) {
     send_http_response(fd, 404, "text/plain", "Not Found", 9, NULL);
 }
 
+/* Send a file with sendfile(2), no userspace copy.
+ * Returns -1 without sending anything if the file can't be opened. */
+static int send_file_response(int fd, const char *path, const char *content_type,
+                              const char *extra_headers) {
+    int file_fd = open(path, O_RDONLY);
+    if (file_fd < 0) return -1;
+
+    struct stat st;
+    if (fstat(file_fd, &st) != 0 || st.st_size <= 0) {
+        close(file_fd);
+        return -1;
+    }
+
+    send_http_response(fd, 200, content_type, NULL, (size_t)st.st_size, extra_headers);
+
+    off_t offset = 0;
+    while (offset < st.st_size) {
+        ssize_t n = sendfile(fd, file_fd, &offset, st.st_size - offset);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                usleep(1000);
+                continue;
+            }
+            break;
+        }
+        if (n == 0) break;
+    }
+
+    close(file_fd);
+    return 0;
+}
+
 static void send_json_error(int fd, int status_code, const char *message) {
     cJSON *root = cJSON_CreateObject();
     cJSON_AddStringToObject(root, "error", message);
@@ -214,96 +269,56 @@ static int form_get_int(const FormParam *params, int count, const char *key, int
     return val ? atoi(val) : def;
 }
 
-/* Read a template file and return malloc'd content (caller must free) */
-static char *load_template(const char *dir, const char *filename) {
-    char path[512];
-    snprintf(path, sizeof(path), "%s/%s", dir, filename);
-
-    FILE *f = fopen(path, "r");
-    if (!f) {
-        fprintf(stderr, "Control: Cannot open template %s: %s\n", path, strerror(errno));
-        return NULL;
+/* Find a request header value (case-insensitive name).
+ * Copies the value into out and returns 0, or -1 if absent. */
+static int get_request_header(const char *request, const char *name,
+                              char *out, size_t out_len) {
+    if (!request) return -1;
+    size_t nlen = strlen(name);
+    const char *line = strstr(request, "\r\n");
+    while (line && line[2] != '\r' && line[2] != '\0') {
+        line += 2;
+        if (strncasecmp(line, name, nlen) == 0 && line[nlen] == ':') {
+            const char *v = line + nlen + 1;
+            while (*v == ' ') v++;
+            size_t vlen = strcspn(v, "\r\n");
+            if (vlen >= out_len) vlen = out_len - 1;
+            memcpy(out, v, vlen);
+            out[vlen] = '\0';
+            return 0;
+        }
+        line = strstr(line, "\r\n");
     }
+    return -1;
+}
 
-    fseek(f, 0, SEEK_END);
-    long fsize = ftell(f);
-    fseek(f, 0, SEEK_SET);
+/* Render a cached template and send it. Answers 304 when the client's
+ * If-None-Match matches and sends the gzip copy when accepted.
+ * Returns -1 (nothing sent) if the template is unavailable. */
+static int send_template(int fd, const char *request, const char *filename,
+                         const TemplateVar *vars, int nvars) {
+    char accept[128] = "";
+    get_request_header(request, "Accept-Encoding", accept, sizeof(accept));
 
-    if (fsize <= 0 || fsize > CTRL_MAX_TEMPLATE) {
-        fclose(f);
-        return NULL;
-    }
+    TemplateOutput out;
+    if (template_render(filename, vars, nvars, strstr(accept, "gzip") != NULL, &out) < 0)
+        return -1;
 
-    char *content = malloc(fsize + 1);
-    if (!content) {
-        fclose(f);
-        return NULL;
+    char extra[160];
+    char inm[64];
+    if (get_request_header(request, "If-None-Match", inm, sizeof(inm)) == 0 &&
+        strcmp(inm, out.etag) == 0) {
+        snprintf(extra, sizeof(extra),
+                 "ETag: %s\r\nCache-Control: no-cache\r\n", out.etag);
+        send_http_response(fd, 304, "text/html; charset=utf-8", NULL, 0, extra);
+        return 0;
     }
 
-    size_t nread = fread(content, 1, fsize, f);
-    fclose(f);
-    content[nread] = '\0';
-    return content;
-}
-
-/* Template substitution: replace $variable_name with values.
- * Returns malloc'd result (caller must free). */
-typedef struct {
-    const char *name;   /* variable name (without $) */
-    const char *value;  /* replacement value */
-} TemplateVar;
-
-static char *template_substitute(const char *tmpl, const TemplateVar *vars, int nvars) {
-    /* Calculate worst-case output size */
-    size_t tmpl_len = strlen(tmpl);
-    size_t max_expansion = 0;
-    for (int i = 0; i < nvars; i++) {
-        max_expansion += strlen(vars[i].value) * 100; /* crude upper bound */
-    }
-
-    size_t out_size = tmpl_len + max_expansion + 1;
-    if (out_size > CTRL_MAX_TEMPLATE) out_size = CTRL_MAX_TEMPLATE;
-
-    char *out = malloc(out_size);
-    if (!out) return NULL;
-
-    size_t out_pos = 0;
-    const char *p = tmpl;
-
-    while (*p && out_pos < out_size - 1) {
-        if (*p == '$') {
-            /* Try to match a variable name */
-            int matched = 0;
-            for (int i = 0; i < nvars; i++) {
-                size_t nlen = strlen(vars[i].name);
-                if (strncmp(p + 1, vars[i].name, nlen) == 0) {
-                    /* Check that next char is not alphanumeric/underscore */
-                    char next = p[1 + nlen];
-                    if (next == '\0' || (!((next >= 'a' && next <= 'z') ||
-                        (next >= 'A' && next <= 'Z') ||
-                        (next >= '0' && next <= '9') || next == '_'))) {
-                        /* Found match - copy value */
-                        size_t vlen = strlen(vars[i].value);
-                        if (out_pos + vlen < out_size) {
-                            memcpy(out + out_pos, vars[i].value, vlen);
-                            out_pos += vlen;
-                        }
-                        p += 1 + nlen;
-                        matched = 1;
-                        break;
-                    }
-                }
-            }
-            if (!matched) {
-                out[out_pos++] = *p++;
-            }
-        } else {
-            out[out_pos++] = *p++;
-        }
-    }
-
-    out[out_pos] = '\0';
-    return out;
+    snprintf(extra, sizeof(extra),
+             "ETag: %s\r\nCache-Control: no-cache\r\nVary: Accept-Encoding\r\n%s",
+             out.etag, out.gzipped ? "Content-Encoding: gzip\r\n" : "");
+    send_http_response(fd, 200, "text/html; charset=utf-8", out.body, out.len, extra);
+    return 0;
 }
 
 /* Read encoder stats from control file (/tmp/h264_ctrl) */
@@ -327,6 +342,8 @@ static void read_encoder_stats(ControlServer *srv) {
         else if (strcmp(key, "mjpeg_clients") == 0) srv->encoder_mjpeg_clients = atoi(val);
         else if (strcmp(key, "flv_clients") == 0) srv->encoder_flv_clients = atoi(val);
         else if (strcmp(key, "display_clients") == 0) srv->encoder_display_clients = atoi(val);
+        else if (strcmp(key, "display_encoded") == 0) srv->encoder_display_encoded = strtoul(val, NULL, 10);
+        else if (strcmp(key, "display_skipped") == 0) srv->encoder_display_skipped = strtoul(val, NULL, 10);
         else if (strcmp(key, "camera_max_fps") == 0) srv->max_camera_fps = atoi(val);
     }
     fclose(f);
@@ -426,14 +443,7 @@ static int get_ip_address(char *buf, size_t bufsize) {
  * ============================================================================ */
 
 /* GET / - Homepage */
-static void serve_homepage(ControlServer *srv, int fd) {
-    char *tmpl = load_template(srv->template_dir, "index.html");
-    if (!tmpl) {
-        /* Fallback: simple redirect to /control */
-        send_redirect(fd, "/control");
-        return;
-    }
-
+static void serve_homepage(ControlServer *srv, int fd, const char *request) {
     char sp[8], cp[8];
     snprintf(sp, sizeof(sp), "%d", srv->config->streaming_port);
     snprintf(cp, sizeof(cp), "%d", srv->config->control_port);
@@ -443,27 +453,14 @@ static void serve_homepage(ControlServer *srv, int fd) {
         { "control_port", cp },
     };
 
-    char *html = template_substitute(tmpl, vars, 2);
-    free(tmpl);
-
-    if (html) {
-        send_http_response(fd, 200, "text/html; charset=utf-8", html, strlen(html),
-                          "Cache-Control: no-cache\r\n");
-        free(html);
-    } else {
-        send_404(fd);
+    if (send_template(fd, request, "index.html", vars, 2) < 0) {
+        /* Fallback: simple redirect to /control */
+        send_redirect(fd, "/control");
     }
 }
 
 /* GET /control - Settings page */
-static void serve_control_page(ControlServer *srv, int fd) {
-    char *tmpl = load_template(srv->template_dir, "control.html");
-    if (!tmpl) {
-        send_http_response(fd, 500, "text/plain",
-                          "Template not found", 18, NULL);
-        return;
-    }
-
+static void serve_control_page(ControlServer *srv, int fd, const char *request) {
     AppConfig *cfg = srv->config;
 
     /* Build template variables */
@@ -605,6 +602,7 @@ static void serve_control_page(ControlServer *srv, int fd) {
         { "timelapse_stream_delay", tl_sd_str },
         { "timelapse_flip_x_checked", cfg->timelapse_flip_x ? checked : empty },
         { "timelapse_flip_y_checked", cfg->timelapse_flip_y ? checked : empty },
+        { "timelapse_streaming_checked", cfg->timelapse_streaming ? checked : empty },
         { "timelapse_end_delay", tl_ed_str },
         /* Fault detection */
         { "fd_installed", fault_detect_installed() ? "true" : "false" },
@@ -622,15 +620,9 @@ static void serve_control_page(ControlServer *srv, int fd) {
     };
     int nvars = sizeof(vars) / sizeof(vars[0]);
 
-    char *html = template_substitute(tmpl, vars, nvars);
-    free(tmpl);
-
-    if (html) {
-        send_http_response(fd, 200, "text/html; charset=utf-8", html, strlen(html),
-                          "Cache-Control: no-cache\r\n");
-        free(html);
-    } else {
-        send_http_response(fd, 500, "text/plain", "Template error", 14, NULL);
+    if (send_template(fd, request, "control.html", vars, nvars) < 0) {
+        send_http_response(fd, 500, "text/plain",
+                          "Template not found", 18, NULL);
     }
 }
 
@@ -725,24 +717,22 @@ static void handle_control_post(ControlServer *srv, int fd,
     send_redirect(fd, "/control");
 }
 
-/* GET /api/stats - JSON stats */
-static void serve_api_stats(ControlServer *srv, int fd) {
-    /* Update CPU and encoder stats */
-    cpu_monitor_update(&srv->cpu_monitor);
-    read_encoder_stats(srv);
-
-    cJSON *root = cJSON_CreateObject();
+/* Write the /api/stats object into w.
+ * CPU and encoder stats come from the server thread's periodic update,
+ * so building is cheap regardless of how many clients ask. */
+static void build_api_stats(ControlServer *srv, JsonWriter *w) {
+    jw_obj_begin(w);
 
     /* CPU stats */
-    cJSON *cpu = cJSON_CreateObject();
+    jw_kobj(w, "cpu");
     float total_cpu = cpu_monitor_get_total(&srv->cpu_monitor);
-    cJSON_AddNumberToObject(cpu, "total", (int)(total_cpu + 0.5f));
+    jw_kint(w, "total", (int)(total_cpu + 0.5f));
 
     /* Encoder CPU: this process (primary rkmpi_enc) */
     float enc_cpu = cpu_monitor_get_process(&srv->cpu_monitor, getpid());
     if (enc_cpu < 0) enc_cpu = 0;
     int enc_cpu_i = (int)(enc_cpu + 0.5f);
-    cJSON_AddNumberToObject(cpu, "encoder_cpu", enc_cpu_i);
+    jw_kint(w, "encoder_cpu", enc_cpu_i);
 
     /* Secondary encoders CPU: sum of all managed child processes */
     float sec_cpu = 0;
@@ -754,16 +744,15 @@ static void serve_api_stats(ControlServer *srv, int fd) {
         }
     }
     int sec_cpu_i = (int)(sec_cpu + 0.5f);
-    cJSON_AddNumberToObject(cpu, "streamer_cpu", sec_cpu_i);
-    cJSON_AddItemToObject(root, "cpu", cpu);
+    jw_kint(w, "streamer_cpu", sec_cpu_i);
+    jw_obj_end(w);
 
-    cJSON_AddNumberToObject(root, "encoder_cpu", enc_cpu_i);
-    cJSON_AddNumberToObject(root, "streamer_cpu", sec_cpu_i);
+    jw_kint(w, "encoder_cpu", enc_cpu_i);
+    jw_kint(w, "streamer_cpu", sec_cpu_i);
 
     /* FPS (round to 1 decimal place) */
-    cJSON *fps = cJSON_CreateObject();
-    cJSON_AddNumberToObject(fps, "mjpeg",
-        ((int)(srv->encoder_mjpeg_fps * 10 + 0.5f)) / 10.0);
+    jw_kobj(w, "fps");
+    jw_knum(w, "mjpeg", ((int)(srv->encoder_mjpeg_fps * 10 + 0.5f)) / 10.0);
     /* Use FLV proxy FPS when proxy is active and local encoder reports 0 */
     float h264_fps = srv->encoder_h264_fps;
     if (h264_fps < 0.1f) {
@@ -771,155 +760,383 @@ static void serve_api_stats(ControlServer *srv, int fd) {
         if (proxy_fps > 0.1f)
             h264_fps = proxy_fps;
     }
-    cJSON_AddNumberToObject(fps, "h264",
-        ((int)(h264_fps * 10 + 0.5f)) / 10.0);
-    cJSON_AddItemToObject(root, "fps", fps);
+    jw_knum(w, "h264", ((int)(h264_fps * 10 + 0.5f)) / 10.0);
+    jw_obj_end(w);
 
     /* Clients */
-    cJSON *clients = cJSON_CreateObject();
-    cJSON_AddNumberToObject(clients, "mjpeg", srv->encoder_mjpeg_clients);
-    cJSON_AddNumberToObject(clients, "flv", srv->encoder_flv_clients);
-    cJSON_AddItemToObject(root, "clients", clients);
+    jw_kobj(w, "clients");
+    jw_kint(w, "mjpeg", srv->encoder_mjpeg_clients);
+    jw_kint(w, "flv", srv->encoder_flv_clients);
+    jw_obj_end(w);
 
     /* Settings */
-    cJSON_AddStringToObject(root, "encoder_type", srv->config->encoder_type);
-    cJSON_AddBoolToObject(root, "h264_enabled", srv->config->h264_enabled);
+    jw_kstr(w, "encoder_type", srv->config->encoder_type);
+    jw_kbool(w, "h264_enabled", srv->config->h264_enabled);
     /* Runtime skip_ratio (auto-adjusted) vs saved config value */
     int rt_skip = srv->runtime_skip_ratio > 0 ? srv->runtime_skip_ratio
                                                : srv->config->skip_ratio;
-    cJSON_AddNumberToObject(root, "skip_ratio", rt_skip);
-    cJSON_AddNumberToObject(root, "saved_skip_ratio", srv->config->skip_ratio);
-    cJSON_AddBoolToObject(root, "auto_skip", srv->config->auto_skip);
-    cJSON_AddNumberToObject(root, "target_cpu", srv->config->target_cpu);
-    cJSON_AddBoolToObject(root, "autolanmode", srv->config->autolanmode);
-    cJSON_AddNumberToObject(root, "mjpeg_fps_target", srv->config->mjpeg_fps);
-    cJSON_AddNumberToObject(root, "max_camera_fps", srv->max_camera_fps);
-    cJSON_AddStringToObject(root, "session_id", srv->session_id);
-    cJSON_AddBoolToObject(root, "display_enabled", srv->config->display_enabled);
-    cJSON_AddNumberToObject(root, "display_fps", srv->config->display_fps);
-    cJSON_AddStringToObject(root, "mode", srv->config->mode);
+    jw_kint(w, "skip_ratio", rt_skip);
+    jw_kint(w, "saved_skip_ratio", srv->config->skip_ratio);
+    jw_kbool(w, "auto_skip", srv->config->auto_skip);
+    jw_kint(w, "target_cpu", srv->config->target_cpu);
+    jw_kbool(w, "autolanmode", srv->config->autolanmode);
+    jw_kint(w, "mjpeg_fps_target", srv->config->mjpeg_fps);
+    jw_kint(w, "max_camera_fps", srv->max_camera_fps);
+    jw_kstr(w, "session_id", srv->session_id);
+    jw_kbool(w, "display_enabled", srv->config->display_enabled);
+    jw_kint(w, "display_fps", srv->config->display_fps);
+    jw_kint(w, "display_frames_encoded", srv->encoder_display_encoded);
+    jw_kint(w, "display_frames_skipped", srv->encoder_display_skipped);
+    jw_kstr(w, "mode", srv->config->mode);
 
     /* Fault detection status */
     {
-        cJSON *fd_obj = cJSON_CreateObject();
+        jw_kobj(w, "fault_detect");
         fd_state_t fd_state = fault_detect_get_state();
         static const char *fd_status_names[] = {
             "disabled", "enabled", "active", "error", "no_npu", "mem_low"
         };
         int si = (int)fd_state.status;
         if (si < 0 || si > 5) si = 3;
-        cJSON_AddStringToObject(fd_obj, "status", fd_status_names[si]);
-        cJSON_AddStringToObject(fd_obj, "detection",
+        jw_kstr(w, "status", fd_status_names[si]);
+        jw_kstr(w, "detection",
             fd_state.last_result.result == FD_CLASS_FAULT ? "fault" : "ok");
-        cJSON_AddStringToObject(fd_obj, "fault_class",
-            fd_state.last_result.fault_class_name);
-        cJSON_AddNumberToObject(fd_obj, "confidence",
+        jw_kstr(w, "fault_class", fd_state.last_result.fault_class_name);
+        jw_knum(w, "confidence",
             ((int)(fd_state.last_result.confidence * 100 + 0.5f)) / 100.0);
-        cJSON_AddNumberToObject(fd_obj, "inference_ms",
-            (int)(fd_state.last_result.total_ms + 0.5f));
-        cJSON_AddNumberToObject(fd_obj, "cycle_count",
-            (double)fd_state.cycle_count);
-        cJSON_AddBoolToObject(fd_obj, "npu_available",
-            fault_detect_npu_available());
+        jw_kint(w, "inference_ms", (int)(fd_state.last_result.total_ms + 0.5f));
+        jw_kint(w, "cycle_count", (long long)fd_state.cycle_count);
+        jw_kbool(w, "npu_available", fault_detect_npu_available());
+
+        /* Resident model cache */
+        {
+            fd_model_cache_stats_t mc = fault_detect_get_model_cache_stats();
+            jw_kobj(w, "model_cache");
+            jw_kint(w, "hits", mc.hits);
+            jw_kint(w, "misses", mc.misses);
+            jw_kint(w, "evictions", mc.evictions);
+            jw_kint(w, "resident", mc.resident);
+            jw_kint(w, "cma_kb", mc.cma_kb);
+            jw_kint(w, "budget_kb", mc.budget_kb);
+            jw_kint(w, "last_load_ms", (int)(mc.last_load_ms + 0.5f));
+            jw_kint(w, "avg_load_ms", (int)(mc.avg_load_ms + 0.5f));
+            jw_kint(w, "zero_copy_runs", mc.zero_copy_runs);
+            jw_kint(w, "input_copies", mc.input_copies);
+            jw_obj_end(w);
+        }
+
+        /* Cascade: this cycle's cost vs. the full stack, learned latency */
+        {
+            fd_cascade_stats_t cs = fault_detect_get_cascade_stats();
+            jw_kobj(w, "cascade");
+            jw_kbool(w, "enabled", srv->config->fault_detect_cascade);
+            jw_kstr(w, "exit", fd_state.last_result.cascade_exit);
+            jw_kint(w, "expected_ms", (int)(fd_state.last_result.expected_ms + 0.5f));
+            jw_kint(w, "actual_ms", (int)(fd_state.last_result.actual_ms + 0.5f));
+            jw_kint(w, "cycles", cs.cycles);
+            jw_kint(w, "exits_cnn", cs.exits_cnn);
+            jw_kint(w, "exits_proto", cs.exits_proto);
+            jw_kint(w, "skipped_multi", cs.skipped_multi);
+            jw_kint(w, "skipped_spatial", cs.skipped_spatial);
+            jw_kint(w, "expected_ms_total", (long long)(cs.expected_ms_total + 0.5));
+            jw_kint(w, "actual_ms_total", (long long)(cs.actual_ms_total + 0.5));
+            jw_kobj(w, "learned_ms");
+            jw_kint(w, "cnn", (int)(cs.cnn_ms + 0.5f));
+            jw_kint(w, "proto", (int)(cs.proto_ms + 0.5f));
+            jw_kint(w, "multi", (int)(cs.multi_ms + 0.5f));
+            jw_kint(w, "spatial", (int)(cs.spatial_ms + 0.5f));
+            jw_obj_end(w);
+            jw_obj_end(w);
+        }
+
+        /* Scheduler decisions */
+        {
+            fd_sched_stats_t ss = fault_detect_get_sched_stats();
+            static const char *print_names[] = { "unknown", "idle", "printing" };
+            jw_kobj(w, "scheduler");
+            jw_kbool(w, "enabled", srv->config->fault_detect_sched_enabled);
+            jw_kint(w, "probes", ss.probes);
+            jw_kint(w, "runs_first", ss.runs_first);
+            jw_kint(w, "runs_verify", ss.runs_verify);
+            jw_kint(w, "runs_risky", ss.runs_risky);
+            jw_kint(w, "runs_layer", ss.runs_layer);
+            jw_kint(w, "runs_scene", ss.runs_scene);
+            jw_kint(w, "runs_stale", ss.runs_stale);
+            jw_kint(w, "runs_fixed", ss.runs_fixed);
+            jw_kint(w, "skips_static", ss.skips_static);
+            jw_kint(w, "skips_idle", ss.skips_idle);
+            jw_knum(w, "last_change_pct",
+                ((int)(ss.last_change_pct * 10 + 0.5f)) / 10.0);
+            jw_kstr(w, "last_decision", ss.last_decision);
+            jw_kstr(w, "print_state", print_names[ss.print_state + 1]);
+            jw_kint(w, "layer", ss.layer);
+            jw_obj_end(w);
+        }
 
         /* Per-model confidence detail */
         {
             #define R2(v) (((int)((v) * 100 + 0.5f)) / 100.0)
-            cJSON *models = cJSON_CreateObject();
             fd_result_t *lr = &fd_state.last_result;
+            jw_kobj(w, "models");
             if (lr->cnn_ran) {
-                cJSON *m = cJSON_CreateObject();
-                cJSON_AddNumberToObject(m, "raw", R2(lr->cnn_raw));
-                cJSON_AddNumberToObject(m, "fault_lk", R2(lr->cnn_fault_lk));
-                cJSON_AddNumberToObject(m, "ms", (int)(lr->cnn_ms + 0.5f));
-                cJSON_AddStringToObject(m, "vote", lr->cnn_vote ? "fault" : "ok");
-                cJSON_AddItemToObject(models, "cnn", m);
+                jw_kobj(w, "cnn");
+                jw_knum(w, "raw", R2(lr->cnn_raw));
+                jw_knum(w, "fault_lk", R2(lr->cnn_fault_lk));
+                jw_kint(w, "ms", (int)(lr->cnn_ms + 0.5f));
+                jw_kstr(w, "vote", lr->cnn_vote ? "fault" : "ok");
+                jw_obj_end(w);
             }
             if (lr->proto_ran) {
-                cJSON *m = cJSON_CreateObject();
-                cJSON_AddNumberToObject(m, "raw", R2(lr->proto_raw));
-                cJSON_AddNumberToObject(m, "fault_lk", R2(lr->proto_fault_lk));
-                cJSON_AddNumberToObject(m, "ms", (int)(lr->proto_ms + 0.5f));
-                cJSON_AddStringToObject(m, "vote", lr->proto_vote ? "fault" : "ok");
-                cJSON_AddItemToObject(models, "proto", m);
+                jw_kobj(w, "proto");
+                jw_knum(w, "raw", R2(lr->proto_raw));
+                jw_knum(w, "fault_lk", R2(lr->proto_fault_lk));
+                jw_kint(w, "ms", (int)(lr->proto_ms + 0.5f));
+                jw_kstr(w, "vote", lr->proto_vote ? "fault" : "ok");
+                jw_obj_end(w);
             }
             if (lr->multi_ran) {
-                cJSON *m = cJSON_CreateObject();
-                cJSON_AddNumberToObject(m, "raw", R2(lr->multi_raw));
-                cJSON_AddNumberToObject(m, "fault_lk", R2(lr->multi_fault_lk));
-                cJSON_AddNumberToObject(m, "ms", (int)(lr->multi_ms + 0.5f));
-                cJSON_AddStringToObject(m, "vote", lr->multi_vote ? "fault" : "ok");
-                cJSON_AddItemToObject(models, "multi", m);
+                jw_kobj(w, "multi");
+                jw_knum(w, "raw", R2(lr->multi_raw));
+                jw_knum(w, "fault_lk", R2(lr->multi_fault_lk));
+                jw_kint(w, "ms", (int)(lr->multi_ms + 0.5f));
+                jw_kstr(w, "vote", lr->multi_vote ? "fault" : "ok");
+                jw_obj_end(w);
             }
-            cJSON_AddItemToObject(fd_obj, "models", models);
+            jw_obj_end(w);
             /* Spatial boost status */
             if (lr->boost_active) {
-                cJSON *boost = cJSON_CreateObject();
-                cJSON_AddBoolToObject(boost, "active", 1);
-                cJSON_AddBoolToObject(boost, "overrode", lr->boost_overrode ? 1 : 0);
-                cJSON_AddNumberToObject(boost, "strong_cells", lr->boost_strong_cells);
-                cJSON_AddNumberToObject(boost, "total_cells", lr->boost_total_cells);
-                cJSON_AddNumberToObject(boost, "heatmap_max", R2(lr->heatmap_max));
-                cJSON_AddItemToObject(fd_obj, "boost", boost);
+                jw_kobj(w, "boost");
+                jw_kbool(w, "active", 1);
+                jw_kbool(w, "overrode", lr->boost_overrode ? 1 : 0);
+                jw_kint(w, "strong_cells", lr->boost_strong_cells);
+                jw_kint(w, "total_cells", lr->boost_total_cells);
+                jw_knum(w, "heatmap_max", R2(lr->heatmap_max));
+                jw_obj_end(w);
             }
             #undef R2
         }
 
         /* Spatial heatmap data */
         {
-            cJSON *hm = cJSON_CreateObject();
-            cJSON_AddBoolToObject(hm, "enabled",
-                srv->config->heatmap_enabled ? 1 : 0);
+            jw_kobj(w, "heatmap");
+            jw_kbool(w, "enabled", srv->config->heatmap_enabled ? 1 : 0);
             if (fd_state.last_result.has_heatmap) {
                 int hm_h = fd_state.last_result.spatial_h > 0 ? fd_state.last_result.spatial_h : 7;
                 int hm_w = fd_state.last_result.spatial_w > 0 ? fd_state.last_result.spatial_w : 7;
-                cJSON_AddBoolToObject(hm, "has_data", 1);
-                cJSON_AddNumberToObject(hm, "rows", hm_h);
-                cJSON_AddNumberToObject(hm, "cols", hm_w);
-                cJSON_AddNumberToObject(hm, "max",
+                jw_kbool(w, "has_data", 1);
+                jw_kint(w, "rows", hm_h);
+                jw_kint(w, "cols", hm_w);
+                jw_knum(w, "max",
                     ((int)(fd_state.last_result.heatmap_max * 100 + 0.5f)) / 100.0);
-                cJSON_AddNumberToObject(hm, "max_row",
-                    fd_state.last_result.heatmap_max_h);
-                cJSON_AddNumberToObject(hm, "max_col",
-                    fd_state.last_result.heatmap_max_w);
-                cJSON *grid = cJSON_CreateArray();
+                jw_kint(w, "max_row", fd_state.last_result.heatmap_max_h);
+                jw_kint(w, "max_col", fd_state.last_result.heatmap_max_w);
+                /* Cells skipped by the mask carry no score: null */
+                const fd_mask196_t *cells = &fd_state.last_result.heatmap_cells;
+                int sparse = !fd_mask_is_zero(cells);
+                jw_karr(w, "grid");
                 for (int h = 0; h < hm_h; h++) {
-                    cJSON *row = cJSON_CreateArray();
-                    for (int w = 0; w < hm_w; w++) {
-                        float v = fd_state.last_result.heatmap[h][w];
-                        cJSON_AddItemToArray(row,
-                            cJSON_CreateNumber(
-                                ((int)(v * 100 + 0.5f)) / 100.0));
+                    jw_arr_begin(w);
+                    for (int x = 0; x < hm_w; x++) {
+                        float v = fd_state.last_result.heatmap[h][x];
+                        if (sparse && !fd_mask_test_bit(cells, h * hm_w + x))
+                            jw_null(w);
+                        else
+                            jw_num(w, ((int)(v * 100 + 0.5f)) / 100.0);
                     }
-                    cJSON_AddItemToArray(grid, row);
+                    jw_arr_end(w);
                 }
-                cJSON_AddItemToObject(hm, "grid", grid);
+                jw_arr_end(w);
             } else {
-                cJSON_AddBoolToObject(hm, "has_data", 0);
+                jw_kbool(w, "has_data", 0);
             }
-            /* Center-crop region */
+            /* Input region the grid covers (bed-region crop when active) */
             {
                 float cx, cy, cw, ch;
                 fault_detect_get_crop(&cx, &cy, &cw, &ch);
-                cJSON *crop_obj = cJSON_CreateObject();
-                cJSON_AddNumberToObject(crop_obj, "x",
-                    ((int)(cx * 10000 + 0.5)) / 10000.0);
-                cJSON_AddNumberToObject(crop_obj, "y",
-                    ((int)(cy * 10000 + 0.5)) / 10000.0);
-                cJSON_AddNumberToObject(crop_obj, "w",
-                    ((int)(cw * 10000 + 0.5)) / 10000.0);
-                cJSON_AddNumberToObject(crop_obj, "h",
-                    ((int)(ch * 10000 + 0.5)) / 10000.0);
-                cJSON_AddItemToObject(hm, "crop", crop_obj);
+                if (fd_state.last_result.crop_w > 0) {
+                    cx = fd_state.last_result.crop_x;
+                    cy = fd_state.last_result.crop_y;
+                    cw = fd_state.last_result.crop_w;
+                    ch = fd_state.last_result.crop_h;
+                }
+                jw_kobj(w, "crop");
+                jw_knum(w, "x", ((int)(cx * 10000 + 0.5)) / 10000.0);
+                jw_knum(w, "y", ((int)(cy * 10000 + 0.5)) / 10000.0);
+                jw_knum(w, "w", ((int)(cw * 10000 + 0.5)) / 10000.0);
+                jw_knum(w, "h", ((int)(ch * 10000 + 0.5)) / 10000.0);
+                jw_obj_end(w);
             }
-            cJSON_AddItemToObject(fd_obj, "heatmap", hm);
+            jw_obj_end(w);
         }
 
-        cJSON_AddItemToObject(root, "fault_detect", fd_obj);
+        jw_obj_end(w);
     }
 
-    send_json_response(fd, 200, root);
-    cJSON_Delete(root);
+    jw_obj_end(w);
+}
+
+/* GET /api/stats - JSON stats */
+static void serve_api_stats(ControlServer *srv, int fd) {
+    JsonWriter *w = json_begin(srv);
+    build_api_stats(srv, w);
+    send_json_writer(fd, 200, w);
+}
+
+/* ============================================================================
+ * Stats push (/api/events, Server-Sent Events)
+ *
+ * Subscribers get a full "stats" event on connect, then "delta" events
+ * holding only the top-level keys that changed since the previous push.
+ * The snapshot is serialized once per tick with member spans tracked, so
+ * the delta is a byte comparison of each member against the last push and
+ * the same bytes are written to every subscriber.
+ * ============================================================================ */
+
+static uint64_t ctrl_time_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void sse_remove(ControlServer *srv, int idx) {
+    close(srv->sse_fds[idx]);
+    srv->sse_fds[idx] = srv->sse_fds[--srv->sse_count];
+}
+
+/* Non-blocking write of a whole event. A subscriber that can't take it
+ * is dropped rather than stalling the server; EventSource reconnects. */
+static int sse_send(int fd, const char *data, size_t len) {
+    ssize_t n = send(fd, data, len, MSG_NOSIGNAL | MSG_DONTWAIT);
+    return (n == (ssize_t)len) ? 0 : -1;
+}
+
+static void sse_broadcast(ControlServer *srv, const char *data, size_t len) {
+    for (int i = srv->sse_count - 1; i >= 0; i--) {
+        if (sse_send(srv->sse_fds[i], data, len) < 0)
+            sse_remove(srv, i);
+    }
+    srv->sse_last_send_ms = ctrl_time_ms();
+}
+
+/* Serialize a stats snapshot into w with top-level member spans */
+static void sse_snapshot(ControlServer *srv, JsonWriter *w) {
+    jw_reset(w);
+    jw_track_spans(w);
+    build_api_stats(srv, w);
+}
+
+/* Frame a whole snapshot as "event: stats" into srv->sse_msg */
+static const char *sse_format_full(ControlServer *srv, const JsonWriter *snap,
+                                   size_t *len) {
+    static const char head[] = "event: stats\ndata: ";
+    JsonWriter *m = &srv->sse_msg;
+    jw_reset(m);
+    jw_write(m, head, sizeof(head) - 1);
+    jw_write(m, snap->buf, snap->len);
+    jw_write(m, "\n\n", 2);
+    return jw_finish(m, len);
+}
+
+/* GET /api/events - Keep the connection open as an SSE subscriber.
+ * Returns 1 if the fd is now owned by the subscriber list. */
+static int sse_subscribe(ControlServer *srv, int fd) {
+    if (srv->sse_count >= CTRL_MAX_SSE_CLIENTS) {
+        send_json_error(fd, 503, "too many event subscribers");
+        return 0;
+    }
+
+    /* Start from the snapshot deltas are computed against, so the
+     * client's merged state stays consistent with later deltas */
+    if (srv->sse_last.len == 0) {
+        sse_snapshot(srv, &srv->sse_last);
+        srv->sse_last_push_ms = ctrl_time_ms();
+    }
+
+    size_t len = 0;
+    const char *msg = jw_finish(&srv->sse_last, NULL) ?
+        sse_format_full(srv, &srv->sse_last, &len) : NULL;
+    if (!msg) {
+        jw_reset(&srv->sse_last);
+        send_json_error(fd, 500, "JSON error");
+        return 0;
+    }
+
+    const char *hdr =
+        "HTTP/1.1 200 OK\r\n"
+        "Content-Type: text/event-stream\r\n"
+        "Cache-Control: no-cache\r\n"
+        "Connection: keep-alive\r\n"
+        "Access-Control-Allow-Origin: *\r\n"
+        "\r\n"
+        "retry: 3000\n\n";
+    if (ctrl_send(fd, hdr, strlen(hdr)) < 0 || ctrl_send(fd, msg, len) < 0)
+        return 0;
+
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    srv->sse_fds[srv->sse_count++] = fd;
+    return 1;
+}
+
+/* Called from the server loop: push a delta at most every stats_push_ms */
+static void sse_tick(ControlServer *srv) {
+    if (srv->sse_count == 0) {
+        /* Nobody listening: drop the base so the next subscriber is fresh */
+        jw_reset(&srv->sse_last);
+        return;
+    }
+
+    uint64_t now = ctrl_time_ms();
+    if (now - srv->sse_last_push_ms < (uint64_t)srv->config->stats_push_ms)
+        return;
+    srv->sse_last_push_ms = now;
+
+    JsonWriter *next = &srv->sse_next;
+    JsonWriter *last = &srv->sse_last;
+    sse_snapshot(srv, next);
+    if (!jw_finish(next, NULL))
+        return;
+
+    const char *msg = NULL;
+    size_t len = 0;
+    if (last->len == 0 || next->spans_overflow || last->spans_overflow) {
+        /* No usable base: resend everything */
+        msg = sse_format_full(srv, next, &len);
+    } else {
+        static const char head[] = "event: delta\ndata: {";
+        JsonWriter *m = &srv->sse_msg;
+        int changed = 0;
+        jw_reset(m);
+        jw_write(m, head, sizeof(head) - 1);
+        for (int i = 0; i < next->nspans; i++) {
+            if (jw_span_equal(next, i, last)) continue;
+            if (changed++) jw_write(m, ",", 1);
+            jw_write(m, next->buf + next->spans[i].off, next->spans[i].len);
+        }
+        jw_write(m, "}\n\n", 3);
+        if (changed)
+            msg = jw_finish(m, &len);
+    }
+
+    if (msg) {
+        sse_broadcast(srv, msg, len);
+    } else if (now - srv->sse_last_send_ms >= 15000) {
+        /* Comment line keeps idle proxies/browsers from timing out */
+        static const char keepalive[] = ": keepalive\n\n";
+        sse_broadcast(srv, keepalive, sizeof(keepalive) - 1);
+    }
+
+    /* The new snapshot becomes the base; the old buffer is reused next tick */
+    JsonWriter tmp = *last;
+    *last = *next;
+    *next = tmp;
+}
+
+static void sse_close_all(ControlServer *srv) {
+    while (srv->sse_count > 0)
+        sse_remove(srv, srv->sse_count - 1);
+    jw_free(&srv->sse_last);
+    jw_free(&srv->sse_next);
+    jw_free(&srv->sse_msg);
 }
 
 /* GET /api/config - Full running config */
@@ -955,8 +1172,10 @@ static void serve_api_config(ControlServer *srv, int fd) {
     cJSON_AddNumberToObject(root, "timelapse_stream_delay", cfg->timelapse_stream_delay);
     cJSON_AddBoolToObject(root, "timelapse_flip_x", cfg->timelapse_flip_x);
     cJSON_AddBoolToObject(root, "timelapse_flip_y", cfg->timelapse_flip_y);
+    cJSON_AddBoolToObject(root, "timelapse_streaming", cfg->timelapse_streaming);
     cJSON_AddStringToObject(root, "session_id", srv->session_id);
     cJSON_AddBoolToObject(root, "acproxycam_flv_proxy", cfg->acproxycam_flv_proxy);
+    cJSON_AddNumberToObject(root, "stats_push_ms", cfg->stats_push_ms);
 
     send_json_response(fd, 200, root);
     cJSON_Delete(root);
@@ -973,73 +1192,78 @@ static void serve_fault_detect_sets(ControlServer *srv, int fd) {
     AppConfig *cfg = srv->config;
     fd_config_t fd_cfg = fault_detect_get_config();
 
-    /* Parse stored thresholds config */
-    cJSON *th_root = NULL;
-    if (cfg->fd_thresholds_json[0])
-        th_root = cJSON_Parse(cfg->fd_thresholds_json);
-
-    cJSON *arr = cJSON_CreateArray();
+    JsonWriter *w = json_begin(srv);
+    jw_obj_begin(w);
+    jw_karr(w, "sets");
     for (int i = 0; i < count; i++) {
-        cJSON *item = cJSON_CreateObject();
-        cJSON_AddStringToObject(item, "dir_name", sets[i].dir_name);
-        cJSON_AddStringToObject(item, "display_name", sets[i].display_name);
-        cJSON_AddStringToObject(item, "description", sets[i].description);
-        cJSON_AddBoolToObject(item, "has_cnn", sets[i].has_cnn);
-        cJSON_AddBoolToObject(item, "has_protonet", sets[i].has_protonet);
-        cJSON_AddBoolToObject(item, "has_multiclass", sets[i].has_multiclass);
-        cJSON_AddStringToObject(item, "cnn_display_name", sets[i].cnn_display_name);
-        cJSON_AddStringToObject(item, "proto_display_name", sets[i].proto_display_name);
-        cJSON_AddStringToObject(item, "multi_display_name", sets[i].multi_display_name);
+        jw_obj_begin(w);
+        jw_kstr(w, "dir_name", sets[i].dir_name);
+        jw_kstr(w, "display_name", sets[i].display_name);
+        jw_kstr(w, "description", sets[i].description);
+        jw_kbool(w, "has_cnn", sets[i].has_cnn);
+        jw_kbool(w, "has_protonet", sets[i].has_protonet);
+        jw_kbool(w, "has_multiclass", sets[i].has_multiclass);
+        jw_kstr(w, "cnn_display_name", sets[i].cnn_display_name);
+        jw_kstr(w, "proto_display_name", sets[i].proto_display_name);
+        jw_kstr(w, "multi_display_name", sets[i].multi_display_name);
 
         int selected = (strcmp(sets[i].dir_name, fd_cfg.model_set) == 0);
-        cJSON_AddBoolToObject(item, "selected", selected);
+        jw_kbool(w, "selected", selected);
 
         /* Profiles */
-        cJSON *prof_obj = cJSON_CreateObject();
+        jw_kobj(w, "profiles");
         for (int p = 0; p < sets[i].num_profiles; p++) {
             fd_threshold_profile_t *pr = &sets[i].profiles[p];
-            cJSON *pj = cJSON_CreateObject();
-            cJSON_AddStringToObject(pj, "description", pr->description);
-            cJSON_AddNumberToObject(pj, "cnn_threshold", round2(pr->cnn_threshold));
-            cJSON_AddNumberToObject(pj, "cnn_dynamic_threshold", round2(pr->cnn_dynamic_threshold));
-            cJSON_AddNumberToObject(pj, "proto_threshold", round2(pr->proto_threshold));
-            cJSON_AddNumberToObject(pj, "proto_dynamic_trigger", round2(pr->proto_dynamic_trigger));
-            cJSON_AddNumberToObject(pj, "multi_threshold", round2(pr->multi_threshold));
-            cJSON_AddNumberToObject(pj, "heatmap_boost_threshold", round2(pr->heatmap_boost_threshold));
+            jw_kobj(w, pr->name);
+            jw_kstr(w, "description", pr->description);
+            jw_knum(w, "cnn_threshold", round2(pr->cnn_threshold));
+            jw_knum(w, "cnn_dynamic_threshold", round2(pr->cnn_dynamic_threshold));
+            jw_knum(w, "proto_threshold", round2(pr->proto_threshold));
+            jw_knum(w, "proto_dynamic_trigger", round2(pr->proto_dynamic_trigger));
+            jw_knum(w, "multi_threshold", round2(pr->multi_threshold));
+            jw_knum(w, "heatmap_boost_threshold", round2(pr->heatmap_boost_threshold));
             /* Advanced boost tuning */
-            cJSON_AddNumberToObject(pj, "boost_min_cells", pr->boost_min_cells);
-            cJSON_AddNumberToObject(pj, "boost_cell_threshold", round2(pr->boost_cell_threshold));
-            cJSON_AddNumberToObject(pj, "boost_lean_factor", round2(pr->boost_lean_factor));
-            cJSON_AddNumberToObject(pj, "boost_proto_lean", round2(pr->boost_proto_lean));
-            cJSON_AddNumberToObject(pj, "boost_multi_lean", round2(pr->boost_multi_lean));
-            cJSON_AddNumberToObject(pj, "boost_proto_veto", round2(pr->boost_proto_veto));
-            cJSON_AddNumberToObject(pj, "boost_proto_strong", round2(pr->boost_proto_strong));
-            cJSON_AddNumberToObject(pj, "boost_amplifier_cap", round2(pr->boost_amplifier_cap));
-            cJSON_AddNumberToObject(pj, "boost_confidence_cap", round2(pr->boost_confidence_cap));
-            cJSON_AddNumberToObject(pj, "ema_alpha", round2(pr->ema_alpha));
-            cJSON_AddNumberToObject(pj, "heatmap_coarse_weight", round2(pr->heatmap_coarse_weight));
-            cJSON_AddItemToObject(prof_obj, pr->name, pj);
+            jw_kint(w, "boost_min_cells", pr->boost_min_cells);
+            jw_knum(w, "boost_cell_threshold", round2(pr->boost_cell_threshold));
+            jw_knum(w, "boost_lean_factor", round2(pr->boost_lean_factor));
+            jw_knum(w, "boost_proto_lean", round2(pr->boost_proto_lean));
+            jw_knum(w, "boost_multi_lean", round2(pr->boost_multi_lean));
+            jw_knum(w, "boost_proto_veto", round2(pr->boost_proto_veto));
+            jw_knum(w, "boost_proto_strong", round2(pr->boost_proto_strong));
+            jw_knum(w, "boost_amplifier_cap", round2(pr->boost_amplifier_cap));
+            jw_knum(w, "boost_confidence_cap", round2(pr->boost_confidence_cap));
+            jw_knum(w, "ema_alpha", round2(pr->ema_alpha));
+            jw_knum(w, "heatmap_coarse_weight", round2(pr->heatmap_coarse_weight));
+            jw_knum(w, "cascade_cnn_ok", round2(pr->cascade_cnn_ok));
+            jw_knum(w, "cascade_proto_ok", round2(pr->cascade_proto_ok));
+            jw_obj_end(w);
         }
-        cJSON_AddItemToObject(item, "profiles", prof_obj);
-
-        /* threshold_config for selected set only */
-        if (selected && th_root) {
-            cJSON *tc = cJSON_GetObjectItemCaseSensitive(th_root, sets[i].dir_name);
-            if (tc)
-                cJSON_AddItemReferenceToObject(item, "threshold_config", tc);
+        jw_obj_end(w);
+
+        /* threshold_config for selected set only. The stored config is
+         * parsed here rather than copied raw: it may have been truncated
+         * on load and must not corrupt the response. */
+        if (selected && cfg->fd_thresholds_json[0]) {
+            cJSON *th_root = cJSON_Parse(cfg->fd_thresholds_json);
+            cJSON *tc = th_root ?
+                cJSON_GetObjectItemCaseSensitive(th_root, sets[i].dir_name) : NULL;
+            char *tc_str = tc ? cJSON_PrintUnformatted(tc) : NULL;
+            if (tc_str) {
+                jw_key(w, "threshold_config");
+                jw_raw(w, tc_str);
+                free(tc_str);
+            }
+            cJSON_Delete(th_root);
         }
 
-        cJSON_AddItemToArray(arr, item);
+        jw_obj_end(w);
     }
+    jw_arr_end(w);
+    jw_kbool(w, "installed", fault_detect_installed());
+    jw_kbool(w, "npu_available", fault_detect_npu_available());
+    jw_obj_end(w);
 
-    cJSON *root = cJSON_CreateObject();
-    cJSON_AddItemToObject(root, "sets", arr);
-    cJSON_AddBoolToObject(root, "installed", fault_detect_installed());
-    cJSON_AddBoolToObject(root, "npu_available", fault_detect_npu_available());
-
-    send_json_response(fd, 200, root);
-    cJSON_Delete(root);
-    if (th_root) cJSON_Delete(th_root);
+    send_json_writer(fd, 200, w);
 }
 
 /* Clamp float threshold to valid range */
@@ -1134,6 +1358,26 @@ static void handle_fault_detect_settings(ControlServer *srv, int fd,
         if (v >= 0 && v <= 500) cfg->fault_detect_pace_ms = v;
     }
 
+    item = cJSON_GetObjectItemCaseSensitive(root, "model_cache_mb");
+    if (item && cJSON_IsNumber(item)) {
+        int v = item->valueint;
+        if (v >= 0 && v <= 128) cfg->fault_detect_model_cache_mb = v;
+    }
+
+    item = cJSON_GetObjectItemCaseSensitive(root, "sched_enabled");
+    if (item) cfg->fault_detect_sched_enabled = cJSON_IsTrue(item) ? 1 : 0;
+
+    item = cJSON_GetObjectItemCaseSensitive(root, "max_skip_s");
+    if (item && cJSON_IsNumber(item)) {
+        int v = item->valueint;
+        if (v >= 5 && v <= 600) cfg->fault_detect_max_skip_s = v;
+    }
+
+    item = cJSON_GetObjectItemCaseSensitive(root, "cascade_enabled");
+    if (item) cfg->fault_detect_cascade = cJSON_IsTrue(item) ? 1 : 0;
+    item = cJSON_GetObjectItemCaseSensitive(root, "roi_crop");
+    if (item) cfg->fault_detect_roi_crop = cJSON_IsTrue(item) ? 1 : 0;
+
     /* Threshold settings (per-set, merged into fd_thresholds_json) */
     const cJSON *th_obj = cJSON_GetObjectItemCaseSensitive(root, "thresholds");
     if (th_obj && cJSON_IsObject(th_obj)) {
@@ -1216,6 +1460,12 @@ static void handle_fault_detect_settings(ControlServer *srv, int fd,
             v = cJSON_GetObjectItemCaseSensitive(set_th, "heatmap_coarse_weight");
             if (v && cJSON_IsNumber(v))
                 cJSON_AddNumberToObject(entry, "heatmap_coarse_weight", round2(clamp_float((float)v->valuedouble, 0.0f, 1.0f)));
+            v = cJSON_GetObjectItemCaseSensitive(set_th, "cascade_cnn_ok");
+            if (v && cJSON_IsNumber(v) && v->valuedouble > 0)  /* 0 = default */
+                cJSON_AddNumberToObject(entry, "cascade_cnn_ok", round2(clamp_float((float)v->valuedouble, 0.01f, 0.5f)));
+            v = cJSON_GetObjectItemCaseSensitive(set_th, "cascade_proto_ok");
+            if (v && cJSON_IsNumber(v) && v->valuedouble > 0)  /* 0 = default */
+                cJSON_AddNumberToObject(entry, "cascade_proto_ok", round2(clamp_float((float)v->valuedouble, 0.01f, 0.5f)));
 
             cJSON_DeleteItemFromObjectCaseSensitive(existing, set_th->string);
             cJSON_AddItemToObject(existing, set_th->string, entry);
@@ -1404,16 +1654,21 @@ static void handle_proto_dataset_download(ControlServer *srv, int fd, const char
 }
 
 /* GET /api/proto/datasets/download/status */
-static void serve_proto_download_status(int fd) {
+static void serve_proto_download_status(ControlServer *srv, int fd) {
     fd_download_progress_t p = fault_detect_get_download_progress();
-    cJSON *root = cJSON_CreateObject();
     const char *states[] = {"idle", "running", "extracting", "done", "error"};
-    cJSON_AddStringToObject(root, "state", states[p.state]);
-    cJSON_AddNumberToObject(root, "downloaded_bytes", (double)p.downloaded_bytes);
-    cJSON_AddNumberToObject(root, "progress_pct", p.progress_pct);
+    JsonWriter *w = json_begin(srv);
+    jw_obj_begin(w);
+    jw_kstr(w, "state", states[p.state]);
+    jw_kint(w, "downloaded_bytes", (long long)p.downloaded_bytes);
+    jw_kint(w, "total_bytes", (long long)p.total_bytes);
+    jw_kint(w, "progress_pct", p.progress_pct);
+    jw_kint(w, "files", p.files);
+    jw_kint(w, "retries", p.retries);
     if (p.error_msg[0])
-        cJSON_AddStringToObject(root, "error", p.error_msg);
-    send_json_response(fd, 200, root);
+        jw_kstr(w, "error", p.error_msg);
+    jw_obj_end(w);
+    send_json_writer(fd, 200, w);
 }
 
 /* GET /api/proto/sets */
@@ -1422,33 +1677,33 @@ static void serve_proto_sets(ControlServer *srv, int fd) {
     int count = fault_detect_list_proto_sets(sets, FD_MAX_PROTO_SETS,
                                               srv->config->proto_active_set);
 
-    cJSON *arr = cJSON_CreateArray();
+    JsonWriter *w = json_begin(srv);
+    jw_obj_begin(w);
+    jw_karr(w, "sets");
     for (int i = 0; i < count; i++) {
-        cJSON *item = cJSON_CreateObject();
-        cJSON_AddStringToObject(item, "name", sets[i].name);
-        cJSON_AddStringToObject(item, "source_dataset", sets[i].source_dataset);
-        cJSON_AddNumberToObject(item, "n_failure", sets[i].n_failure);
-        cJSON_AddNumberToObject(item, "n_success", sets[i].n_success);
-        cJSON_AddBoolToObject(item, "is_active", sets[i].is_active);
-
-        cJSON *margins = cJSON_CreateArray();
+        jw_obj_begin(w);
+        jw_kstr(w, "name", sets[i].name);
+        jw_kstr(w, "source_dataset", sets[i].source_dataset);
+        jw_kint(w, "n_failure", sets[i].n_failure);
+        jw_kint(w, "n_success", sets[i].n_success);
+        jw_kbool(w, "is_active", sets[i].is_active);
+
+        jw_karr(w, "margins");
         for (int j = 0; j < 3; j++)
-            cJSON_AddItemToArray(margins, cJSON_CreateNumber(
-                (double)((int)(sets[i].margin[j] * 1000 + 0.5f)) / 1000.0));
-        cJSON_AddItemToObject(item, "margins", margins);
+            jw_num(w, (double)((int)(sets[i].margin[j] * 1000 + 0.5f)) / 1000.0);
+        jw_arr_end(w);
 
-        cJSON *enc = cJSON_CreateArray();
+        jw_karr(w, "encoder_hashes");
         for (int j = 0; j < 3; j++)
-            cJSON_AddItemToArray(enc, cJSON_CreateString(sets[i].encoder_hashes[j]));
-        cJSON_AddItemToObject(item, "encoder_hashes", enc);
+            jw_str(w, sets[i].encoder_hashes[j]);
+        jw_arr_end(w);
 
-        cJSON_AddItemToArray(arr, item);
+        jw_obj_end(w);
     }
-
-    cJSON *root = cJSON_CreateObject();
-    cJSON_AddItemToObject(root, "sets", arr);
-    cJSON_AddStringToObject(root, "active_set", srv->config->proto_active_set);
-    send_json_response(fd, 200, root);
+    jw_arr_end(w);
+    jw_kstr(w, "active_set", srv->config->proto_active_set);
+    jw_obj_end(w);
+    send_json_writer(fd, 200, w);
 }
 
 /* POST /api/proto/compute */
@@ -1483,43 +1738,46 @@ static void handle_proto_compute(int fd, const char *body, int incremental) {
 }
 
 /* GET /api/proto/compute/status */
-static void serve_proto_compute_status(int fd) {
+static void serve_proto_compute_status(ControlServer *srv, int fd) {
     fd_proto_compute_progress_t p = fault_detect_get_proto_progress();
-    cJSON *root = cJSON_CreateObject();
+    JsonWriter *w = json_begin(srv);
+    jw_obj_begin(w);
 
     const char *states[] = {"idle", "pending", "running", "saving", "done", "error", "cancelled"};
-    cJSON_AddStringToObject(root, "state", states[p.state]);
-    cJSON_AddStringToObject(root, "dataset", p.dataset_name);
-    cJSON_AddStringToObject(root, "set_name", p.set_name);
-    cJSON_AddNumberToObject(root, "current_model", p.current_model);
+    jw_kstr(w, "state", states[p.state]);
+    jw_kstr(w, "dataset", p.dataset_name);
+    jw_kstr(w, "set_name", p.set_name);
+    jw_kint(w, "current_model", p.current_model);
     if (p.model_name)
-        cJSON_AddStringToObject(root, "model_name", p.model_name);
-    cJSON_AddNumberToObject(root, "current_class", p.current_class);
-    cJSON_AddNumberToObject(root, "images_processed", p.images_processed);
-    cJSON_AddNumberToObject(root, "images_total", p.images_total);
-    cJSON_AddNumberToObject(root, "total_processed", p.total_images_processed);
-    cJSON_AddNumberToObject(root, "total_all", p.total_images_all);
-    cJSON_AddNumberToObject(root, "elapsed_s", p.elapsed_s);
-    cJSON_AddNumberToObject(root, "estimated_total_s", p.estimated_total_s);
-    cJSON_AddBoolToObject(root, "incremental", p.incremental);
+        jw_kstr(w, "model_name", p.model_name);
+    jw_kint(w, "current_class", p.current_class);
+    jw_kint(w, "images_processed", p.images_processed);
+    jw_kint(w, "images_total", p.images_total);
+    jw_kint(w, "total_processed", p.total_images_processed);
+    jw_kint(w, "total_all", p.total_images_all);
+    jw_kint(w, "elapsed_s", p.elapsed_s);
+    jw_kint(w, "estimated_total_s", p.estimated_total_s);
+    jw_kbool(w, "incremental", p.incremental);
+    jw_knum(w, "images_per_s", (double)((int)(p.images_per_s * 100 + 0.5f)) / 100.0);
+    jw_kint(w, "resumed_images", p.resumed_images);
+    jw_kint(w, "jpeg_decodes", p.jpeg_decodes);
 
     if (p.state == PROTO_COMPUTE_DONE || p.state == PROTO_COMPUTE_ERROR) {
-        cJSON *margins = cJSON_CreateArray();
-        cJSON *cos_sims = cJSON_CreateArray();
-        for (int i = 0; i < 3; i++) {
-            cJSON_AddItemToArray(margins, cJSON_CreateNumber(
-                (double)((int)(p.margin[i] * 1000 + 0.5f)) / 1000.0));
-            cJSON_AddItemToArray(cos_sims, cJSON_CreateNumber(
-                (double)((int)(p.cos_sim[i] * 1000 + 0.5f)) / 1000.0));
-        }
-        cJSON_AddItemToObject(root, "margins", margins);
-        cJSON_AddItemToObject(root, "cos_sims", cos_sims);
+        jw_karr(w, "margins");
+        for (int i = 0; i < 3; i++)
+            jw_num(w, (double)((int)(p.margin[i] * 1000 + 0.5f)) / 1000.0);
+        jw_arr_end(w);
+        jw_karr(w, "cos_sims");
+        for (int i = 0; i < 3; i++)
+            jw_num(w, (double)((int)(p.cos_sim[i] * 1000 + 0.5f)) / 1000.0);
+        jw_arr_end(w);
     }
 
     if (p.error_msg[0])
-        cJSON_AddStringToObject(root, "error", p.error_msg);
+        jw_kstr(w, "error", p.error_msg);
 
-    send_json_response(fd, 200, root);
+    jw_obj_end(w);
+    send_json_writer(fd, 200, w);
 }
 
 /* POST /api/proto/sets/activate */
@@ -1609,14 +1867,7 @@ static void handle_proto_save_frame(int fd, const char *body) {
 }
 
 /* GET /setup - Serve wizard page */
-static void serve_setup_page(ControlServer *srv, int fd) {
-    char *tmpl = load_template(srv->template_dir, "setup.html");
-    if (!tmpl) {
-        send_http_response(fd, 500, "text/plain",
-                          "Template not found", 18, NULL);
-        return;
-    }
-
+static void serve_setup_page(ControlServer *srv, int fd, const char *request) {
     AppConfig *cfg = srv->config;
 
     char sp_str[12], cp_str[12], status_str[4];
@@ -1672,15 +1923,9 @@ static void serve_setup_page(ControlServer *srv, int fd) {
     };
     int nvars = sizeof(vars) / sizeof(vars[0]);
 
-    char *html = template_substitute(tmpl, vars, nvars);
-    free(tmpl);
-
-    if (html) {
-        send_http_response(fd, 200, "text/html; charset=utf-8", html, strlen(html),
-                          "Cache-Control: no-cache\r\n");
-        free(html);
-    } else {
-        send_http_response(fd, 500, "text/plain", "Template error", 14, NULL);
+    if (send_template(fd, request, "setup.html", vars, nvars) < 0) {
+        send_http_response(fd, 500, "text/plain",
+                          "Template not found", 18, NULL);
     }
 }
 
@@ -2580,18 +2825,12 @@ static void serve_status(ControlServer *srv, int fd) {
 }
 
 /* GET /timelapse - Timelapse browser page */
-static void serve_timelapse_page(ControlServer *srv, int fd) {
-    char *tmpl = load_template(srv->template_dir, "timelapse.html");
-    if (!tmpl) {
+static void serve_timelapse_page(ControlServer *srv, int fd, const char *request) {
+    /* No template variables needed - all data loaded via JS */
+    if (send_template(fd, request, "timelapse.html", NULL, 0) < 0) {
         send_http_response(fd, 500, "text/plain",
                           "Template not found", 18, NULL);
-        return;
     }
-
-    /* No template variables needed - all data loaded via JS */
-    send_http_response(fd, 200, "text/html; charset=utf-8", tmpl, strlen(tmpl),
-                      "Cache-Control: no-cache\r\n");
-    free(tmpl);
 }
 
 /* Helper: get timelapse directory path */
@@ -2675,31 +2914,26 @@ static void serve_timelapse_list(ControlServer *srv, int fd, const char *storage
             snprintf(base, sizeof(base), "%.*s", (int)baselen, mp4);
             cJSON_AddStringToObject(rec, "name", base);
             cJSON_AddStringToObject(rec, "mp4", mp4);
-            if (thumb)
-                cJSON_AddStringToObject(rec, "thumbnail", thumb);
+            /* Without a sidecar the thumbnail is extracted from the MP4 */
+            cJSON_AddStringToObject(rec, "thumbnail", thumb ? thumb : mp4);
             cJSON_AddNumberToObject(rec, "frames", frames);
             cJSON_AddNumberToObject(rec, "size", (double)st.st_size);
             cJSON_AddNumberToObject(rec, "mtime", (double)st.st_mtime);
             total_size += st.st_size;
 
-            /* Get duration using ffprobe if available */
-            char cmd[768];
-            snprintf(cmd, sizeof(cmd),
-                "%s -v error -show_entries format=duration "
-                "-of csv=p=0 '%s' 2>/dev/null",
-                FFPROBE_PATH, filepath);
-            FILE *p = popen(cmd, "r");
-            if (p) {
-                char dur_buf[32];
-                if (fgets(dur_buf, sizeof(dur_buf), p)) {
-                    cJSON_AddNumberToObject(rec, "duration", atof(dur_buf));
-                }
-                pclose(p);
+            /* Duration from the recording index (native mvhd parse, cached) */
+            double duration;
+            if (tl_index_lookup(dir_path, mp4, (uint64_t)st.st_size,
+                                st.st_mtime, &duration) == 0) {
+                cJSON_AddNumberToObject(rec, "duration", duration);
             }
 
             cJSON_AddItemToArray(recordings, rec);
         }
 
+        /* Drop index entries for recordings no longer on disk */
+        tl_index_commit(dir_path);
+
         /* Free names */
         for (int i = 0; i < mp4_count; i++) free(mp4_names[i]);
         for (int i = 0; i < jpg_count; i++) free(jpg_names[i]);
@@ -2714,71 +2948,51 @@ static void serve_timelapse_list(ControlServer *srv, int fd, const char *storage
     cJSON_Delete(root);
 }
 
-/* GET /api/timelapse/thumb/<name> - Serve thumbnail JPEG.
- * If <name> is a .jpg that exists in the timelapse dir, serve it directly.
- * Otherwise try extracting first frame from video via ffmpeg. */
-static void serve_timelapse_thumb(ControlServer *srv, int fd,
-                                   const char *name, const char *storage) {
+/* GET /api/timelapse/thumb/<name>[?v=<version>] - Serve thumbnail JPEG.
+ * <name> is the recording's .jpg sidecar, or the .mp4 itself when it has
+ * none. Serves the downscaled copy from the thumbnail cache (generated on
+ * first request for older recordings), falling back to the full-size
+ * sidecar. An MP4's frame is decoded in the background: until it is
+ * ready the answer is a 503 with Retry-After, which the page polls. Names
+ * are reused after a delete, so only a URL carrying the recording's
+ * version (mtime and size, set by the timelapse page) is cached as
+ * immutable. */
+static void serve_timelapse_thumb(ControlServer *srv, int fd, const char *name,
+                                   const char *storage, const char *version) {
     const char *dir_path = get_timelapse_dir(srv, storage);
-    char filepath[512];
-    snprintf(filepath, sizeof(filepath), "%s/%s", dir_path, name);
-
-    /* If the requested file is a JPG that exists, serve directly */
-    size_t nlen = strlen(name);
-    int is_jpg = (nlen > 4 && strcasecmp(name + nlen - 4, ".jpg") == 0);
 
-    struct stat st;
-    if (is_jpg && stat(filepath, &st) == 0 && st.st_size > 0 && st.st_size <= 512 * 1024) {
-        FILE *f = fopen(filepath, "rb");
-        if (f) {
-            char *data = malloc(st.st_size);
-            if (data) {
-                fread(data, 1, st.st_size, f);
-                fclose(f);
-                send_http_response(fd, 200, "image/jpeg", data, st.st_size,
-                                  "Cache-Control: max-age=3600\r\n");
-                free(data);
-                return;
-            }
-            fclose(f);
-        }
-    }
-
-    /* Fallback: extract first frame from video via ffmpeg */
-    if (stat(filepath, &st) != 0) {
+    /* Validate: no path traversal */
+    if (strchr(name, '/') || strstr(name, "..")) {
         send_404(fd);
         return;
     }
 
-    char cmd[768];
-    snprintf(cmd, sizeof(cmd),
-        "%s -y -i '%s' -vframes 1 -q:v 5 -f image2 /tmp/timelapse_thumb.jpg 2>/dev/null",
-        FFMPEG_PATH, filepath);
+    const char *cache_hdr = version && version[0]
+        ? "Cache-Control: public, max-age=31536000, immutable\r\n"
+        : "Cache-Control: max-age=300\r\n";
 
-    if (system(cmd) != 0) {
-        send_404(fd);
+    char thumb_path[512];
+    int ret = tl_thumb_get(dir_path, name, thumb_path, sizeof(thumb_path));
+    if (ret == 0 && send_file_response(fd, thumb_path, "image/jpeg", cache_hdr) == 0)
+        return;
+    if (ret == 1) {
+        send_http_response(fd, 503, "text/plain", "Generating", 10,
+                           "Retry-After: 2\r\nCache-Control: no-store\r\n");
         return;
     }
 
-    FILE *f = fopen("/tmp/timelapse_thumb.jpg", "rb");
-    if (!f) { send_404(fd); return; }
-
-    fseek(f, 0, SEEK_END);
-    long fsize = ftell(f);
-    fseek(f, 0, SEEK_SET);
-
-    if (fsize <= 0 || fsize > 512 * 1024) { fclose(f); send_404(fd); return; }
-
-    char *jpeg_data = malloc(fsize);
-    if (!jpeg_data) { fclose(f); send_404(fd); return; }
-
-    fread(jpeg_data, 1, fsize, f);
-    fclose(f);
-    unlink("/tmp/timelapse_thumb.jpg");
+    /* The full-size fallback is only kept briefly, so the downscaled copy
+     * replaces it once the cache can be written */
+    size_t nlen = strlen(name);
+    if (nlen > 4 && strcasecmp(name + nlen - 4, ".jpg") == 0) {
+        char filepath[512];
+        snprintf(filepath, sizeof(filepath), "%s/%s", dir_path, name);
+        if (send_file_response(fd, filepath, "image/jpeg",
+                               "Cache-Control: max-age=300\r\n") == 0)
+            return;
+    }
 
-    send_http_response(fd, 200, "image/jpeg", jpeg_data, fsize,
-                      "Cache-Control: max-age=3600\r\n");
-    free(jpeg_data);
+    send_404(fd);
 }
 
 /* GET /api/timelapse/video/<name> - Video download with Range support */
@@ -2891,6 +3105,12 @@ static void handle_timelapse_delete(ControlServer *srv, int fd,
     char filepath[512];
     snprintf(filepath, sizeof(filepath), "%s/%s.mp4", dir_path, name);
     int mp4_ok = (unlink(filepath) == 0);
+    if (mp4_ok) {
+        char mp4_name[300];
+        snprintf(mp4_name, sizeof(mp4_name), "%s.mp4", name);
+        tl_index_remove(dir_path, mp4_name);
+        tl_thumb_remove(dir_path, mp4_name);
+    }
 
     /* Delete matching thumbnail(s): <name>_*.jpg */
     size_t namelen = strlen(name);
@@ -2905,6 +3125,7 @@ static void handle_timelapse_delete(ControlServer *srv, int fd,
             if (strncmp(fn, name, namelen) == 0 && fn[namelen] == '_') {
                 snprintf(filepath, sizeof(filepath), "%s/%s", dir_path, fn);
                 unlink(filepath);
+                tl_thumb_remove(dir_path, fn);
             }
         }
         closedir(dir);
@@ -3053,6 +3274,8 @@ static void handle_timelapse_settings(ControlServer *srv, int fd, const char *bo
                             strcmp(form_get(params, nparams, "timelapse_flip_x"), "1") == 0;
     cfg->timelapse_flip_y = form_has(params, nparams, "timelapse_flip_y") &&
                             strcmp(form_get(params, nparams, "timelapse_flip_y"), "1") == 0;
+    cfg->timelapse_streaming = form_has(params, nparams, "timelapse_streaming") &&
+                               strcmp(form_get(params, nparams, "timelapse_streaming"), "1") == 0;
 
     /* Save config */
     config_save(cfg, CONFIG_DEFAULT_PATH);
@@ -4120,18 +4343,19 @@ static void handle_client(ControlServer *srv, int client_fd,
     }
 
     /* Route the request */
+    int keep_open = 0;  /* set when the fd is handed off (SSE subscriber) */
     int is_get = strcmp(method, "GET") == 0;
     int is_post = strcmp(method, "POST") == 0;
     int is_delete = strcmp(method, "DELETE") == 0;
 
     if (is_get && strcmp(path, "/") == 0) {
-        serve_homepage(srv, client_fd);
+        serve_homepage(srv, client_fd, buf);
     }
     else if (strcmp(path, "/control") == 0) {
         if (is_post) {
             handle_control_post(srv, client_fd, post_body ? post_body : "");
         } else {
-            serve_control_page(srv, client_fd);
+            serve_control_page(srv, client_fd, buf);
         }
     }
     else if (is_get && strcmp(path, "/status") == 0) {
@@ -4140,6 +4364,9 @@ static void handle_client(ControlServer *srv, int client_fd,
     else if (is_get && strcmp(path, "/api/stats") == 0) {
         serve_api_stats(srv, client_fd);
     }
+    else if (is_get && strcmp(path, "/api/events") == 0) {
+        keep_open = sse_subscribe(srv, client_fd);
+    }
     else if (is_get && strcmp(path, "/api/config") == 0) {
         serve_api_config(srv, client_fd);
     }
@@ -4165,7 +4392,7 @@ static void handle_client(ControlServer *srv, int client_fd,
     }
     /* Timelapse routes */
     else if (is_get && strcmp(path, "/timelapse") == 0) {
-        serve_timelapse_page(srv, client_fd);
+        serve_timelapse_page(srv, client_fd, buf);
     }
     else if (is_get && strcmp(path, "/api/timelapse/list") == 0) {
         const char *storage = form_get(query_params, nquery, "storage");
@@ -4177,7 +4404,8 @@ static void handle_client(ControlServer *srv, int client_fd,
         char decoded_name[256];
         strncpy(decoded_name, name, sizeof(decoded_name) - 1);
         url_decode(decoded_name);
-        serve_timelapse_thumb(srv, client_fd, decoded_name, storage ? storage : "internal");
+        serve_timelapse_thumb(srv, client_fd, decoded_name, storage ? storage : "internal",
+                              form_get(query_params, nquery, "v"));
     }
     else if (is_get && strncmp(path, "/api/timelapse/video/", 21) == 0) {
         const char *name = path + 21;
@@ -4282,7 +4510,7 @@ static void handle_client(ControlServer *srv, int client_fd,
         handle_proto_dataset_download(srv, client_fd, post_body ? post_body : "");
     }
     else if (is_get && strcmp(path, "/api/proto/datasets/download/status") == 0) {
-        serve_proto_download_status(client_fd);
+        serve_proto_download_status(srv, client_fd);
     }
     else if (is_post && strcmp(path, "/api/proto/datasets/download/cancel") == 0) {
         fault_detect_cancel_download();
@@ -4303,7 +4531,7 @@ static void handle_client(ControlServer *srv, int client_fd,
         handle_proto_compute(client_fd, post_body ? post_body : "", 1);
     }
     else if (is_get && strcmp(path, "/api/proto/compute/status") == 0) {
-        serve_proto_compute_status(client_fd);
+        serve_proto_compute_status(srv, client_fd);
     }
     else if (is_post && strcmp(path, "/api/proto/compute/cancel") == 0) {
         fault_detect_cancel_proto_compute();
@@ -4319,7 +4547,7 @@ static void handle_client(ControlServer *srv, int client_fd,
     }
     /* Setup wizard routes */
     else if (is_get && strcmp(path, "/setup") == 0) {
-        serve_setup_page(srv, client_fd);
+        serve_setup_page(srv, client_fd, buf);
     }
     else if (is_get && strcmp(path, "/api/setup/status") == 0) {
         serve_setup_status(srv, client_fd);
@@ -4354,7 +4582,8 @@ static void handle_client(ControlServer *srv, int client_fd,
     }
 
     free(post_body);
-    close(client_fd);
+    if (!keep_open)
+        close(client_fd);
 }
 
 /* ============================================================================
@@ -4368,9 +4597,31 @@ static void *control_server_thread(void *arg) {
         fd_set read_fds;
         FD_ZERO(&read_fds);
         FD_SET(srv->listen_fd, &read_fds);
+        int max_fd = srv->listen_fd;
 
+        /* Watch SSE subscribers for disconnect */
+        for (int i = 0; i < srv->sse_count; i++) {
+            FD_SET(srv->sse_fds[i], &read_fds);
+            if (srv->sse_fds[i] > max_fd) max_fd = srv->sse_fds[i];
+        }
+
+        /* Wake often enough to honour the push interval */
         struct timeval tv = { .tv_sec = 1, .tv_usec = 0 };
-        int ret = select(srv->listen_fd + 1, &read_fds, NULL, NULL, &tv);
+        if (srv->sse_count > 0 && srv->config->stats_push_ms < 1000) {
+            tv.tv_sec = 0;
+            tv.tv_usec = srv->config->stats_push_ms * 1000;
+        }
+        int ret = select(max_fd + 1, &read_fds, NULL, NULL, &tv);
+
+        if (ret > 0) {
+            for (int i = srv->sse_count - 1; i >= 0; i--) {
+                if (!FD_ISSET(srv->sse_fds[i], &read_fds)) continue;
+                char drain[256];
+                ssize_t n = recv(srv->sse_fds[i], drain, sizeof(drain), MSG_DONTWAIT);
+                if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK))
+                    sse_remove(srv, i);
+            }
+        }
 
         if (ret > 0 && FD_ISSET(srv->listen_fd, &read_fds)) {
             struct sockaddr_in client_addr;
@@ -4400,6 +4651,9 @@ static void *control_server_thread(void *arg) {
             last_cpu_update = now;
         }
 
+        /* Push stats to /api/events subscribers */
+        sse_tick(srv);
+
         /* Periodic: IP change detection + WiFi optimization (every 30s) */
         static time_t last_net_check = 0;
         static char last_ip[64] = {0};
@@ -4475,6 +4729,9 @@ int control_server_start(AppConfig *cfg, int port, const char *template_dir) {
         }
     }
 
+    /* Parsed-template cache, reloaded on inotify events */
+    template_cache_init(srv->template_dir);
+
     /* Initialize CPU monitor */
     cpu_monitor_init(&srv->cpu_monitor);
 
@@ -4525,6 +4782,9 @@ void control_server_stop(void) {
 
     srv->running = 0;
     pthread_join(srv->thread, NULL);
+    sse_close_all(srv);
+    jw_free(&srv->json);
+    template_cache_cleanup();
 
     if (srv->listen_fd > 0) {
         close(srv->listen_fd);
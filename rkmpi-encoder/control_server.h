@@ -18,6 +18,7 @@
 #include "cpu_monitor.h"
 #include "camera_detect.h"
 #include "process_manager.h"
+#include "json_writer.h"
 #include <stdint.h>
 #include <pthread.h>
 #include <time.h>
@@ -25,8 +26,8 @@
 /* Maximum POST body size */
 #define CTRL_MAX_POST_BODY  8192
 
-/* Maximum template size after substitution */
-#define CTRL_MAX_TEMPLATE   (192 * 1024)
+/* Maximum concurrent /api/events (Server-Sent Events) subscribers */
+#define CTRL_MAX_SSE_CLIENTS 8
 
 /* Maximum key-value pairs in form data */
 #define CTRL_MAX_FORM_PARAMS 64
@@ -38,10 +39,6 @@
 #define TIMELAPSE_DIR_INTERNAL  "/useremain/app/gk/Time-lapse-Video"
 #define TIMELAPSE_DIR_USB       "/mnt/udisk/Time-lapse-Video"
 
-/* ffmpeg/ffprobe paths */
-#define FFMPEG_PATH     "/ac_lib/lib/third_bin/ffmpeg"
-#define FFPROBE_PATH    "/ac_lib/lib/third_bin/ffprobe"
-
 /* Control server state */
 typedef struct {
     int listen_fd;
@@ -61,6 +58,8 @@ typedef struct {
     int encoder_mjpeg_clients;
     int encoder_flv_clients;
     int encoder_display_clients;
+    unsigned int encoder_display_encoded;   /* Display frames encoded */
+    unsigned int encoder_display_skipped;   /* Unchanged display frames skipped */
     int max_camera_fps;
     int runtime_skip_ratio;     /* Actual skip ratio (auto-adjusted) */
 
@@ -69,6 +68,19 @@ typedef struct {
     time_t acproxycam_last_seen;
     int flv_proxy_clients;
 
+    /* /api/events subscribers: stats are serialized once per tick and
+     * the same bytes written to every subscriber */
+    int sse_fds[CTRL_MAX_SSE_CLIENTS];
+    int sse_count;
+    JsonWriter sse_last;            /* last pushed snapshot, base for deltas */
+    JsonWriter sse_next;            /* snapshot being built this tick */
+    JsonWriter sse_msg;             /* framed event bytes */
+    uint64_t sse_last_push_ms;
+    uint64_t sse_last_send_ms;      /* for keepalive comments */
+
+    /* Reusable response buffer for JSON endpoints (server thread only) */
+    JsonWriter json;
+
     /* Session ID (unique per startup) */
     char session_id[40];
 
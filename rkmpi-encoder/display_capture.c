@@ -48,6 +48,9 @@
 /* VENC channel for display JPEG encoding (separate from camera channels 0,1) */
 #define VENC_CHN_DISPLAY  2
 
+/* VENC channel for display H.264 (3 is the timelapse encoder) */
+#define VENC_CHN_DISPLAY_H264  4
+
 /* External verbose flag */
 extern int g_verbose;
 
@@ -58,6 +61,9 @@ static volatile int g_display_running = 0;
 
 /* Client tracking and enable/disable */
 static volatile int g_display_client_count = 0;
+static volatile int g_display_h264_client_count = 0;
+static volatile int g_display_h264_idr = 0;     /* New H.264 client needs a keyframe */
+static int g_display_h264_state = 0;            /* 0=not created, 1=ready, -1=failed */
 static volatile int g_display_enabled = 0;  /* Disabled by default */
 static volatile int g_display_target_fps = DISPLAY_DEFAULT_FPS;
 static pthread_mutex_t g_display_mutex = PTHREAD_MUTEX_INITIALIZER;
@@ -69,6 +75,8 @@ static MB_BLK g_display_dst_mb = MB_INVALID_HANDLE;  /* Destination NV12 buffer
 static void *g_display_src_vaddr = NULL;
 static void *g_display_rot_vaddr = NULL;
 static void *g_display_dst_vaddr = NULL;
+static int g_display_dst_fd = -1;
+static int g_display_fused = 1;  /* Single-pass RGA rotate+convert works */
 
 /* DRM framebuffer DMA-buf fd (zero-copy mode) */
 static int g_drm_fd = -1;
@@ -560,6 +568,83 @@ static int rga_convert_from_fd(int src_fd, void *dst_nv12, int width, int height
     return 0;
 }
 
+/*
+ * Rotate and convert BGRX to NV12 in a single RGA job
+ * Reads the framebuffer (DMA-buf fd if exported, else its mmap) and writes
+ * straight into the VENC input block by fd, so there is no intermediate BGRX
+ * buffer and no CPU cache maintenance between the steps.
+ */
+static int rga_rotate_convert(const DisplayCapture *ctx, int src_fd, int dst_fd) {
+    rga_buffer_t src_buf, dst_buf, pat_buf;
+    im_rect srect, drect, prect;
+    IM_STATUS status;
+    int usage = IM_SYNC;
+
+    switch (ctx->orientation) {
+        case DISPLAY_ORIENT_FLIP_180:  usage |= IM_HAL_TRANSFORM_FLIP_H_V; break;
+        case DISPLAY_ORIENT_ROTATE_90:  usage |= IM_HAL_TRANSFORM_ROT_90; break;
+        case DISPLAY_ORIENT_ROTATE_270: usage |= IM_HAL_TRANSFORM_ROT_270; break;
+        default: break;
+    }
+
+    if (src_fd >= 0) {
+        src_buf = wrapbuffer_fd(src_fd, ctx->fb_width, ctx->fb_height, RK_FORMAT_BGRX_8888);
+    } else {
+        src_buf = wrapbuffer_virtualaddr(ctx->fb_pixels, ctx->fb_width, ctx->fb_height,
+                                         RK_FORMAT_BGRX_8888);
+    }
+    if (src_buf.width == 0) return -1;
+
+    dst_buf = wrapbuffer_fd(dst_fd, ctx->output_width, ctx->output_height,
+                            RK_FORMAT_YCbCr_420_SP);
+    if (dst_buf.width == 0) return -1;
+    dst_buf.color_space_mode = IM_RGB_TO_YUV_BT601_LIMIT;
+
+    memset(&pat_buf, 0, sizeof(pat_buf));
+    memset(&srect, 0, sizeof(srect));
+    memset(&drect, 0, sizeof(drect));
+    memset(&prect, 0, sizeof(prect));
+
+    status = improcess(src_buf, dst_buf, pat_buf, srect, drect, prect, usage);
+    if (status != IM_STATUS_SUCCESS) {
+        log_error("RGA rotate+convert failed: %s\n", imStrError(status));
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Allocate the BGRX source/rotation buffers used by the split path
+ * Only needed when the single-pass RGA job is not supported.
+ */
+static int alloc_split_buffers(DisplayCapture *ctx) {
+    RK_S32 ret;
+
+    if (g_display_src_mb == MB_INVALID_HANDLE) {
+        ret = RK_MPI_MMZ_Alloc(&g_display_src_mb, ctx->fb_size, RK_MMZ_ALLOC_CACHEABLE);
+        if (ret != RK_SUCCESS || g_display_src_mb == MB_INVALID_HANDLE) {
+            log_error("RK_MPI_MMZ_Alloc(src) failed: 0x%x\n", ret);
+            g_display_src_mb = MB_INVALID_HANDLE;
+            return -1;
+        }
+        g_display_src_vaddr = RK_MPI_MMZ_Handle2VirAddr(g_display_src_mb);
+    }
+
+    if (g_display_rot_mb == MB_INVALID_HANDLE) {
+        ret = RK_MPI_MMZ_Alloc(&g_display_rot_mb, ctx->fb_size, RK_MMZ_ALLOC_CACHEABLE);
+        if (ret != RK_SUCCESS || g_display_rot_mb == MB_INVALID_HANDLE) {
+            log_error("RK_MPI_MMZ_Alloc(rot) failed: 0x%x\n", ret);
+            g_display_rot_mb = MB_INVALID_HANDLE;
+            return -1;
+        }
+        g_display_rot_vaddr = RK_MPI_MMZ_Handle2VirAddr(g_display_rot_mb);
+    }
+
+    log_info("Allocated split-path DMA buffers: 2 x %zu bytes\n", ctx->fb_size);
+    return 0;
+}
+
 /*
  * Initialize VENC for display JPEG encoding
  */
@@ -614,6 +699,69 @@ static void cleanup_display_venc(void) {
     RK_MPI_VENC_DestroyChn(VENC_CHN_DISPLAY);
 }
 
+/*
+ * Initialize VENC for display H.264 encoding
+ * Created on demand while FLV display clients are connected. Static UI
+ * content encodes to tiny P-frames, and ticks with no damage send nothing.
+ */
+static int init_display_h264_venc(int width, int height) {
+    RK_S32 ret;
+    VENC_CHN_ATTR_S stAttr;
+    VENC_RECV_PIC_PARAM_S stRecvParam;
+
+    memset(&stAttr, 0, sizeof(stAttr));
+    memset(&stRecvParam, 0, sizeof(stRecvParam));
+
+    stAttr.stVencAttr.enType = RK_VIDEO_ID_AVC;
+    stAttr.stVencAttr.enPixelFormat = RK_FMT_YUV420SP;  /* NV12 input */
+    stAttr.stVencAttr.u32Profile = 100;                 /* High */
+    stAttr.stVencAttr.u32PicWidth = width;
+    stAttr.stVencAttr.u32PicHeight = height;
+    stAttr.stVencAttr.u32VirWidth = width;
+    stAttr.stVencAttr.u32VirHeight = height;
+    stAttr.stVencAttr.u32StreamBufCnt = 2;
+    stAttr.stVencAttr.u32BufSize = width * height * 3 / 2;
+    stAttr.stVencAttr.enMirror = MIRROR_NONE;
+
+    /* VBR: idle P-frames cost nearly nothing, UI transitions may burst */
+    stAttr.stRcAttr.enRcMode = VENC_RC_MODE_H264VBR;
+    stAttr.stRcAttr.stH264Vbr.u32BitRate = DISPLAY_H264_BITRATE;
+    stAttr.stRcAttr.stH264Vbr.u32MaxBitRate = DISPLAY_H264_BITRATE * 2;
+    stAttr.stRcAttr.stH264Vbr.u32MinBitRate = DISPLAY_H264_BITRATE / 4;
+    stAttr.stRcAttr.stH264Vbr.u32Gop = DISPLAY_H264_GOP;
+    stAttr.stRcAttr.stH264Vbr.u32SrcFrameRateNum = DISPLAY_MAX_FPS;
+    stAttr.stRcAttr.stH264Vbr.u32SrcFrameRateDen = 1;
+    stAttr.stRcAttr.stH264Vbr.fr32DstFrameRateNum = DISPLAY_MAX_FPS;
+    stAttr.stRcAttr.stH264Vbr.fr32DstFrameRateDen = 1;
+
+    stAttr.stGopAttr.enGopMode = VENC_GOPMODE_NORMALP;
+    stAttr.stGopAttr.s32VirIdrLen = DISPLAY_H264_GOP;
+
+    ret = RK_MPI_VENC_CreateChn(VENC_CHN_DISPLAY_H264, &stAttr);
+    if (ret != RK_SUCCESS) {
+        log_error("RK_MPI_VENC_CreateChn(DISPLAY_H264) failed: 0x%x\n", ret);
+        return -1;
+    }
+
+    stRecvParam.s32RecvPicNum = -1;  /* Continuous */
+    ret = RK_MPI_VENC_StartRecvFrame(VENC_CHN_DISPLAY_H264, &stRecvParam);
+    if (ret != RK_SUCCESS) {
+        log_error("RK_MPI_VENC_StartRecvFrame(DISPLAY_H264) failed: 0x%x\n", ret);
+        RK_MPI_VENC_DestroyChn(VENC_CHN_DISPLAY_H264);
+        return -1;
+    }
+
+    log_info("VENC DISPLAY_H264 initialized: %dx%d, %dkbps, GOP=%d\n",
+             width, height, DISPLAY_H264_BITRATE, DISPLAY_H264_GOP);
+    return 0;
+}
+
+static void cleanup_display_h264_venc(void) {
+    RK_MPI_VENC_StopRecvFrame(VENC_CHN_DISPLAY_H264);
+    RK_MPI_VENC_DestroyChn(VENC_CHN_DISPLAY_H264);
+    log_info("VENC DISPLAY_H264 released\n");
+}
+
 int display_capture_init(DisplayCapture *ctx, int fps) {
     memset(ctx, 0, sizeof(*ctx));
     ctx->fps = fps > 0 ? fps : DISPLAY_DEFAULT_FPS;
@@ -671,60 +819,39 @@ int display_capture_init(DisplayCapture *ctx, int fps) {
 
     /* Try to get framebuffer DMA-buf fd for zero-copy mode */
     if (get_framebuffer_dmabuf(ctx->fb_width, ctx->fb_height) == 0) {
-        /* Zero-copy mode: don't need source DMA buffer */
         log_info("Using zero-copy mode (DMA-buf fd)\n");
     } else {
-        /* Fallback: allocate DMA buffer for source BGRX (copy from framebuffer) */
-        size_t src_size = ctx->fb_size;
-        RK_S32 ret = RK_MPI_MMZ_Alloc(&g_display_src_mb, src_size, RK_MMZ_ALLOC_CACHEABLE);
-        if (ret != RK_SUCCESS || g_display_src_mb == MB_INVALID_HANDLE) {
-            log_error("RK_MPI_MMZ_Alloc(src) failed: 0x%x\n", ret);
-            munmap(ctx->fb_pixels, ctx->fb_size);
-            close(ctx->fb_fd);
-            return -1;
-        }
-        g_display_src_vaddr = RK_MPI_MMZ_Handle2VirAddr(g_display_src_mb);
-        log_info("Allocated source DMA buffer: %zu bytes (copy mode)\n", src_size);
+        /* RGA reads the framebuffer mmap instead */
+        log_info("Using copy mode (framebuffer mmap)\n");
     }
 
-    /* Allocate DMA buffer for rotation (RGA rotation output) */
-    size_t src_size = ctx->fb_size;
-    RK_S32 ret = RK_MPI_MMZ_Alloc(&g_display_rot_mb, src_size, RK_MMZ_ALLOC_CACHEABLE);
-    if (ret != RK_SUCCESS || g_display_rot_mb == MB_INVALID_HANDLE) {
-        log_error("RK_MPI_MMZ_Alloc(rot) failed: 0x%x\n", ret);
-        RK_MPI_MMZ_Free(g_display_src_mb);
-        g_display_src_mb = MB_INVALID_HANDLE;
-        munmap(ctx->fb_pixels, ctx->fb_size);
-        close(ctx->fb_fd);
-        return -1;
-    }
-    g_display_rot_vaddr = RK_MPI_MMZ_Handle2VirAddr(g_display_rot_mb);
-    log_info("Allocated rotation DMA buffer: %zu bytes\n", src_size);
-
-    /* Allocate DMA buffer for destination NV12 */
+    /*
+     * Allocate DMA buffer for destination NV12 (VENC input). RGA writes it
+     * by fd in one rotate+convert pass; the BGRX buffers for the split path
+     * are only allocated if that pass turns out to be unsupported.
+     */
     size_t nv12_size = ctx->output_width * ctx->output_height * 3 / 2;
-    ret = RK_MPI_MMZ_Alloc(&g_display_dst_mb, nv12_size, RK_MMZ_ALLOC_CACHEABLE);
+    RK_S32 ret = RK_MPI_MMZ_Alloc(&g_display_dst_mb, nv12_size, RK_MMZ_ALLOC_CACHEABLE);
     if (ret != RK_SUCCESS || g_display_dst_mb == MB_INVALID_HANDLE) {
         log_error("RK_MPI_MMZ_Alloc(dst) failed: 0x%x\n", ret);
-        RK_MPI_MMZ_Free(g_display_rot_mb);
-        g_display_rot_mb = MB_INVALID_HANDLE;
-        RK_MPI_MMZ_Free(g_display_src_mb);
-        g_display_src_mb = MB_INVALID_HANDLE;
+        g_display_dst_mb = MB_INVALID_HANDLE;
+        cleanup_framebuffer_dmabuf();
         munmap(ctx->fb_pixels, ctx->fb_size);
         close(ctx->fb_fd);
         return -1;
     }
     g_display_dst_vaddr = RK_MPI_MMZ_Handle2VirAddr(g_display_dst_mb);
+    g_display_dst_fd = RK_MPI_MMZ_Handle2Fd(g_display_dst_mb);
+    g_display_fused = (g_display_dst_fd >= 0);
     log_info("Allocated destination DMA buffer: %zu bytes\n", nv12_size);
 
     /* Initialize VENC for display JPEG encoding */
     if (init_display_venc(ctx->output_width, ctx->output_height, ctx->fps, DISPLAY_JPEG_QUALITY) != 0) {
         RK_MPI_MMZ_Free(g_display_dst_mb);
-        RK_MPI_MMZ_Free(g_display_rot_mb);
-        RK_MPI_MMZ_Free(g_display_src_mb);
         g_display_dst_mb = MB_INVALID_HANDLE;
-        g_display_rot_mb = MB_INVALID_HANDLE;
-        g_display_src_mb = MB_INVALID_HANDLE;
+        g_display_dst_vaddr = NULL;
+        g_display_dst_fd = -1;
+        cleanup_framebuffer_dmabuf();
         munmap(ctx->fb_pixels, ctx->fb_size);
         close(ctx->fb_fd);
         return -1;
@@ -740,12 +867,17 @@ void display_capture_cleanup(DisplayCapture *ctx) {
 
     /* Cleanup VENC */
     cleanup_display_venc();
+    if (g_display_h264_state > 0) {
+        cleanup_display_h264_venc();
+    }
+    g_display_h264_state = 0;
 
     /* Free DMA buffers */
     if (g_display_dst_mb != MB_INVALID_HANDLE) {
         RK_MPI_MMZ_Free(g_display_dst_mb);
         g_display_dst_mb = MB_INVALID_HANDLE;
         g_display_dst_vaddr = NULL;
+        g_display_dst_fd = -1;
     }
 
     if (g_display_rot_mb != MB_INVALID_HANDLE) {
@@ -782,6 +914,7 @@ static inline uint64_t get_time_us(void) {
     return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
 }
 
+static uint64_t g_timing_mark[8];
 static int g_timing_frame_count = 0;
 static uint64_t g_timing_memcpy = 0;
 static uint64_t g_timing_flush1 = 0;
@@ -792,26 +925,42 @@ static uint64_t g_timing_venc = 0;
 static uint64_t g_timing_output = 0;
 #endif /* DISPLAY_TIMING */
 
-size_t display_capture_frame(DisplayCapture *ctx, uint8_t *jpeg_buf, size_t jpeg_buf_size) {
-    if (!ctx->running || !g_display_rot_vaddr || !g_display_dst_vaddr) {
-        return 0;
+/*
+ * Rotate and convert the current framebuffer into the NV12 buffer shared by
+ * the JPEG and H.264 encoders. Returns 0 on success.
+ */
+static int display_render_nv12(DisplayCapture *ctx) {
+    if (!ctx->running || !g_display_dst_vaddr) {
+        return -1;
     }
 
-    /* Need either DMA-buf fd (zero-copy) or source buffer (copy mode) */
-    int zero_copy = (g_fb_dmabuf_fd >= 0);
-    if (!zero_copy && !g_display_src_vaddr) {
-        return 0;
+#ifdef DISPLAY_TIMING
+    g_timing_mark[0] = get_time_us();
+#endif
+
+    if (g_display_fused) {
+        if (rga_rotate_convert(ctx, g_fb_dmabuf_fd, g_display_dst_fd) == 0) {
+#ifdef DISPLAY_TIMING
+            /* One job: reported under convert, no copy/rotate/flush stages */
+            g_timing_mark[1] = g_timing_mark[2] = g_timing_mark[3] = g_timing_mark[0];
+            g_timing_mark[4] = g_timing_mark[5] = get_time_us();
+#endif
+            return 0;
+        }
+        log_error("Single-pass RGA unavailable, using separate rotate/convert\n");
+        g_display_fused = 0;
+    }
+
+    /* Split path: rotate into a BGRX buffer, then convert */
+    if (!g_display_rot_vaddr && alloc_split_buffers(ctx) != 0) {
+        return -1;
     }
 
+    int zero_copy = (g_fb_dmabuf_fd >= 0);
     void *rga_src = NULL;
     int rga_width = ctx->fb_width;
     int rga_height = ctx->fb_height;
 
-#ifdef DISPLAY_TIMING
-    uint64_t t0, t1, t2, t3, t4, t5, t6, t7;
-    t0 = get_time_us();
-#endif
-
     if (zero_copy) {
         /*
          * Zero-copy mode: RGA reads directly from framebuffer via DMA-buf fd
@@ -852,8 +1001,8 @@ size_t display_capture_frame(DisplayCapture *ctx, uint8_t *jpeg_buf, size_t jpeg
     }
 
 #ifdef DISPLAY_TIMING
-    t1 = get_time_us();
-    t2 = t1;
+    g_timing_mark[1] = get_time_us();
+    g_timing_mark[2] = g_timing_mark[1];
 #endif
 
     if (!zero_copy && g_display_src_vaddr) {
@@ -866,8 +1015,8 @@ size_t display_capture_frame(DisplayCapture *ctx, uint8_t *jpeg_buf, size_t jpeg
         }
 
 #ifdef DISPLAY_TIMING
-        t1 = get_time_us();
-        t2 = t1;
+        g_timing_mark[1] = get_time_us();
+        g_timing_mark[2] = g_timing_mark[1];
 #endif
 
         /* Apply rotation using RGA hardware */
@@ -912,7 +1061,7 @@ size_t display_capture_frame(DisplayCapture *ctx, uint8_t *jpeg_buf, size_t jpeg
     }
 
 #ifdef DISPLAY_TIMING
-    t3 = get_time_us();
+    g_timing_mark[3] = get_time_us();
 #endif
 
     /* RGA color conversion (BGRX to NV12) */
@@ -926,11 +1075,11 @@ size_t display_capture_frame(DisplayCapture *ctx, uint8_t *jpeg_buf, size_t jpeg
 
     if (!convert_ok) {
         log_error("RGA conversion failed\n");
-        return 0;
+        return -1;
     }
 
 #ifdef DISPLAY_TIMING
-    t4 = get_time_us();
+    g_timing_mark[4] = get_time_us();
 #endif
 
     /* Flush destination cache for VENC */
@@ -939,19 +1088,29 @@ size_t display_capture_frame(DisplayCapture *ctx, uint8_t *jpeg_buf, size_t jpeg
     RK_MPI_MMZ_FlushCacheEnd(g_display_dst_mb, 0, nv12_size, RK_MMZ_SYNC_WRITEONLY);
 
 #ifdef DISPLAY_TIMING
-    t5 = get_time_us();
+    g_timing_mark[5] = get_time_us();
 #endif
 
+    return 0;
+}
+
+/* Wrap the NV12 buffer as a VENC input frame */
+static void display_nv12_frame(const DisplayCapture *ctx, VIDEO_FRAME_INFO_S *frame) {
+    memset(frame, 0, sizeof(*frame));
+    frame->stVFrame.pMbBlk = g_display_dst_mb;
+    frame->stVFrame.u32Width = ctx->output_width;
+    frame->stVFrame.u32Height = ctx->output_height;
+    frame->stVFrame.u32VirWidth = ctx->output_width;
+    frame->stVFrame.u32VirHeight = ctx->output_height;
+    frame->stVFrame.enPixelFormat = RK_FMT_YUV420SP;
+    frame->stVFrame.enCompressMode = COMPRESS_MODE_NONE;
+}
+
+/* JPEG-encode the rendered NV12 buffer, returns JPEG size or 0 */
+static size_t display_encode_jpeg(DisplayCapture *ctx, uint8_t *jpeg_buf, size_t jpeg_buf_size) {
     /* Setup frame info for VENC */
     VIDEO_FRAME_INFO_S stFrame;
-    memset(&stFrame, 0, sizeof(stFrame));
-    stFrame.stVFrame.pMbBlk = g_display_dst_mb;
-    stFrame.stVFrame.u32Width = ctx->output_width;
-    stFrame.stVFrame.u32Height = ctx->output_height;
-    stFrame.stVFrame.u32VirWidth = ctx->output_width;
-    stFrame.stVFrame.u32VirHeight = ctx->output_height;
-    stFrame.stVFrame.enPixelFormat = RK_FMT_YUV420SP;
-    stFrame.stVFrame.enCompressMode = COMPRESS_MODE_NONE;
+    display_nv12_frame(ctx, &stFrame);
 
     /* Send frame to VENC */
     RK_S32 ret = RK_MPI_VENC_SendFrame(VENC_CHN_DISPLAY, &stFrame, 1000);
@@ -977,7 +1136,7 @@ size_t display_capture_frame(DisplayCapture *ctx, uint8_t *jpeg_buf, size_t jpeg
     }
 
 #ifdef DISPLAY_TIMING
-    t6 = get_time_us();
+    g_timing_mark[6] = get_time_us();
 #endif
 
     /* Copy JPEG data to output buffer */
@@ -998,21 +1157,22 @@ size_t display_capture_frame(DisplayCapture *ctx, uint8_t *jpeg_buf, size_t jpeg
     free(stStream.pstPack);
 
 #ifdef DISPLAY_TIMING
-    t7 = get_time_us();
+    g_timing_mark[7] = get_time_us();
 
     /* Accumulate timing stats */
-    g_timing_memcpy += (t1 - t0);
-    g_timing_flush1 += (t2 - t1);
-    g_timing_rotate += (t3 - t2);
-    g_timing_convert += (t4 - t3);
-    g_timing_flush2 += (t5 - t4);
-    g_timing_venc += (t6 - t5);
-    g_timing_output += (t7 - t6);
+    g_timing_memcpy += (g_timing_mark[1] - g_timing_mark[0]);
+    g_timing_flush1 += (g_timing_mark[2] - g_timing_mark[1]);
+    g_timing_rotate += (g_timing_mark[3] - g_timing_mark[2]);
+    g_timing_convert += (g_timing_mark[4] - g_timing_mark[3]);
+    g_timing_flush2 += (g_timing_mark[5] - g_timing_mark[4]);
+    g_timing_venc += (g_timing_mark[6] - g_timing_mark[5]);
+    g_timing_output += (g_timing_mark[7] - g_timing_mark[6]);
     g_timing_frame_count++;
 
     /* Log timing every 10 frames */
     if (g_timing_frame_count >= 10) {
-        log_info("TIMING (avg us/frame): memcpy=%llu flush1=%llu rotate=%llu convert=%llu flush2=%llu venc=%llu output=%llu total=%llu\n",
+        log_info("TIMING (avg us/frame, %s): memcpy=%llu flush1=%llu rotate=%llu convert=%llu flush2=%llu venc=%llu output=%llu total=%llu\n",
+                 g_display_fused ? "fused" : "split",
                  (unsigned long long)(g_timing_memcpy / 10),
                  (unsigned long long)(g_timing_flush1 / 10),
                  (unsigned long long)(g_timing_rotate / 10),
@@ -1031,6 +1191,154 @@ size_t display_capture_frame(DisplayCapture *ctx, uint8_t *jpeg_buf, size_t jpeg
     return jpeg_size;
 }
 
+/*
+ * H.264-encode the rendered NV12 buffer into g_display_h264_buffer
+ * Returns 0 on success
+ */
+static int display_encode_h264(DisplayCapture *ctx, uint64_t timestamp_us) {
+    VIDEO_FRAME_INFO_S stFrame;
+    display_nv12_frame(ctx, &stFrame);
+
+    RK_S32 ret = RK_MPI_VENC_SendFrame(VENC_CHN_DISPLAY_H264, &stFrame, 1000);
+    if (ret != RK_SUCCESS) {
+        log_error("RK_MPI_VENC_SendFrame(DISPLAY_H264) failed: 0x%x\n", ret);
+        return -1;
+    }
+
+    VENC_STREAM_S stStream;
+    VENC_PACK_S stPack;
+    memset(&stStream, 0, sizeof(stStream));
+    stStream.pstPack = &stPack;
+
+    ret = RK_MPI_VENC_GetStream(VENC_CHN_DISPLAY_H264, &stStream, 1000);
+    if (ret != RK_SUCCESS) {
+        log_error("RK_MPI_VENC_GetStream(DISPLAY_H264) failed: 0x%x\n", ret);
+        return -1;
+    }
+
+    int rc = -1;
+    if (stStream.u32PackCount > 0) {
+        const uint8_t *p = RK_MPI_MB_Handle2VirAddr(stPack.pMbBlk);
+        size_t len = stPack.u32Len;
+        if (p && len > 0) {
+            /* Keyframe if any NAL in the access unit is an IDR slice */
+            int is_keyframe = 0;
+            for (size_t i = 0; i + 4 < len; i++) {
+                if (p[i] == 0 && p[i+1] == 0 && p[i+2] == 1) {
+                    int nal_type = p[i+3] & 0x1F;
+                    if (nal_type == 5) {
+                        is_keyframe = 1;
+                        break;
+                    }
+                    if (nal_type == 1) break;
+                    i += 2;
+                }
+            }
+            frame_buffer_write(&g_display_h264_buffer, p, len, timestamp_us, is_keyframe);
+            rc = 0;
+        }
+    }
+
+    RK_MPI_VENC_ReleaseStream(VENC_CHN_DISPLAY_H264, &stStream);
+    return rc;
+}
+
+size_t display_capture_frame(DisplayCapture *ctx, uint8_t *jpeg_buf, size_t jpeg_buf_size) {
+    if (display_render_nv12(ctx) != 0) {
+        return 0;
+    }
+    return display_encode_jpeg(ctx, jpeg_buf, jpeg_buf_size);
+}
+
+/*
+ * Damage tracking
+ *
+ * The printer UI is static most of the time, so before running the RGA/VENC
+ * pipeline each tick samples one phase of framebuffer rows (every
+ * DISPLAY_DAMAGE_ROW_STEP-th row, phase advancing per tick) and folds them
+ * into one FNV-1a hash per tile. If no tile of that phase changed, the frame
+ * is skipped and clients keep the last JPEG. Every row is covered within
+ * DISPLAY_DAMAGE_ROW_STEP ticks; a periodic refresh encode also keeps
+ * streams under HTTP_STALE_STREAM_TIMEOUT_SEC.
+ */
+#define DISPLAY_DAMAGE_TILE       32
+#define DISPLAY_DAMAGE_ROW_STEP   4
+#define DISPLAY_DAMAGE_REFRESH_S  10
+#define DISPLAY_DAMAGE_MAX_TILES \
+    (((DISPLAY_WIDTH + DISPLAY_DAMAGE_TILE - 1) / DISPLAY_DAMAGE_TILE) * \
+     ((DISPLAY_HEIGHT + DISPLAY_DAMAGE_TILE - 1) / DISPLAY_DAMAGE_TILE))
+
+static uint32_t g_damage_hash[DISPLAY_DAMAGE_ROW_STEP][DISPLAY_DAMAGE_MAX_TILES];
+static int g_damage_phase = 0;
+static int g_damage_valid = 0;
+static volatile int g_display_force_encode = 1;
+static volatile uint32_t g_display_frames_encoded = 0;
+static volatile uint32_t g_display_frames_skipped = 0;
+
+/* Hash one row phase into hash[]; returns number of tiles that differ from old */
+static int damage_hash_phase(const DisplayCapture *ctx, int phase, uint32_t *hash) {
+    int tiles_x = (ctx->fb_width + DISPLAY_DAMAGE_TILE - 1) / DISPLAY_DAMAGE_TILE;
+    int tiles_y = (ctx->fb_height + DISPLAY_DAMAGE_TILE - 1) / DISPLAY_DAMAGE_TILE;
+    uint32_t cur[DISPLAY_DAMAGE_MAX_TILES];
+    int dirty = 0;
+
+    for (int i = 0; i < tiles_x * tiles_y; i++)
+        cur[i] = 2166136261u;
+
+    for (int y = phase; y < ctx->fb_height; y += DISPLAY_DAMAGE_ROW_STEP) {
+        const uint32_t *row = ctx->fb_pixels + (size_t)y * ctx->fb_width;
+        uint32_t *th = cur + (y / DISPLAY_DAMAGE_TILE) * tiles_x;
+        for (int x = 0; x < ctx->fb_width; x++) {
+            uint32_t *h = &th[x / DISPLAY_DAMAGE_TILE];
+            *h = (*h ^ row[x]) * 16777619u;
+        }
+    }
+
+    for (int i = 0; i < tiles_x * tiles_y; i++) {
+        if (cur[i] != hash[i]) {
+            hash[i] = cur[i];
+            dirty++;
+        }
+    }
+    return dirty;
+}
+
+/*
+ * Decide whether this tick needs an encode.
+ * Returns 1 to encode, 0 when the display is unchanged.
+ */
+static int damage_check(const DisplayCapture *ctx, uint64_t now_us, uint64_t *last_encode_us) {
+    int tiles_x = (ctx->fb_width + DISPLAY_DAMAGE_TILE - 1) / DISPLAY_DAMAGE_TILE;
+    int tiles_y = (ctx->fb_height + DISPLAY_DAMAGE_TILE - 1) / DISPLAY_DAMAGE_TILE;
+
+    /* Oversized framebuffer: no tracking, always encode */
+    if (tiles_x * tiles_y > DISPLAY_DAMAGE_MAX_TILES || !ctx->fb_pixels)
+        return 1;
+
+    int force = g_display_force_encode || !g_damage_valid ||
+                now_us - *last_encode_us >= (uint64_t)DISPLAY_DAMAGE_REFRESH_S * 1000000;
+    int dirty;
+
+    if (!g_damage_valid) {
+        /* Seed every phase so later ticks compare against a full snapshot */
+        for (int p = 0; p < DISPLAY_DAMAGE_ROW_STEP; p++)
+            damage_hash_phase(ctx, p, g_damage_hash[p]);
+        g_damage_valid = 1;
+        g_damage_phase = 0;
+        dirty = tiles_x * tiles_y;
+    } else {
+        dirty = damage_hash_phase(ctx, g_damage_phase, g_damage_hash[g_damage_phase]);
+        g_damage_phase = (g_damage_phase + 1) % DISPLAY_DAMAGE_ROW_STEP;
+    }
+
+    if (!force && dirty == 0)
+        return 0;
+
+    g_display_force_encode = 0;
+    *last_encode_us = now_us;
+    return 1;
+}
+
 /*
  * Display capture thread function
  * Only encodes when: display is enabled AND clients are connected
@@ -1048,17 +1356,29 @@ static void *display_capture_thread(void *arg) {
 
     struct timespec ts;
     int was_active = 0;
+    uint64_t last_encode_us = 0;
 
     log_info("Capture thread started (idle until clients connect)\n");
 
     while (ctx->running && g_display_running) {
         /* Check if we should be encoding */
-        int is_active = g_display_enabled && (g_display_client_count > 0);
+        int jpeg_clients = g_display_client_count;
+        int h264_clients = g_display_h264_client_count;
+        int is_active = g_display_enabled && (jpeg_clients + h264_clients > 0);
+
+        /* H.264 channel lives only while FLV display clients are connected */
+        if (h264_clients == 0 && g_display_h264_state != 0) {
+            if (g_display_h264_state > 0) {
+                cleanup_display_h264_venc();
+            }
+            g_display_h264_state = 0;
+        }
 
         if (!is_active) {
             /* Idle mode - sleep and check periodically */
             if (was_active) {
-                log_info("Display capture paused (no clients or disabled)\n");
+                log_info("Display capture paused (no clients or disabled), %u encoded, %u skipped\n",
+                         (unsigned)g_display_frames_encoded, (unsigned)g_display_frames_skipped);
                 was_active = 0;
             }
             usleep(100000);  /* 100ms idle poll */
@@ -1066,9 +1386,11 @@ static void *display_capture_thread(void *arg) {
         }
 
         if (!was_active) {
-            log_info("Display capture active: %d client(s), %d fps\n",
-                     g_display_client_count, g_display_target_fps);
+            log_info("Display capture active: %d JPEG + %d H.264 client(s), %d fps\n",
+                     jpeg_clients, h264_clients, g_display_target_fps);
             was_active = 1;
+            /* Display may have changed while idle: re-seed and encode */
+            g_damage_valid = 0;
         }
 
         /* Calculate frame interval from current FPS setting */
@@ -1080,12 +1402,50 @@ static void *display_capture_thread(void *arg) {
         clock_gettime(CLOCK_MONOTONIC, &ts);
         uint64_t start_us = (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
 
-        /* Capture frame */
-        size_t jpeg_size = display_capture_frame(ctx, jpeg_buf, jpeg_buf_size);
+        if (h264_clients > 0 && g_display_h264_state == 0) {
+            g_display_h264_state =
+                init_display_h264_venc(ctx->output_width, ctx->output_height) == 0 ? 1 : -1;
+        }
+        int h264_ready = (h264_clients > 0 && g_display_h264_state > 0);
+        if (h264_ready && g_display_h264_idr) {
+            /* New FLV client: start it on a keyframe */
+            g_display_h264_idr = 0;
+            RK_MPI_VENC_RequestIDR(VENC_CHN_DISPLAY_H264, RK_TRUE);
+            g_display_force_encode = 1;
+        }
+        if (jpeg_clients == 0 && !h264_ready) {
+            /* Only H.264 clients and the channel failed: nothing to encode */
+            usleep(frame_interval_us);
+            continue;
+        }
 
-        if (jpeg_size > 0) {
-            /* Write to display frame buffer */
-            frame_buffer_write(&g_display_buffer, jpeg_buf, jpeg_size, 0, 1);
+        /* Unchanged display: skip rotate/convert/encode, keep last frame */
+        if (!damage_check(ctx, start_us, &last_encode_us)) {
+            g_display_frames_skipped++;
+        } else if (display_render_nv12(ctx) != 0) {
+            /* Retry on the next tick rather than waiting for new damage */
+            g_display_force_encode = 1;
+        } else {
+            int encoded = 0;
+
+            if (jpeg_clients > 0) {
+                size_t jpeg_size = display_encode_jpeg(ctx, jpeg_buf, jpeg_buf_size);
+                if (jpeg_size > 0) {
+                    /* Write to display frame buffer */
+                    frame_buffer_write(&g_display_buffer, jpeg_buf, jpeg_size, 0, 1);
+                    encoded = 1;
+                }
+            }
+
+            if (h264_ready && display_encode_h264(ctx, start_us) == 0) {
+                encoded = 1;
+            }
+
+            if (encoded) {
+                g_display_frames_encoded++;
+            } else {
+                g_display_force_encode = 1;
+            }
         }
 
         /* Sleep until next frame */
@@ -1158,6 +1518,8 @@ int display_capture_is_running(void) {
 void display_client_connect(void) {
     pthread_mutex_lock(&g_display_mutex);
     g_display_client_count++;
+    /* New clients wait for a fresh sequence, so always encode one */
+    g_display_force_encode = 1;
     log_info("Display client connected (total: %d)\n", g_display_client_count);
     pthread_mutex_unlock(&g_display_mutex);
 }
@@ -1172,7 +1534,34 @@ void display_client_disconnect(void) {
 }
 
 int display_get_client_count(void) {
-    return g_display_client_count;
+    return g_display_client_count + g_display_h264_client_count;
+}
+
+void display_h264_request_idr(void) {
+    g_display_h264_idr = 1;
+    g_display_force_encode = 1;
+}
+
+void display_h264_client_connect(void) {
+    pthread_mutex_lock(&g_display_mutex);
+    g_display_h264_client_count++;
+    display_h264_request_idr();
+    log_info("Display H.264 client connected (total: %d)\n", g_display_h264_client_count);
+    pthread_mutex_unlock(&g_display_mutex);
+}
+
+void display_h264_client_disconnect(void) {
+    pthread_mutex_lock(&g_display_mutex);
+    if (g_display_h264_client_count > 0) {
+        g_display_h264_client_count--;
+    }
+    log_info("Display H.264 client disconnected (total: %d)\n", g_display_h264_client_count);
+    pthread_mutex_unlock(&g_display_mutex);
+}
+
+void display_get_output_size(int *width, int *height) {
+    *width = g_display_ctx.output_width;
+    *height = g_display_ctx.output_height;
 }
 
 /* Enable/disable display capture */
@@ -1201,3 +1590,12 @@ void display_set_fps(int fps) {
 int display_get_fps(void) {
     return g_display_target_fps;
 }
+
+/* Damage tracking counters */
+uint32_t display_get_frames_encoded(void) {
+    return g_display_frames_encoded;
+}
+
+uint32_t display_get_frames_skipped(void) {
+    return g_display_frames_skipped;
+}
@@ -11,6 +11,8 @@
  * - Orientation varies by model
  *
  * Pipeline: Framebuffer -> Rotate -> BGRX to NV12 -> VENC MJPEG -> JPEG
+ *                                                -> VENC H.264 -> FLV (on demand)
+ * Frames whose sampled tile hashes are unchanged skip the pipeline entirely.
  */
 
 #ifndef DISPLAY_CAPTURE_H
@@ -27,6 +29,11 @@
 /* JPEG encoding quality for display capture (0-100) */
 #define DISPLAY_JPEG_QUALITY  80
 
+/* H.264 display stream (FLV): bitrate in kbps and GOP length in frames.
+ * Unchanged frames are skipped, so a GOP spans far longer than GOP/fps. */
+#define DISPLAY_H264_BITRATE  800
+#define DISPLAY_H264_GOP      120
+
 /* Default capture FPS (display updates are typically slow) */
 #define DISPLAY_DEFAULT_FPS   5
 
@@ -84,6 +91,16 @@ void display_client_connect(void);
 void display_client_disconnect(void);
 int display_get_client_count(void);
 
+/* H.264 (FLV) client tracking - the H.264 channel only exists while > 0 */
+void display_h264_client_connect(void);
+void display_h264_client_disconnect(void);
+
+/* Ask for an IDR on the next display tick (client waiting for a keyframe) */
+void display_h264_request_idr(void);
+
+/* Output dimensions after rotation (valid once capture has started) */
+void display_get_output_size(int *width, int *height);
+
 /* Enable/disable display capture (pauses encoding when disabled) */
 void display_set_enabled(int enabled);
 int display_is_enabled(void);
@@ -92,4 +109,8 @@ int display_is_enabled(void);
 void display_set_fps(int fps);
 int display_get_fps(void);
 
+/* Damage tracking counters: frames encoded vs. skipped as unchanged */
+uint32_t display_get_frames_encoded(void);
+uint32_t display_get_frames_skipped(void);
+
 #endif /* DISPLAY_CAPTURE_H */
@@ -18,6 +18,7 @@
 #include "mqtt_client.h"
 #include "cJSON.h"
 #include "rknn/rknn_api.h"
+#include "rk_mpi_mmz.h"
 #include <turbojpeg.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -30,8 +31,22 @@
 #include <sys/time.h>
 #include <sys/stat.h>
 #include <sys/wait.h>
+#include <sys/mman.h>
+#include <sys/statvfs.h>
+#include <sys/socket.h>
+#include <netdb.h>
+#include <poll.h>
+#include <signal.h>
+#include <strings.h>
 #include <fcntl.h>
 #include <errno.h>
+#ifdef HAVE_OPENSSL
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+#endif
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
 
 /* Logging macros (match rkmpi_enc.c style) */
 #define fd_log(fmt, ...) fprintf(stderr, "[FD] " fmt, ##__VA_ARGS__)
@@ -40,6 +55,8 @@
 /* Forward declarations (defined in Helpers section) */
 static double fd_get_time_ms(void);
 static fd_mask196_t fd_get_mask_for_z(const fd_config_t *cfg, float z);
+static void fd_roi_update(const fd_config_t *cfg);
+static fd_mask196_t fd_roi_remap_mask(const fd_mask196_t *m);
 
 /* Forward declarations (defined in Prototype Management section) */
 static void fd_do_proto_computation(void);
@@ -150,6 +167,8 @@ typedef int (*fn_rknn_set_io_mem)(rknn_context, rknn_tensor_mem *,
 typedef int (*fn_rknn_run)(rknn_context, rknn_run_extend *);
 typedef int (*fn_rknn_destroy_mem)(rknn_context, rknn_tensor_mem *);
 typedef int (*fn_rknn_destroy)(rknn_context);
+typedef rknn_tensor_mem *(*fn_rknn_create_mem_from_fd)(rknn_context, int32_t,
+                                                      void *, uint32_t, int32_t);
 
 static struct {
     void *handle;
@@ -160,6 +179,7 @@ static struct {
     fn_rknn_run run;
     fn_rknn_destroy_mem destroy_mem;
     fn_rknn_destroy destroy;
+    fn_rknn_create_mem_from_fd create_mem_from_fd;  /* optional: shared input */
 } g_rknn;
 
 /* ============================================================================
@@ -176,11 +196,30 @@ typedef struct {
     rknn_tensor_mem *input_mem;
     rknn_tensor_mem *output_mems[FD_MAX_OUTPUTS];
     uint32_t input_size;
+    uint32_t input_pitch;       /* bytes per row, 0 = unknown layout */
+    int shared_input;           /* input_mem is bound to the shared tensor */
 } fd_rknn_model_t;
 
 /* Embedding dimension for ProtoNet */
 #define EMB_DIM 1024
 
+/* A fail/success prototype pair reduced to the single direction the margin
+ * needs: cos(x,fail) - cos(x,succ) == dot(x, unit(fail) - unit(succ)) / |x|.
+ * Built once per prototype load, so each heatmap cell is one pass over x. */
+typedef struct {
+    float dir[FD_SPATIAL_EMB_MAX];
+    int dim;
+
+    /* dir in fixed point for the int8 NPU output: dir[i] ~= qdir[i] * qdir_scale */
+    int16_t qdir[FD_SPATIAL_EMB_MAX];
+    float qdir_scale;
+    int64_t qdir_sum;
+} fd_margin_t;
+
+/* Largest |qdir|: keeps each int32 NEON lane (n/4 products of 128 * this)
+ * from overflowing for n up to FD_SPATIAL_EMB_MAX */
+#define FD_QDIR_MAX 16383
+
 /* ============================================================================
  * Module state
  * ============================================================================ */
@@ -212,20 +251,26 @@ static struct {
     /* ProtoNet prototypes (classification — 1024-dim) */
     float prototypes[2][EMB_DIM];
     float proto_norms[2];
+    fd_margin_t proto_margin;
     int prototypes_loaded;
 
     /* Spatial prototypes (separate — variable dim from header) */
     float spatial_protos[2][FD_SPATIAL_EMB_MAX];
     float spatial_proto_norms[2];
+    fd_margin_t spatial_margin;
     int spatial_protos_loaded;
     int spatial_h, spatial_w, spatial_emb_dim, spatial_total;
 
     /* Coarse spatial prototypes (for multi-scale fusion) */
     float spatial_coarse_protos[2][FD_SPATIAL_EMB_MAX];
     float spatial_coarse_proto_norms[2];
+    fd_margin_t spatial_coarse_margin;
     int spatial_coarse_loaded;
     int spatial_coarse_h, spatial_coarse_w, spatial_coarse_emb_dim, spatial_coarse_total;
 
+    /* Dequantized spatial output, only for encoders without int8 output */
+    float *spatial_f32;
+
     /* Z-dependent mask */
     float current_z;
     pthread_mutex_t z_mutex;
@@ -234,6 +279,10 @@ static struct {
     float crop_x, crop_y, crop_w, crop_h;
     int crop_valid;
 
+    /* Bed-region crop: square in center-crop coords (detection thread only) */
+    float roi_x, roi_y, roi_s;
+    int roi_valid;
+
     /* CNN logit EMA for temporal smoothing */
     float cnn_ema_logits[2];
     int cnn_ema_init;
@@ -245,6 +294,7 @@ static struct {
     /* Heatmap EMA for temporal smoothing (filters single-frame INT8 spikes) */
     float heatmap_ema[FD_SPATIAL_H_MAX][FD_SPATIAL_W_MAX];
     int heatmap_ema_init;
+    fd_mask196_t heatmap_ema_cells;  /* cell set the EMA was built over */
 
     /* Last FD-processed frame (for UI overlay) */
     uint8_t  fd_frame_buf[512 * 1024];
@@ -315,18 +365,126 @@ static void fd_softmax(float *arr, int n)
         arr[i] /= sum;
 }
 
-static float fd_cosine_similarity(const float *a, const float *b,
-                                   float norm_b, int n)
+/* ============================================================================
+ * Vector kernels
+ * ============================================================================ */
+
+#if defined(__ARM_NEON)
+static inline float fd_vec_hsum(float32x4_t v)
+{
+    float32x2_t s = vadd_f32(vget_low_f32(v), vget_high_f32(v));
+    s = vpadd_f32(s, s);
+    return vget_lane_f32(s, 0);
+}
+#endif
+
+/* dot(a, b) and |a|^2 in one pass over a */
+static float fd_vec_dot_sq(const float *a, const float *b, int n, float *sq_out)
 {
-    float dot = 0.0f, na = 0.0f;
-    for (int i = 0; i < n; i++) {
+    int i = 0;
+    float dot = 0.0f, sq = 0.0f;
+#if defined(__ARM_NEON)
+    /* Two accumulators hide the VMLA latency on Cortex-A7 */
+    float32x4_t d0 = vdupq_n_f32(0.0f), d1 = vdupq_n_f32(0.0f);
+    float32x4_t s0 = vdupq_n_f32(0.0f), s1 = vdupq_n_f32(0.0f);
+    for (; i + 8 <= n; i += 8) {
+        float32x4_t a0 = vld1q_f32(a + i);
+        float32x4_t a1 = vld1q_f32(a + i + 4);
+        d0 = vmlaq_f32(d0, a0, vld1q_f32(b + i));
+        d1 = vmlaq_f32(d1, a1, vld1q_f32(b + i + 4));
+        s0 = vmlaq_f32(s0, a0, a0);
+        s1 = vmlaq_f32(s1, a1, a1);
+    }
+    dot = fd_vec_hsum(vaddq_f32(d0, d1));
+    sq = fd_vec_hsum(vaddq_f32(s0, s1));
+#endif
+    for (; i < n; i++) {
         dot += a[i] * b[i];
-        na += a[i] * a[i];
+        sq += a[i] * a[i];
+    }
+    *sq_out = sq;
+    return dot;
+}
+
+/* Sums over int8 q and int16 d: q.d, sum(q) and q.q */
+static void fd_vec_dot_q8(const int8_t *q, const int16_t *d, int n,
+                          int64_t *dot_out, int64_t *sum_out, int64_t *sq_out)
+{
+    int i = 0;
+    int64_t dot = 0, sum = 0, sq = 0;
+#if defined(__ARM_NEON)
+    int32x4_t vd = vdupq_n_s32(0), vs = vdupq_n_s32(0), vq = vdupq_n_s32(0);
+    for (; i + 8 <= n; i += 8) {
+        int8x8_t q8 = vld1_s8(q + i);
+        int16x8_t q16 = vmovl_s8(q8);
+        int16x8_t d16 = vld1q_s16(d + i);
+        vd = vmlal_s16(vd, vget_low_s16(q16), vget_low_s16(d16));
+        vd = vmlal_s16(vd, vget_high_s16(q16), vget_high_s16(d16));
+        vs = vpadalq_s16(vs, q16);
+        vq = vpadalq_s16(vq, vmull_s8(q8, q8));   /* |q|^2 <= 16384 fits s16 */
+    }
+    int64x2_t t;
+    t = vpaddlq_s32(vd); dot = vgetq_lane_s64(t, 0) + vgetq_lane_s64(t, 1);
+    t = vpaddlq_s32(vs); sum = vgetq_lane_s64(t, 0) + vgetq_lane_s64(t, 1);
+    t = vpaddlq_s32(vq); sq  = vgetq_lane_s64(t, 0) + vgetq_lane_s64(t, 1);
+#endif
+    for (; i < n; i++) {
+        dot += (int32_t)q[i] * d[i];
+        sum += q[i];
+        sq += (int32_t)q[i] * q[i];
+    }
+    *dot_out = dot;
+    *sum_out = sum;
+    *sq_out = sq;
+}
+
+/* Build the margin direction for a prototype pair (norms already computed).
+ * The prototypes are always normalized here, whatever norm they were
+ * exported with, so the margin stays a cosine difference. */
+static void fd_margin_prepare(fd_margin_t *m, const float *fail, const float *succ,
+                              float norm_fail, float norm_succ, int dim)
+{
+    m->dim = dim;
+    /* A degenerate prototype contributes cos = 0 */
+    float kf = norm_fail < 1e-12f ? 0.0f : 1.0f / norm_fail;
+    float ks = norm_succ < 1e-12f ? 0.0f : 1.0f / norm_succ;
+    float max_abs = 0.0f;
+    for (int i = 0; i < dim; i++) {
+        m->dir[i] = fail[i] * kf - succ[i] * ks;
+        if (fabsf(m->dir[i]) > max_abs) max_abs = fabsf(m->dir[i]);
+    }
+
+    m->qdir_scale = max_abs / FD_QDIR_MAX;
+    m->qdir_sum = 0;
+    for (int i = 0; i < dim; i++) {
+        m->qdir[i] = max_abs > 0.0f ? (int16_t)lrintf(m->dir[i] / m->qdir_scale) : 0;
+        m->qdir_sum += m->qdir[i];
     }
-    na = sqrtf(na);
-    if (na < 1e-12f || norm_b < 1e-12f)
+}
+
+/* Signed margin of x: cos(x,fail) - cos(x,succ) */
+static float fd_margin_eval(const fd_margin_t *m, const float *x)
+{
+    float sq;
+    float dot = fd_vec_dot_sq(x, m->dir, m->dim, &sq);
+    if (sq < 1e-24f)
+        return 0.0f;
+    return dot / sqrtf(sq);
+}
+
+/* Margin of an int8 affine-quantized vector x = (q - zp) * scale, without
+ * dequantizing: dot(x, dir) = scale * qdir_scale * (q.qdir - zp * sum(qdir)),
+ * and the tensor scale cancels out of the cosine, so it is not needed. */
+static float fd_margin_eval_q8(const fd_margin_t *m, const int8_t *q, int32_t zp)
+{
+    int64_t dot, sum, sq;
+    fd_vec_dot_q8(q, m->qdir, m->dim, &dot, &sum, &sq);
+    double num = (double)(dot - (int64_t)zp * m->qdir_sum) * m->qdir_scale;
+    /* sum((q - zp)^2) */
+    int64_t sq_c = sq - 2 * (int64_t)zp * sum + (int64_t)m->dim * zp * zp;
+    if (sq_c <= 0)
         return 0.0f;
-    return dot / (na * norm_b);
+    return (float)(num / sqrt((double)sq_c));
 }
 
 /* ============================================================================
@@ -384,6 +542,8 @@ static int fd_rknn_load(void)
     LOAD_SYM(destroy_mem);
     LOAD_SYM(destroy);
 #undef LOAD_SYM
+    g_rknn.create_mem_from_fd = (fn_rknn_create_mem_from_fd)
+        dlsym(g_rknn.handle, "rknn_create_mem_from_fd");
 
     fd_log("RKNN runtime loaded from %s\n", lib_path);
     return 0;
@@ -397,6 +557,96 @@ static void fd_rknn_unload(void)
     }
 }
 
+/* ============================================================================
+ * Shared NPU input tensor
+ *
+ * All models take the same 448x224 RGB frame. Instead of memcpy'ing the
+ * preprocessed frame into each model's private input tensor, the frame is
+ * resized straight into one DMA buffer that every resident context binds
+ * as its input via rknn_create_mem_from_fd + rknn_set_io_mem. The buffer
+ * is laid out with the NPU's native row stride, taken from the first
+ * model that binds it; a model with a different layout keeps its private
+ * tensor and gets a stride-converting copy.
+ *
+ * Owned by the detection thread.
+ * ============================================================================ */
+
+static struct {
+    MB_BLK blk;
+    uint8_t *virt;
+    int fd;
+    uint32_t size;
+    uint32_t pitch;             /* bytes per row */
+    int cacheable;
+    uint32_t zero_copy_runs;
+    uint32_t input_copies;
+} g_fd_input = { .blk = MB_INVALID_HANDLE, .fd = -1 };
+
+/* Row pitch of a model input tensor, or 0 if it isn't 448x224x3 NHWC */
+static uint32_t fd_tensor_pitch(const rknn_tensor_attr *attr)
+{
+    if (attr->n_dims != 4 || attr->dims[1] != FD_MODEL_INPUT_HEIGHT ||
+        attr->dims[2] != FD_MODEL_INPUT_WIDTH || attr->dims[3] != 3)
+        return 0;
+    uint32_t w = attr->w_stride ? attr->w_stride : FD_MODEL_INPUT_WIDTH;
+    if ((uint64_t)w * 3 * FD_MODEL_INPUT_HEIGHT > attr->size_with_stride)
+        return 0;
+    return w * 3;
+}
+
+/* Row pitch of a preprocessed frame: strided if it lives in the shared
+ * tensor, packed otherwise */
+static uint32_t fd_input_pitch(const uint8_t *input)
+{
+    if (input && input == g_fd_input.virt)
+        return g_fd_input.pitch;
+    return FD_MODEL_INPUT_WIDTH * 3;
+}
+
+static int fd_input_alloc(uint32_t size, uint32_t pitch)
+{
+    MB_BLK blk = MB_INVALID_HANDLE;
+    if (RK_MPI_MMZ_Alloc(&blk, size, RK_MMZ_ALLOC_CACHEABLE) != RK_SUCCESS &&
+        RK_MPI_MMZ_Alloc(&blk, size, RK_MMZ_ALLOC_UNCACHEABLE) != RK_SUCCESS) {
+        fd_log("Shared input: DMA alloc of %u bytes failed, using per-model copies\n",
+               size);
+        return -1;
+    }
+    g_fd_input.blk = blk;
+    g_fd_input.virt = (uint8_t *)RK_MPI_MMZ_Handle2VirAddr(blk);
+    g_fd_input.fd = RK_MPI_MMZ_Handle2Fd(blk);
+    g_fd_input.cacheable = RK_MPI_MMZ_IsCacheable(blk);
+    g_fd_input.size = size;
+    g_fd_input.pitch = pitch;
+    /* Row padding is never written by the resize: clear it once */
+    memset(g_fd_input.virt, 0, size);
+    if (g_fd_input.cacheable)
+        RK_MPI_MMZ_FlushCacheEnd(blk, 0, size, RK_MMZ_SYNC_WRITEONLY);
+    fd_log("Shared input: %u bytes, pitch %u (cacheable=%d)\n",
+           size, pitch, g_fd_input.cacheable);
+    return 0;
+}
+
+/* Only valid once no context has the buffer bound */
+static void fd_input_free(void)
+{
+    if (g_fd_input.blk == MB_INVALID_HANDLE) return;
+    RK_MPI_MMZ_Free(g_fd_input.blk);
+    g_fd_input.blk = MB_INVALID_HANDLE;
+    g_fd_input.virt = NULL;
+    g_fd_input.fd = -1;
+    g_fd_input.size = 0;
+    g_fd_input.pitch = 0;
+}
+
+/* Make CPU writes to the shared tensor visible to the NPU */
+static void fd_input_flush(void)
+{
+    if (g_fd_input.cacheable)
+        RK_MPI_MMZ_FlushCacheEnd(g_fd_input.blk, 0, g_fd_input.size,
+                                 RK_MMZ_SYNC_WRITEONLY);
+}
+
 /* ============================================================================
  * RKNN model init/run/output/release (from rknn_model.c, uses dlopen ptrs)
  * ============================================================================ */
@@ -439,6 +689,7 @@ static int fd_model_init(fd_rknn_model_t *m, const char *model_path)
     m->input_attr.type = RKNN_TENSOR_UINT8;
     m->input_attr.fmt = RKNN_TENSOR_NHWC;
     m->input_size = m->input_attr.size_with_stride;
+    m->input_pitch = fd_tensor_pitch(&m->input_attr);
 
     /* Allocate input memory (CMA) */
     m->input_mem = g_rknn.create_mem(m->ctx, m->input_attr.size_with_stride);
@@ -509,20 +760,71 @@ static int fd_model_init_retry(fd_rknn_model_t *m, const char *model_path)
     return ret;
 }
 
-static int fd_model_run(fd_rknn_model_t *m, const uint8_t *input_data,
-                         uint32_t src_size)
+/* Run inference on a preprocessed frame. No copy when the frame already
+ * sits in the shared tensor this model is bound to. */
+static int fd_model_run(fd_rknn_model_t *m, const uint8_t *input_data)
 {
-    /* Cap copy at source size to prevent over-read when
-     * size_with_stride (NC1HWC2 padded) > actual NHWC data */
-    uint32_t copy_size = src_size < m->input_size ? src_size : m->input_size;
-    memcpy(m->input_mem->virt_addr, input_data, copy_size);
-    /* Zero-fill stride padding so NPU gets clean data */
-    if (copy_size < m->input_size)
-        memset((uint8_t *)m->input_mem->virt_addr + copy_size, 0,
-               m->input_size - copy_size);
+    uint8_t *dst = (uint8_t *)m->input_mem->virt_addr;
+    if (input_data == dst) {
+        g_fd_input.zero_copy_runs++;
+        return g_rknn.run(m->ctx, NULL);
+    }
+
+    uint32_t src_pitch = fd_input_pitch(input_data);
+    if (m->input_pitch && m->input_pitch != src_pitch) {
+        /* Different row stride: copy row by row, zero the row padding */
+        const uint32_t row = FD_MODEL_INPUT_WIDTH * 3;
+        for (int y = 0; y < FD_MODEL_INPUT_HEIGHT; y++) {
+            memcpy(dst + y * m->input_pitch, input_data + y * src_pitch, row);
+            memset(dst + y * m->input_pitch + row, 0, m->input_pitch - row);
+        }
+        uint32_t used = FD_MODEL_INPUT_HEIGHT * m->input_pitch;
+        if (used < m->input_size)
+            memset(dst + used, 0, m->input_size - used);
+    } else {
+        /* Cap copy at source size to prevent over-read when
+         * size_with_stride (NC1HWC2 padded) > actual NHWC data */
+        uint32_t src_size = FD_MODEL_INPUT_HEIGHT * src_pitch;
+        uint32_t copy_size = src_size < m->input_size ? src_size : m->input_size;
+        memcpy(dst, input_data, copy_size);
+        /* Zero-fill stride padding so NPU gets clean data */
+        if (copy_size < m->input_size)
+            memset(dst + copy_size, 0, m->input_size - copy_size);
+    }
+    g_fd_input.input_copies++;
+    if (m->shared_input)
+        fd_input_flush();
     return g_rknn.run(m->ctx, NULL);
 }
 
+/* Rebind a freshly loaded model's input to the shared tensor, allocating
+ * the tensor on first use. Keeps the private tensor if anything fails or
+ * the layout doesn't match. Detection thread only. */
+static void fd_model_share_input(fd_rknn_model_t *m)
+{
+    if (!g_rknn.create_mem_from_fd || !m->input_pitch)
+        return;
+    if (!g_fd_input.virt &&
+        fd_input_alloc(m->input_attr.size_with_stride, m->input_pitch) < 0)
+        return;
+    if (m->input_pitch != g_fd_input.pitch ||
+        m->input_attr.size_with_stride > g_fd_input.size)
+        return;
+
+    rknn_tensor_mem *mem = g_rknn.create_mem_from_fd(m->ctx, g_fd_input.fd,
+                                                     g_fd_input.virt,
+                                                     m->input_attr.size_with_stride, 0);
+    if (!mem) return;
+    if (g_rknn.set_io_mem(m->ctx, mem, &m->input_attr) < 0) {
+        g_rknn.destroy_mem(m->ctx, mem);
+        g_rknn.set_io_mem(m->ctx, m->input_mem, &m->input_attr);
+        return;
+    }
+    g_rknn.destroy_mem(m->ctx, m->input_mem);
+    m->input_mem = mem;
+    m->shared_input = 1;
+}
+
 static int fd_model_get_output(fd_rknn_model_t *m, int out_idx,
                                 float *out_buf, int max_elems)
 {
@@ -584,6 +886,224 @@ static void fd_model_release(fd_rknn_model_t *m)
     m->ctx = 0;
 }
 
+/* ============================================================================
+ * Resident model cache
+ *
+ * Keeps initialized RKNN contexts (weights + I/O tensors in CMA) across
+ * detection cycles instead of rknn_init/destroy per inference. Contexts
+ * are kept under a CMA budget and evicted least-recently-used first; the
+ * whole cache is dropped when free memory falls under min_free_mem_mb or
+ * timelapse encoding needs CMA for VENC, and stays empty while a streaming
+ * timelapse has its encoder open. A budget of 0 restores the old
+ * load-per-inference behavior.
+ *
+ * Slots are acquired by the detection thread only. The mutex exists so
+ * fault_detect_release_models() can free idle contexts from other threads.
+ * ============================================================================ */
+
+#define FD_MODEL_CACHE_SLOTS 5      /* CNN, ProtoNet, Multiclass, fine + coarse spatial */
+
+typedef struct {
+    fd_rknn_model_t model;
+    char path[512];
+    size_t cma_bytes;               /* weights + internal + I/O tensors */
+    uint64_t last_used;             /* LRU tick */
+    int loaded;
+    int in_use;                     /* acquired, or being loaded */
+} fd_model_slot_t;
+
+static struct {
+    fd_model_slot_t slots[FD_MODEL_CACHE_SLOTS];
+    size_t budget;                  /* bytes, 0 = no caching */
+    size_t used;
+    uint64_t tick;
+    int flush_pending;              /* release in-use slots when put back */
+    double load_ms_total;
+    fd_model_cache_stats_t stats;
+    pthread_mutex_t mutex;
+} g_fd_cache = { .mutex = PTHREAD_MUTEX_INITIALIZER };
+
+/* CMA held by an initialized context. Falls back to model file size plus
+ * I/O tensors when the runtime can't report its allocations. */
+static size_t fd_model_cma_bytes(fd_rknn_model_t *m, const char *path)
+{
+    size_t io = m->input_attr.size_with_stride;
+    for (uint32_t i = 0; i < m->io_num.n_output; i++)
+        io += m->output_attrs[i].size_with_stride;
+
+    rknn_mem_size ms;
+    memset(&ms, 0, sizeof(ms));
+    if (g_rknn.query(m->ctx, RKNN_QUERY_MEM_SIZE, &ms, sizeof(ms)) == 0) {
+        if (ms.total_dma_allocated_size > 0)
+            return (size_t)ms.total_dma_allocated_size;
+        if (ms.total_weight_size > 0)
+            return (size_t)ms.total_weight_size + ms.total_internal_size + io;
+    }
+
+    struct stat st;
+    return (stat(path, &st) == 0 ? (size_t)st.st_size : 0) + io;
+}
+
+/* Caller holds g_fd_cache.mutex */
+static void fd_cache_slot_unload(fd_model_slot_t *s)
+{
+    if (!s->loaded) return;
+    fd_model_release(&s->model);
+    g_fd_cache.used -= s->cma_bytes;
+    s->loaded = 0;
+    s->cma_bytes = 0;
+    s->path[0] = '\0';
+}
+
+/* Unload a resident context and count it as evicted */
+static void fd_cache_slot_free(fd_model_slot_t *s)
+{
+    if (!s->loaded) return;
+    fd_cache_slot_unload(s);
+    g_fd_cache.stats.evictions++;
+}
+
+/* Evict idle slots, least recently used first, until used + need fits the
+ * budget. Caller holds the mutex. */
+static void fd_cache_evict_lru(size_t need)
+{
+    while (g_fd_cache.used + need > g_fd_cache.budget) {
+        fd_model_slot_t *lru = NULL;
+        for (int i = 0; i < FD_MODEL_CACHE_SLOTS; i++) {
+            fd_model_slot_t *s = &g_fd_cache.slots[i];
+            if (s->loaded && !s->in_use &&
+                (!lru || s->last_used < lru->last_used))
+                lru = s;
+        }
+        if (!lru) break;
+        fd_cache_slot_free(lru);
+    }
+}
+
+/* Free all idle slots. Returns number of contexts released. */
+static int fd_cache_flush_idle(void)
+{
+    int freed = 0;
+    pthread_mutex_lock(&g_fd_cache.mutex);
+    for (int i = 0; i < FD_MODEL_CACHE_SLOTS; i++) {
+        fd_model_slot_t *s = &g_fd_cache.slots[i];
+        if (s->loaded && !s->in_use) {
+            fd_cache_slot_free(s);
+            freed++;
+        }
+    }
+    pthread_mutex_unlock(&g_fd_cache.mutex);
+    return freed;
+}
+
+static void fd_model_cache_set_budget(int mb)
+{
+    pthread_mutex_lock(&g_fd_cache.mutex);
+    g_fd_cache.budget = mb > 0 ? (size_t)mb * 1024 * 1024 : 0;
+    fd_cache_evict_lru(0);
+    pthread_mutex_unlock(&g_fd_cache.mutex);
+}
+
+/* Get an initialized context for model_path, loading it on a miss.
+ * Returns NULL with *err set (-1 error, -2 CMA failure) on failure.
+ * Every successful acquire must be paired with fd_model_put(). */
+static fd_rknn_model_t *fd_model_acquire(const char *model_path, int *err)
+{
+    pthread_mutex_lock(&g_fd_cache.mutex);
+    g_fd_cache.flush_pending = 0;
+
+    fd_model_slot_t *slot = NULL;
+    for (int i = 0; i < FD_MODEL_CACHE_SLOTS; i++) {
+        fd_model_slot_t *s = &g_fd_cache.slots[i];
+        if (s->loaded && !s->in_use && strcmp(s->path, model_path) == 0) {
+            s->in_use = 1;
+            s->last_used = ++g_fd_cache.tick;
+            g_fd_cache.stats.hits++;
+            pthread_mutex_unlock(&g_fd_cache.mutex);
+            return &s->model;
+        }
+        if (!slot && !s->loaded && !s->in_use)
+            slot = s;
+    }
+
+    /* Miss: take a free slot, or the least recently used idle one */
+    if (!slot) {
+        for (int i = 0; i < FD_MODEL_CACHE_SLOTS; i++) {
+            fd_model_slot_t *s = &g_fd_cache.slots[i];
+            if (!s->in_use && (!slot || s->last_used < slot->last_used))
+                slot = s;
+        }
+        if (!slot) {
+            pthread_mutex_unlock(&g_fd_cache.mutex);
+            fd_err("Model cache: no free slot for %s\n", model_path);
+            *err = -1;
+            return NULL;
+        }
+        fd_cache_slot_free(slot);
+    }
+    g_fd_cache.stats.misses++;
+    slot->in_use = 1;
+    snprintf(slot->path, sizeof(slot->path), "%s", model_path);
+    pthread_mutex_unlock(&g_fd_cache.mutex);
+
+    double t0 = fd_get_time_ms();
+    int ret = fd_model_init(&slot->model, model_path);
+    if (ret == -2 && fd_cache_flush_idle() > 0) {
+        /* CMA exhausted: resident models are in the way, drop them */
+        fd_log("Model cache: CMA alloc failed, released idle models\n");
+        ret = fd_model_init(&slot->model, model_path);
+    }
+    if (ret < 0) {
+        fd_log("Retrying model init after 200ms...\n");
+        usleep(200000);
+        ret = fd_model_init(&slot->model, model_path);
+        if (ret < 0)
+            fd_err("Model init failed after retry: %s\n", model_path);
+    }
+    double load_ms = fd_get_time_ms() - t0;
+
+    pthread_mutex_lock(&g_fd_cache.mutex);
+    if (ret < 0) {
+        slot->in_use = 0;
+        slot->path[0] = '\0';
+        pthread_mutex_unlock(&g_fd_cache.mutex);
+        *err = ret;
+        return NULL;
+    }
+    fd_model_share_input(&slot->model);
+    slot->loaded = 1;
+    slot->cma_bytes = fd_model_cma_bytes(&slot->model, model_path);
+    slot->last_used = ++g_fd_cache.tick;
+    g_fd_cache.used += slot->cma_bytes;
+    g_fd_cache.load_ms_total += load_ms;
+    g_fd_cache.stats.last_load_ms = (float)load_ms;
+    pthread_mutex_unlock(&g_fd_cache.mutex);
+    return &slot->model;
+}
+
+/* Return a context from fd_model_acquire(). It stays resident if it fits
+ * the budget alongside the other resident models. A context that can never
+ * fit (budget 0, or larger than the whole budget) was not cached at all:
+ * it is released without counting an eviction. */
+static void fd_model_put(fd_rknn_model_t *m)
+{
+    pthread_mutex_lock(&g_fd_cache.mutex);
+    for (int i = 0; i < FD_MODEL_CACHE_SLOTS; i++) {
+        fd_model_slot_t *s = &g_fd_cache.slots[i];
+        if (&s->model != m) continue;
+        s->in_use = 0;
+        s->last_used = ++g_fd_cache.tick;
+        if (g_fd_cache.budget == 0 || s->cma_bytes > g_fd_cache.budget)
+            fd_cache_slot_unload(s);
+        else if (g_fd_cache.flush_pending)
+            fd_cache_slot_free(s);
+        else
+            fd_cache_evict_lru(0);
+        break;
+    }
+    pthread_mutex_unlock(&g_fd_cache.mutex);
+}
+
 /* ============================================================================
  * Preprocessing (from preprocess.c)
  * ============================================================================ */
@@ -594,8 +1114,10 @@ typedef struct {
     int width, height;
 } fd_image_t;
 
-static int fd_decode_jpeg(const uint8_t *jpeg_data, size_t jpeg_size,
-                           fd_image_t *img)
+/* min_w x min_h is the smallest decoded size the resize may use without
+ * upscaling (512x256 for the center crop, more for a bed-region crop) */
+static int fd_decode_jpeg_min(const uint8_t *jpeg_data, size_t jpeg_size,
+                              fd_image_t *img, int min_w, int min_h)
 {
     tjhandle handle = tjInitDecompress();
     if (!handle) return -1;
@@ -611,7 +1133,7 @@ static int fd_decode_jpeg(const uint8_t *jpeg_data, size_t jpeg_size,
     /* Find smallest TurboJPEG scaling factor where the decoded image is
      * large enough for fd_resize_crop to downscale (not upscale).
      * Need: resize scale = max(256/sh, 512/sw) <= 1.0
-     * i.e., sw >= 512 AND sh >= 256 */
+     * i.e., sw >= 512 AND sh >= 256 (min_w/min_h) */
     int num_sf = 0;
     tjscalingfactor *sf = tjGetScalingFactors(&num_sf);
     tjscalingfactor best_sf = {1, 1};  /* default: no scaling */
@@ -621,7 +1143,7 @@ static int fd_decode_jpeg(const uint8_t *jpeg_data, size_t jpeg_size,
             int sh = TJSCALED(height, sf[i]);
             int best_w = TJSCALED(width, best_sf);
             int best_h = TJSCALED(height, best_sf);
-            if (sw >= 512 && sh >= 256 && sw * sh < best_w * best_h) {
+            if (sw >= min_w && sh >= min_h && sw * sh < best_w * best_h) {
                 best_sf = sf[i];
             }
         }
@@ -650,31 +1172,32 @@ static int fd_decode_jpeg(const uint8_t *jpeg_data, size_t jpeg_size,
     return 0;
 }
 
-/* Fused resize + center crop in single pass (no intermediate buffer).
- * Resizes so result >= 512x256, center-crops 448x224, keeps RGB color.
- * Bilinear interpolation. */
-static void fd_resize_crop(const uint8_t *src, int sw, int sh,
-                            uint8_t *dst)
+static int fd_decode_jpeg(const uint8_t *jpeg_data, size_t jpeg_size,
+                           fd_image_t *img)
+{
+    return fd_decode_jpeg_min(jpeg_data, jpeg_size, img, 512, 256);
+}
+
+/* Bilinear resample of a source rectangle into the 448x224 RGB input.
+ * Output pixel (dx, dy) samples source ((dx + ox) * x_ratio,
+ * (dy + oy) * y_ratio), i.e. (ox, oy) is the rectangle origin in output
+ * pixel units. dst_pitch is the output row stride in bytes (>= 448*3);
+ * row padding beyond the image is left untouched. */
+static void fd_resize_rect(const uint8_t *src, int sw, int sh,
+                           float ox, float oy, float x_ratio, float y_ratio,
+                           uint8_t *dst, int dst_pitch)
 {
     const int dw = FD_MODEL_INPUT_WIDTH;
     const int dh = FD_MODEL_INPUT_HEIGHT;
-    float scale_h = 256.0f / (float)sh;
-    float scale_w = 512.0f / (float)sw;
-    float scale = scale_h > scale_w ? scale_h : scale_w;
-    int rw = (int)(sw * scale);
-    int rh = (int)(sh * scale);
-    int cx = (rw - dw) / 2;
-    int cy = (rh - dh) / 2;
-    float x_ratio = (float)sw / (float)rw;
-    float y_ratio = (float)sh / (float)rh;
 
     if (sw < 2 || sh < 2) {
-        memset(dst, 0, dw * dh * 3);
+        for (int dy = 0; dy < dh; dy++)
+            memset(dst + dy * dst_pitch, 0, dw * 3);
         return;
     }
 
     for (int dy = 0; dy < dh; dy++) {
-        float sy_f = (dy + cy) * y_ratio;
+        float sy_f = (dy + oy) * y_ratio;
         int sy = (int)sy_f;
         float y_diff = sy_f - sy;
         if (sy < 0) { sy = 0; y_diff = 0.0f; }
@@ -684,7 +1207,7 @@ static void fd_resize_crop(const uint8_t *src, int sw, int sh,
         const uint8_t *row1 = src + (sy + 1) * sw * 3;
 
         for (int dx = 0; dx < dw; dx++) {
-            float sx_f = (dx + cx) * x_ratio;
+            float sx_f = (dx + ox) * x_ratio;
             int sx = (int)sx_f;
             float x_diff = sx_f - sx;
             if (sx < 0) { sx = 0; x_diff = 0.0f; }
@@ -701,7 +1224,7 @@ static void fd_resize_crop(const uint8_t *src, int sw, int sh,
             float w11 = x_diff * y_diff;
 
             /* Bilinear interpolate each channel, keep RGB color */
-            int off = (dy * dw + dx) * 3;
+            int off = dy * dst_pitch + dx * 3;
             for (int ch = 0; ch < 3; ch++) {
                 float v = a[ch]*w00 + b[ch]*w10 + c[ch]*w01 + d[ch]*w11;
                 int iv = (int)(v + 0.5f);
@@ -713,10 +1236,51 @@ static void fd_resize_crop(const uint8_t *src, int sw, int sh,
     }
 }
 
-/* Preprocess: scaled-decode image → fused resize+crop (color RGB) */
+/* Fused resize + center crop in single pass (no intermediate buffer).
+ * Resizes so result >= 512x256, center-crops 448x224, keeps RGB color.
+ * Bilinear interpolation. */
+static void fd_resize_crop(const uint8_t *src, int sw, int sh,
+                            uint8_t *dst, int dst_pitch)
+{
+    float scale_h = 256.0f / (float)sh;
+    float scale_w = 512.0f / (float)sw;
+    float scale = scale_h > scale_w ? scale_h : scale_w;
+    int rw = (int)(sw * scale);
+    int rh = (int)(sh * scale);
+    int cx = (rw - FD_MODEL_INPUT_WIDTH) / 2;
+    int cy = (rh - FD_MODEL_INPUT_HEIGHT) / 2;
+
+    fd_resize_rect(src, sw, sh, (float)cx, (float)cy,
+                   (float)sw / (float)rw, (float)sh / (float)rh,
+                   dst, dst_pitch);
+}
+
+/* Resize the bed-region crop (g_fd.roi_*, relative to the center crop
+ * g_fd.crop_*) into the model input. Same 2:1 aspect as the center crop. */
+static void fd_resize_roi(const uint8_t *src, int sw, int sh,
+                          uint8_t *dst, int dst_pitch)
+{
+    float fx = g_fd.crop_x + g_fd.roi_x * g_fd.crop_w;
+    float fy = g_fd.crop_y + g_fd.roi_y * g_fd.crop_h;
+    float x_ratio = g_fd.roi_s * g_fd.crop_w * sw / FD_MODEL_INPUT_WIDTH;
+    float y_ratio = g_fd.roi_s * g_fd.crop_h * sh / FD_MODEL_INPUT_HEIGHT;
+
+    fd_resize_rect(src, sw, sh, fx * sw / x_ratio, fy * sh / y_ratio,
+                   x_ratio, y_ratio, dst, dst_pitch);
+}
+
+/* Preprocess: scaled-decode image → fused resize+crop (color RGB).
+ * out_buf is either a packed buffer or the shared NPU input tensor. */
 static int fd_preprocess(const fd_image_t *img, uint8_t *out_buf)
 {
-    fd_resize_crop(img->data, img->width, img->height, out_buf);
+    if (g_fd.roi_valid && g_fd.crop_valid)
+        fd_resize_roi(img->data, img->width, img->height, out_buf,
+                      fd_input_pitch(out_buf));
+    else
+        fd_resize_crop(img->data, img->width, img->height, out_buf,
+                       fd_input_pitch(out_buf));
+    if (out_buf == g_fd_input.virt)
+        fd_input_flush();
     return 0;
 }
 
@@ -747,6 +1311,8 @@ static int fd_load_prototypes(const char *path)
             sum += g_fd.prototypes[k][i] * g_fd.prototypes[k][i];
         g_fd.proto_norms[k] = sqrtf(sum);
     }
+    fd_margin_prepare(&g_fd.proto_margin, g_fd.prototypes[0], g_fd.prototypes[1],
+                      g_fd.proto_norms[0], g_fd.proto_norms[1], EMB_DIM);
     g_fd.prototypes_loaded = 1;
     return 0;
 }
@@ -811,6 +1377,9 @@ static int fd_load_spatial_prototypes(const char *path)
             sum += g_fd.spatial_protos[k][i] * g_fd.spatial_protos[k][i];
         g_fd.spatial_proto_norms[k] = sqrtf(sum);
     }
+    fd_margin_prepare(&g_fd.spatial_margin, g_fd.spatial_protos[0],
+                      g_fd.spatial_protos[1], g_fd.spatial_proto_norms[0],
+                      g_fd.spatial_proto_norms[1], emb_dim);
 
     g_fd.spatial_h = sp_h;
     g_fd.spatial_w = sp_w;
@@ -878,6 +1447,9 @@ static int fd_load_spatial_prototypes_coarse(const char *path)
             sum += g_fd.spatial_coarse_protos[k][i] * g_fd.spatial_coarse_protos[k][i];
         g_fd.spatial_coarse_proto_norms[k] = sqrtf(sum);
     }
+    fd_margin_prepare(&g_fd.spatial_coarse_margin, g_fd.spatial_coarse_protos[0],
+                      g_fd.spatial_coarse_protos[1], g_fd.spatial_coarse_proto_norms[0],
+                      g_fd.spatial_coarse_proto_norms[1], emb_dim);
 
     g_fd.spatial_coarse_h = sp_h;
     g_fd.spatial_coarse_w = sp_w;
@@ -895,22 +1467,35 @@ static int fd_load_spatial_prototypes_coarse(const char *path)
 static void fd_bilinear_upscale(const float *src, int src_h, int src_w,
                                  float *dst, int dst_h, int dst_w)
 {
+    /* Column taps are the same for every row: compute them once */
+    int col_x0[FD_SPATIAL_W_MAX];
+    float col_fx[FD_SPATIAL_W_MAX];
+    if (dst_w > FD_SPATIAL_W_MAX) dst_w = FD_SPATIAL_W_MAX;
+    for (int c = 0; c < dst_w; c++) {
+        float sx = (c + 0.5f) * src_w / (float)dst_w - 0.5f;
+        int x0 = (int)floorf(sx);
+        float fx = sx - x0;
+        if (x0 < 0) { x0 = 0; fx = 0.0f; }
+        if (x0 >= src_w - 1) { x0 = src_w - 2; fx = 1.0f; }
+        col_x0[c] = x0;
+        col_fx[c] = fx;
+    }
+
     for (int r = 0; r < dst_h; r++) {
         float sy = (r + 0.5f) * src_h / (float)dst_h - 0.5f;
         int y0 = (int)floorf(sy);
         float fy = sy - y0;
         if (y0 < 0) { y0 = 0; fy = 0.0f; }
         if (y0 >= src_h - 1) { y0 = src_h - 2; fy = 1.0f; }
+        const float *row0 = src + y0 * src_w;
+        const float *row1 = row0 + src_w;
         for (int c = 0; c < dst_w; c++) {
-            float sx = (c + 0.5f) * src_w / (float)dst_w - 0.5f;
-            int x0 = (int)floorf(sx);
-            float fx = sx - x0;
-            if (x0 < 0) { x0 = 0; fx = 0.0f; }
-            if (x0 >= src_w - 1) { x0 = src_w - 2; fx = 1.0f; }
-            float v = src[y0 * src_w + x0] * (1 - fy) * (1 - fx)
-                    + src[y0 * src_w + (x0 + 1)] * (1 - fy) * fx
-                    + src[(y0 + 1) * src_w + x0] * fy * (1 - fx)
-                    + src[(y0 + 1) * src_w + (x0 + 1)] * fy * fx;
+            int x0 = col_x0[c];
+            float fx = col_fx[c];
+            float v = row0[x0] * (1 - fy) * (1 - fx)
+                    + row0[x0 + 1] * (1 - fy) * fx
+                    + row1[x0] * fy * (1 - fx)
+                    + row1[x0 + 1] * fy * fx;
             dst[r * dst_w + c] = v;
         }
     }
@@ -1003,6 +1588,8 @@ typedef struct {
     float boost_conf_cap;
     float ema_alpha;
     float heatmap_coarse_wt;
+    float cascade_cnn_ok;
+    float cascade_proto_ok;
 } fd_thresholds_t;
 
 /* Thresholds: read from config, fallback to hardcoded defaults.
@@ -1044,6 +1631,12 @@ static void fd_get_thresholds(const fd_config_t *cfg, int strategy,
     th->boost_conf_cap    = t->boost_confidence_cap > 0 ? t->boost_confidence_cap : 0.95f;
     th->ema_alpha         = t->ema_alpha > 0 ? t->ema_alpha : 0.30f;
     th->heatmap_coarse_wt = t->heatmap_coarse_weight > 0 ? t->heatmap_coarse_weight : 0.70f;
+
+    /* Cascade early exit, in fault-likelihood space. Calibrated OK scenes
+     * (empty bed, objects) sit at CNN <= 0.04 / Proto <= 0.10, tiny
+     * spaghetti at CNN 0.07 / Proto 0.38: only the former stop early. */
+    th->cascade_cnn_ok   = t->cascade_cnn_ok > 0 ? t->cascade_cnn_ok : 0.05f;
+    th->cascade_proto_ok = t->cascade_proto_ok > 0 ? t->cascade_proto_ok : 0.20f;
 }
 
 static int fd_run_cnn(const uint8_t *input, fd_result_t *r, float threshold,
@@ -1057,25 +1650,25 @@ static int fd_run_cnn(const uint8_t *input, fd_result_t *r, float threshold,
         return -1;
     }
 
-    fd_rknn_model_t model;
-    int init_ret = fd_model_init_retry(&model, path);
-    if (init_ret < 0)
+    int init_ret;
+    fd_rknn_model_t *model = fd_model_acquire(path, &init_ret);
+    if (!model)
         return init_ret;
 
     double t0 = fd_get_time_ms();
-    int ret = fd_model_run(&model, input, FD_MODEL_INPUT_BYTES);
+    int ret = fd_model_run(model, input);
     if (ret < 0) {
         fd_err("CNN run failed: %d\n", ret);
-        fd_model_release(&model);
+        fd_model_put(model);
         return -1;
     }
 
     float logits[2] = {0};
-    fd_model_get_output(&model, 0, logits, 2);
+    fd_model_get_output(model, 0, logits, 2);
     double t1 = fd_get_time_ms();
     r->cnn_ms = (float)(t1 - t0);
 
-    fd_model_release(&model);
+    fd_model_put(model);
 
     /* EMA smoothing on logits to reduce camera noise sensitivity.
      * The model amplifies tiny pixel-level noise into large logit swings
@@ -1111,6 +1704,7 @@ static int fd_run_cnn(const uint8_t *input, fd_result_t *r, float threshold,
 
     r->result = cnn_class;
     r->confidence = cnn_conf;
+    r->cnn_raw = logits[0];
     return 0;
 }
 
@@ -1136,31 +1730,27 @@ static int fd_run_protonet(const uint8_t *input, fd_result_t *r,
             return -1;
     }
 
-    fd_rknn_model_t model;
-    int init_ret = fd_model_init_retry(&model, path);
-    if (init_ret < 0)
+    int init_ret;
+    fd_rknn_model_t *model = fd_model_acquire(path, &init_ret);
+    if (!model)
         return init_ret;
 
     double t0 = fd_get_time_ms();
-    int ret = fd_model_run(&model, input, FD_MODEL_INPUT_BYTES);
+    int ret = fd_model_run(model, input);
     if (ret < 0) {
         fd_err("ProtoNet run failed: %d\n", ret);
-        fd_model_release(&model);
+        fd_model_put(model);
         return -1;
     }
 
     float embedding[EMB_DIM];
-    fd_model_get_output(&model, 0, embedding, EMB_DIM);
+    fd_model_get_output(model, 0, embedding, EMB_DIM);
     double t1 = fd_get_time_ms();
     r->proto_ms = (float)(t1 - t0);
 
-    fd_model_release(&model);
+    fd_model_put(model);
 
-    float cos_fail = fd_cosine_similarity(embedding, g_fd.prototypes[0],
-                                           g_fd.proto_norms[0], EMB_DIM);
-    float cos_succ = fd_cosine_similarity(embedding, g_fd.prototypes[1],
-                                           g_fd.proto_norms[1], EMB_DIM);
-    float cos_margin = cos_fail - cos_succ;
+    float cos_margin = fd_margin_eval(&g_fd.proto_margin, embedding);
 
     r->result = cos_margin > proto_threshold ? FD_CLASS_FAULT : FD_CLASS_OK;
     r->confidence = cos_margin;  /* signed margin for threshold-relative confidence */
@@ -1184,25 +1774,25 @@ static int fd_run_multiclass(const uint8_t *input, fd_result_t *r,
         return -1;
     }
 
-    fd_rknn_model_t model;
-    int init_ret = fd_model_init_retry(&model, path);
-    if (init_ret < 0)
+    int init_ret;
+    fd_rknn_model_t *model = fd_model_acquire(path, &init_ret);
+    if (!model)
         return init_ret;
 
     double t0 = fd_get_time_ms();
-    int ret = fd_model_run(&model, input, FD_MODEL_INPUT_BYTES);
+    int ret = fd_model_run(model, input);
     if (ret < 0) {
         fd_err("Multiclass run failed: %d\n", ret);
-        fd_model_release(&model);
+        fd_model_put(model);
         return -1;
     }
 
     float logits[FD_MCLASS_COUNT] = {0};
-    fd_model_get_output(&model, 0, logits, FD_MCLASS_COUNT);
+    fd_model_get_output(model, 0, logits, FD_MCLASS_COUNT);
     double t1 = fd_get_time_ms();
     r->multi_ms = (float)(t1 - t0);
 
-    fd_model_release(&model);
+    fd_model_put(model);
 
     /* EMA smoothing on logits — same approach as CNN EMA.
      * Multiclass scores swing ~15% between frames on static scenes.
@@ -1246,88 +1836,105 @@ static int fd_run_multiclass(const uint8_t *input, fd_result_t *r,
  * Spatial heatmap inference
  * ============================================================================ */
 
-/* Compute per-location heatmap from features and prototypes.
- * Returns max margin value. Fills heatmap array. */
-static float fd_compute_heatmap(const float *features, int sp_h, int sp_w,
-                                 int emb_dim,
-                                 const float protos[][FD_SPATIAL_EMB_MAX],
-                                 const float *proto_norms,
-                                 float heatmap[][FD_SPATIAL_W_MAX])
+/* Heatmap of max(-999, margin) per cell. Int8 affine outputs are scored in
+ * fixed point straight from the NPU output tensor; anything else is
+ * dequantized into g_fd.spatial_f32 first. Caller holds the model.
+ * cells (NULL = all) limits scoring to the set bits (index h*sp_w+w);
+ * skipped cells are left untouched. */
+static int fd_compute_heatmap(fd_rknn_model_t *model, int sp_h, int sp_w,
+                              int emb_dim, const fd_margin_t *mg,
+                              const fd_mask196_t *cells,
+                              float heatmap[][FD_SPATIAL_W_MAX])
 {
-    int use_dot_product = (proto_norms[0] < 1.1f && proto_norms[1] < 1.1f);
-    float max_margin = -999.0f;
+    const rknn_tensor_attr *attr = &model->output_attrs[0];
+    int sp_total = sp_h * sp_w * emb_dim;
+    if ((int)attr->n_elems < sp_total || mg->dim != emb_dim) {
+        fd_err("Spatial output mismatch: %u elems vs %dx%dx%d (protos %d)\n",
+               attr->n_elems, sp_h, sp_w, emb_dim, mg->dim);
+        return -1;
+    }
 
-    for (int h = 0; h < sp_h; h++) {
-        for (int w = 0; w < sp_w; w++) {
-            const float *vec = &features[(h * sp_w + w) * emb_dim];
-            float margin;
-            if (use_dot_product) {
-                float dot_fail = 0.0f, dot_succ = 0.0f;
-                for (int i = 0; i < emb_dim; i++) {
-                    dot_fail += vec[i] * protos[0][i];
-                    dot_succ += vec[i] * protos[1][i];
-                }
-                margin = dot_fail - dot_succ;
-            } else {
-                float cos_fail = fd_cosine_similarity(vec, protos[0],
-                                                       proto_norms[0], emb_dim);
-                float cos_succ = fd_cosine_similarity(vec, protos[1],
-                                                       proto_norms[1], emb_dim);
-                margin = cos_fail - cos_succ;
-            }
-            heatmap[h][w] = margin;
-            if (margin > max_margin)
-                max_margin = margin;
+    if (attr->type == RKNN_TENSOR_INT8 &&
+        attr->qnt_type == RKNN_TENSOR_QNT_AFFINE_ASYMMETRIC) {
+        const int8_t *raw = (const int8_t *)model->output_mems[0]->virt_addr;
+        if (cells) {
+            for (int i = fd_mask_next_bit(cells, 0); i >= 0 && i < sp_h * sp_w;
+                 i = fd_mask_next_bit(cells, i + 1))
+                heatmap[i / sp_w][i % sp_w] = fd_margin_eval_q8(mg,
+                                                  &raw[i * emb_dim], attr->zp);
+            return 0;
+        }
+        for (int h = 0; h < sp_h; h++)
+            for (int w = 0; w < sp_w; w++)
+                heatmap[h][w] = fd_margin_eval_q8(mg,
+                                                  &raw[(h * sp_w + w) * emb_dim],
+                                                  attr->zp);
+        return 0;
+    }
+
+    if (!g_fd.spatial_f32) {
+        g_fd.spatial_f32 = (float *)malloc(FD_SPATIAL_H_MAX * FD_SPATIAL_W_MAX *
+                                           FD_SPATIAL_EMB_MAX * sizeof(float));
+        if (!g_fd.spatial_f32) {
+            fd_err("spatial buffer alloc failed\n");
+            return -1;
         }
     }
-    return max_margin;
+    fd_model_get_output_nhwc(model, 0, g_fd.spatial_f32, sp_h, sp_w, emb_dim);
+    if (cells) {
+        for (int i = fd_mask_next_bit(cells, 0); i >= 0 && i < sp_h * sp_w;
+             i = fd_mask_next_bit(cells, i + 1))
+            heatmap[i / sp_w][i % sp_w] = fd_margin_eval(mg,
+                                              &g_fd.spatial_f32[i * emb_dim]);
+        return 0;
+    }
+    for (int h = 0; h < sp_h; h++)
+        for (int w = 0; w < sp_w; w++)
+            heatmap[h][w] = fd_margin_eval(mg,
+                                           &g_fd.spatial_f32[(h * sp_w + w) * emb_dim]);
+    return 0;
 }
 
-/* Run a single spatial encoder and read output features into spatial_buf.
- * Output is converted from RKNN NC1HWC2 format to NHWC for correct per-cell
- * channel ordering (required for heatmap cosine similarity computation).
- * Returns 0=ok, -1=error, timing stored in *ms_out. */
-static int fd_run_spatial_encoder(const char *model_path,
-                                   const uint8_t *input, float *spatial_buf,
+/* Run a single spatial encoder and score its output against a prototype
+ * margin. Output is queried in NHWC, so each cell's channels are
+ * contiguous. Returns 0=ok, -1=error, -2=CMA failure; timing stored in
+ * *ms_out. */
+static int fd_run_spatial_encoder(const char *model_path, const uint8_t *input,
                                    int sp_h, int sp_w, int emb_dim,
+                                   const fd_margin_t *mg,
+                                   const fd_mask196_t *cells,
+                                   float heatmap[][FD_SPATIAL_W_MAX],
                                    float *ms_out)
 {
-    fd_rknn_model_t model;
-    int init_ret = fd_model_init_retry(&model, model_path);
-    if (init_ret < 0)
+    int init_ret;
+    fd_rknn_model_t *model = fd_model_acquire(model_path, &init_ret);
+    if (!model)
         return init_ret;
 
     double t0 = fd_get_time_ms();
-    int ret = fd_model_run(&model, input, FD_MODEL_INPUT_BYTES);
+    int ret = fd_model_run(model, input);
     if (ret < 0) {
         fd_err("Spatial run failed: %d (model=%s)\n", ret, model_path);
-        fd_model_release(&model);
+        fd_model_put(model);
         return -1;
     }
 
-    int sp_total = sp_h * sp_w * emb_dim;
-    int n = fd_model_get_output_nhwc(&model, 0, spatial_buf,
-                                      sp_h, sp_w, emb_dim);
+    ret = fd_compute_heatmap(model, sp_h, sp_w, emb_dim, mg, cells, heatmap);
     double t1 = fd_get_time_ms();
 
-    fd_model_release(&model);
+    fd_model_put(model);
 
     if (ms_out) *ms_out = (float)(t1 - t0);
-
-    if (n < sp_total) {
-        fd_err("Spatial output too short: %d vs %d\n", n, sp_total);
-        return -1;
-    }
-
-    return 0;
+    return ret;
 }
 
 /* Run spatial encoder and compute per-location heatmap.
  * Auto-detects multi-scale mode when both coarse + fine encoders exist.
- * spatial_buf must be pre-allocated (large enough for model output).
+ * Only cells inside active_mask are scored (all of them in setup mode, so
+ * the wizard sees the whole grid); the rest stay 0.
  * Returns 0=ok, -1=error, -2=CMA failure */
 static int fd_run_heatmap(const uint8_t *input, fd_result_t *r,
-                          const fd_config_t *cfg, float *spatial_buf,
+                          const fd_config_t *cfg,
                           fd_mask196_t active_mask, float heatmap_coarse_wt,
                           float ema_alpha)
 {
@@ -1359,8 +1966,10 @@ static int fd_run_heatmap(const uint8_t *input, fd_result_t *r,
         fd_load_spatial_prototypes_coarse(sp_path);
     }
 
-    /* Memory gate */
+    /* Memory gate (spatial encoders are the largest models: make room first) */
     int mem_mb = fd_get_available_memory_mb();
+    if (mem_mb > 0 && mem_mb < cfg->min_free_mem_mb && fd_cache_flush_idle() > 0)
+        mem_mb = fd_get_available_memory_mb();
     if (mem_mb > 0 && mem_mb < cfg->min_free_mem_mb) {
         fd_log("  Heatmap: skipping, %dMB free < %dMB min\n",
                mem_mb, cfg->min_free_mem_mb);
@@ -1369,6 +1978,18 @@ static int fd_run_heatmap(const uint8_t *input, fd_result_t *r,
 
     /* Clear entire heatmap array */
     memset(r->heatmap, 0, sizeof(r->heatmap));
+
+    fd_mask196_t scored = active_mask;
+    if (cfg->setup_mode)
+        fd_mask_clear(&scored);
+    const fd_mask196_t *cells = fd_mask_is_zero(&scored) ? NULL : &scored;
+    r->heatmap_cells = scored;
+
+    /* A different cell set leaves stale EMA behind: re-seed */
+    if (memcmp(&scored, &g_fd.heatmap_ema_cells, sizeof(scored)) != 0) {
+        g_fd.heatmap_ema_cells = scored;
+        g_fd.heatmap_ema_init = 0;
+    }
     double t_total_start = fd_get_time_ms();
 
     /* ---- Multi-scale mode: coarse + fine → blend ---- */
@@ -1382,14 +2003,11 @@ static int fd_run_heatmap(const uint8_t *input, fd_result_t *r,
          * Use a temporary 2D array for fd_compute_heatmap (stride=FD_SPATIAL_W_MAX),
          * then compact to flat array for upscaling (stride=cw). */
         float coarse_ms = 0;
-        int rc = fd_run_spatial_encoder(coarse_path, input, spatial_buf,
-                                         ch, cw, c_emb, &coarse_ms);
-        if (rc < 0) return rc;
-
         float coarse_hm[FD_SPATIAL_H_MAX][FD_SPATIAL_W_MAX] = {{0}};
-        fd_compute_heatmap(spatial_buf, ch, cw, c_emb,
-                           (const float (*)[FD_SPATIAL_EMB_MAX])g_fd.spatial_coarse_protos,
-                           g_fd.spatial_coarse_proto_norms, coarse_hm);
+        int rc = fd_run_spatial_encoder(coarse_path, input, ch, cw, c_emb,
+                                         &g_fd.spatial_coarse_margin, NULL,
+                                         coarse_hm, &coarse_ms);
+        if (rc < 0) return rc;
 
         /* Compact coarse heatmap to flat array (stride=cw) for bilinear upscale */
         float coarse_flat[FD_SPATIAL_H_MAX * FD_SPATIAL_W_MAX];
@@ -1399,28 +2017,27 @@ static int fd_run_heatmap(const uint8_t *input, fd_result_t *r,
 
         /* Step 2: Run fine encoder → compute fine heatmap */
         float fine_ms = 0;
-        rc = fd_run_spatial_encoder(fine_path, input, spatial_buf,
-                                     fh, fw, f_emb, &fine_ms);
-        if (rc < 0) return rc;
-
         float fine_hm[FD_SPATIAL_H_MAX][FD_SPATIAL_W_MAX] = {{0}};
-        fd_compute_heatmap(spatial_buf, fh, fw, f_emb,
-                           (const float (*)[FD_SPATIAL_EMB_MAX])g_fd.spatial_protos,
-                           g_fd.spatial_proto_norms, fine_hm);
+        rc = fd_run_spatial_encoder(fine_path, input, fh, fw, f_emb,
+                                     &g_fd.spatial_margin, cells, fine_hm,
+                                     &fine_ms);
+        if (rc < 0) return rc;
 
         /* Step 3: Upscale coarse to fine resolution */
         float coarse_up[FD_SPATIAL_H_MAX * FD_SPATIAL_W_MAX];
         fd_bilinear_upscale(coarse_flat, ch, cw, coarse_up, fh, fw);
 
-        /* Step 4: Normalize fine to match coarse value range */
+        /* Step 4: Normalize fine to match coarse value range (over the
+         * scored cells only; skipped fine cells hold no margin) */
         float c_min = 999.0f, c_max = -999.0f;
         float f_min = 999.0f, f_max = -999.0f;
-        for (int i = 0; i < fh * fw; i++) {
-            if (coarse_up[i] < c_min) c_min = coarse_up[i];
-            if (coarse_up[i] > c_max) c_max = coarse_up[i];
-        }
         for (int h = 0; h < fh; h++)
             for (int w = 0; w < fw; w++) {
+                int i = h * fw + w;
+                if (cells && !fd_mask_test_bit(cells, i))
+                    continue;
+                if (coarse_up[i] < c_min) c_min = coarse_up[i];
+                if (coarse_up[i] > c_max) c_max = coarse_up[i];
                 if (fine_hm[h][w] < f_min) f_min = fine_hm[h][w];
                 if (fine_hm[h][w] > f_max) f_max = fine_hm[h][w];
             }
@@ -1434,6 +2051,8 @@ static int fd_run_heatmap(const uint8_t *input, fd_result_t *r,
 
         for (int h = 0; h < fh; h++) {
             for (int w = 0; w < fw; w++) {
+                if (cells && !fd_mask_test_bit(cells, h * fw + w))
+                    continue;
                 float v = heatmap_coarse_wt * coarse_up[h * fw + w]
                         + fine_wt * fine_hm[h][w] * fine_scale;
                 r->heatmap[h][w] = v;
@@ -1510,8 +2129,7 @@ static int fd_run_heatmap(const uint8_t *input, fd_result_t *r,
     /* ---- Single-encoder mode (fallback) ---- */
     const char *model_path;
     int sp_h, sp_w, emb_dim;
-    const float (*protos)[FD_SPATIAL_EMB_MAX];
-    const float *proto_norms;
+    const fd_margin_t *margin;
 
     if (have_coarse && g_fd.spatial_coarse_loaded) {
         model_path = coarse_path;
@@ -1519,16 +2137,14 @@ static int fd_run_heatmap(const uint8_t *input, fd_result_t *r,
         sp_h = g_fd.spatial_coarse_h;
         sp_w = g_fd.spatial_coarse_w;
         emb_dim = g_fd.spatial_coarse_emb_dim;
-        protos = (const float (*)[FD_SPATIAL_EMB_MAX])g_fd.spatial_coarse_protos;
-        proto_norms = g_fd.spatial_coarse_proto_norms;
+        margin = &g_fd.spatial_coarse_margin;
     } else if (have_fine && g_fd.spatial_protos_loaded) {
         model_path = fine_path;
 
         sp_h = g_fd.spatial_h;
         sp_w = g_fd.spatial_w;
         emb_dim = g_fd.spatial_emb_dim;
-        protos = (const float (*)[FD_SPATIAL_EMB_MAX])g_fd.spatial_protos;
-        proto_norms = g_fd.spatial_proto_norms;
+        margin = &g_fd.spatial_margin;
     } else if (have_fine && g_fd.prototypes_loaded) {
         /* Fallback: fine encoder with classification prototypes */
         model_path = fine_path;
@@ -1536,25 +2152,20 @@ static int fd_run_heatmap(const uint8_t *input, fd_result_t *r,
         sp_h = 7;
         sp_w = 7;
         emb_dim = EMB_DIM;
-        protos = (const float (*)[FD_SPATIAL_EMB_MAX])g_fd.prototypes;
-        proto_norms = g_fd.proto_norms;
+        margin = &g_fd.proto_margin;
     } else {
         model_path = have_coarse ? coarse_path : fine_path;
         sp_h = 7;
         sp_w = 7;
         emb_dim = EMB_DIM;
-        protos = (const float (*)[FD_SPATIAL_EMB_MAX])g_fd.prototypes;
-        proto_norms = g_fd.proto_norms;
+        margin = &g_fd.proto_margin;
     }
 
     float enc_ms = 0;
-    int rc = fd_run_spatial_encoder(model_path, input, spatial_buf,
-                                     sp_h, sp_w, emb_dim, &enc_ms);
+    int rc = fd_run_spatial_encoder(model_path, input, sp_h, sp_w, emb_dim,
+                                     margin, cells, r->heatmap, &enc_ms);
     if (rc < 0) return rc;
 
-    fd_compute_heatmap(spatial_buf, sp_h, sp_w, emb_dim, protos, proto_norms,
-                       r->heatmap);
-
     /* EMA smoothing — filters single-frame INT8 quantization spikes */
     if (!g_fd.heatmap_ema_init) {
         for (int h = 0; h < sp_h; h++)
@@ -1603,17 +2214,90 @@ static int fd_run_heatmap(const uint8_t *input, fd_result_t *r,
     return 0;
 }
 
+/* ============================================================================
+ * Cascade
+ * ============================================================================ */
+
+/* Models run cheapest first and a decisively OK result ends the cycle:
+ * the remaining global model, multiclass and the heatmap only run when
+ * the first answer is ambiguous. Latency is learned from the measured
+ * per-model times so the order follows the hardware. A model is only
+ * skipped once its EMA is seeded, so the first ambiguous frame after a
+ * run of skips is still smoothed against earlier frames. */
+#define FD_COST_ALPHA   0.2f
+
+static struct {
+    pthread_mutex_t mutex;
+    fd_cascade_stats_t stats;
+} g_fd_cascade = {
+    .mutex = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static void fd_cost_learn(float *ema, float ms)
+{
+    if (ms <= 0.0f) return;
+    *ema = *ema > 0.0f ? *ema + FD_COST_ALPHA * (ms - *ema) : ms;
+}
+
+/* Learn latency from the models that ran, and record what the full
+ * stack (exp_* = would have run with the cascade off) would have cost. */
+static void fd_cascade_account(fd_result_t *r, int exp_cnn, int exp_proto,
+                                int exp_multi, int exp_spatial, int spatial_ran)
+{
+    pthread_mutex_lock(&g_fd_cascade.mutex);
+    fd_cascade_stats_t *st = &g_fd_cascade.stats;
+    if (r->cnn_ran) fd_cost_learn(&st->cnn_ms, r->cnn_ms);
+    if (r->proto_ran) fd_cost_learn(&st->proto_ms, r->proto_ms);
+    if (r->multi_ran) fd_cost_learn(&st->multi_ms, r->multi_ms);
+    if (spatial_ran) fd_cost_learn(&st->spatial_ms, r->spatial_ms);
+
+    r->expected_ms = (exp_cnn ? st->cnn_ms : 0.0f) +
+                     (exp_proto ? st->proto_ms : 0.0f) +
+                     (exp_multi ? st->multi_ms : 0.0f) +
+                     (exp_spatial ? st->spatial_ms : 0.0f);
+    r->actual_ms = (r->cnn_ran ? r->cnn_ms : 0.0f) +
+                   (r->proto_ran ? r->proto_ms : 0.0f) +
+                   (r->multi_ran ? r->multi_ms : 0.0f) +
+                   (spatial_ran ? r->spatial_ms : 0.0f);
+
+    st->cycles++;
+    st->expected_ms_total += r->expected_ms;
+    st->actual_ms_total += r->actual_ms;
+    if (strcmp(r->cascade_exit, "cnn") == 0) st->exits_cnn++;
+    if (strcmp(r->cascade_exit, "proto") == 0) st->exits_proto++;
+    if (exp_multi && !r->multi_ran) st->skipped_multi++;
+    if (exp_spatial && !spatial_ran) st->skipped_spatial++;
+    pthread_mutex_unlock(&g_fd_cascade.mutex);
+}
+
+/* CNN step behind the memory gate. Returns 1 when it ran, 0 when
+ * skipped for memory, <0 on error. */
+static int fd_detect_cnn(const uint8_t *input, fd_result_t *r, float threshold,
+                          const fd_config_t *cfg, float ema_alpha)
+{
+    int mem_mb = fd_get_available_memory_mb();
+    if (mem_mb > 0 && mem_mb < cfg->min_free_mem_mb) {
+        fd_log("  Skipping CNN: %dMB free < %dMB min\n",
+               mem_mb, cfg->min_free_mem_mb);
+        return 0;
+    }
+    memset(r, 0, sizeof(*r));
+    int rc = fd_run_cnn(input, r, threshold, cfg, ema_alpha);
+    return rc < 0 ? rc : 1;
+}
+
 /* ============================================================================
  * Combined detection + strategy (from detect.c)
  * ============================================================================ */
 
 /* Returns 0 on success, -1 if a model failed to load (skip cycle) */
 static int fd_run_detection(const uint8_t *preprocessed, fd_result_t *result,
-                             fd_config_t *cfg, float *spatial_buf)
+                             fd_config_t *cfg)
 {
     double t0 = fd_get_time_ms();
     memset(result, 0, sizeof(*result));
     snprintf(result->fault_class_name, sizeof(result->fault_class_name), "-");
+    snprintf(result->cascade_exit, sizeof(result->cascade_exit), "-");
 
     /* Get thresholds from config (or fallback to hardcoded defaults) */
     fd_thresholds_t th;
@@ -1646,7 +2330,44 @@ static int fd_run_detection(const uint8_t *preprocessed, fd_result_t *result,
     int pace_us = cfg->pace_ms * 1000;
     int rc;
 
-    /* Run ProtoNet FIRST (its margin gates the CNN threshold) */
+    /* Cascade: off (or in setup mode) every enabled model runs. On, the
+     * cheaper of CNN/ProtoNet goes first once both latencies are known. */
+    pthread_mutex_lock(&g_fd_cascade.mutex);
+    fd_cascade_stats_t cost = g_fd_cascade.stats;
+    pthread_mutex_unlock(&g_fd_cascade.mutex);
+    int cascade = cfg->cascade_enabled && !cfg->setup_mode;
+    int cnn_first = cascade && have_cnn && have_proto &&
+                    cost.cnn_ms > 0.0f && cost.proto_ms > 0.0f &&
+                    cost.cnn_ms < cost.proto_ms;
+    int exp_cnn = have_cnn, exp_proto = have_proto;
+    int cnn_done = 0;
+    float cnn_fail = 0.0f;
+
+    if (cnn_first) {
+        rc = fd_detect_cnn(preprocessed, &model_result, cnn_th, cfg, th.ema_alpha);
+        if (rc < 0) {
+            result->total_ms = (float)(fd_get_time_ms() - t0);
+            return rc;
+        }
+        cnn_done = 1;
+        if (rc == 0) {
+            have_cnn = 0;
+        } else {
+            cnn_class = model_result.result;
+            cnn_conf = model_result.confidence;
+            cnn_fail = model_result.cnn_raw;
+            result->cnn_ms = model_result.cnn_ms;
+            if (cnn_fail < th.cascade_cnn_ok) {
+                have_proto = 0;
+                snprintf(result->cascade_exit, sizeof(result->cascade_exit), "cnn");
+                fd_log("  Cascade: CNN decisive OK (fail=%.3f < %.2f)\n",
+                       cnn_fail, th.cascade_cnn_ok);
+            }
+        }
+        if (pace_us > 0 && have_proto) usleep(pace_us);
+    }
+
+    /* Run ProtoNet (its margin gates the CNN threshold) */
     if (have_proto) {
         memset(&model_result, 0, sizeof(model_result));
         rc = fd_run_protonet(preprocessed, &model_result, proto_th, cfg);
@@ -1657,7 +2378,14 @@ static int fd_run_detection(const uint8_t *preprocessed, fd_result_t *result,
         proto_class = model_result.result;
         proto_conf = model_result.confidence;
         result->proto_ms = model_result.proto_ms;
-        if (pace_us > 0 && have_cnn) usleep(pace_us);
+        if (cascade && have_cnn && !cnn_done && g_fd.cnn_ema_init &&
+            0.5f + 0.5f * proto_conf < th.cascade_proto_ok) {
+            have_cnn = 0;
+            snprintf(result->cascade_exit, sizeof(result->cascade_exit), "proto");
+            fd_log("  Cascade: Proto decisive OK (lk=%.3f < %.2f)\n",
+                   0.5f + 0.5f * proto_conf, th.cascade_proto_ok);
+        }
+        if (pace_us > 0 && have_cnn && !cnn_done) usleep(pace_us);
     }
 
     /* Dynamic CNN threshold: when ProtoNet is moderately suspicious,
@@ -1671,30 +2399,33 @@ static int fd_run_detection(const uint8_t *preprocessed, fd_result_t *result,
         cnn_th = cnn_dyn_th;
         fd_log("  Dynamic CNN th: %.2f (proto=%.3f trigger=%.2f)\n",
                cnn_th, proto_conf, proto_dyn_trigger);
+        /* CNN already ran first: re-apply its fail prob to the lowered th */
+        if (cnn_done)
+            cnn_class = cnn_fail > cnn_th ? FD_CLASS_FAULT : FD_CLASS_OK;
     }
 
-    /* Memory gate: skip remaining models if memory is low */
-    if (have_cnn) {
-        int mem_mb = fd_get_available_memory_mb();
-        if (mem_mb > 0 && mem_mb < cfg->min_free_mem_mb) {
-            fd_log("  Skipping CNN: %dMB free < %dMB min\n",
-                   mem_mb, cfg->min_free_mem_mb);
+    /* Run CNN (memory gate inside) */
+    if (have_cnn && !cnn_done) {
+        rc = fd_detect_cnn(preprocessed, &model_result, cnn_th, cfg, th.ema_alpha);
+        if (rc < 0) {
+            result->total_ms = (float)(fd_get_time_ms() - t0);
+            return rc;
+        }
+        if (rc == 0) {
             have_cnn = 0;
+        } else {
+            cnn_class = model_result.result;
+            cnn_conf = model_result.confidence;
+            cnn_fail = model_result.cnn_raw;
+            result->cnn_ms = model_result.cnn_ms;
         }
     }
 
-    /* Run CNN */
-    if (have_cnn) {
-        memset(&model_result, 0, sizeof(model_result));
-        rc = fd_run_cnn(preprocessed, &model_result, cnn_th, cfg, th.ema_alpha);
-        if (rc < 0) {
-            result->total_ms = (float)(fd_get_time_ms() - t0);
-            return rc;
-        }
-        cnn_class = model_result.result;
-        cnn_conf = model_result.confidence;
-        result->cnn_ms = model_result.cnn_ms;
-    }
+    /* Every global model that ran is far on the OK side: multiclass and
+     * the heatmap cannot add anything the cascade needs */
+    int decisive_ok = cascade && (have_cnn || have_proto) &&
+        (!have_cnn || cnn_fail < th.cascade_cnn_ok) &&
+        (!have_proto || 0.5f + 0.5f * proto_conf < th.cascade_proto_ok);
 
     /* VERIFY/CLASSIFY: only run multiclass if CNN or ProtoNet flagged FAULT,
      * unless heatmap is enabled — then always run multi for boost corroboration
@@ -1709,6 +2440,9 @@ static int fd_run_detection(const uint8_t *preprocessed, fd_result_t *result,
         if (have_proto && proto_class == FD_CLASS_FAULT) or_fault = 1;
         run_multi = or_fault;
     }
+    int exp_multi = run_multi;
+    if (decisive_ok && g_fd.multi_ema_init)
+        run_multi = 0;
 
     /* Memory gate before multiclass */
     if (run_multi) {
@@ -1935,15 +2669,19 @@ static int fd_run_detection(const uint8_t *preprocessed, fd_result_t *result,
      * The 448x224 global classifiers (CNN/ProtoNet) use GAP which dilutes fault
      * signal for small/localized defects.  The spatial heatmap detects per-cell
      * and can boost the classification when global models miss. */
-    if (cfg->heatmap_enabled &&
-        (g_fd.prototypes_loaded || g_fd.spatial_protos_loaded) && spatial_buf) {
+    int exp_spatial = cfg->heatmap_enabled &&
+        (g_fd.prototypes_loaded || g_fd.spatial_protos_loaded);
+    int spatial_ran = 0;
+    if (exp_spatial && !(decisive_ok && g_fd.heatmap_ema_init)) {
         if (pace_us > 0) usleep(pace_us);
         /* Resolve Z-dependent mask */
         pthread_mutex_lock(&g_fd.z_mutex);
         float cur_z = g_fd.current_z;
         pthread_mutex_unlock(&g_fd.z_mutex);
         fd_mask196_t active_mask = fd_get_mask_for_z(cfg, cur_z);
-        int hm_ret = fd_run_heatmap(preprocessed, result, cfg, spatial_buf, active_mask, th.heatmap_coarse_wt, th.ema_alpha);
+        active_mask = fd_roi_remap_mask(&active_mask);
+        int hm_ret = fd_run_heatmap(preprocessed, result, cfg, active_mask, th.heatmap_coarse_wt, th.ema_alpha);
+        spatial_ran = hm_ret >= 0;
         if (hm_ret < 0) {
             fd_log("  Heatmap: skipped (%s)\n",
                    hm_ret == -2 ? "low memory" : "error");
@@ -2126,10 +2864,245 @@ static int fd_run_detection(const uint8_t *preprocessed, fd_result_t *result,
         }
     }
 
+    fd_cascade_account(result, exp_cnn, exp_proto, exp_multi, exp_spatial,
+                       spatial_ran);
     result->total_ms = (float)(fd_get_time_ms() - t0);
     return 0;
 }
 
+/* ============================================================================
+ * Event-driven scheduling
+ * ============================================================================ */
+
+/* Each cycle a frame is probed with cheap signals before the model stack
+ * runs: JPEG size, a 32x18 grid of luma block means (1/8-scale grayscale
+ * decode), print state and layer hints from the Moonraker/RPC clients, and
+ * Z. Unchanged frames and idle periods are skipped; the first layers and
+ * fault verification run every cycle at verify_interval_s. */
+#define FD_SCHED_GRID_W         32
+#define FD_SCHED_GRID_H         18
+#define FD_SCHED_BLOCK_DELTA    12      /* luma levels for a block to count as changed */
+#define FD_SCHED_CHANGE_PCT     3.0f    /* changed blocks that make a new scene */
+#define FD_SCHED_SIZE_DELTA_PCT 15      /* JPEG size change that makes a new scene */
+#define FD_SCHED_RISKY_LAYERS   3       /* first layers: no skipping */
+#define FD_SCHED_RISKY_Z_MM     1.0f
+#define FD_SCHED_Z_STEP_MM      0.1f    /* Z rise treated as a layer change */
+
+static struct {
+    pthread_mutex_t mutex;
+    /* Print progress (written by the Moonraker/RPC threads) */
+    int print_state;            /* -1 unknown, 0 idle, 1 printing */
+    int layer;
+    uint32_t layer_seq;         /* bumped on every layer event */
+    uint32_t epoch;             /* bumped on print start/stop and config changes */
+    fd_sched_stats_t stats;
+
+    /* Detection thread only */
+    int have_ref;
+    uint8_t ref_luma[FD_SCHED_GRID_W * FD_SCHED_GRID_H];
+    uint8_t probe_luma[FD_SCHED_GRID_W * FD_SCHED_GRID_H];
+    size_t ref_jpeg_size;
+    uint32_t ref_layer_seq;
+    uint32_t ref_epoch;
+    float ref_z;
+    uint32_t probe_layer_seq;
+    uint32_t probe_epoch;
+    double last_run_ms;
+} g_fd_sched = {
+    .mutex = PTHREAD_MUTEX_INITIALIZER,
+    .print_state = -1,
+    .layer = -1,
+};
+
+/* Grayscale decode at the smallest scale, averaged into the probe grid.
+ * Returns 0 on success. */
+static int fd_sched_probe_luma(const uint8_t *jpeg, size_t size)
+{
+    tjhandle handle = tjInitDecompress();
+    if (!handle) return -1;
+
+    int width, height, subsample, colorspace;
+    if (tjDecompressHeader3(handle, jpeg, (unsigned long)size,
+                            &width, &height, &subsample, &colorspace) < 0) {
+        tjDestroy(handle);
+        return -1;
+    }
+
+    int num_sf = 0;
+    tjscalingfactor *sf = tjGetScalingFactors(&num_sf);
+    tjscalingfactor best_sf = {1, 1};
+    for (int i = 0; sf && i < num_sf; i++) {
+        int sw = TJSCALED(width, sf[i]);
+        int sh = TJSCALED(height, sf[i]);
+        if (sw >= FD_SCHED_GRID_W && sh >= FD_SCHED_GRID_H &&
+            sw * sh < TJSCALED(width, best_sf) * TJSCALED(height, best_sf))
+            best_sf = sf[i];
+    }
+
+    int w = TJSCALED(width, best_sf);
+    int h = TJSCALED(height, best_sf);
+    uint8_t *gray = (uint8_t *)malloc((size_t)w * h);
+    if (!gray) {
+        tjDestroy(handle);
+        return -1;
+    }
+    int ret = tjDecompress2(handle, jpeg, (unsigned long)size,
+                            gray, w, 0, h, TJPF_GRAY, TJFLAG_FASTDCT);
+    tjDestroy(handle);
+    if (ret < 0) {
+        free(gray);
+        return -1;
+    }
+
+    for (int gy = 0; gy < FD_SCHED_GRID_H; gy++) {
+        int y0 = gy * h / FD_SCHED_GRID_H, y1 = (gy + 1) * h / FD_SCHED_GRID_H;
+        for (int gx = 0; gx < FD_SCHED_GRID_W; gx++) {
+            int x0 = gx * w / FD_SCHED_GRID_W, x1 = (gx + 1) * w / FD_SCHED_GRID_W;
+            uint32_t sum = 0;
+            for (int y = y0; y < y1; y++)
+                for (int x = x0; x < x1; x++)
+                    sum += gray[y * w + x];
+            int n = (y1 - y0) * (x1 - x0);
+            g_fd_sched.probe_luma[gy * FD_SCHED_GRID_W + gx] =
+                (uint8_t)(n > 0 ? sum / n : 0);
+        }
+    }
+    free(gray);
+    return 0;
+}
+
+/* Percentage of grid blocks that moved more than FD_SCHED_BLOCK_DELTA */
+static float fd_sched_luma_change(void)
+{
+    int changed = 0;
+    for (int i = 0; i < FD_SCHED_GRID_W * FD_SCHED_GRID_H; i++) {
+        int d = (int)g_fd_sched.probe_luma[i] - (int)g_fd_sched.ref_luma[i];
+        if (d > FD_SCHED_BLOCK_DELTA || d < -FD_SCHED_BLOCK_DELTA)
+            changed++;
+    }
+    return 100.0f * changed / (FD_SCHED_GRID_W * FD_SCHED_GRID_H);
+}
+
+/* Does the current print phase need every cycle at verify_interval_s? */
+static int fd_sched_is_risky(void)
+{
+    pthread_mutex_lock(&g_fd_sched.mutex);
+    int printing = g_fd_sched.print_state;
+    int layer = g_fd_sched.layer;
+    pthread_mutex_unlock(&g_fd_sched.mutex);
+
+    if (printing == 0) return 0;
+    if (layer >= 0)
+        return layer <= FD_SCHED_RISKY_LAYERS;     /* layers count from 1 */
+
+    pthread_mutex_lock(&g_fd.z_mutex);
+    float z = g_fd.current_z;
+    pthread_mutex_unlock(&g_fd.z_mutex);
+    return printing == 1 && z > 0.0f && z < FD_SCHED_RISKY_Z_MM;
+}
+
+/* Decide whether the frame gets a full run (1) or is skipped (0).
+ * verifying is set while a fault is being confirmed. */
+static int fd_sched_decide(const fd_config_t *cfg,
+                           const uint8_t *jpeg, size_t size,
+                           int verifying)
+{
+    pthread_mutex_lock(&g_fd_sched.mutex);
+    int printing = g_fd_sched.print_state;
+    uint32_t layer_seq = g_fd_sched.layer_seq;
+    uint32_t epoch = g_fd_sched.epoch;
+    pthread_mutex_unlock(&g_fd_sched.mutex);
+
+    pthread_mutex_lock(&g_fd.z_mutex);
+    float z = g_fd.current_z;
+    pthread_mutex_unlock(&g_fd.z_mutex);
+
+    int probed = fd_sched_probe_luma(jpeg, size) == 0;
+    if (epoch != g_fd_sched.ref_epoch)
+        g_fd_sched.have_ref = 0;
+
+    double now = fd_get_time_ms();
+    int stale = now - g_fd_sched.last_run_ms >= cfg->max_skip_s * 1000.0;
+    float change = -1.0f;
+    int run = 1;
+    const char *reason;
+    uint32_t *counter;
+
+    if (!cfg->sched_enabled || cfg->setup_mode) {
+        reason = "fixed";
+        counter = &g_fd_sched.stats.runs_fixed;
+    } else if (!g_fd_sched.have_ref || !probed) {
+        reason = "first";
+        counter = &g_fd_sched.stats.runs_first;
+    } else if (verifying) {
+        reason = "verify";
+        counter = &g_fd_sched.stats.runs_verify;
+    } else if (printing == 0) {
+        reason = stale ? "stale" : "idle";
+        counter = stale ? &g_fd_sched.stats.runs_stale
+                        : &g_fd_sched.stats.skips_idle;
+        run = stale;
+    } else if (fd_sched_is_risky()) {
+        reason = "risky";
+        counter = &g_fd_sched.stats.runs_risky;
+    } else if (layer_seq != g_fd_sched.ref_layer_seq ||
+               z > g_fd_sched.ref_z + FD_SCHED_Z_STEP_MM) {
+        reason = "layer";
+        counter = &g_fd_sched.stats.runs_layer;
+    } else {
+        size_t ref = g_fd_sched.ref_jpeg_size;
+        size_t delta = size > ref ? size - ref : ref - size;
+        change = fd_sched_luma_change();
+        if (delta * 100 > ref * FD_SCHED_SIZE_DELTA_PCT ||
+            change >= FD_SCHED_CHANGE_PCT) {
+            reason = "scene";
+            counter = &g_fd_sched.stats.runs_scene;
+        } else if (stale) {
+            reason = "stale";
+            counter = &g_fd_sched.stats.runs_stale;
+        } else {
+            reason = "static";
+            counter = &g_fd_sched.stats.skips_static;
+            run = 0;
+        }
+    }
+
+    pthread_mutex_lock(&g_fd_sched.mutex);
+    g_fd_sched.stats.probes++;
+    (*counter)++;
+    if (change >= 0.0f)
+        g_fd_sched.stats.last_change_pct = change;
+    snprintf(g_fd_sched.stats.last_decision,
+             sizeof(g_fd_sched.stats.last_decision), "%s", reason);
+    pthread_mutex_unlock(&g_fd_sched.mutex);
+
+    if (cfg->debug_logging)
+        fd_log("Scheduler: %s (size=%zu, change=%.1f%%)\n", reason, size, change);
+
+    /* The reference moves on only once the model stack ran (fd_sched_commit) */
+    g_fd_sched.probe_layer_seq = layer_seq;
+    g_fd_sched.probe_epoch = epoch;
+    return run;
+}
+
+/* The probed frame was fully evaluated: make it the new reference */
+static void fd_sched_commit(size_t jpeg_size)
+{
+    pthread_mutex_lock(&g_fd.z_mutex);
+    float z = g_fd.current_z;
+    pthread_mutex_unlock(&g_fd.z_mutex);
+
+    memcpy(g_fd_sched.ref_luma, g_fd_sched.probe_luma,
+           sizeof(g_fd_sched.ref_luma));
+    g_fd_sched.ref_jpeg_size = jpeg_size;
+    g_fd_sched.ref_layer_seq = g_fd_sched.probe_layer_seq;
+    g_fd_sched.ref_epoch = g_fd_sched.probe_epoch;
+    if (z > g_fd_sched.ref_z || !g_fd_sched.have_ref)
+        g_fd_sched.ref_z = z;
+    g_fd_sched.last_run_ms = fd_get_time_ms();
+    g_fd_sched.have_ref = 1;
+}
+
 /* ============================================================================
  * Detection thread
  * ============================================================================ */
@@ -2161,14 +3134,6 @@ static void *fd_thread_func(void *arg)
         return NULL;
     }
 
-    /* Persistent spatial buffer — allocated for max possible size, reused each cycle.
-     * Max: 14x28x1024 = 401408 floats = ~1.5MB (covers 7x14x1024 and 14x28x232) */
-    int spatial_buf_size = FD_SPATIAL_H_MAX * FD_SPATIAL_W_MAX * FD_SPATIAL_EMB_MAX;
-    float *spatial_buf = (float *)malloc(spatial_buf_size * sizeof(float));
-    if (!spatial_buf) {
-        fd_log("Warning: spatial buffer alloc failed, heatmap disabled\n");
-    }
-
     int consecutive_ok = 0;
     int use_verify_interval = 0;
     uint64_t last_led_check = 0;
@@ -2182,11 +3147,13 @@ static void *fd_thread_func(void *arg)
             pthread_mutex_unlock(&g_proto.mutex);
             if (proto_pending) {
                 fd_set_state(FD_STATUS_DISABLED, NULL, "computing prototypes");
+                fd_cache_flush_idle();
                 fd_do_proto_computation();
                 /* Reset EMA state since prototypes changed */
                 g_fd.cnn_ema_init = 0;
                 g_fd.multi_ema_init = 0;
                 g_fd.heatmap_ema_init = 0;
+                g_fd_sched.have_ref = 0;
                 continue;
             }
         }
@@ -2198,13 +3165,20 @@ static void *fd_thread_func(void *arg)
 
         if (!cfg.enabled) {
             fd_set_state(FD_STATUS_DISABLED, NULL, NULL);
+            fd_cache_flush_idle();
             usleep(1000000);
             continue;
         }
 
-        /* Sleep for the appropriate interval */
-        int interval = use_verify_interval ? cfg.verify_interval_s
-                                           : cfg.interval_s;
+        /* A streaming timelapse holds VENC CMA for the whole print: load
+         * models per inference instead of keeping them next to it */
+        fd_model_cache_set_budget(timelapse_streaming_encoder_open() ? 0 : cfg.model_cache_mb);
+
+        /* Sleep for the appropriate interval (short while verifying a fault
+         * or during the first layers) */
+        int fast = use_verify_interval ||
+                   (cfg.sched_enabled && fd_sched_is_risky());
+        int interval = fast ? cfg.verify_interval_s : cfg.interval_s;
         for (int i = 0; i < interval * 10 && !g_fd.thread_stop; i++)
             usleep(100000);  /* 100ms chunks for responsive shutdown */
 
@@ -2215,12 +3189,19 @@ static void *fd_thread_func(void *arg)
             TimelapseEncodeStatus tl_status = timelapse_get_encode_status();
             if (tl_status == TL_ENCODE_PENDING || tl_status == TL_ENCODE_RUNNING) {
                 fd_log("Skipping cycle: timelapse encoding in progress\n");
+                fd_cache_flush_idle();
                 continue;
             }
         }
 
-        /* Check available memory */
+        /* Check available memory. Resident models are the first thing to go. */
         int avail_mb = fd_get_available_memory_mb();
+        if (avail_mb > 0 && avail_mb < cfg.min_free_mem_mb &&
+            fd_cache_flush_idle() > 0) {
+            fd_log("Released resident models: %d MB available < %d MB threshold\n",
+                   avail_mb, cfg.min_free_mem_mb);
+            avail_mb = fd_get_available_memory_mb();
+        }
         if (avail_mb > 0 && avail_mb < cfg.min_free_mem_mb) {
             fd_set_state(FD_STATUS_MEM_LOW, NULL, "memory low");
             fd_log("Skipping cycle: %d MB available < %d MB threshold\n",
@@ -2280,25 +3261,38 @@ static void *fd_thread_func(void *arg)
         uint8_t *jpeg_copy = (uint8_t *)malloc(jpeg_size);
         if (jpeg_copy)
             memcpy(jpeg_copy, g_fd.jpeg_buf, jpeg_size);
+        pthread_mutex_unlock(&g_fd.frame_mutex);
+
+        if (!jpeg_copy) continue;
+
+        /* Cheap probe first: unchanged or idle frames skip the models */
+        if (!fd_sched_decide(&cfg, jpeg_copy, jpeg_size, use_verify_interval)) {
+            free(jpeg_copy);
+            continue;
+        }
 
         /* Retain copy for UI overlay (separate mutex, no contention) */
-        if (jpeg_copy && jpeg_size <= sizeof(g_fd.fd_frame_buf)) {
+        if (jpeg_size <= sizeof(g_fd.fd_frame_buf)) {
             pthread_mutex_lock(&g_fd.fd_frame_mutex);
-            memcpy(g_fd.fd_frame_buf, g_fd.jpeg_buf, jpeg_size);
+            memcpy(g_fd.fd_frame_buf, jpeg_copy, jpeg_size);
             g_fd.fd_frame_size = jpeg_size;
             g_fd.fd_frame_cycle = g_fd.state.cycle_count;
             pthread_mutex_unlock(&g_fd.fd_frame_mutex);
         }
-        pthread_mutex_unlock(&g_fd.frame_mutex);
-
-        if (!jpeg_copy) continue;
 
         fd_set_state(FD_STATUS_ACTIVE, NULL, NULL);
         int pace_us = cfg.pace_ms * 1000;
 
-        /* Decode JPEG (with TurboJPEG scaled decode) */
+        /* Decode JPEG (with TurboJPEG scaled decode). A bed-region crop
+         * samples a smaller area, so decode larger to avoid upscaling. */
+        fd_roi_update(&cfg);
+        int min_w = 512, min_h = 256;
+        if (g_fd.roi_valid) {
+            min_w = (int)(512 / g_fd.roi_s);
+            min_h = (int)(256 / g_fd.roi_s);
+        }
         fd_image_t img = {0};
-        if (fd_decode_jpeg(jpeg_copy, jpeg_size, &img) < 0) {
+        if (fd_decode_jpeg_min(jpeg_copy, jpeg_size, &img, min_w, min_h) < 0) {
             free(jpeg_copy);
             fd_set_state(FD_STATUS_ERROR, NULL, "JPEG decode failed");
             continue;
@@ -2322,8 +3316,10 @@ static void *fd_thread_func(void *arg)
 
         if (pace_us > 0) usleep(pace_us);
 
-        /* Fused resize+crop+grayscale (single pass, no intermediate alloc) */
-        if (fd_preprocess(&img, preprocessed) < 0) {
+        /* Fused resize+crop (single pass, no intermediate alloc), straight
+         * into the shared NPU input once a model has bound it */
+        uint8_t *input = g_fd_input.virt ? g_fd_input.virt : preprocessed;
+        if (fd_preprocess(&img, input) < 0) {
             free(img.data);
             fd_set_state(FD_STATUS_ERROR, NULL, "preprocess failed");
             continue;
@@ -2334,7 +3330,7 @@ static void *fd_thread_func(void *arg)
 
         /* Run detection (pacing between models handled inside) */
         fd_result_t result;
-        int det_ret = fd_run_detection(preprocessed, &result, &cfg, spatial_buf);
+        int det_ret = fd_run_detection(input, &result, &cfg);
         if (det_ret < 0) {
             if (det_ret == -2)
                 fd_set_state(FD_STATUS_MEM_LOW, NULL, "CMA alloc failed");
@@ -2342,6 +3338,7 @@ static void *fd_thread_func(void *arg)
                 fd_set_state(FD_STATUS_ERROR, NULL, "model load failed");
             continue;  /* Skip cycle entirely */
         }
+        fd_sched_commit(jpeg_size);
 
         /* Diagnostic: log center cell + EMA state (debug_logging only) */
         if (cfg.debug_logging && result.has_heatmap &&
@@ -2352,11 +3349,17 @@ static void *fd_thread_func(void *arg)
                    g_fd.cnn_ema_logits[0], g_fd.cnn_ema_logits[1]);
         }
 
-        /* Attach center-crop region to result */
+        /* Attach the region the model saw (center or bed-region crop) */
         result.crop_x = g_fd.crop_x;
         result.crop_y = g_fd.crop_y;
         result.crop_w = g_fd.crop_w;
         result.crop_h = g_fd.crop_h;
+        if (g_fd.roi_valid && g_fd.crop_valid) {
+            result.crop_x += g_fd.roi_x * g_fd.crop_w;
+            result.crop_y += g_fd.roi_y * g_fd.crop_h;
+            result.crop_w *= g_fd.roi_s;
+            result.crop_h *= g_fd.roi_s;
+        }
 
         /* Update state */
         pthread_mutex_lock(&g_fd.state_mutex);
@@ -2393,8 +3396,11 @@ static void *fd_thread_func(void *arg)
                result.total_ms);
     }
 
+    fd_cache_flush_idle();
+    fd_input_free();
     free(preprocessed);
-    free(spatial_buf);
+    free(g_fd.spatial_f32);
+    g_fd.spatial_f32 = NULL;
     fd_buzzer_cleanup();
     fd_log("Detection thread stopped\n");
     return NULL;
@@ -2431,6 +3437,99 @@ static fd_mask196_t fd_get_mask_for_z(const fd_config_t *cfg, float z)
     return cfg->z_masks[0].mask;
 }
 
+/* ============================================================================
+ * Bed-region crop
+ * ============================================================================ */
+
+/* Skip the zoom when the bed region covers most of the center crop */
+#define FD_ROI_MAX_SIZE 0.9f
+
+/* Tighter model input around the calibrated bed: bounding box of every cell
+ * any mask can enable (static mask, or all Z entries), padded by one cell
+ * and squared in center-crop coords so the 448x224 input keeps its aspect.
+ * Off without masks, in setup mode (the wizard draws over the full crop),
+ * and when the box would barely shrink the input. */
+static void fd_roi_update(const fd_config_t *cfg)
+{
+    g_fd.roi_valid = 0;
+    if (!cfg->roi_crop || cfg->setup_mode)
+        return;
+
+    fd_mask196_t all;
+    if (cfg->z_mask_count > 0) {
+        fd_mask_clear(&all);
+        for (int i = 0; i < cfg->z_mask_count; i++) {
+            if (fd_mask_is_zero(&cfg->z_masks[i].mask))
+                return;  /* an unmasked layer range needs the whole crop */
+            for (int k = 0; k < FD_MASK_WORDS; k++)
+                all.w[k] |= cfg->z_masks[i].mask.w[k];
+        }
+    } else {
+        all = cfg->heatmap_mask;
+    }
+
+    int gh, gw;
+    fault_detect_get_spatial_dims(&gh, &gw);
+    int r0 = gh, r1 = -1, c0 = gw, c1 = -1;
+    for (int i = fd_mask_next_bit(&all, 0); i >= 0 && i < gh * gw;
+         i = fd_mask_next_bit(&all, i + 1)) {
+        int r = i / gw, c = i % gw;
+        if (r < r0) r0 = r;
+        if (r > r1) r1 = r;
+        if (c < c0) c0 = c;
+        if (c > c1) c1 = c;
+    }
+    if (r1 < 0)
+        return;
+
+    if (r0 > 0) r0--;
+    if (c0 > 0) c0--;
+    if (r1 < gh - 1) r1++;
+    if (c1 < gw - 1) c1++;
+
+    float x0 = (float)c0 / gw, x1 = (float)(c1 + 1) / gw;
+    float y0 = (float)r0 / gh, y1 = (float)(r1 + 1) / gh;
+    float size = (x1 - x0) > (y1 - y0) ? (x1 - x0) : (y1 - y0);
+    if (size > FD_ROI_MAX_SIZE)
+        return;
+
+    float x = (x0 + x1 - size) * 0.5f;
+    float y = (y0 + y1 - size) * 0.5f;
+    if (x < 0) x = 0;
+    if (y < 0) y = 0;
+    if (x > 1.0f - size) x = 1.0f - size;
+    if (y > 1.0f - size) y = 1.0f - size;
+
+    g_fd.roi_x = x;
+    g_fd.roi_y = y;
+    g_fd.roi_s = size;
+    g_fd.roi_valid = 1;
+}
+
+/* Express a center-crop grid mask on the bed-region grid: each cell takes
+ * the bit of the center-crop cell under its center. Zero stays zero. */
+static fd_mask196_t fd_roi_remap_mask(const fd_mask196_t *m)
+{
+    if (!g_fd.roi_valid || fd_mask_is_zero(m))
+        return *m;
+
+    int gh, gw;
+    fault_detect_get_spatial_dims(&gh, &gw);
+    fd_mask196_t out;
+    fd_mask_clear(&out);
+    for (int r = 0; r < gh; r++) {
+        int br = (int)((g_fd.roi_y + (r + 0.5f) / gh * g_fd.roi_s) * gh);
+        if (br > gh - 1) br = gh - 1;
+        for (int c = 0; c < gw; c++) {
+            int bc = (int)((g_fd.roi_x + (c + 0.5f) / gw * g_fd.roi_s) * gw);
+            if (bc > gw - 1) bc = gw - 1;
+            if (fd_mask_test_bit(m, br * gw + bc))
+                fd_mask_set_bit(&out, r * gw + c);
+        }
+    }
+    return out;
+}
+
 /* ============================================================================
  * Public API
  * ============================================================================ */
@@ -2620,6 +3719,8 @@ int fault_detect_warmup(void)
         return 0;
     }
 
+    fault_detect_release_models();
+
     fd_log("CMA warmup: loading %s (%ld KB) to pre-allocate CMA...\n",
            biggest_name, biggest_size / 1024);
 
@@ -2634,6 +3735,35 @@ int fault_detect_warmup(void)
     return 0;
 }
 
+int fault_detect_release_models(void)
+{
+    pthread_mutex_lock(&g_fd_cache.mutex);
+    g_fd_cache.flush_pending = 1;
+    pthread_mutex_unlock(&g_fd_cache.mutex);
+
+    int freed = fd_cache_flush_idle();
+    if (freed > 0)
+        fd_log("Released %d resident model(s)\n", freed);
+    return freed;
+}
+
+fd_model_cache_stats_t fault_detect_get_model_cache_stats(void)
+{
+    pthread_mutex_lock(&g_fd_cache.mutex);
+    fd_model_cache_stats_t st = g_fd_cache.stats;
+    st.resident = 0;
+    for (int i = 0; i < FD_MODEL_CACHE_SLOTS; i++)
+        if (g_fd_cache.slots[i].loaded) st.resident++;
+    st.cma_kb = (uint32_t)(g_fd_cache.used / 1024);
+    st.budget_kb = (uint32_t)(g_fd_cache.budget / 1024);
+    st.avg_load_ms = st.misses > 0 ?
+        (float)(g_fd_cache.load_ms_total / st.misses) : 0.0f;
+    st.zero_copy_runs = g_fd_input.zero_copy_runs;
+    st.input_copies = g_fd_input.input_copies;
+    pthread_mutex_unlock(&g_fd_cache.mutex);
+    return st;
+}
+
 int fault_detect_needs_frame(void)
 {
     return g_fd.initialized && g_fd.need_frame;
@@ -2685,6 +3815,11 @@ void fault_detect_set_config(const fd_config_t *config)
     g_fd.cnn_ema_init = 0;
     g_fd.multi_ema_init = 0;
     g_fd.heatmap_ema_init = 0;
+
+    /* Next frame runs the models regardless of scene change */
+    pthread_mutex_lock(&g_fd_sched.mutex);
+    g_fd_sched.epoch++;
+    pthread_mutex_unlock(&g_fd_sched.mutex);
 }
 
 void fault_detect_set_current_z(float z_mm)
@@ -2694,6 +3829,47 @@ void fault_detect_set_current_z(float z_mm)
     pthread_mutex_unlock(&g_fd.z_mutex);
 }
 
+fd_cascade_stats_t fault_detect_get_cascade_stats(void)
+{
+    pthread_mutex_lock(&g_fd_cascade.mutex);
+    fd_cascade_stats_t st = g_fd_cascade.stats;
+    pthread_mutex_unlock(&g_fd_cascade.mutex);
+    return st;
+}
+
+fd_sched_stats_t fault_detect_get_sched_stats(void)
+{
+    pthread_mutex_lock(&g_fd_sched.mutex);
+    fd_sched_stats_t st = g_fd_sched.stats;
+    st.print_state = g_fd_sched.print_state;
+    st.layer = g_fd_sched.layer;
+    pthread_mutex_unlock(&g_fd_sched.mutex);
+    return st;
+}
+
+void fault_detect_notify_print_state(int printing)
+{
+    printing = printing ? 1 : 0;
+    pthread_mutex_lock(&g_fd_sched.mutex);
+    if (g_fd_sched.print_state != printing) {
+        g_fd_sched.print_state = printing;
+        g_fd_sched.layer = -1;
+        g_fd_sched.epoch++;
+    }
+    pthread_mutex_unlock(&g_fd_sched.mutex);
+}
+
+void fault_detect_notify_layer(int layer)
+{
+    pthread_mutex_lock(&g_fd_sched.mutex);
+    if (layer < 0 || layer != g_fd_sched.layer) {
+        if (layer >= 0)
+            g_fd_sched.layer = layer;
+        g_fd_sched.layer_seq++;
+    }
+    pthread_mutex_unlock(&g_fd_sched.mutex);
+}
+
 void fault_detect_set_z_masks(const fd_z_mask_entry_t *entries, int count)
 {
     if (count < 0) count = 0;
@@ -2843,6 +4019,8 @@ static void fd_parse_set_metadata(fd_model_set_t *s)
             p->boost_confidence_cap = fd_json_float(prof, "boost_confidence_cap");
             p->ema_alpha = fd_json_float(prof, "ema_alpha");
             p->heatmap_coarse_weight = fd_json_float(prof, "heatmap_coarse_weight");
+            p->cascade_cnn_ok = fd_json_float(prof, "cascade_cnn_ok");
+            p->cascade_proto_ok = fd_json_float(prof, "cascade_proto_ok");
             s->num_profiles++;
         }
     }
@@ -3073,16 +4251,24 @@ static int fd_md5_file(const char *path, char *out)
     return 0;
 }
 
-/* In-process FNV-1a hash of raw data. Returns 16-char hex string in out (17 bytes min).
- * No forking — safe for thousands of calls on memory-constrained devices. */
-static void fd_fnv1a_hash(const uint8_t *data, size_t len, char *out)
+/* Incremental FNV-1a: h = fd_fnv1a_update(FD_FNV1A_INIT, ...) chunk by chunk */
+#define FD_FNV1A_INIT 0xcbf29ce484222325ULL
+
+static uint64_t fd_fnv1a_update(uint64_t h, const uint8_t *data, size_t len)
 {
-    uint64_t h = 0xcbf29ce484222325ULL;
     for (size_t i = 0; i < len; i++) {
         h ^= data[i];
         h *= 0x100000001b3ULL;
     }
-    snprintf(out, 17, "%016llx", (unsigned long long)h);
+    return h;
+}
+
+/* In-process FNV-1a hash of raw data. Returns 16-char hex string in out (17 bytes min).
+ * No forking — safe for thousands of calls on memory-constrained devices. */
+static void fd_fnv1a_hash(const uint8_t *data, size_t len, char *out)
+{
+    snprintf(out, 17, "%016llx",
+             (unsigned long long)fd_fnv1a_update(FD_FNV1A_INIT, data, len));
 }
 
 /* Get total size of directory tree (bytes) */
@@ -3094,6 +4280,7 @@ static size_t fd_dir_size(const char *path)
     struct dirent *ent;
     char child[512];
     while ((ent = readdir(d)) != NULL) {
+        /* Counts the decode cache, which stays with the dataset */
         if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0)
             continue;
         snprintf(child, sizeof(child), "%s/%s", path, ent->d_name);
@@ -3150,102 +4337,558 @@ static void fd_proto_set_state(fd_proto_compute_state_t state,
     pthread_mutex_unlock(&g_proto.mutex);
 }
 
-/* Core prototype computation — runs in FD thread context.
- * Pauses normal FD inference during computation. */
-static void fd_do_proto_computation(void)
-{
-    pthread_mutex_lock(&g_proto.mutex);
-    fd_proto_compute_progress_t prog = g_proto.progress;
-    pthread_mutex_unlock(&g_proto.mutex);
+/* ============================================================================
+ * Prototype Management — Decode cache, pipeline and checkpoints
+ *
+ * Every dataset image is read, hashed, decoded and preprocessed once into
+ * a tensor cache file next to the dataset (page-aligned 448x224x3
+ * records, mmap'd back for the later model passes). The cache is keyed on
+ * the dataset's file list and kept, so later computations from the same
+ * images decode nothing. A producer thread
+ * fills a small ring ahead of the NPU, so JPEG decode overlaps inference.
+ * Progress is checkpointed into the set directory; prototype outputs are
+ * staged as *.new until the whole set completes, so a cancelled or
+ * crashed run resumes where it stopped and incremental merges never see
+ * half-written prototypes. Without disk space for the cache, each pass
+ * decodes again (still overlapped).
+ * ============================================================================ */
 
-    fd_log("Proto compute: dataset=%s set=%s incremental=%d\n",
-           prog.dataset_name, prog.set_name, prog.incremental);
+#define FD_PROTO_CACHE_FILE     ".preproc.cache"
+#define FD_PROTO_CKPT_FILE      ".checkpoint"
+#define FD_PROTO_CACHE_MAGIC    0x43504446      /* "FDPC" */
+#define FD_PROTO_CKPT_MAGIC     0x4b434446      /* "FDCK" */
+#define FD_PROTO_CACHE_VERSION  1
+#define FD_PROTO_CKPT_VERSION   1
+#define FD_PROTO_PAGE           4096
+#define FD_PROTO_RECORD_BYTES   ((FD_MODEL_INPUT_BYTES + FD_PROTO_PAGE - 1) & ~(FD_PROTO_PAGE - 1))
+#define FD_PROTO_RING           3               /* preprocessed images queued ahead */
+#define FD_PROTO_CKPT_EVERY     32              /* images between checkpoints */
+#define FD_PROTO_CACHE_RESERVE  (32 * 1024 * 1024)  /* free space left on the disk */
 
-    /* Validate dataset */
-    char fail_dir[512], succ_dir[512];
-    snprintf(fail_dir, sizeof(fail_dir), "%s/%s/failure", FD_DATASETS_DIR, prog.dataset_name);
-    snprintf(succ_dir, sizeof(succ_dir), "%s/%s/success", FD_DATASETS_DIR, prog.dataset_name);
+enum { FD_PC_EMPTY = 0, FD_PC_VALID, FD_PC_BAD };
 
-    int n_fail, n_succ;
-    char **fail_files = fd_collect_jpegs(fail_dir, &n_fail);
-    char **succ_files = fd_collect_jpegs(succ_dir, &n_succ);
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t record_bytes;
+    uint32_t n;
+    uint64_t signature;         /* dataset file list, see fd_proto_signature() */
+    uint32_t synced;            /* index entries [0, synced) are on disk */
+    uint32_t reserved;
+} fd_proto_cache_hdr_t;
 
-    if (n_fail == 0 || n_succ == 0) {
-        fd_err("Proto compute: empty dataset (fail=%d succ=%d)\n", n_fail, n_succ);
-        fd_proto_set_state(PROTO_COMPUTE_ERROR, "Dataset has no images in failure/ or success/");
-        fd_free_jpeg_list(fail_files, n_fail);
-        fd_free_jpeg_list(succ_files, n_succ);
+typedef struct {
+    uint8_t state;              /* FD_PC_* */
+    char hash[17];              /* FNV-1a of the JPEG, for metadata dedup */
+    uint8_t pad[14];
+} fd_proto_cache_ent_t;
+
+typedef struct {
+    int fd;                     /* -1: no cache, decode every pass */
+    fd_proto_cache_hdr_t hdr;
+    fd_proto_cache_ent_t *index;
+    off_t data_off;
+    int reused;                 /* records valid when opened */
+} fd_proto_cache_t;
+
+/* Checkpoint header, followed by accum[2][emb_dim] floats */
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t signature;
+    char dataset[64];
+    int incremental;
+    int model;                  /* model in progress, 3 = all done */
+    int next_image;             /* first image not yet in accum */
+    int emb_dim;
+    int new_counts[2];
+    int final_new_counts[2];
+    float cos_sim[3];
+    float margin[3];
+    char encoder_hashes[3][33];
+} fd_proto_ckpt_t;
+
+/* One preprocessed image handed from the producer to the NPU loop */
+typedef struct {
+    const uint8_t *tensor;      /* NULL: unreadable, or already in the set */
+    void *map;                  /* cache record mapping, unmapped on pop */
+} fd_proto_item_t;
+
+typedef struct {
+    char **files;               /* failure images, then success images */
+    int n;
+    char (*hashes)[17];
+    fd_proto_cache_t *cache;
+    char **old_hashes;          /* incremental: images already in the set */
+    int n_old_hashes;
+    int start;
+
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    fd_proto_item_t items[FD_PROTO_RING];
+    uint8_t *bufs[FD_PROTO_RING];
+    int head, count;
+    int stop;
+    int decoded;                /* JPEG decodes this pass */
+} fd_proto_pipe_t;
+
+/* FNV-1a over every path, size and mtime: changes when images are added,
+ * removed or replaced */
+static uint64_t fd_proto_signature(char **files, int n)
+{
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (int i = 0; i < n; i++) {
+        struct stat st;
+        int64_t meta[2] = { 0, 0 };
+        if (stat(files[i], &st) == 0) {
+            meta[0] = (int64_t)st.st_size;
+            meta[1] = (int64_t)st.st_mtime;
+        }
+        const uint8_t *p = (const uint8_t *)files[i];
+        for (; *p; p++) { h ^= *p; h *= 0x100000001b3ULL; }
+        p = (const uint8_t *)meta;
+        for (size_t k = 0; k < sizeof(meta); k++) { h ^= p[k]; h *= 0x100000001b3ULL; }
+    }
+    return h;
+}
+
+static void fd_proto_cache_close(fd_proto_cache_t *c, const char *unlink_path)
+{
+    if (c->fd >= 0) close(c->fd);
+    c->fd = -1;
+    free(c->index);
+    c->index = NULL;
+    if (unlink_path) unlink(unlink_path);
+}
+
+/* Open the cache for this file list, reusing records written by an earlier
+ * run. Leaves c->fd = -1 if the disk can't hold it. */
+static void fd_proto_cache_open(fd_proto_cache_t *c, const char *path,
+                                int n, uint64_t signature)
+{
+    memset(c, 0, sizeof(*c));
+    c->fd = -1;
+
+    size_t index_bytes = (size_t)n * sizeof(fd_proto_cache_ent_t);
+    uint64_t data_off = (sizeof(fd_proto_cache_hdr_t) + index_bytes + FD_PROTO_PAGE - 1) &
+                        ~(uint64_t)(FD_PROTO_PAGE - 1);
+    uint64_t total = data_off + (uint64_t)n * FD_PROTO_RECORD_BYTES;
+    if (total > 0x7fffffffULL) {
+        fd_log("Proto cache: %d images too many for a cache file, decoding per pass\n", n);
         return;
     }
 
-    /* Total images across all 3 models */
-    int total_images = (n_fail + n_succ) * 3;
+    c->index = (fd_proto_cache_ent_t *)calloc(n, sizeof(fd_proto_cache_ent_t));
+    if (!c->index) return;
+    c->data_off = (off_t)data_off;
 
-    pthread_mutex_lock(&g_proto.mutex);
-    g_proto.progress.state = PROTO_COMPUTE_RUNNING;
-    g_proto.progress.total_images_all = total_images;
-    g_proto.progress.total_images_processed = 0;
-    pthread_mutex_unlock(&g_proto.mutex);
+    c->fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (c->fd < 0) {
+        fd_log("Proto cache: cannot open %s: %s\n", path, strerror(errno));
+        fd_proto_cache_close(c, NULL);
+        return;
+    }
 
-    /* Create output directory */
-    char set_dir[512];
-    snprintf(set_dir, sizeof(set_dir), "%s/%s", FD_PROTO_SETS_DIR, prog.set_name);
-    fd_mkdir_p(set_dir);
+    fd_proto_cache_hdr_t *h = &c->hdr;
+    if (pread(c->fd, h, sizeof(*h), 0) == (ssize_t)sizeof(*h) &&
+        h->magic == FD_PROTO_CACHE_MAGIC && h->version == FD_PROTO_CACHE_VERSION &&
+        h->record_bytes == FD_PROTO_RECORD_BYTES && h->n == (uint32_t)n &&
+        h->signature == signature &&
+        pread(c->fd, c->index, index_bytes, sizeof(*h)) == (ssize_t)index_bytes) {
+        /* Entries past the last sync may describe records that never hit disk */
+        for (int i = 0; i < n; i++) {
+            if ((uint32_t)i >= h->synced) c->index[i].state = FD_PC_EMPTY;
+            if (c->index[i].state == FD_PC_VALID) c->reused++;
+        }
+        fd_log("Proto cache: reusing %s (%d/%d images)\n", path, c->reused, n);
+        return;
+    }
 
-    /* Allocate preprocessing buffer */
-    uint8_t *preproc_buf = (uint8_t *)malloc(FD_MODEL_INPUT_BYTES);
-    if (!preproc_buf) {
-        fd_proto_set_state(PROTO_COMPUTE_ERROR, "malloc failed for preprocess buffer");
-        fd_free_jpeg_list(fail_files, n_fail);
-        fd_free_jpeg_list(succ_files, n_succ);
+    /* New or stale cache: check space, then lay out a sparse file */
+    struct statvfs vfs;
+    char dir[512];
+    snprintf(dir, sizeof(dir), "%s", path);
+    char *slash = strrchr(dir, '/');
+    if (slash) *slash = '\0';
+    if (statvfs(dir, &vfs) != 0 ||
+        (uint64_t)vfs.f_bavail * vfs.f_bsize < total + FD_PROTO_CACHE_RESERVE) {
+        fd_log("Proto cache: not enough space for %lluMB in %s, decoding per pass\n",
+               (unsigned long long)(total >> 20), dir);
+        fd_proto_cache_close(c, path);
         return;
     }
 
-    /* Allocate image hash arrays — computed during first model pass (mi==0)
-     * to avoid forking 1000 md5sum processes which caused OOM on RV1106 */
-    char (*fail_hashes)[17] = (char (*)[17])calloc(n_fail, 17);
-    char (*succ_hashes)[17] = (char (*)[17])calloc(n_succ, 17);
+    memset(h, 0, sizeof(*h));
+    h->magic = FD_PROTO_CACHE_MAGIC;
+    h->version = FD_PROTO_CACHE_VERSION;
+    h->record_bytes = FD_PROTO_RECORD_BYTES;
+    h->n = (uint32_t)n;
+    h->signature = signature;
+    memset(c->index, 0, index_bytes);
+    if (ftruncate(c->fd, 0) != 0 || ftruncate(c->fd, (off_t)total) != 0 ||
+        pwrite(c->fd, h, sizeof(*h), 0) != (ssize_t)sizeof(*h) ||
+        pwrite(c->fd, c->index, index_bytes, sizeof(*h)) != (ssize_t)index_bytes) {
+        fd_log("Proto cache: cannot create %s: %s\n", path, strerror(errno));
+        fd_proto_cache_close(c, path);
+        return;
+    }
+    fd_log("Proto cache: created %s (%lluMB for %d images)\n",
+           path, (unsigned long long)(total >> 20), n);
+}
 
-    /* --- Incremental mode: load existing metadata for hash dedup + running mean --- */
-    int old_n_fail = 0, old_n_succ = 0;
-    int n_old_hashes = 0;
-    char **old_hashes = NULL;       /* existing image hash strings */
-    float *old_protos[3][2];        /* old prototype vectors per model per class */
-    int old_emb_dims[3] = {0};
-    memset(old_protos, 0, sizeof(old_protos));
+/* Flush records and mark index entries below upto as durable */
+static void fd_proto_cache_sync(fd_proto_cache_t *c, int upto)
+{
+    if (c->fd < 0) return;
+    fdatasync(c->fd);
+    if ((uint32_t)upto > c->hdr.synced) {
+        c->hdr.synced = (uint32_t)upto;
+        pwrite(c->fd, &c->hdr, sizeof(c->hdr), 0);
+    }
+}
 
-    if (prog.incremental) {
-        /* Load existing metadata.json for hash list + counts */
-        char meta_path[512];
-        snprintf(meta_path, sizeof(meta_path), "%s/%s/metadata.json",
-                 FD_PROTO_SETS_DIR, prog.set_name);
-        FILE *mf = fopen(meta_path, "r");
-        if (!mf) {
-            fd_err("Proto incremental: no existing metadata at %s, doing full compute\n", meta_path);
-            prog.incremental = 0;
-        } else {
-            fseek(mf, 0, SEEK_END);
-            long msz = ftell(mf);
-            fseek(mf, 0, SEEK_SET);
-            char *mbuf = (char *)malloc(msz + 1);
-            if (mbuf) {
-                fread(mbuf, 1, msz, mf);
-                mbuf[msz] = '\0';
-                fclose(mf);
-                cJSON *mj = cJSON_Parse(mbuf);
-                free(mbuf);
-                if (mj) {
-                    const cJSON *nf = cJSON_GetObjectItemCaseSensitive(mj, "n_failure");
-                    const cJSON *ns = cJSON_GetObjectItemCaseSensitive(mj, "n_success");
-                    if (nf) old_n_fail = nf->valueint;
-                    if (ns) old_n_succ = ns->valueint;
+static void fd_proto_cache_mark(fd_proto_cache_t *c, int i, int state,
+                                const char *hash)
+{
+    if (c->fd < 0) return;
+    fd_proto_cache_ent_t *e = &c->index[i];
+    e->state = (uint8_t)state;
+    if (hash) memcpy(e->hash, hash, sizeof(e->hash));
+    pwrite(c->fd, e, sizeof(*e), sizeof(c->hdr) + (off_t)i * sizeof(*e));
+}
 
-                    /* Load existing hash array */
-                    const cJSON *ih = cJSON_GetObjectItemCaseSensitive(mj, "image_hashes");
-                    if (ih && cJSON_IsArray(ih)) {
-                        n_old_hashes = cJSON_GetArraySize(ih);
-                        old_hashes = (char **)calloc(n_old_hashes, sizeof(char *));
-                        if (old_hashes) {
+static int fd_proto_is_old(const fd_proto_pipe_t *p, const char *hash)
+{
+    if (!hash[0]) return 0;
+    for (int i = 0; i < p->n_old_hashes; i++)
+        if (p->old_hashes[i] && strcmp(hash, p->old_hashes[i]) == 0)
+            return 1;
+    return 0;
+}
+
+/* Read image i: from the cache when possible, else read + hash + decode +
+ * preprocess into buf (and store it in the cache) */
+static void fd_proto_produce(fd_proto_pipe_t *p, int i, fd_proto_item_t *it,
+                             uint8_t *buf)
+{
+    fd_proto_cache_t *c = p->cache;
+    it->tensor = NULL;
+    it->map = NULL;
+
+    if (c->fd >= 0 && c->index[i].state != FD_PC_EMPTY) {
+        if (!p->hashes[i][0])
+            memcpy(p->hashes[i], c->index[i].hash, sizeof(p->hashes[i]));
+        if (c->index[i].state == FD_PC_BAD || fd_proto_is_old(p, p->hashes[i]))
+            return;
+        void *m = mmap(NULL, FD_MODEL_INPUT_BYTES, PROT_READ, MAP_SHARED, c->fd,
+                       c->data_off + (off_t)i * FD_PROTO_RECORD_BYTES);
+        if (m != MAP_FAILED) {
+            it->map = m;
+            it->tensor = (const uint8_t *)m;
+            return;
+        }
+    }
+
+    FILE *f = fopen(p->files[i], "rb");
+    if (!f) return;
+    fseek(f, 0, SEEK_END);
+    long fsize = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    if (fsize <= 0 || fsize > 2 * 1024 * 1024) {
+        fclose(f);
+        fd_proto_cache_mark(c, i, FD_PC_BAD, NULL);
+        return;
+    }
+    uint8_t *jpeg_data = (uint8_t *)malloc(fsize);
+    if (!jpeg_data) { fclose(f); return; }
+    size_t nread = fread(jpeg_data, 1, fsize, f);
+    fclose(f);
+    if (nread != (size_t)fsize) { free(jpeg_data); return; }
+
+    /* Hash image data here instead of forking md5sum per file (OOM on RV1106) */
+    fd_fnv1a_hash(jpeg_data, fsize, p->hashes[i]);
+    if (fd_proto_is_old(p, p->hashes[i])) {
+        free(jpeg_data);
+        return;
+    }
+
+    fd_image_t img = {0};
+    int ret = fd_decode_jpeg(jpeg_data, fsize, &img);
+    free(jpeg_data);
+    if (ret != 0) {
+        fd_proto_cache_mark(c, i, FD_PC_BAD, p->hashes[i]);
+        return;
+    }
+    fd_resize_crop(img.data, img.width, img.height, buf, FD_MODEL_INPUT_WIDTH * 3);
+    free(img.data);
+    p->decoded++;
+
+    if (c->fd >= 0 &&
+        pwrite(c->fd, buf, FD_MODEL_INPUT_BYTES,
+               c->data_off + (off_t)i * FD_PROTO_RECORD_BYTES) == FD_MODEL_INPUT_BYTES)
+        fd_proto_cache_mark(c, i, FD_PC_VALID, p->hashes[i]);
+    it->tensor = buf;
+}
+
+static void *fd_proto_producer(void *arg)
+{
+    fd_proto_pipe_t *p = (fd_proto_pipe_t *)arg;
+
+    for (int i = p->start; i < p->n; i++) {
+        pthread_mutex_lock(&p->mutex);
+        while (p->count == FD_PROTO_RING && !p->stop)
+            pthread_cond_wait(&p->cond, &p->mutex);
+        int stop = p->stop;
+        int pos = (p->head + p->count) % FD_PROTO_RING;
+        pthread_mutex_unlock(&p->mutex);
+        if (stop) break;
+
+        /* Ring slot pos is free: the consumer only touches queued slots */
+        fd_proto_item_t it;
+        fd_proto_produce(p, i, &it, p->bufs[pos]);
+
+        pthread_mutex_lock(&p->mutex);
+        p->items[pos] = it;
+        p->count++;
+        pthread_cond_broadcast(&p->cond);
+        pthread_mutex_unlock(&p->mutex);
+    }
+    return NULL;
+}
+
+static int fd_proto_pipe_start(fd_proto_pipe_t *p, int start)
+{
+    p->start = start;
+    p->head = p->count = 0;
+    p->stop = 0;
+    p->decoded = 0;
+    pthread_mutex_init(&p->mutex, NULL);
+    pthread_cond_init(&p->cond, NULL);
+    for (int k = 0; k < FD_PROTO_RING; k++) {
+        p->bufs[k] = (uint8_t *)malloc(FD_MODEL_INPUT_BYTES);
+        if (!p->bufs[k]) goto fail;
+    }
+    if (pthread_create(&p->thread, NULL, fd_proto_producer, p) != 0)
+        goto fail;
+    return 0;
+
+fail:
+    for (int k = 0; k < FD_PROTO_RING; k++) {
+        free(p->bufs[k]);
+        p->bufs[k] = NULL;
+    }
+    pthread_cond_destroy(&p->cond);
+    pthread_mutex_destroy(&p->mutex);
+    return -1;
+}
+
+/* Next image in order; NULL once the pipe is stopped */
+static const fd_proto_item_t *fd_proto_pipe_next(fd_proto_pipe_t *p)
+{
+    pthread_mutex_lock(&p->mutex);
+    while (p->count == 0 && !p->stop)
+        pthread_cond_wait(&p->cond, &p->mutex);
+    const fd_proto_item_t *it = p->count > 0 ? &p->items[p->head] : NULL;
+    pthread_mutex_unlock(&p->mutex);
+    return it;
+}
+
+static void fd_proto_pipe_pop(fd_proto_pipe_t *p)
+{
+    pthread_mutex_lock(&p->mutex);
+    fd_proto_item_t *it = &p->items[p->head];
+    if (it->map) munmap(it->map, FD_MODEL_INPUT_BYTES);
+    it->map = NULL;
+    p->head = (p->head + 1) % FD_PROTO_RING;
+    p->count--;
+    pthread_cond_broadcast(&p->cond);
+    pthread_mutex_unlock(&p->mutex);
+}
+
+static void fd_proto_pipe_stop(fd_proto_pipe_t *p)
+{
+    pthread_mutex_lock(&p->mutex);
+    p->stop = 1;
+    pthread_cond_broadcast(&p->cond);
+    pthread_mutex_unlock(&p->mutex);
+    pthread_join(p->thread, NULL);
+
+    while (p->count > 0)
+        fd_proto_pipe_pop(p);
+    for (int k = 0; k < FD_PROTO_RING; k++) {
+        free(p->bufs[k]);
+        p->bufs[k] = NULL;
+    }
+    pthread_cond_destroy(&p->cond);
+    pthread_mutex_destroy(&p->mutex);
+}
+
+/* Atomically replace the checkpoint (tmp + fsync + rename) */
+static void fd_proto_ckpt_save(const char *set_dir, const fd_proto_ckpt_t *ck,
+                               float *const accum[2])
+{
+    char path[512], tmp[520];
+    snprintf(path, sizeof(path), "%s/%s", set_dir, FD_PROTO_CKPT_FILE);
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+
+    FILE *f = fopen(tmp, "wb");
+    if (!f) return;
+    int ok = fwrite(ck, sizeof(*ck), 1, f) == 1;
+    for (int ci = 0; ci < 2 && ok && ck->emb_dim > 0; ci++)
+        ok = fwrite(accum[ci], sizeof(float), ck->emb_dim, f) == (size_t)ck->emb_dim;
+    ok = ok && fflush(f) == 0 && fsync(fileno(f)) == 0;
+    fclose(f);
+    if (ok) rename(tmp, path);
+    else unlink(tmp);
+}
+
+/* Load a checkpoint matching this run. *accum gets 2*emb_dim floats
+ * (malloc'd, may be NULL if the run was between models). */
+static int fd_proto_ckpt_load(const char *set_dir, fd_proto_ckpt_t *ck,
+                              const char *dataset, int incremental,
+                              uint64_t signature, float **accum)
+{
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", set_dir, FD_PROTO_CKPT_FILE);
+    *accum = NULL;
+
+    FILE *f = fopen(path, "rb");
+    if (!f) return -1;
+    int ok = fread(ck, sizeof(*ck), 1, f) == 1 &&
+             ck->magic == FD_PROTO_CKPT_MAGIC && ck->version == FD_PROTO_CKPT_VERSION &&
+             ck->signature == signature && ck->incremental == incremental &&
+             strncmp(ck->dataset, dataset, sizeof(ck->dataset)) == 0 &&
+             ck->model >= 0 && ck->model <= 3 && ck->next_image >= 0 &&
+             ck->emb_dim >= 0 && ck->emb_dim <= FD_SPATIAL_EMB_MAX;
+    if (ok && ck->emb_dim > 0) {
+        *accum = (float *)malloc(2 * ck->emb_dim * sizeof(float));
+        ok = *accum && fread(*accum, sizeof(float), 2 * ck->emb_dim, f) ==
+                       (size_t)(2 * ck->emb_dim);
+    }
+    fclose(f);
+    if (!ok) {
+        free(*accum);
+        *accum = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+/* Hash images the producer never read this run (resumed past them) */
+static void fd_proto_fill_hashes(char **files, char (*hashes)[17], int n)
+{
+    for (int i = 0; i < n; i++) {
+        if (hashes[i][0]) continue;
+        FILE *f = fopen(files[i], "rb");
+        if (!f) continue;
+        fseek(f, 0, SEEK_END);
+        long fsize = ftell(f);
+        fseek(f, 0, SEEK_SET);
+        uint8_t *data = (fsize > 0 && fsize <= 2 * 1024 * 1024) ?
+                        (uint8_t *)malloc(fsize) : NULL;
+        if (data && fread(data, 1, fsize, f) == (size_t)fsize)
+            fd_fnv1a_hash(data, fsize, hashes[i]);
+        free(data);
+        fclose(f);
+    }
+}
+
+/* Core prototype computation — runs in FD thread context.
+ * Pauses normal FD inference during computation. */
+static void fd_do_proto_computation(void)
+{
+    pthread_mutex_lock(&g_proto.mutex);
+    fd_proto_compute_progress_t prog = g_proto.progress;
+    pthread_mutex_unlock(&g_proto.mutex);
+
+    fd_log("Proto compute: dataset=%s set=%s incremental=%d\n",
+           prog.dataset_name, prog.set_name, prog.incremental);
+
+    /* Validate dataset */
+    char fail_dir[512], succ_dir[512];
+    snprintf(fail_dir, sizeof(fail_dir), "%s/%s/failure", FD_DATASETS_DIR, prog.dataset_name);
+    snprintf(succ_dir, sizeof(succ_dir), "%s/%s/success", FD_DATASETS_DIR, prog.dataset_name);
+
+    int n_fail, n_succ;
+    char **fail_files = fd_collect_jpegs(fail_dir, &n_fail);
+    char **succ_files = fd_collect_jpegs(succ_dir, &n_succ);
+
+    if (n_fail == 0 || n_succ == 0) {
+        fd_err("Proto compute: empty dataset (fail=%d succ=%d)\n", n_fail, n_succ);
+        fd_proto_set_state(PROTO_COMPUTE_ERROR, "Dataset has no images in failure/ or success/");
+        fd_free_jpeg_list(fail_files, n_fail);
+        fd_free_jpeg_list(succ_files, n_succ);
+        return;
+    }
+
+    /* One image list across both classes: failure first, then success */
+    int n_images = n_fail + n_succ;
+    char **all_files = (char **)malloc(n_images * sizeof(char *));
+    /* Image hashes — filled by the decode pipeline (no md5sum forks, which
+     * caused OOM on RV1106) */
+    char (*all_hashes)[17] = (char (*)[17])calloc(n_images, 17);
+    if (!all_files || !all_hashes) {
+        fd_proto_set_state(PROTO_COMPUTE_ERROR, "malloc failed for image list");
+        free(all_files);
+        free(all_hashes);
+        fd_free_jpeg_list(fail_files, n_fail);
+        fd_free_jpeg_list(succ_files, n_succ);
+        return;
+    }
+    memcpy(all_files, fail_files, n_fail * sizeof(char *));
+    memcpy(all_files + n_fail, succ_files, n_succ * sizeof(char *));
+    char (*fail_hashes)[17] = all_hashes;
+    char (*succ_hashes)[17] = all_hashes + n_fail;
+
+    /* Total images across all 3 models */
+    int total_images = n_images * 3;
+
+    /* Create output directory */
+    char set_dir[512];
+    snprintf(set_dir, sizeof(set_dir), "%s/%s", FD_PROTO_SETS_DIR, prog.set_name);
+    fd_mkdir_p(set_dir);
+
+    /* --- Incremental mode: load existing metadata for hash dedup + running mean --- */
+    int old_n_fail = 0, old_n_succ = 0;
+    int n_old_hashes = 0;
+    char **old_hashes = NULL;       /* existing image hash strings */
+    float *old_protos[3][2];        /* old prototype vectors per model per class */
+    int old_emb_dims[3] = {0};
+    memset(old_protos, 0, sizeof(old_protos));
+
+    if (prog.incremental) {
+        /* Load existing metadata.json for hash list + counts */
+        char meta_path[512];
+        snprintf(meta_path, sizeof(meta_path), "%s/%s/metadata.json",
+                 FD_PROTO_SETS_DIR, prog.set_name);
+        FILE *mf = fopen(meta_path, "r");
+        if (!mf) {
+            fd_err("Proto incremental: no existing metadata at %s, doing full compute\n", meta_path);
+            prog.incremental = 0;
+        } else {
+            fseek(mf, 0, SEEK_END);
+            long msz = ftell(mf);
+            fseek(mf, 0, SEEK_SET);
+            char *mbuf = (char *)malloc(msz + 1);
+            if (mbuf) {
+                fread(mbuf, 1, msz, mf);
+                mbuf[msz] = '\0';
+                fclose(mf);
+                cJSON *mj = cJSON_Parse(mbuf);
+                free(mbuf);
+                if (mj) {
+                    const cJSON *nf = cJSON_GetObjectItemCaseSensitive(mj, "n_failure");
+                    const cJSON *ns = cJSON_GetObjectItemCaseSensitive(mj, "n_success");
+                    if (nf) old_n_fail = nf->valueint;
+                    if (ns) old_n_succ = ns->valueint;
+
+                    /* Load existing hash array */
+                    const cJSON *ih = cJSON_GetObjectItemCaseSensitive(mj, "image_hashes");
+                    if (ih && cJSON_IsArray(ih)) {
+                        n_old_hashes = cJSON_GetArraySize(ih);
+                        old_hashes = (char **)calloc(n_old_hashes, sizeof(char *));
+                        if (old_hashes) {
                             int idx = 0;
                             const cJSON *h;
                             cJSON_ArrayForEach(h, ih) {
@@ -3258,7 +4901,6 @@ static void fd_do_proto_computation(void)
                     fd_log("Proto incremental: existing set has %d fail + %d succ, %d hashes\n",
                            old_n_fail, old_n_succ, n_old_hashes);
                 } else {
-                    fclose(mf);
                     prog.incremental = 0;
                 }
             } else {
@@ -3304,8 +4946,52 @@ static void fd_do_proto_computation(void)
         }
     }
 
-    /* Build skip-set from old hashes for O(1) lookup (simple linear scan is fine
-     * for <2000 hashes — avoids hash table complexity on embedded target) */
+    /* Resume from a checkpoint left by a cancelled or interrupted run of
+     * the same dataset into the same set */
+    uint64_t signature = fd_proto_signature(all_files, n_images);
+    fd_proto_ckpt_t ck;
+    float *ck_accum = NULL;
+    int resumed = 0;
+    if (fd_proto_ckpt_load(set_dir, &ck, prog.dataset_name, prog.incremental,
+                           signature, &ck_accum) == 0) {
+        resumed = ck.model * n_images + (ck.model < 3 ? ck.next_image : 0);
+        fd_log("Proto compute: resuming at model %d image %d/%d\n",
+               ck.model, ck.next_image, n_images);
+    } else {
+        memset(&ck, 0, sizeof(ck));
+        ck.magic = FD_PROTO_CKPT_MAGIC;
+        ck.version = FD_PROTO_CKPT_VERSION;
+        ck.signature = signature;
+        snprintf(ck.dataset, sizeof(ck.dataset), "%s", prog.dataset_name);
+        ck.incremental = prog.incremental;
+    }
+
+    pthread_mutex_lock(&g_proto.mutex);
+    g_proto.progress.state = PROTO_COMPUTE_RUNNING;
+    g_proto.progress.total_images_all = total_images;
+    g_proto.progress.total_images_processed = resumed;
+    g_proto.progress.resumed_images = resumed;
+    for (int mi = 0; mi < ck.model && mi < 3; mi++) {
+        g_proto.progress.cos_sim[mi] = ck.cos_sim[mi];
+        g_proto.progress.margin[mi] = ck.margin[mi];
+    }
+    pthread_mutex_unlock(&g_proto.mutex);
+
+    /* Decode-once tensor cache, kept next to the dataset */
+    char cache_path[512];
+    snprintf(cache_path, sizeof(cache_path), "%s/%s/%s",
+             FD_DATASETS_DIR, prog.dataset_name, FD_PROTO_CACHE_FILE);
+    fd_proto_cache_t cache;
+    fd_proto_cache_open(&cache, cache_path, n_images, signature);
+
+    fd_proto_pipe_t pipe = {
+        .files = all_files,
+        .n = n_images,
+        .hashes = all_hashes,
+        .cache = &cache,
+        .old_hashes = prog.incremental ? old_hashes : NULL,
+        .n_old_hashes = prog.incremental ? n_old_hashes : 0,
+    };
 
     /* Get current model set name for path resolution */
     pthread_mutex_lock(&g_fd.config_mutex);
@@ -3317,17 +5003,17 @@ static void fd_do_proto_computation(void)
     struct timeval tv_start;
     gettimeofday(&tv_start, NULL);
 
-    char encoder_hashes[3][33];
-    memset(encoder_hashes, 0, sizeof(encoder_hashes));
     int all_ok = 1;
-    int final_new_counts[2] = {0, 0};  /* new images across all models (set by mi==0) */
+    int decoded_total = 0;
 
     /* Process each of 3 models */
-    for (int mi = 0; mi < 3 && all_ok && !g_proto.cancel; mi++) {
+    for (int mi = ck.model; mi < 3 && all_ok && !g_proto.cancel; mi++) {
         char model_path[512];
         snprintf(model_path, sizeof(model_path), "%s/%s/%s",
                  g_fd.models_base_dir, set_name, g_proto_model_files[mi]);
 
+        fd_proto_set_state(PROTO_COMPUTE_RUNNING, NULL);
+
         /* Check if model exists */
         if (access(model_path, R_OK) != 0) {
             fd_log("Proto compute: model %s not found, skipping\n", g_proto_model_names[mi]);
@@ -3335,13 +5021,18 @@ static void fd_do_proto_computation(void)
             pthread_mutex_lock(&g_proto.mutex);
             g_proto.progress.cos_sim[mi] = 0;
             g_proto.progress.margin[mi] = 0;
-            g_proto.progress.total_images_processed += (n_fail + n_succ);
+            g_proto.progress.total_images_processed += n_images - ck.next_image;
             pthread_mutex_unlock(&g_proto.mutex);
+            ck.cos_sim[mi] = ck.margin[mi] = 0;
+            ck.model = mi + 1;
+            ck.next_image = 0;
+            ck.emb_dim = 0;
+            fd_proto_ckpt_save(set_dir, &ck, NULL);
             continue;
         }
 
         /* Compute MD5 of encoder model */
-        fd_md5_file(model_path, encoder_hashes[mi]);
+        fd_md5_file(model_path, ck.encoder_hashes[mi]);
 
         /* Load RKNN model */
         fd_rknn_model_t model;
@@ -3401,77 +5092,59 @@ static void fd_do_proto_computation(void)
             all_ok = 0;
             break;
         }
-        int new_counts[2] = {0, 0};  /* count of NEW images processed per class */
-
-        /* Process both classes */
-        char **class_files[2] = { fail_files, succ_files };
-        int class_counts[2] = { n_fail, n_succ };
-
-        for (int ci = 0; ci < 2 && !g_proto.cancel; ci++) {
-            pthread_mutex_lock(&g_proto.mutex);
-            g_proto.progress.current_model = mi;
-            g_proto.progress.model_name = g_proto_model_names[mi];
-            g_proto.progress.current_class = ci;
-            g_proto.progress.images_processed = 0;
-            g_proto.progress.images_total = class_counts[ci];
-            pthread_mutex_unlock(&g_proto.mutex);
 
-            for (int fi = 0; fi < class_counts[ci] && !g_proto.cancel; fi++) {
-                /* Load and preprocess image */
-                FILE *f = fopen(class_files[ci][fi], "rb");
-                if (!f) continue;
-                fseek(f, 0, SEEK_END);
-                long fsize = ftell(f);
-                fseek(f, 0, SEEK_SET);
-                if (fsize <= 0 || fsize > 2 * 1024 * 1024) { fclose(f); continue; }
-
-                uint8_t *jpeg_data = (uint8_t *)malloc(fsize);
-                if (!jpeg_data) { fclose(f); continue; }
-                fread(jpeg_data, 1, fsize, f);
-                fclose(f);
-
-                /* Hash image data during first model pass (no fork/popen) */
-                if (mi == 0) {
-                    char (*hashes)[17] = ci == 0 ? fail_hashes : succ_hashes;
-                    if (hashes)
-                        fd_fnv1a_hash(jpeg_data, fsize, hashes[fi]);
-                }
-
-                /* Incremental: skip images whose hash is in the existing set */
-                if (prog.incremental && old_hashes && n_old_hashes > 0) {
-                    char (*hashes)[17] = ci == 0 ? fail_hashes : succ_hashes;
-                    if (hashes && hashes[fi][0]) {
-                        int found = 0;
-                        for (int hi = 0; hi < n_old_hashes && !found; hi++) {
-                            if (old_hashes[hi] && strcmp(hashes[fi], old_hashes[hi]) == 0)
-                                found = 1;
-                        }
-                        if (found) {
-                            free(jpeg_data);
-                            pthread_mutex_lock(&g_proto.mutex);
-                            g_proto.progress.images_processed = fi + 1;
-                            g_proto.progress.total_images_processed++;
-                            pthread_mutex_unlock(&g_proto.mutex);
-                            continue;  /* skip — already in prototype */
-                        }
-                    }
-                }
+        /* Pick up a partially accumulated model from the checkpoint */
+        int start = 0;
+        if (ck_accum && ck.model == mi && ck.emb_dim == emb_dim && ck.next_image < n_images) {
+            memcpy(proto_accum[0], ck_accum, emb_dim * sizeof(float));
+            memcpy(proto_accum[1], ck_accum + emb_dim, emb_dim * sizeof(float));
+            start = ck.next_image;
+        } else {
+            ck.new_counts[0] = ck.new_counts[1] = 0;
+            if (ck.model == mi && ck.next_image > 0) {
+                /* Output shape changed since the checkpoint: redo this model */
+                resumed -= ck.next_image;
+                pthread_mutex_lock(&g_proto.mutex);
+                g_proto.progress.total_images_processed -= ck.next_image;
+                g_proto.progress.resumed_images = resumed;
+                pthread_mutex_unlock(&g_proto.mutex);
+            }
+        }
+        free(ck_accum);
+        ck_accum = NULL;
+        ck.model = mi;
+        ck.next_image = start;
+        ck.emb_dim = emb_dim;
+        int *new_counts = ck.new_counts;  /* count of NEW images processed per class */
+
+        if (fd_proto_pipe_start(&pipe, start) != 0) {
+            free(out_buf);
+            free(proto_accum[0]); free(proto_accum[1]);
+            fd_model_release(&model);
+            fd_proto_set_state(PROTO_COMPUTE_ERROR, "cannot start decode pipeline");
+            all_ok = 0;
+            break;
+        }
 
-                fd_image_t img = {0};
-                if (fd_decode_jpeg(jpeg_data, fsize, &img) != 0) {
-                    free(jpeg_data);
-                    continue;
-                }
-                free(jpeg_data);
+        int since_ckpt = 0;
+        for (int gi = start; gi < n_images && !g_proto.cancel; gi++) {
+            int ci = gi < n_fail ? 0 : 1;
+            int fi = ci == 0 ? gi : gi - n_fail;
 
-                fd_resize_crop(img.data, img.width, img.height, preproc_buf);
-                free(img.data);
+            if (gi == start || gi == n_fail) {
+                pthread_mutex_lock(&g_proto.mutex);
+                g_proto.progress.current_model = mi;
+                g_proto.progress.model_name = g_proto_model_names[mi];
+                g_proto.progress.current_class = ci;
+                g_proto.progress.images_total = ci == 0 ? n_fail : n_succ;
+                pthread_mutex_unlock(&g_proto.mutex);
+            }
 
-                /* Run inference */
-                ret = fd_model_run(&model, preproc_buf, FD_MODEL_INPUT_BYTES);
-                if (ret != 0) continue;
+            const fd_proto_item_t *it = fd_proto_pipe_next(&pipe);
+            if (!it) break;
 
-                /* Get output */
+            /* Run inference; the producer is already decoding the next image */
+            if (it->tensor && fd_model_run(&model, it->tensor) == 0) {
                 if (is_spatial) {
                     fd_model_get_output_nhwc(&model, 0, out_buf, out_h, out_w, out_c);
                     /* Apply GAP: average over H*W spatial positions */
@@ -3487,29 +5160,47 @@ static void fd_do_proto_computation(void)
                         proto_accum[ci][c] += out_buf[c];
                 }
                 new_counts[ci]++;
+            }
+            fd_proto_pipe_pop(&pipe);
+            ck.next_image = gi + 1;
 
-                /* Update progress */
-                pthread_mutex_lock(&g_proto.mutex);
-                g_proto.progress.images_processed = fi + 1;
-                g_proto.progress.total_images_processed++;
-
-                /* Update ETA */
-                struct timeval tv_now;
-                gettimeofday(&tv_now, NULL);
-                int elapsed = (int)(tv_now.tv_sec - tv_start.tv_sec);
-                g_proto.progress.elapsed_s = elapsed;
-                if (g_proto.progress.total_images_processed > 0) {
-                    float rate = (float)g_proto.progress.total_images_processed / (float)(elapsed > 0 ? elapsed : 1);
-                    g_proto.progress.estimated_total_s = (int)(total_images / rate);
-                }
-                pthread_mutex_unlock(&g_proto.mutex);
+            /* Update progress */
+            pthread_mutex_lock(&g_proto.mutex);
+            g_proto.progress.images_processed = fi + 1;
+            g_proto.progress.total_images_processed++;
+
+            /* Update rate and ETA (images done before a resume don't count) */
+            struct timeval tv_now;
+            gettimeofday(&tv_now, NULL);
+            double elapsed = (tv_now.tv_sec - tv_start.tv_sec) +
+                             (tv_now.tv_usec - tv_start.tv_usec) / 1e6;
+            int done = g_proto.progress.total_images_processed - resumed;
+            g_proto.progress.elapsed_s = (int)elapsed;
+            if (done > 0 && elapsed > 0.0) {
+                float rate = (float)(done / elapsed);
+                g_proto.progress.images_per_s = rate;
+                g_proto.progress.estimated_total_s = (int)(elapsed +
+                    (total_images - g_proto.progress.total_images_processed) / rate);
+            }
+            pthread_mutex_unlock(&g_proto.mutex);
 
-                /* Yield to let kernel reclaim pages after each image cycle */
-                usleep(1000);
+            if (++since_ckpt >= FD_PROTO_CKPT_EVERY) {
+                fd_proto_cache_sync(&cache, ck.next_image);
+                fd_proto_ckpt_save(set_dir, &ck, proto_accum);
+                since_ckpt = 0;
             }
         }
 
+        fd_proto_pipe_stop(&pipe);
+        decoded_total += pipe.decoded;
+        pthread_mutex_lock(&g_proto.mutex);
+        g_proto.progress.jpeg_decodes = decoded_total;
+        pthread_mutex_unlock(&g_proto.mutex);
+
         if (g_proto.cancel) {
+            /* Keep what we have so the next run resumes from here */
+            fd_proto_cache_sync(&cache, ck.next_image);
+            fd_proto_ckpt_save(set_dir, &ck, proto_accum);
             free(out_buf);
             free(proto_accum[0]); free(proto_accum[1]);
             fd_model_release(&model);
@@ -3564,15 +5255,15 @@ static void fd_do_proto_computation(void)
 
         /* Save new image counts from first model pass for metadata */
         if (mi == 0) {
-            final_new_counts[0] = new_counts[0];
-            final_new_counts[1] = new_counts[1];
+            ck.final_new_counts[0] = new_counts[0];
+            ck.final_new_counts[1] = new_counts[1];
         }
 
-        /* Save prototype binary */
+        /* Stage prototype binary as .new — published once every model is done */
         fd_proto_set_state(PROTO_COMPUTE_SAVING, NULL);
 
         char proto_path[512];
-        snprintf(proto_path, sizeof(proto_path), "%s/%s",
+        snprintf(proto_path, sizeof(proto_path), "%s/%s.new",
                  set_dir, g_proto_output_files[mi]);
 
         FILE *pf = fopen(proto_path, "wb");
@@ -3586,6 +5277,8 @@ static void fd_do_proto_computation(void)
             /* Write fail then success prototype */
             fwrite(proto_accum[0], sizeof(float), emb_dim, pf);
             fwrite(proto_accum[1], sizeof(float), emb_dim, pf);
+            fflush(pf);
+            fsync(fileno(pf));
             fclose(pf);
             fd_log("Proto compute: saved %s (%d floats/class)\n",
                    proto_path, emb_dim);
@@ -3593,6 +5286,14 @@ static void fd_do_proto_computation(void)
             fd_err("Proto compute: cannot write %s\n", proto_path);
         }
 
+        ck.cos_sim[mi] = cos_sim;
+        ck.margin[mi] = margin;
+        ck.model = mi + 1;
+        ck.next_image = 0;
+        ck.emb_dim = 0;
+        fd_proto_cache_sync(&cache, n_images);
+        fd_proto_ckpt_save(set_dir, &ck, NULL);
+
         free(out_buf);
         free(proto_accum[0]);
         free(proto_accum[1]);
@@ -3603,7 +5304,7 @@ static void fd_do_proto_computation(void)
         usleep(500000);
     }
 
-    free(preproc_buf);
+    free(ck_accum);
 
     if (g_proto.cancel) {
         fd_proto_set_state(PROTO_COMPUTE_CANCELLED, "Cancelled by user");
@@ -3611,17 +5312,19 @@ static void fd_do_proto_computation(void)
     }
 
     if (!all_ok) {
-        goto cleanup_no_meta;
+        goto cleanup;
     }
 
     /* Skip past cleanup labels */
     goto write_meta;
 
 cleanup:
-cleanup_no_meta:
+    /* Checkpoint and decode cache stay on disk for the next attempt */
+    fd_proto_cache_close(&cache, NULL);
+    free(all_files);
+    free(all_hashes);
     fd_free_jpeg_list(fail_files, n_fail);
     fd_free_jpeg_list(succ_files, n_succ);
-    free(fail_hashes); free(succ_hashes);
     for (int i = 0; i < n_old_hashes; i++) free(old_hashes[i]);
     free(old_hashes);
     for (int mi2 = 0; mi2 < 3; mi2++)
@@ -3631,9 +5334,21 @@ cleanup_no_meta:
 write_meta:
     ;
 
+    /* Publish the staged prototypes */
+    for (int mi = 0; mi < 3; mi++) {
+        char staged[520], final_path[512];
+        snprintf(final_path, sizeof(final_path), "%s/%s", set_dir, g_proto_output_files[mi]);
+        snprintf(staged, sizeof(staged), "%s.new", final_path);
+        if (access(staged, F_OK) == 0 && rename(staged, final_path) != 0)
+            fd_err("Proto compute: cannot publish %s: %s\n", final_path, strerror(errno));
+    }
+
+    /* Images resumed past were never read this run */
+    fd_proto_fill_hashes(all_files, all_hashes, n_images);
+
     /* Write metadata.json — use merged counts for incremental */
-    int meta_n_fail = prog.incremental ? (old_n_fail + final_new_counts[0]) : n_fail;
-    int meta_n_succ = prog.incremental ? (old_n_succ + final_new_counts[1]) : n_succ;
+    int meta_n_fail = prog.incremental ? (old_n_fail + ck.final_new_counts[0]) : n_fail;
+    int meta_n_succ = prog.incremental ? (old_n_succ + ck.final_new_counts[1]) : n_succ;
 
     cJSON *meta = cJSON_CreateObject();
     cJSON_AddStringToObject(meta, "name", prog.set_name);
@@ -3650,9 +5365,9 @@ write_meta:
 
     /* Encoder hashes */
     cJSON *hashes = cJSON_CreateObject();
-    cJSON_AddStringToObject(hashes, "classification", encoder_hashes[0]);
-    cJSON_AddStringToObject(hashes, "spatial_fine", encoder_hashes[1]);
-    cJSON_AddStringToObject(hashes, "spatial_coarse", encoder_hashes[2]);
+    cJSON_AddStringToObject(hashes, "classification", ck.encoder_hashes[0]);
+    cJSON_AddStringToObject(hashes, "spatial_fine", ck.encoder_hashes[1]);
+    cJSON_AddStringToObject(hashes, "spatial_coarse", ck.encoder_hashes[2]);
     cJSON_AddItemToObject(meta, "encoder_hashes", hashes);
 
     /* Metrics */
@@ -3712,10 +5427,18 @@ write_meta:
     }
     cJSON_Delete(meta);
 
+    /* Set is complete: drop the checkpoint. The decode cache stays with the
+     * dataset, so the next computation from it (into any set) decodes
+     * nothing until images are added, removed or replaced. */
+    char ckpt_path[512];
+    snprintf(ckpt_path, sizeof(ckpt_path), "%s/%s", set_dir, FD_PROTO_CKPT_FILE);
+    unlink(ckpt_path);
+    fd_proto_cache_close(&cache, NULL);
+
+    free(all_files);
+    free(all_hashes);
     fd_free_jpeg_list(fail_files, n_fail);
     fd_free_jpeg_list(succ_files, n_succ);
-    free(fail_hashes);
-    free(succ_hashes);
     /* Free incremental state */
     for (int i = 0; i < n_old_hashes; i++) free(old_hashes[i]);
     free(old_hashes);
@@ -3729,10 +5452,13 @@ write_meta:
     pthread_mutex_lock(&g_proto.mutex);
     g_proto.progress.state = PROTO_COMPUTE_DONE;
     g_proto.progress.elapsed_s = total_elapsed;
+    float ips = g_proto.progress.images_per_s;
     pthread_mutex_unlock(&g_proto.mutex);
 
-    fd_log("Proto compute: DONE in %ds. Classification margin=%.3f\n",
-           total_elapsed, g_proto.progress.margin[0]);
+    fd_log("Proto compute: DONE in %ds (%.2f images/s, %d JPEG decodes for %d images%s). "
+           "Classification margin=%.3f\n",
+           total_elapsed, ips, decoded_total, n_images,
+           resumed ? ", resumed" : "", g_proto.progress.margin[0]);
 }
 
 /* ============================================================================
@@ -4067,180 +5793,975 @@ int fault_detect_delete_proto_set(const char *set_name)
  * Prototype Management — Dataset Download
  * ============================================================================ */
 
-/* Resolve dataset URL: if URL points to a .json metadata file, fetch it and
- * extract the actual download URL and dataset name from it.
- * Returns 0 on success (url/name updated), -1 on error, 1 if not a metadata URL. */
-static int fd_resolve_dataset_metadata(char *url, size_t url_sz, char *name, size_t name_sz)
+/* Datasets are streamed end to end: HTTP(S) body -> gzip -dc child ->
+ * in-process tar parser -> files on disk, each FNV-1a hashed on the way.
+ * Nothing is staged in /tmp (RAM on the printer) and memory is a few fixed
+ * buffers whatever the archive size. A connection lost mid-body resumes
+ * with an HTTP Range request at the first byte gzip has not consumed. */
+
+#define FD_DL_BUF_SIZE      32768   /* socket / gunzip chunk */
+#define FD_DL_URL_MAX       1024    /* signed CDN redirect URLs are long */
+#define FD_DL_HDR_MAX       16384   /* response header block */
+#define FD_DL_TIMEOUT_S     30      /* connect / read / gzip stall timeout */
+#define FD_DL_MAX_RETRIES   8       /* consecutive attempts without progress */
+#define FD_DL_MAX_REDIRECTS 5
+#define FD_DL_META_MAX      8192    /* dataset metadata JSON */
+#define FD_DL_MANIFEST      ".fnv1a"  /* "<hash>  <path>" per extracted file */
+
+static void fd_dl_report(long long done, long long total, int retry)
 {
-    /* Only resolve if URL ends with .json */
-    size_t len = strlen(url);
-    if (len < 6 || strcmp(url + len - 5, ".json") != 0)
-        return 1;  /* not metadata, use URL directly */
+    pthread_mutex_lock(&g_proto.dl_mutex);
+    g_proto.dl_progress.downloaded_bytes = (size_t)done;
+    if (total > 0) {
+        g_proto.dl_progress.total_bytes = (size_t)total;
+        g_proto.dl_progress.progress_pct = (int)(done * 100 / total);
+    }
+    g_proto.dl_progress.retries += retry;
+    pthread_mutex_unlock(&g_proto.dl_mutex);
+}
 
-    fd_log("Download: fetching metadata from %s\n", url);
+/* ---- HTTP(S) client ---- */
 
-    char tmp_meta[] = "/tmp/fd_dataset_meta.json";
-    char cmd[600];
-    snprintf(cmd, sizeof(cmd), "wget -q -O '%s' '%s' 2>&1", tmp_meta, url);
-    int ret = system(cmd);
-    if (ret != 0) {
-        fd_log("Download: metadata fetch failed (exit %d)\n", WEXITSTATUS(ret));
-        unlink(tmp_meta);
+typedef struct {
+    int fd;
+#ifdef HAVE_OPENSSL
+    SSL_CTX *ssl_ctx;
+    SSL *ssl;
+#endif
+    uint8_t buf[FD_DL_BUF_SIZE];   /* read-ahead for header and chunk lines */
+    size_t pos, len;
+
+    int status;
+    long long content_length;      /* -1 = not sent */
+    long long range_start;         /* Content-Range start, -1 = not sent */
+    long long range_total;         /* Content-Range total, -1 = unknown */
+    int chunked;
+    char location[FD_DL_URL_MAX];
+
+    long long body_left;           /* Content-Length left, -1 = until close */
+    long long chunk_left;          /* current chunk left, -1 = size line next */
+    int body_done;
+} fd_http_t;
+
+/* Split http[s]://host[:port][/path]. Returns 0, or -1 if unsupported. */
+static int fd_url_split(const char *url, int *tls, char *host, size_t host_sz,
+                        int *port, char *path, size_t path_sz)
+{
+    const char *p;
+    if (strncmp(url, "http://", 7) == 0) {
+        *tls = 0; *port = 80; p = url + 7;
+    } else if (strncmp(url, "https://", 8) == 0) {
+        *tls = 1; *port = 443; p = url + 8;
+    } else {
         return -1;
     }
 
-    /* Read and parse JSON */
-    FILE *f = fopen(tmp_meta, "r");
-    if (!f) { unlink(tmp_meta); return -1; }
-
-    fseek(f, 0, SEEK_END);
-    long fsize = ftell(f);
-    fseek(f, 0, SEEK_SET);
-    if (fsize <= 0 || fsize > 8192) { fclose(f); unlink(tmp_meta); return -1; }
-
-    char *buf = malloc(fsize + 1);
-    if (!buf) { fclose(f); unlink(tmp_meta); return -1; }
-    fread(buf, 1, fsize, f);
-    buf[fsize] = '\0';
-    fclose(f);
-    unlink(tmp_meta);
-
-    cJSON *root = cJSON_Parse(buf);
-    free(buf);
-    if (!root) {
-        fd_log("Download: metadata JSON parse failed\n");
+    size_t hl = strcspn(p, ":/?");
+    if (hl == 0 || hl >= host_sz)
         return -1;
+    memcpy(host, p, hl);
+    host[hl] = '\0';
+    p += hl;
+    if (*p == ':') {
+        *port = atoi(p + 1);
+        p += 1 + strspn(p + 1, "0123456789");
+        if (*port <= 0 || *port > 65535)
+            return -1;
     }
+    if ((size_t)snprintf(path, path_sz, "%s%s", *p == '/' ? "" : "/", p) >= path_sz)
+        return -1;
+    return 0;
+}
 
-    cJSON *ds = cJSON_GetObjectItemCaseSensitive(root, "prototype_dataset");
-    if (!ds) { cJSON_Delete(root); return -1; }
+static void fd_http_close(fd_http_t *h)
+{
+#ifdef HAVE_OPENSSL
+    if (h->ssl) {
+        SSL_free(h->ssl);
+        h->ssl = NULL;
+    }
+    if (h->ssl_ctx) {
+        SSL_CTX_free(h->ssl_ctx);
+        h->ssl_ctx = NULL;
+    }
+#endif
+    if (h->fd >= 0) {
+        close(h->fd);
+        h->fd = -1;
+    }
+    h->pos = h->len = 0;
+}
 
-    cJSON *ds_url = cJSON_GetObjectItemCaseSensitive(ds, "url");
-    cJSON *ds_name = cJSON_GetObjectItemCaseSensitive(ds, "name");
-    if (!ds_url || !cJSON_IsString(ds_url) || !ds_url->valuestring[0]) {
-        cJSON_Delete(root);
+/* Returns bytes read, 0 on orderly close, -1 on error or timeout */
+static int fd_http_read_raw(fd_http_t *h, void *buf, size_t len)
+{
+#ifdef HAVE_OPENSSL
+    if (h->ssl) {
+        int n = SSL_read(h->ssl, buf, (int)len);
+        if (n > 0)
+            return n;
+        int e = SSL_get_error(h->ssl, n);
+        /* Peers that close without close_notify: EOF with nothing queued */
+        if (e == SSL_ERROR_ZERO_RETURN ||
+            (e == SSL_ERROR_SYSCALL && n == 0 && ERR_peek_error() == 0))
+            return 0;
         return -1;
     }
+#endif
+    ssize_t n;
+    do {
+        n = recv(h->fd, buf, len, 0);
+    } while (n < 0 && errno == EINTR);
+    return (int)n;
+}
 
-    snprintf(url, url_sz, "%s", ds_url->valuestring);
-    if (ds_name && cJSON_IsString(ds_name) && ds_name->valuestring[0])
-        snprintf(name, name_sz, "%s", ds_name->valuestring);
+static int fd_http_send(fd_http_t *h, const char *data, size_t len)
+{
+    while (len > 0) {
+        int n;
+#ifdef HAVE_OPENSSL
+        if (h->ssl)
+            n = SSL_write(h->ssl, data, (int)len);
+        else
+#endif
+            n = (int)send(h->fd, data, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+        data += n;
+        len -= n;
+    }
+    return 0;
+}
 
-    fd_log("Download: resolved to url=%s name=%s\n", url, name);
-    cJSON_Delete(root);
+/* Read one line (CR/LF stripped, truncated to sz-1). Returns length or -1 */
+static int fd_http_line(fd_http_t *h, char *line, size_t sz)
+{
+    size_t n = 0;
+    for (;;) {
+        if (h->pos == h->len) {
+            int r = fd_http_read_raw(h, h->buf, sizeof(h->buf));
+            if (r <= 0)
+                return -1;
+            h->pos = 0;
+            h->len = r;
+        }
+        char c = (char)h->buf[h->pos++];
+        if (c == '\n')
+            break;
+        if (c != '\r' && n + 1 < sz)
+            line[n++] = c;
+    }
+    line[n] = '\0';
+    return (int)n;
+}
+
+static int fd_http_connect(fd_http_t *h, const char *host, int port, int tls,
+                           char *err, size_t err_sz)
+{
+    struct addrinfo hints, *res = NULL;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    char port_s[8];
+    snprintf(port_s, sizeof(port_s), "%d", port);
+    if (getaddrinfo(host, port_s, &hints, &res) != 0 || !res) {
+        snprintf(err, err_sz, "cannot resolve %s", host);
+        return -1;
+    }
+
+    for (struct addrinfo *ai = res; ai && h->fd < 0; ai = ai->ai_next) {
+        int fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+        if (fd < 0)
+            continue;
+        /* SO_SNDTIMEO also bounds connect() */
+        struct timeval tv = { FD_DL_TIMEOUT_S, 0 };
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+        if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0)
+            h->fd = fd;
+        else
+            close(fd);
+    }
+    freeaddrinfo(res);
+    if (h->fd < 0) {
+        snprintf(err, err_sz, "cannot connect to %s:%d", host, port);
+        return -1;
+    }
+    if (!tls)
+        return 0;
+
+#ifdef HAVE_OPENSSL
+    /* Same trust model as the MQTT client: no CA store on the printer */
+    h->ssl_ctx = SSL_CTX_new(TLS_client_method());
+    if (h->ssl_ctx) {
+        SSL_CTX_set_verify(h->ssl_ctx, SSL_VERIFY_NONE, NULL);
+        h->ssl = SSL_new(h->ssl_ctx);
+    }
+    if (!h->ssl) {
+        snprintf(err, err_sz, "TLS setup failed");
+        return -1;
+    }
+    SSL_set_fd(h->ssl, h->fd);
+    SSL_set_tlsext_host_name(h->ssl, host);
+    if (SSL_connect(h->ssl) <= 0) {
+        snprintf(err, err_sz, "TLS handshake with %s failed", host);
+        return -1;
+    }
     return 0;
+#else
+    snprintf(err, err_sz, "https not supported in this build");
+    return -1;
+#endif
 }
 
-static void *fd_download_thread_func(void *arg)
+/* Send a GET (from byte offset when > 0) and parse status and headers */
+static int fd_http_request(fd_http_t *h, const char *host, const char *path,
+                           long long offset, char *err, size_t err_sz)
 {
-    (void)arg;
+    char req[FD_DL_URL_MAX + 512];
+    int n = snprintf(req, sizeof(req),
+                     "GET %s HTTP/1.1\r\n"
+                     "Host: %s\r\n"
+                     "User-Agent: rkmpi_enc\r\n"
+                     "Accept-Encoding: identity\r\n"
+                     "Connection: close\r\n", path, host);
+    if (offset > 0 && n < (int)sizeof(req))
+        n += snprintf(req + n, sizeof(req) - n, "Range: bytes=%lld-\r\n", offset);
+    if (n < (int)sizeof(req))
+        n += snprintf(req + n, sizeof(req) - n, "\r\n");
+    if (n >= (int)sizeof(req) || fd_http_send(h, req, n) < 0) {
+        snprintf(err, err_sz, "request to %s failed", host);
+        return -1;
+    }
 
-    pthread_mutex_lock(&g_proto.dl_mutex);
-    g_proto.dl_progress.state = FD_DOWNLOAD_RUNNING;
-    g_proto.dl_progress.downloaded_bytes = 0;
-    g_proto.dl_progress.progress_pct = 0;
-    g_proto.dl_progress.error_msg[0] = '\0';
-    pthread_mutex_unlock(&g_proto.dl_mutex);
+    char line[FD_DL_URL_MAX + 64];
+    if (fd_http_line(h, line, sizeof(line)) < 0 ||
+        sscanf(line, "HTTP/%*s %d", &h->status) != 1) {
+        snprintf(err, err_sz, "no HTTP response from %s", host);
+        return -1;
+    }
 
-    /* Resolve metadata URL if needed */
-    char resolved_url[512];
-    char resolved_name[64];
-    snprintf(resolved_url, sizeof(resolved_url), "%s", g_proto.dl_url);
-    snprintf(resolved_name, sizeof(resolved_name), "%s", g_proto.dl_name);
+    h->content_length = -1;
+    h->range_start = -1;
+    h->range_total = -1;
+    h->chunked = 0;
+    h->location[0] = '\0';
+    int hdr_bytes = 0;
+    for (;;) {
+        int len = fd_http_line(h, line, sizeof(line));
+        if (len < 0) {
+            snprintf(err, err_sz, "truncated response headers");
+            return -1;
+        }
+        if (len == 0)
+            break;
+        hdr_bytes += len;
+        if (hdr_bytes > FD_DL_HDR_MAX) {
+            snprintf(err, err_sz, "response headers too large");
+            return -1;
+        }
 
-    int meta_ret = fd_resolve_dataset_metadata(resolved_url, sizeof(resolved_url),
-                                                resolved_name, sizeof(resolved_name));
-    if (meta_ret < 0) {
-        pthread_mutex_lock(&g_proto.dl_mutex);
-        g_proto.dl_progress.state = FD_DOWNLOAD_ERROR;
-        snprintf(g_proto.dl_progress.error_msg, sizeof(g_proto.dl_progress.error_msg),
-                 "failed to fetch dataset metadata");
-        pthread_mutex_unlock(&g_proto.dl_mutex);
-        g_proto.dl_thread_running = 0;
-        return NULL;
+        char *v = strchr(line, ':');
+        if (!v)
+            continue;
+        *v++ = '\0';
+        v += strspn(v, " \t");
+        if (strcasecmp(line, "Content-Length") == 0)
+            h->content_length = strtoll(v, NULL, 10);
+        else if (strcasecmp(line, "Transfer-Encoding") == 0)
+            h->chunked = strncasecmp(v, "chunked", 7) == 0;
+        else if (strcasecmp(line, "Content-Range") == 0)
+            sscanf(v, "bytes %lld-%*d/%lld", &h->range_start, &h->range_total);
+        else if (strcasecmp(line, "Location") == 0)
+            snprintf(h->location, sizeof(h->location), "%s", v);
+    }
+
+    h->body_left = h->chunked ? -1 : h->content_length;
+    h->chunk_left = -1;
+    h->body_done = 0;
+    return 0;
+}
+
+/* Connect and GET url from offset, following redirects (absolute or
+ * host-relative). On success the body is ready for fd_http_body(). */
+static int fd_http_open(fd_http_t *h, const char *url, long long offset,
+                        char *err, size_t err_sz)
+{
+    char cur[FD_DL_URL_MAX];
+    snprintf(cur, sizeof(cur), "%s", url);
+
+    for (int hop = 0; hop <= FD_DL_MAX_REDIRECTS; hop++) {
+        char host[256], path[FD_DL_URL_MAX];
+        int tls, port;
+        if (fd_url_split(cur, &tls, host, sizeof(host), &port, path, sizeof(path)) < 0) {
+            snprintf(err, err_sz, "unsupported URL");
+            return -1;
+        }
+        if (fd_http_connect(h, host, port, tls, err, err_sz) < 0 ||
+            fd_http_request(h, host, path, offset, err, err_sz) < 0) {
+            fd_http_close(h);
+            return -1;
+        }
+        if (h->status < 300 || h->status >= 400 || !h->location[0])
+            return 0;
+
+        if (h->location[0] == '/') {
+            int n = snprintf(cur, sizeof(cur), "%s://%s:%d",
+                             tls ? "https" : "http", host, port);
+            snprintf(cur + n, sizeof(cur) - n, "%s", h->location);
+        } else {
+            memcpy(cur, h->location, sizeof(cur));
+        }
+        fd_http_close(h);
+        fd_log("Download: HTTP %d redirect to %s\n", h->status, cur);
     }
+    snprintf(err, err_sz, "too many redirects");
+    return -1;
+}
 
-    /* Update name if metadata resolved it */
-    snprintf(g_proto.dl_name, sizeof(g_proto.dl_name), "%s", resolved_name);
+/* Read body bytes, undoing chunked framing. Returns >0 bytes, 0 at the end
+ * of the body, -1 on error or a connection lost mid-body. */
+static int fd_http_body(fd_http_t *h, uint8_t *dst, size_t cap)
+{
+    if (h->body_done)
+        return 0;
 
-    char tmp_path[] = "/tmp/fd_dataset.tar.gz";
+    if (h->chunked) {
+        char line[64];
+        if (h->chunk_left == 0) {  /* CRLF closing the previous chunk */
+            if (fd_http_line(h, line, sizeof(line)) < 0)
+                return -1;
+            h->chunk_left = -1;
+        }
+        if (h->chunk_left < 0) {
+            char *end;
+            if (fd_http_line(h, line, sizeof(line)) < 0)
+                return -1;
+            h->chunk_left = strtoll(line, &end, 16);
+            if (end == line || h->chunk_left < 0)
+                return -1;
+            if (h->chunk_left == 0) {  /* last chunk; trailers ignored */
+                h->body_done = 1;
+                return 0;
+            }
+        }
+        if ((long long)cap > h->chunk_left)
+            cap = (size_t)h->chunk_left;
+    } else if (h->body_left >= 0) {
+        if (h->body_left == 0) {
+            h->body_done = 1;
+            return 0;
+        }
+        if ((long long)cap > h->body_left)
+            cap = (size_t)h->body_left;
+    }
 
-    /* Download with wget (busybox) */
-    char cmd[600];
-    snprintf(cmd, sizeof(cmd), "wget -q -O '%s' '%s' 2>&1", tmp_path, resolved_url);
+    int n;
+    if (h->pos < h->len) {
+        n = (int)(h->len - h->pos < cap ? h->len - h->pos : cap);
+        memcpy(dst, h->buf + h->pos, n);
+        h->pos += n;
+    } else {
+        n = fd_http_read_raw(h, dst, cap);
+    }
+    if (n == 0 && !h->chunked && h->body_left < 0) {  /* close-delimited */
+        h->body_done = 1;
+        return 0;
+    }
+    if (n <= 0)
+        return -1;
 
-    fd_log("Download: starting %s\n", resolved_url);
-    int ret = system(cmd);
+    if (h->chunked)
+        h->chunk_left -= n;
+    else if (h->body_left > 0)
+        h->body_left -= n;
+    return n;
+}
 
-    if (g_proto.dl_cancel) {
-        unlink(tmp_path);
-        pthread_mutex_lock(&g_proto.dl_mutex);
-        g_proto.dl_progress.state = FD_DOWNLOAD_IDLE;
-        pthread_mutex_unlock(&g_proto.dl_mutex);
-        g_proto.dl_thread_running = 0;
-        return NULL;
+/* Consumer of a streamed body; returns 0, or -1 to abort the transfer */
+typedef int (*fd_dl_sink_fn)(void *ctx, const uint8_t *data, size_t len);
+
+/* Stream url into sink. When the connection drops mid-body the request is
+ * repeated with a Range header from the first byte the sink has not taken;
+ * a server that ignores Range sends from byte 0 again and the prefix is
+ * discarded. Gives up after FD_DL_MAX_RETRIES attempts in a row without
+ * progress. report=1 publishes progress to g_proto.dl_progress.
+ * Returns 0 ok, -1 error (err set), -2 cancelled. */
+static int fd_http_fetch(const char *url, fd_dl_sink_fn sink, void *ctx,
+                         int report, char *err, size_t err_sz)
+{
+    fd_http_t *h = (fd_http_t *)calloc(1, sizeof(*h));
+    uint8_t *buf = (uint8_t *)malloc(FD_DL_BUF_SIZE);
+    if (!h || !buf) {
+        free(h);
+        free(buf);
+        snprintf(err, err_sz, "out of memory");
+        return -1;
     }
+    h->fd = -1;
 
-    if (ret != 0) {
-        unlink(tmp_path);
-        pthread_mutex_lock(&g_proto.dl_mutex);
-        g_proto.dl_progress.state = FD_DOWNLOAD_ERROR;
-        snprintf(g_proto.dl_progress.error_msg, sizeof(g_proto.dl_progress.error_msg),
-                 "wget failed (exit code %d)", WEXITSTATUS(ret));
-        pthread_mutex_unlock(&g_proto.dl_mutex);
-        g_proto.dl_thread_running = 0;
-        return NULL;
+    long long done = 0, total = -1;
+    int fails = 0, ret = 1;  /* 1 = retry */
+    while (ret == 1) {
+        long long at_start = done, skip = 0;
+
+        if (g_proto.dl_cancel) {
+            ret = -2;
+            break;
+        }
+        if (fd_http_open(h, url, done, err, err_sz) == 0) {
+            if (h->status == 206 && h->range_start == done) {
+                if (h->range_total > 0)
+                    total = h->range_total;
+            } else if (h->status == 206) {
+                snprintf(err, err_sz, "server resumed at the wrong offset");
+                ret = -1;
+            } else if (h->status == 200) {
+                skip = done;
+                if (h->content_length > 0)
+                    total = h->content_length;
+                if (done > 0)
+                    fd_log("Download: server ignored Range, skipping %lld bytes\n", done);
+            } else {
+                snprintf(err, err_sz, "HTTP %d", h->status);
+                /* Client errors and a mismatched range will not heal */
+                if (h->status < 500)
+                    ret = -1;
+            }
+            if (report)
+                fd_dl_report(done, total, 0);
+
+            while (ret == 1 && (h->status == 200 || h->status == 206)) {
+                int n = fd_http_body(h, buf, FD_DL_BUF_SIZE);
+                if (n == 0) {
+                    if (total > 0 && done != total)
+                        snprintf(err, err_sz, "body ended at %lld of %lld bytes",
+                                 done, total);
+                    else
+                        ret = 0;
+                    break;
+                }
+                if (n < 0) {
+                    snprintf(err, err_sz, "connection lost at %lld bytes", done);
+                    break;
+                }
+                if (g_proto.dl_cancel) {
+                    ret = -2;
+                    break;
+                }
+                const uint8_t *p = buf;
+                if (skip > 0) {
+                    int k = skip < n ? (int)skip : n;
+                    p += k;
+                    n -= k;
+                    skip -= k;
+                }
+                if (n > 0 && sink(ctx, p, n) < 0) {
+                    snprintf(err, err_sz, "stream rejected at %lld bytes", done);
+                    ret = -1;
+                    break;
+                }
+                done += n;
+                if (report)
+                    fd_dl_report(done, total, 0);
+            }
+        }
+        fd_http_close(h);
+        if (ret != 1)
+            break;
+
+        if (done > at_start)
+            fails = 0;
+        if (++fails > FD_DL_MAX_RETRIES) {
+            ret = -1;
+            break;
+        }
+        int wait_s = fails < 5 ? 1 << fails : 30;
+        fd_log("Download: %s, retry %d/%d in %ds from byte %lld\n",
+               err, fails, FD_DL_MAX_RETRIES, wait_s, done);
+        if (report)
+            fd_dl_report(done, total, 1);
+        for (int i = 0; i < wait_s * 10 && !g_proto.dl_cancel; i++)
+            usleep(100000);
     }
 
-    /* Check downloaded file size */
-    struct stat st;
-    if (stat(tmp_path, &st) == 0) {
+    free(h);
+    free(buf);
+    return ret;
+}
+
+typedef struct {
+    char *buf;
+    size_t len, cap;
+} fd_dl_mem_t;
+
+/* Bounded in-memory sink; keeps buf NUL-terminated */
+static int fd_dl_mem_sink(void *ctx, const uint8_t *data, size_t len)
+{
+    fd_dl_mem_t *m = (fd_dl_mem_t *)ctx;
+    if (m->len + len >= m->cap)
+        return -1;
+    memcpy(m->buf + m->len, data, len);
+    m->len += len;
+    m->buf[m->len] = '\0';
+    return 0;
+}
+
+/* ---- Streaming .tar.gz extraction ---- */
+
+enum { FD_TAR_SKIP, FD_TAR_FILE, FD_TAR_LONGNAME };
+
+typedef struct {
+    const char *dest;
+    pid_t pid;                    /* gzip -dc */
+    int gz_in, gz_out;            /* its stdin (we write) and stdout (we read) */
+    uint8_t obuf[FD_DL_BUF_SIZE];
+
+    uint8_t hdr[512];             /* tar header being assembled */
+    size_t hdr_fill;
+    long long data_left;          /* entry payload still to come */
+    size_t pad_left;              /* padding to the next 512-byte block */
+    int kind;
+    int out_fd;
+    uint64_t hash;
+    char path[256];               /* entry path relative to dest */
+    char longname[256];           /* GNU 'L' name for the next entry */
+    size_t longname_len;
+    int have_longname;
+    int ended;                    /* end-of-archive block seen */
+
+    FILE *manifest;
+    int files;
+    char err[128];
+} fd_untar_t;
+
+static long long fd_tar_octal(const uint8_t *f, size_t len)
+{
+    long long v = 0;
+    for (size_t i = 0; i < len && f[i]; i++) {
+        if (f[i] == ' ')
+            continue;
+        if (f[i] < '0' || f[i] > '7')
+            return -1;
+        v = v * 8 + (f[i] - '0');
+    }
+    return v;
+}
+
+/* Archive path -> path under dest. Strips "./" and trailing '/', refuses
+ * absolute paths and ".." components. Returns 0, or -1 to skip the entry. */
+static int fd_tar_safe_path(const char *name, char *out, size_t sz)
+{
+    while (name[0] == '.' && name[1] == '/')
+        name += 2;
+    if (name[0] == '/')
+        return -1;
+    for (const char *c = name; *c; ) {
+        size_t l = strcspn(c, "/");
+        if (l == 2 && c[0] == '.' && c[1] == '.')
+            return -1;
+        c += l;
+        c += strspn(c, "/");
+    }
+    snprintf(out, sz, "%s", name);
+    size_t n = strlen(out);
+    while (n > 0 && out[n - 1] == '/')
+        out[--n] = '\0';
+    return n > 0 ? 0 : -1;
+}
+
+static void fd_untar_entry_end(fd_untar_t *t)
+{
+    if (t->kind == FD_TAR_FILE) {
+        close(t->out_fd);
+        t->out_fd = -1;
+        t->files++;
+        if (t->manifest)
+            fprintf(t->manifest, "%016llx  %s\n",
+                    (unsigned long long)t->hash, t->path);
         pthread_mutex_lock(&g_proto.dl_mutex);
-        g_proto.dl_progress.downloaded_bytes = st.st_size;
-        g_proto.dl_progress.progress_pct = 100;
+        g_proto.dl_progress.files = t->files;
         pthread_mutex_unlock(&g_proto.dl_mutex);
+    } else if (t->kind == FD_TAR_LONGNAME) {
+        t->have_longname = 1;
     }
+    t->kind = FD_TAR_SKIP;
+}
 
-    /* Extract */
-    pthread_mutex_lock(&g_proto.dl_mutex);
-    g_proto.dl_progress.state = FD_DOWNLOAD_EXTRACTING;
-    pthread_mutex_unlock(&g_proto.dl_mutex);
+static int fd_untar_header(fd_untar_t *t)
+{
+    const uint8_t *h = t->hdr;
+    unsigned sum = 0;
+    int zero = 1;
+    for (int i = 0; i < 512; i++) {
+        sum += (i >= 148 && i < 156) ? ' ' : h[i];
+        if (h[i]) zero = 0;
+    }
+    if (zero) {
+        t->ended = 1;
+        return 0;
+    }
+    if (fd_tar_octal(h + 148, 8) != (long long)sum) {
+        snprintf(t->err, sizeof(t->err), "corrupt tar header");
+        return -1;
+    }
+    long long size = fd_tar_octal(h + 124, 12);
+    if (size < 0) {
+        snprintf(t->err, sizeof(t->err), "unsupported tar entry size");
+        return -1;
+    }
 
-    fd_mkdir_p(FD_DATASETS_DIR);
+    char type = (char)h[156];
+    t->data_left = size;
+    t->pad_left = (size_t)((512 - size % 512) % 512);
+    t->kind = FD_TAR_SKIP;
 
-    char dest_dir[512];
-    snprintf(dest_dir, sizeof(dest_dir), "%s/%s", FD_DATASETS_DIR, g_proto.dl_name);
-    fd_mkdir_p(dest_dir);
+    if (type == 'L') {
+        t->kind = FD_TAR_LONGNAME;
+        t->longname_len = 0;
+        t->longname[0] = '\0';
+    } else {
+        char name[320];
+        if (t->have_longname)
+            snprintf(name, sizeof(name), "%s", t->longname);
+        else if (memcmp(h + 257, "ustar", 5) == 0 && h[345])
+            snprintf(name, sizeof(name), "%.155s/%.100s",
+                     (const char *)h + 345, (const char *)h);
+        else
+            snprintf(name, sizeof(name), "%.100s", (const char *)h);
+        t->have_longname = 0;
+
+        /* Regular files and directories; links and pax headers skipped */
+        int is_file = (type == '0' || type == '\0' || type == '7');
+        if (is_file || type == '5') {
+            char full[600];
+            if (fd_tar_safe_path(name, t->path, sizeof(t->path)) < 0) {
+                if (is_file)
+                    fd_log("Download: skipping unsafe path %s\n", name);
+            } else if (!is_file) {
+                snprintf(full, sizeof(full), "%s/%s", t->dest, t->path);
+                fd_mkdir_p(full);
+            } else {
+                snprintf(full, sizeof(full), "%s/%s", t->dest, t->path);
+                char *slash = strrchr(full, '/');
+                *slash = '\0';
+                fd_mkdir_p(full);
+                *slash = '/';
+                t->out_fd = open(full, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+                if (t->out_fd < 0) {
+                    snprintf(t->err, sizeof(t->err), "cannot create %.64s: %s",
+                             t->path, strerror(errno));
+                    return -1;
+                }
+                t->kind = FD_TAR_FILE;
+                t->hash = FD_FNV1A_INIT;
+            }
+        }
+    }
 
-    snprintf(cmd, sizeof(cmd), "tar xzf '%s' -C '%s' --strip-components=0 2>&1",
-             tmp_path, dest_dir);
-    ret = system(cmd);
-    unlink(tmp_path);
+    if (t->data_left == 0)
+        fd_untar_entry_end(t);
+    return 0;
+}
 
-    if (ret != 0) {
+static int fd_untar_data(fd_untar_t *t, const uint8_t *p, size_t n)
+{
+    if (t->kind == FD_TAR_FILE) {
+        t->hash = fd_fnv1a_update(t->hash, p, n);
+        while (n > 0) {
+            ssize_t w = write(t->out_fd, p, n);
+            if (w < 0 && errno == EINTR)
+                continue;
+            if (w <= 0) {
+                snprintf(t->err, sizeof(t->err), "write %.64s: %s",
+                         t->path, strerror(errno));
+                return -1;
+            }
+            p += w;
+            n -= w;
+        }
+    } else if (t->kind == FD_TAR_LONGNAME) {
+        size_t room = sizeof(t->longname) - 1 - t->longname_len;
+        size_t k = n < room ? n : room;
+        memcpy(t->longname + t->longname_len, p, k);
+        t->longname_len += k;
+        t->longname[t->longname_len] = '\0';
+    }
+    return 0;
+}
+
+/* Feed decompressed tar bytes: headers, payload and block padding */
+static int fd_untar_feed(fd_untar_t *t, const uint8_t *p, size_t n)
+{
+    while (n > 0 && !t->ended) {
+        size_t k;
+        if (t->data_left > 0) {
+            k = (long long)n < t->data_left ? n : (size_t)t->data_left;
+            if (fd_untar_data(t, p, k) < 0)
+                return -1;
+            t->data_left -= k;
+            if (t->data_left == 0)
+                fd_untar_entry_end(t);
+        } else if (t->pad_left > 0) {
+            k = n < t->pad_left ? n : t->pad_left;
+            t->pad_left -= k;
+        } else {
+            k = 512 - t->hdr_fill;
+            if (k > n) k = n;
+            memcpy(t->hdr + t->hdr_fill, p, k);
+            t->hdr_fill += k;
+            if (t->hdr_fill == 512) {
+                t->hdr_fill = 0;
+                if (fd_untar_header(t) < 0)
+                    return -1;
+            }
+        }
+        p += k;
+        n -= k;
+    }
+    return 0;
+}
+
+/* Write src into gzip's stdin while draining its stdout into the tar
+ * parser, so neither pipe fills up. finish=1 closes stdin and drains to
+ * EOF. Returns 0, or -1 (t->err set). */
+static int fd_untar_pump(fd_untar_t *t, const uint8_t *src, size_t len, int finish)
+{
+    if (finish && t->gz_in >= 0) {
+        close(t->gz_in);
+        t->gz_in = -1;
+    }
+    while (finish || len > 0) {
+        struct pollfd pfd[2] = {
+            { .fd = t->gz_out, .events = POLLIN },
+            { .fd = t->gz_in, .events = POLLOUT },
+        };
+        int np = len > 0 ? 2 : 1;
+        int r = poll(pfd, np, FD_DL_TIMEOUT_S * 1000);
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r <= 0) {
+            snprintf(t->err, sizeof(t->err), "gzip stalled");
+            return -1;
+        }
+
+        if (pfd[0].revents) {
+            ssize_t n = read(t->gz_out, t->obuf, sizeof(t->obuf));
+            if (n > 0) {
+                if (fd_untar_feed(t, t->obuf, n) < 0)
+                    return -1;
+            } else if (n == 0) {
+                if (finish)
+                    return 0;
+                snprintf(t->err, sizeof(t->err), "archive is not valid gzip");
+                return -1;
+            } else if (errno != EAGAIN && errno != EINTR) {
+                snprintf(t->err, sizeof(t->err), "gzip read: %s", strerror(errno));
+                return -1;
+            }
+        }
+        if (np > 1 && pfd[1].revents) {
+            ssize_t n = write(t->gz_in, src, len);
+            if (n > 0) {
+                src += n;
+                len -= n;
+            } else if (n < 0 && errno != EAGAIN && errno != EINTR) {
+                snprintf(t->err, sizeof(t->err), "archive is not valid gzip");
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+static int fd_untar_sink(void *ctx, const uint8_t *data, size_t len)
+{
+    return fd_untar_pump((fd_untar_t *)ctx, data, len, 0);
+}
+
+static int fd_untar_start(fd_untar_t *t, const char *dest)
+{
+    int in[2], out[2];
+    if (pipe(in) < 0)
+        return -1;
+    if (pipe(out) < 0) {
+        close(in[0]);
+        close(in[1]);
+        return -1;
+    }
+    /* Keep other threads' system() children off the pipes: gzip only sees
+     * EOF once every copy of the write end is closed */
+    for (int i = 0; i < 2; i++) {
+        fcntl(in[i], F_SETFD, FD_CLOEXEC);
+        fcntl(out[i], F_SETFD, FD_CLOEXEC);
+    }
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(in[0]); close(in[1]);
+        close(out[0]); close(out[1]);
+        return -1;
+    }
+    if (pid == 0) {
+        dup2(in[0], STDIN_FILENO);
+        dup2(out[1], STDOUT_FILENO);
+        execlp("gzip", "gzip", "-dc", (char *)NULL);
+        _exit(127);
+    }
+    close(in[0]);
+    close(out[1]);
+    fcntl(in[1], F_SETFL, O_NONBLOCK);
+    fcntl(out[0], F_SETFL, O_NONBLOCK);
+
+    t->dest = dest;
+    t->pid = pid;
+    t->gz_in = in[1];
+    t->gz_out = out[0];
+    t->out_fd = -1;
+
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", dest, FD_DL_MANIFEST);
+    t->manifest = fopen(path, "w");
+    return 0;
+}
+
+/* Drain gzip, reap it and check the archive was complete */
+static int fd_untar_finish(fd_untar_t *t)
+{
+    int rc = fd_untar_pump(t, NULL, 0, 1);
+    int status = 0;
+    waitpid(t->pid, &status, 0);
+    t->pid = -1;
+    if (rc == 0 && (!WIFEXITED(status) || WEXITSTATUS(status) != 0)) {
+        snprintf(t->err, sizeof(t->err), "archive corrupt (gzip exit %d)",
+                 WIFEXITED(status) ? WEXITSTATUS(status) : -1);
+        rc = -1;
+    }
+    if (rc == 0 && (t->data_left > 0 || t->hdr_fill > 0)) {
+        snprintf(t->err, sizeof(t->err), "archive truncated");
+        rc = -1;
+    }
+    return rc;
+}
+
+static void fd_untar_close(fd_untar_t *t)
+{
+    if (t->gz_in >= 0) close(t->gz_in);
+    if (t->gz_out >= 0) close(t->gz_out);
+    if (t->pid > 0) {
+        kill(t->pid, SIGTERM);
+        waitpid(t->pid, NULL, 0);
+    }
+    if (t->out_fd >= 0) close(t->out_fd);
+    if (t->manifest) fclose(t->manifest);
+}
+
+/* Download a .tar.gz dataset from url and extract it into dest_dir.
+ * Returns 0 ok, -1 error (err set), -2 cancelled. */
+static int fd_dataset_fetch(const char *url, const char *dest_dir,
+                            char *err, size_t err_sz)
+{
+    fd_untar_t *t = (fd_untar_t *)calloc(1, sizeof(*t));
+    if (!t) {
+        snprintf(err, err_sz, "out of memory");
+        return -1;
+    }
+    fd_mkdir_p(dest_dir);
+    if (fd_untar_start(t, dest_dir) < 0) {
+        snprintf(err, err_sz, "cannot start gzip");
+        free(t);
+        return -1;
+    }
+
+    int ret = fd_http_fetch(url, fd_untar_sink, t, 1, err, err_sz);
+    if (ret == 0) {
         pthread_mutex_lock(&g_proto.dl_mutex);
-        g_proto.dl_progress.state = FD_DOWNLOAD_ERROR;
-        snprintf(g_proto.dl_progress.error_msg, sizeof(g_proto.dl_progress.error_msg),
-                 "tar extract failed (exit code %d)", WEXITSTATUS(ret));
+        g_proto.dl_progress.state = FD_DOWNLOAD_EXTRACTING;
         pthread_mutex_unlock(&g_proto.dl_mutex);
-        g_proto.dl_thread_running = 0;
-        return NULL;
+        ret = fd_untar_finish(t);
+    }
+    if (ret == -1 && t->err[0])
+        snprintf(err, err_sz, "%s", t->err);
+    if (ret == 0)
+        fd_log("Download: extracted %d files into %s\n", t->files, dest_dir);
+
+    fd_untar_close(t);
+    free(t);
+    return ret;
+}
+
+/* Drop the "<sub>/" prefix from manifest paths after sub was moved up */
+static void fd_dl_manifest_strip(const char *dest_dir, const char *sub)
+{
+    char path[512], tmp[520];
+    snprintf(path, sizeof(path), "%s/%s", dest_dir, FD_DL_MANIFEST);
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE *in = fopen(path, "r");
+    if (!in)
+        return;
+    FILE *out = fopen(tmp, "w");
+    if (!out) {
+        fclose(in);
+        return;
+    }
+
+    size_t sl = strlen(sub);
+    char line[512];
+    while (fgets(line, sizeof(line), in)) {
+        const char *p = line + 18;  /* past "<16 hex>  " */
+        if (strlen(line) > 18 && strncmp(p, sub, sl) == 0 && p[sl] == '/')
+            fprintf(out, "%.18s%s", line, p + sl + 1);
+        else
+            fputs(line, out);
+    }
+    fclose(in);
+    fclose(out);
+    rename(tmp, path);
+}
+
+/* Fetch a dataset archive into dest_dir. It is extracted into a hidden
+ * sibling (".<name>.part", which fault_detect_list_datasets skips) and only
+ * renamed into place once complete, so a cancelled or failed download leaves
+ * nothing behind. An existing dest_dir is replaced.
+ * Returns 0 ok, -1 error (err set), -2 cancelled. */
+static int fd_dataset_install(const char *url, const char *dest_dir,
+                              char *err, size_t err_sz)
+{
+    char part_dir[512];
+    const char *slash = strrchr(dest_dir, '/');
+    int n = slash ? snprintf(part_dir, sizeof(part_dir), "%.*s/.%s.part",
+                             (int)(slash - dest_dir), dest_dir, slash + 1)
+                  : snprintf(part_dir, sizeof(part_dir), ".%s.part", dest_dir);
+    if (n < 0 || (size_t)n >= sizeof(part_dir)) {
+        snprintf(err, err_sz, "dataset path too long");
+        return -1;
+    }
+    fd_rmdir_recursive(part_dir);       /* left over from a crash */
+
+    int ret = fd_dataset_fetch(url, part_dir, err, err_sz);
+    if (ret < 0) {
+        fd_rmdir_recursive(part_dir);
+        return ret;
     }
 
     /* Check if tar extracted into a subdirectory — if so, move contents up */
-    DIR *d = opendir(dest_dir);
+    DIR *d = opendir(part_dir);
     if (d) {
         struct dirent *ent;
         char only_subdir[512] = "";
+        char only_name[256] = "";
         int dir_count = 0, file_count = 0;
         while ((ent = readdir(d)) != NULL) {
             if (ent->d_name[0] == '.') continue;
             char child[512];
-            snprintf(child, sizeof(child), "%s/%s", dest_dir, ent->d_name);
+            snprintf(child, sizeof(child), "%s/%s", part_dir, ent->d_name);
             struct stat cst;
             if (stat(child, &cst) == 0) {
                 if (S_ISDIR(cst.st_mode)) {
                     snprintf(only_subdir, sizeof(only_subdir), "%s", child);
+                    snprintf(only_name, sizeof(only_name), "%s", ent->d_name);
                     dir_count++;
                 } else {
                     file_count++;
@@ -4251,20 +6772,143 @@ static void *fd_download_thread_func(void *arg)
 
         /* If exactly 1 subdir and no files, move contents up (strip-components) */
         if (dir_count == 1 && file_count == 0 && only_subdir[0]) {
+            char cmd[1600];
             snprintf(cmd, sizeof(cmd), "mv '%s'/* '%s'/ 2>/dev/null; rmdir '%s' 2>/dev/null",
-                     only_subdir, dest_dir, only_subdir);
+                     only_subdir, part_dir, only_subdir);
             system(cmd);
+            fd_dl_manifest_strip(part_dir, only_name);
         }
     }
 
     /* Ensure failure/success subdirs exist */
     char sub[512];
-    snprintf(sub, sizeof(sub), "%s/failure", dest_dir);
+    snprintf(sub, sizeof(sub), "%s/failure", part_dir);
     mkdir(sub, 0755);
-    snprintf(sub, sizeof(sub), "%s/success", dest_dir);
+    snprintf(sub, sizeof(sub), "%s/success", part_dir);
     mkdir(sub, 0755);
 
+    struct stat st;
+    if (stat(dest_dir, &st) == 0) {
+        fd_log("Download: replacing existing %s\n", dest_dir);
+        fd_rmdir_recursive(dest_dir);
+    }
+    if (rename(part_dir, dest_dir) != 0) {
+        snprintf(err, err_sz, "cannot move dataset into place: %s", strerror(errno));
+        fd_rmdir_recursive(part_dir);
+        return -1;
+    }
+    return 0;
+}
+
+/* Resolve dataset URL: if URL points to a .json metadata file, fetch it and
+ * extract the actual download URL and dataset name from it.
+ * Returns 0 on success (url/name updated), -1 on error, 1 if not a metadata URL. */
+static int fd_resolve_dataset_metadata(char *url, size_t url_sz, char *name, size_t name_sz)
+{
+    /* Only resolve if URL ends with .json */
+    size_t len = strlen(url);
+    if (len < 6 || strcmp(url + len - 5, ".json") != 0)
+        return 1;  /* not metadata, use URL directly */
+
+    fd_log("Download: fetching metadata from %s\n", url);
+
+    fd_dl_mem_t m = { (char *)malloc(FD_DL_META_MAX + 1), 0, FD_DL_META_MAX + 1 };
+    char err[128] = "";
+    int ret = m.buf ? fd_http_fetch(url, fd_dl_mem_sink, &m, 0, err, sizeof(err)) : -1;
+    if (ret != 0) {
+        fd_log("Download: metadata fetch failed (%s)\n",
+               ret == -2 ? "cancelled" : err[0] ? err : "out of memory");
+        free(m.buf);
+        return -1;
+    }
+
+    cJSON *root = cJSON_Parse(m.buf);
+    free(m.buf);
+    if (!root) {
+        fd_log("Download: metadata JSON parse failed\n");
+        return -1;
+    }
+
+    cJSON *ds = cJSON_GetObjectItemCaseSensitive(root, "prototype_dataset");
+    if (!ds) { cJSON_Delete(root); return -1; }
+
+    cJSON *ds_url = cJSON_GetObjectItemCaseSensitive(ds, "url");
+    cJSON *ds_name = cJSON_GetObjectItemCaseSensitive(ds, "name");
+    if (!ds_url || !cJSON_IsString(ds_url) || !ds_url->valuestring[0]) {
+        cJSON_Delete(root);
+        return -1;
+    }
+
+    snprintf(url, url_sz, "%s", ds_url->valuestring);
+    if (ds_name && cJSON_IsString(ds_name) && ds_name->valuestring[0])
+        snprintf(name, name_sz, "%s", ds_name->valuestring);
+
+    fd_log("Download: resolved to url=%s name=%s\n", url, name);
+    cJSON_Delete(root);
+    return 0;
+}
+
+static void fd_dl_fail(const char *msg)
+{
+    pthread_mutex_lock(&g_proto.dl_mutex);
+    g_proto.dl_progress.state = FD_DOWNLOAD_ERROR;
+    snprintf(g_proto.dl_progress.error_msg, sizeof(g_proto.dl_progress.error_msg),
+             "%s", msg);
+    pthread_mutex_unlock(&g_proto.dl_mutex);
+}
+
+static void *fd_download_thread_func(void *arg)
+{
+    (void)arg;
+
+    pthread_mutex_lock(&g_proto.dl_mutex);
+    memset(&g_proto.dl_progress, 0, sizeof(g_proto.dl_progress));
+    g_proto.dl_progress.state = FD_DOWNLOAD_RUNNING;
+    pthread_mutex_unlock(&g_proto.dl_mutex);
+
+    /* Resolve metadata URL if needed */
+    char resolved_url[512];
+    char resolved_name[64];
+    snprintf(resolved_url, sizeof(resolved_url), "%s", g_proto.dl_url);
+    snprintf(resolved_name, sizeof(resolved_name), "%s", g_proto.dl_name);
+
+    int meta_ret = fd_resolve_dataset_metadata(resolved_url, sizeof(resolved_url),
+                                                resolved_name, sizeof(resolved_name));
+    if (meta_ret < 0) {
+        fd_dl_fail("failed to fetch dataset metadata");
+        g_proto.dl_thread_running = 0;
+        return NULL;
+    }
+
+    /* Update name if metadata resolved it */
+    snprintf(g_proto.dl_name, sizeof(g_proto.dl_name), "%s", resolved_name);
+
+    fd_mkdir_p(FD_DATASETS_DIR);
+
+    char dest_dir[512];
+    snprintf(dest_dir, sizeof(dest_dir), "%s/%s", FD_DATASETS_DIR, g_proto.dl_name);
+
+    fd_log("Download: streaming %s -> %s\n", resolved_url, dest_dir);
+    char err[128] = "";
+    int ret = fd_dataset_install(resolved_url, dest_dir, err, sizeof(err));
+
+    if (ret == -2) {
+        pthread_mutex_lock(&g_proto.dl_mutex);
+        g_proto.dl_progress.state = FD_DOWNLOAD_IDLE;
+        pthread_mutex_unlock(&g_proto.dl_mutex);
+        g_proto.dl_thread_running = 0;
+        return NULL;
+    }
+
+    if (ret < 0) {
+        fd_err("Download: %s\n", err);
+        fd_dl_fail(err);
+        g_proto.dl_thread_running = 0;
+        return NULL;
+    }
+
     pthread_mutex_lock(&g_proto.dl_mutex);
+    g_proto.dl_progress.progress_pct = 100;
     g_proto.dl_progress.state = FD_DOWNLOAD_DONE;
     pthread_mutex_unlock(&g_proto.dl_mutex);
 
@@ -127,11 +127,21 @@ static inline int fd_mask_from_hex(const char *hex, fd_mask196_t *m) {
 /* Population count */
 static inline int fd_mask_popcount(const fd_mask196_t *m) {
     int count = 0;
-    for (int i = 0; i < FD_MASK_WORDS; i++) {
+    for (int i = 0; i < FD_MASK_WORDS; i++)
+        count += __builtin_popcountll(m->w[i]);
+    return count;
+}
+
+/* Index of the first set bit >= from, or -1 if none.
+ * Iterate: for (i = next_bit(m, 0); i >= 0; i = next_bit(m, i + 1)) */
+static inline int fd_mask_next_bit(const fd_mask196_t *m, int from) {
+    if (from < 0) from = 0;
+    for (int i = from / 64; i < FD_MASK_WORDS; i++) {
         uint64_t v = m->w[i];
-        while (v) { count++; v &= v - 1; }
+        if (i == from / 64) v &= ~0ULL << (from % 64);
+        if (v) return i * 64 + __builtin_ctzll(v);
     }
-    return count;
+    return -1;
 }
 
 /* Z-dependent mask table limits */
@@ -213,6 +223,9 @@ typedef struct {
     float boost_confidence_cap;            /* Max confidence from boost (default 0.95) */
     float ema_alpha;                       /* EMA smoothing factor (default 0.30) */
     float heatmap_coarse_weight;           /* Coarse blend weight (default 0.70) */
+    /* Cascade early exit */
+    float cascade_cnn_ok;                  /* CNN fail prob that is decisively OK (default 0.05) */
+    float cascade_proto_ok;                /* Proto fault likelihood that is decisively OK (default 0.20) */
 } fd_threshold_profile_t;
 
 /* Model set info — discovered by scanning */
@@ -264,6 +277,8 @@ typedef struct {
     float boost_confidence_cap;
     float ema_alpha;
     float heatmap_coarse_weight;
+    float cascade_cnn_ok;
+    float cascade_proto_ok;
 } fd_active_thresholds_t;
 
 /* Detection result (last inference cycle) */
@@ -298,11 +313,16 @@ typedef struct {
     float heatmap_max;       /* max fault margin in grid */
     int heatmap_max_h;       /* row index of max */
     int heatmap_max_w;       /* col index of max */
+    fd_mask196_t heatmap_cells; /* cells scored this cycle (zero = all) */
     float spatial_ms;        /* spatial inference time */
     int boost_active;        /* 1 if spatial boost conditions met */
     int boost_overrode;      /* 1 if boost actually changed OK→FAULT */
     int boost_strong_cells;  /* number of strong cells when boost fired */
     int boost_total_cells;   /* total active cells when boost fired */
+    /* Cascade */
+    char cascade_exit[8];    /* model that ended the cascade ("cnn", "proto") or "-" */
+    float expected_ms;       /* learned cost of the full model stack */
+    float actual_ms;         /* inference time of the models that ran */
     /* Center-crop region in normalized [0,1] coords */
     float crop_x, crop_y, crop_w, crop_h;
 } fd_result_t;
@@ -316,6 +336,53 @@ typedef struct {
     char error_msg[128];        /* Last error message */
 } fd_state_t;
 
+/* Resident model cache counters */
+typedef struct {
+    uint32_t hits;              /* acquires served by a resident context */
+    uint32_t misses;            /* acquires that had to rknn_init */
+    uint32_t evictions;         /* contexts released (LRU, budget, memory pressure) */
+    int resident;               /* contexts currently loaded */
+    uint32_t cma_kb;            /* CMA held by resident contexts */
+    uint32_t budget_kb;
+    float last_load_ms;
+    float avg_load_ms;
+    uint32_t zero_copy_runs;    /* inferences reading the shared input tensor */
+    uint32_t input_copies;      /* inferences that copied into a private tensor */
+} fd_model_cache_stats_t;
+
+/* Cascade counters and learned per-model latency */
+typedef struct {
+    uint32_t cycles;            /* detection runs accounted */
+    uint32_t exits_cnn;         /* stopped after a decisive CNN OK */
+    uint32_t exits_proto;       /* stopped after a decisive ProtoNet OK */
+    uint32_t skipped_multi;     /* multiclass runs avoided */
+    uint32_t skipped_spatial;   /* heatmap runs avoided */
+    float cnn_ms;               /* learned latency (EMA), 0 = not seen yet */
+    float proto_ms;
+    float multi_ms;
+    float spatial_ms;
+    double expected_ms_total;   /* full-stack cost at learned latency */
+    double actual_ms_total;     /* inference time that actually ran */
+} fd_cascade_stats_t;
+
+/* Scheduler decision counters (one per probed frame) */
+typedef struct {
+    uint32_t probes;            /* frames examined */
+    uint32_t runs_first;        /* no reference frame yet (start, new print) */
+    uint32_t runs_verify;       /* confirming a detected fault */
+    uint32_t runs_risky;        /* first layers */
+    uint32_t runs_layer;        /* layer change or new Z high */
+    uint32_t runs_scene;        /* JPEG size or luma change */
+    uint32_t runs_stale;        /* max_skip_s without a full run */
+    uint32_t runs_fixed;        /* scheduling disabled: every cycle runs */
+    uint32_t skips_static;      /* frame unchanged since the last run */
+    uint32_t skips_idle;        /* printer known not to be printing */
+    float last_change_pct;      /* changed luma blocks at the last compare */
+    char last_decision[16];
+    int print_state;            /* -1 unknown, 0 idle, 1 printing */
+    int layer;                  /* -1 unknown */
+} fd_sched_stats_t;
+
 /* Detection configuration */
 typedef struct {
     int enabled;
@@ -328,6 +395,11 @@ typedef struct {
     char model_set[FD_SET_NAME_LEN]; /* Selected model set directory name */
     int min_free_mem_mb;        /* Min free memory to run (default 20) */
     int pace_ms;                /* Inter-step pause ms to reduce CPU spikes (0=off) */
+    int model_cache_mb;         /* CMA budget for resident models (0 = load per cycle) */
+    int sched_enabled;          /* 1 = skip unchanged/idle frames (event-driven) */
+    int max_skip_s;             /* Full run at least this often when skipping (default 30) */
+    int cascade_enabled;        /* 1 = cheapest model first, stop early when decisively OK */
+    int roi_crop;               /* 1 = crop model input to the bounding box of the masks */
     fd_active_thresholds_t thresholds; /* Active thresholds (profile or custom) */
     int heatmap_enabled;        /* 0=off, 1=on (spatial heatmap on faults) */
     int beep_pattern;           /* Buzzer alert: 0=none, 1-5=patterns */
@@ -389,6 +461,27 @@ int fault_detect_installed(void);
  * Returns number of models successfully loaded, or -1 on error. */
 int fault_detect_warmup(void);
 
+/* Release all idle resident models (e.g. before VENC needs CMA).
+ * Models in use by the running cycle are released when it returns them.
+ * Returns number of contexts released. */
+int fault_detect_release_models(void);
+
+/* Get resident model cache counters. */
+fd_model_cache_stats_t fault_detect_get_model_cache_stats(void);
+
+/* Get cascade counters and learned model latency. */
+fd_cascade_stats_t fault_detect_get_cascade_stats(void);
+
+/* Get scheduler decision counters. */
+fd_sched_stats_t fault_detect_get_sched_stats(void);
+
+/* Print progress hints for the scheduler (Moonraker / RPC clients).
+ * printing: 1 = printing, 0 = not printing. A transition forces a run. */
+void fault_detect_notify_print_state(int printing);
+
+/* Layer change. layer < 0 when the source doesn't know the number. */
+void fault_detect_notify_layer(int layer);
+
 /* Check if the FD thread is waiting for a frame (non-blocking). */
 int fault_detect_needs_frame(void);
 
@@ -422,9 +515,13 @@ size_t fault_detect_get_fd_frame(uint8_t *buf, size_t max_size, uint64_t *cycle_
  * Prototype Management
  * ============================================================================ */
 
-/* Directories on USB stick */
+/* Directories on USB stick (fd_bench points them at host directories) */
+#ifndef FD_DATASETS_DIR
 #define FD_DATASETS_DIR       "/mnt/udisk/fault_detect/datasets"
+#endif
+#ifndef FD_PROTO_SETS_DIR
 #define FD_PROTO_SETS_DIR     "/mnt/udisk/fault_detect/prototype_sets"
+#endif
 #define FD_MAX_PROTO_SETS     16
 #define FD_MAX_DATASETS       16
 
@@ -466,6 +563,9 @@ typedef struct {
     float margin[3];
     char error_msg[256];
     int incremental;            /* 1 = incremental update mode */
+    int resumed_images;         /* total_images_processed restored from a checkpoint */
+    float images_per_s;         /* model passes per second, this run */
+    int jpeg_decodes;           /* this run; 0 when the decode cache is warm */
 } fd_proto_compute_progress_t;
 
 /* Dataset info (returned by listing) */
@@ -492,8 +592,10 @@ typedef struct {
 typedef struct {
     fd_download_state_t state;
     size_t downloaded_bytes;
-    size_t total_bytes;
+    size_t total_bytes;         /* 0 = unknown (no Content-Length) */
     int progress_pct;
+    int files;                  /* files extracted so far */
+    int retries;                /* reconnects after a dropped transfer */
     char error_msg[256];
 } fd_download_progress_t;
 
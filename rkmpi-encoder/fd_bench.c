@@ -0,0 +1,1539 @@
+/*
+ * Fault Detection Bench
+ *
+ * Host-side replay harness for the fault detection pipeline. Feeds recorded
+ * frames (a directory of JPEGs, e.g. a timelapse temp dir) through the same
+ * code the detection thread runs: TurboJPEG decode, fd_preprocess, and
+ * fd_run_detection with its strategy voting, EMA smoothing and spatial
+ * boost. Prints a per-frame decision trace and per-stage timing histograms.
+ *
+ * fault_detect.c is compiled into this file so the static pipeline stages
+ * run unmodified. The NPU is replaced by a stub RKNN backend: models are
+ * only checked for existence, and each inference produces int8 outputs
+ * scored from the input frame's texture (mean green-channel gradient),
+ * mapped onto the set's real prototypes. The stub is no substitute for
+ * the real models' accuracy, but it drives every decision path and keeps
+ * the thresholds, EMA and boost logic testable without hardware.
+ *
+ * Build on the host with `make fd_bench`.
+ */
+
+/* Datasets and prototype sets live in host directories picked at run time */
+static char g_bench_datasets_dir[512] = "datasets";
+static char g_bench_sets_dir[512] = "prototype_sets";
+#define FD_DATASETS_DIR     g_bench_datasets_dir
+#define FD_PROTO_SETS_DIR   g_bench_sets_dir
+
+#include "fault_detect.c"
+
+#include <stddef.h>
+#include <getopt.h>
+
+/* ============================================================================
+ * Platform stubs (symbols fault_detect.c needs from the rest of rkmpi_enc)
+ * ============================================================================ */
+
+/* DMA buffers are plain heap memory, so the shared input tensor path runs */
+RK_S32 RK_MPI_MMZ_Alloc(MB_BLK *pBlk, RK_U32 u32Length, RK_U32 u32Flags)
+{
+    (void)u32Flags;
+    void *p = NULL;
+    if (posix_memalign(&p, 4096, u32Length) != 0)
+        return -1;
+    *pBlk = p;
+    return RK_SUCCESS;
+}
+
+RK_S32 RK_MPI_MMZ_Free(MB_BLK blk)
+{
+    free(blk);
+    return RK_SUCCESS;
+}
+
+RK_VOID *RK_MPI_MMZ_Handle2VirAddr(MB_BLK blk) { return blk; }
+RK_S32 RK_MPI_MMZ_Handle2Fd(MB_BLK blk) { (void)blk; return -1; }
+RK_S32 RK_MPI_MMZ_IsCacheable(MB_BLK blk) { (void)blk; return 0; }
+
+RK_S32 RK_MPI_MMZ_FlushCacheEnd(MB_BLK blk, RK_U32 u32Offset, RK_U32 u32Length,
+                                RK_U32 u32Flags)
+{
+    (void)blk; (void)u32Offset; (void)u32Length; (void)u32Flags;
+    return RK_SUCCESS;
+}
+
+int mqtt_send_led(int on, int brightness) { (void)on; (void)brightness; return 0; }
+int mqtt_query_led(int timeout_ms) { (void)timeout_ms; return 1; }
+TimelapseEncodeStatus timelapse_get_encode_status(void) { return TL_ENCODE_IDLE; }
+int timelapse_streaming_encoder_open(void) { return 0; }
+
+/* ============================================================================
+ * Stub RKNN backend
+ * ============================================================================ */
+
+typedef enum {
+    BENCH_MODEL_CNN = 0,
+    BENCH_MODEL_ENCODER,
+    BENCH_MODEL_MULTICLASS,
+    BENCH_MODEL_SPATIAL,
+    BENCH_MODEL_SPATIAL_COARSE
+} bench_model_kind_t;
+
+#define BENCH_MAX_CTX   16
+
+typedef struct {
+    int used;
+    bench_model_kind_t kind;
+    int out_h, out_w, out_c;        /* spatial grid (1x1xC otherwise) */
+    const float *proto_fail;        /* prototypes the embeddings are built from */
+    const float *proto_succ;
+    float out_scale;
+    rknn_tensor_mem *input;         /* currently bound tensors */
+    rknn_tensor_mem *output;
+} bench_ctx_t;
+
+static struct {
+    bench_ctx_t ctx[BENCH_MAX_CTX];
+    int npu_us;                     /* simulated latency per inference */
+    float texture_gain;             /* gradient that maps to score 1.0 */
+    uint32_t inits, runs;
+    int record_inputs;              /* hash the input tensor on every run */
+    uint64_t last_input_fnv;
+} g_bench = { .texture_gain = 16.0f };
+
+static bench_ctx_t *bench_ctx(rknn_context ctx)
+{
+    if (ctx < 1 || ctx > BENCH_MAX_CTX || !g_bench.ctx[ctx - 1].used)
+        return NULL;
+    return &g_bench.ctx[ctx - 1];
+}
+
+/* Prototype computation runs the encoders before the set has prototypes:
+ * their embeddings then slide between two fixed pseudo-random directions */
+static void bench_synth_protos(bench_ctx_t *c, int h, int w, int dim)
+{
+    static float synth[2][FD_SPATIAL_EMB_MAX];
+    static int ready;
+    if (!ready) {
+        uint32_t r = 1;
+        for (int k = 0; k < 2; k++)
+            for (int i = 0; i < FD_SPATIAL_EMB_MAX; i++) {
+                r = r * 1664525u + 1013904223u;
+                synth[k][i] = (float)(r >> 8) / 8388608.0f - 1.0f;
+            }
+        ready = 1;
+    }
+    c->out_h = h;
+    c->out_w = w;
+    c->out_c = dim;
+    c->proto_fail = synth[0];
+    c->proto_succ = synth[1];
+}
+
+static float bench_proto_scale(const float *a, const float *b, int n)
+{
+    float m = 0.0f;
+    for (int i = 0; i < n; i++) {
+        if (fabsf(a[i]) > m) m = fabsf(a[i]);
+        if (fabsf(b[i]) > m) m = fabsf(b[i]);
+    }
+    return m > 0.0f ? m / 127.0f : 1.0f / 127.0f;
+}
+
+/* Model kind from the path fd_resolve_model_path built. Embedding models
+ * need their prototypes, which the pipeline loads before the encoder. */
+static int bench_rknn_init(rknn_context *context, void *model, uint32_t size,
+                           uint32_t flag, rknn_init_extend *extend)
+{
+    (void)size; (void)flag; (void)extend;
+    const char *path = (const char *)model;
+
+    int slot = -1;
+    for (int i = 0; i < BENCH_MAX_CTX; i++)
+        if (!g_bench.ctx[i].used) { slot = i; break; }
+    if (slot < 0) return -1;
+
+    bench_ctx_t *c = &g_bench.ctx[slot];
+    memset(c, 0, sizeof(*c));
+    c->out_h = c->out_w = 1;
+
+    if (strstr(path, "spatial_encoder_coarse")) {
+        c->kind = BENCH_MODEL_SPATIAL_COARSE;
+        if (g_fd.spatial_coarse_loaded) {
+            c->out_h = g_fd.spatial_coarse_h;
+            c->out_w = g_fd.spatial_coarse_w;
+            c->out_c = g_fd.spatial_coarse_emb_dim;
+            c->proto_fail = g_fd.spatial_coarse_protos[0];
+            c->proto_succ = g_fd.spatial_coarse_protos[1];
+        } else {
+            bench_synth_protos(c, 7, 14, 256);
+        }
+    } else if (strstr(path, "spatial_encoder")) {
+        c->kind = BENCH_MODEL_SPATIAL;
+        if (g_fd.spatial_protos_loaded) {
+            c->out_h = g_fd.spatial_h;
+            c->out_w = g_fd.spatial_w;
+            c->out_c = g_fd.spatial_emb_dim;
+            c->proto_fail = g_fd.spatial_protos[0];
+            c->proto_succ = g_fd.spatial_protos[1];
+        } else if (g_fd.prototypes_loaded) {
+            /* Same fallback as fd_run_heatmap: 7x7 with classification protos */
+            c->out_h = c->out_w = 7;
+            c->out_c = EMB_DIM;
+            c->proto_fail = g_fd.prototypes[0];
+            c->proto_succ = g_fd.prototypes[1];
+        } else {
+            bench_synth_protos(c, 14, 28, 128);
+        }
+    } else if (strstr(path, "/cnn/")) {
+        c->kind = BENCH_MODEL_CNN;
+        c->out_c = 2;
+    } else if (strstr(path, "/multiclass/")) {
+        c->kind = BENCH_MODEL_MULTICLASS;
+        c->out_c = FD_MCLASS_COUNT;
+    } else {
+        c->kind = BENCH_MODEL_ENCODER;
+        if (g_fd.prototypes_loaded) {
+            c->out_c = EMB_DIM;
+            c->proto_fail = g_fd.prototypes[0];
+            c->proto_succ = g_fd.prototypes[1];
+        } else {
+            bench_synth_protos(c, 1, 1, EMB_DIM);
+        }
+    }
+
+    c->out_scale = c->proto_fail ?
+        bench_proto_scale(c->proto_fail, c->proto_succ, c->out_c) : 8.0f / 127.0f;
+    c->used = 1;
+    g_bench.inits++;
+    *context = (rknn_context)(slot + 1);
+    return 0;
+}
+
+static int bench_rknn_query(rknn_context context, rknn_query_cmd cmd,
+                            void *info, uint32_t size)
+{
+    bench_ctx_t *c = bench_ctx(context);
+    if (!c) return -1;
+
+    switch (cmd) {
+    case RKNN_QUERY_IN_OUT_NUM: {
+        rknn_input_output_num *io = (rknn_input_output_num *)info;
+        if (size < sizeof(*io)) return -1;
+        io->n_input = 1;
+        io->n_output = 1;
+        return 0;
+    }
+    case RKNN_QUERY_NATIVE_INPUT_ATTR: {
+        rknn_tensor_attr *a = (rknn_tensor_attr *)info;
+        if (size < sizeof(*a)) return -1;
+        uint32_t index = a->index;
+        memset(a, 0, sizeof(*a));
+        a->index = index;
+        a->n_dims = 4;
+        a->dims[0] = 1;
+        a->dims[1] = FD_MODEL_INPUT_HEIGHT;
+        a->dims[2] = FD_MODEL_INPUT_WIDTH;
+        a->dims[3] = 3;
+        a->n_elems = FD_MODEL_INPUT_BYTES;
+        a->size = FD_MODEL_INPUT_BYTES;
+        a->w_stride = FD_MODEL_INPUT_WIDTH;
+        a->size_with_stride = FD_MODEL_INPUT_BYTES;
+        a->fmt = RKNN_TENSOR_NHWC;
+        a->type = RKNN_TENSOR_UINT8;
+        return 0;
+    }
+    case RKNN_QUERY_NATIVE_NHWC_OUTPUT_ATTR: {
+        rknn_tensor_attr *a = (rknn_tensor_attr *)info;
+        if (size < sizeof(*a)) return -1;
+        uint32_t index = a->index;
+        memset(a, 0, sizeof(*a));
+        a->index = index;
+        a->n_dims = 4;
+        a->dims[0] = 1;
+        a->dims[1] = c->out_h;
+        a->dims[2] = c->out_w;
+        a->dims[3] = c->out_c;
+        a->n_elems = (uint32_t)(c->out_h * c->out_w * c->out_c);
+        a->size = a->n_elems;
+        a->size_with_stride = a->n_elems;
+        a->fmt = RKNN_TENSOR_NHWC;
+        a->type = RKNN_TENSOR_INT8;
+        a->qnt_type = RKNN_TENSOR_QNT_AFFINE_ASYMMETRIC;
+        a->zp = 0;
+        a->scale = c->out_scale;
+        return 0;
+    }
+    default:
+        return -1;  /* MEM_SIZE: cache falls back to file size + I/O */
+    }
+}
+
+static rknn_tensor_mem *bench_rknn_create_mem(rknn_context context, uint32_t size)
+{
+    (void)context;
+    rknn_tensor_mem *mem = (rknn_tensor_mem *)calloc(1, sizeof(*mem));
+    if (!mem) return NULL;
+    mem->virt_addr = calloc(1, size);
+    if (!mem->virt_addr) {
+        free(mem);
+        return NULL;
+    }
+    mem->fd = -1;
+    mem->size = size;
+    mem->priv_data = mem->virt_addr;    /* owned: freed by destroy_mem */
+    return mem;
+}
+
+static rknn_tensor_mem *bench_rknn_create_mem_from_fd(rknn_context context, int32_t fd,
+                                                      void *virt, uint32_t size,
+                                                      int32_t offset)
+{
+    (void)context;
+    rknn_tensor_mem *mem = (rknn_tensor_mem *)calloc(1, sizeof(*mem));
+    if (!mem) return NULL;
+    mem->virt_addr = (uint8_t *)virt + offset;
+    mem->fd = fd;
+    mem->offset = offset;
+    mem->size = size;
+    return mem;
+}
+
+static int bench_rknn_set_io_mem(rknn_context context, rknn_tensor_mem *mem,
+                                 rknn_tensor_attr *attr)
+{
+    bench_ctx_t *c = bench_ctx(context);
+    if (!c) return -1;
+    if (attr->type == RKNN_TENSOR_UINT8)
+        c->input = mem;
+    else
+        c->output = mem;
+    return 0;
+}
+
+static int bench_rknn_destroy_mem(rknn_context context, rknn_tensor_mem *mem)
+{
+    bench_ctx_t *c = bench_ctx(context);
+    if (c && c->input == mem) c->input = NULL;
+    if (c && c->output == mem) c->output = NULL;
+    free(mem->priv_data);
+    free(mem);
+    return 0;
+}
+
+static int bench_rknn_destroy(rknn_context context)
+{
+    bench_ctx_t *c = bench_ctx(context);
+    if (!c) return -1;
+    c->used = 0;
+    return 0;
+}
+
+/* Texture score in [0,1] for a region of the 448x224 input: mean absolute
+ * horizontal gradient of the green channel, sampled every other pixel.
+ * Bare bed and parts are smooth; spaghetti and stringing are not. */
+static float bench_texture(const uint8_t *in, int x0, int y0, int x1, int y1)
+{
+    const int pitch = FD_MODEL_INPUT_WIDTH * 3;
+    uint32_t sum = 0, n = 0;
+    for (int y = y0; y < y1; y += 2) {
+        const uint8_t *row = in + y * pitch + 1;
+        for (int x = x0; x + 1 < x1; x += 2) {
+            int d = (int)row[(x + 1) * 3] - (int)row[x * 3];
+            sum += (uint32_t)(d < 0 ? -d : d);
+            n++;
+        }
+    }
+    float t = n ? (float)sum / (float)n / g_bench.texture_gain : 0.0f;
+    return t > 1.0f ? 1.0f : t;
+}
+
+static int8_t bench_quant(float v, float scale)
+{
+    float q = roundf(v / scale);
+    if (q > 127.0f) q = 127.0f;
+    if (q < -128.0f) q = -128.0f;
+    return (int8_t)q;
+}
+
+/* Embedding that slides from the success to the failure prototype */
+static void bench_embed(const bench_ctx_t *c, float t, int8_t *out)
+{
+    for (int i = 0; i < c->out_c; i++)
+        out[i] = bench_quant(t * c->proto_fail[i] + (1.0f - t) * c->proto_succ[i],
+                             c->out_scale);
+}
+
+static int bench_rknn_run(rknn_context context, rknn_run_extend *extend)
+{
+    (void)extend;
+    bench_ctx_t *c = bench_ctx(context);
+    if (!c || !c->input || !c->output) return -1;
+
+    const uint8_t *in = (const uint8_t *)c->input->virt_addr;
+    int8_t *out = (int8_t *)c->output->virt_addr;
+    if (g_bench.record_inputs)
+        g_bench.last_input_fnv = fd_fnv1a_update(FD_FNV1A_INIT, in, c->input->size);
+
+    switch (c->kind) {
+    case BENCH_MODEL_CNN: {
+        float l = 6.0f * (bench_texture(in, 0, 0, FD_MODEL_INPUT_WIDTH,
+                                        FD_MODEL_INPUT_HEIGHT) - 0.5f);
+        out[0] = bench_quant(l, c->out_scale);      /* failure */
+        out[1] = bench_quant(-l, c->out_scale);     /* success */
+        break;
+    }
+    case BENCH_MODEL_MULTICLASS: {
+        float l = 6.0f * (bench_texture(in, 0, 0, FD_MODEL_INPUT_WIDTH,
+                                        FD_MODEL_INPUT_HEIGHT) - 0.5f);
+        for (int i = 0; i < FD_MCLASS_COUNT; i++)
+            out[i] = bench_quant(-2.0f, c->out_scale);
+        out[FD_MCLASS_SPAGHETTI] = bench_quant(l, c->out_scale);
+        out[FD_MCLASS_SUCCESS] = bench_quant(-l, c->out_scale);
+        break;
+    }
+    case BENCH_MODEL_ENCODER:
+        bench_embed(c, bench_texture(in, 0, 0, FD_MODEL_INPUT_WIDTH,
+                                     FD_MODEL_INPUT_HEIGHT), out);
+        break;
+    case BENCH_MODEL_SPATIAL:
+    case BENCH_MODEL_SPATIAL_COARSE:
+        for (int h = 0; h < c->out_h; h++)
+            for (int w = 0; w < c->out_w; w++) {
+                int x0 = w * FD_MODEL_INPUT_WIDTH / c->out_w;
+                int x1 = (w + 1) * FD_MODEL_INPUT_WIDTH / c->out_w;
+                int y0 = h * FD_MODEL_INPUT_HEIGHT / c->out_h;
+                int y1 = (h + 1) * FD_MODEL_INPUT_HEIGHT / c->out_h;
+                bench_embed(c, bench_texture(in, x0, y0, x1, y1),
+                            out + (h * c->out_w + w) * c->out_c);
+            }
+        break;
+    }
+
+    if (g_bench.npu_us > 0)
+        usleep(g_bench.npu_us);
+    g_bench.runs++;
+    return 0;
+}
+
+/* Install the stub in place of the dlopen'd runtime. The non-NULL handle
+ * makes fd_rknn_load() a no-op; it is never passed to dlclose(). */
+static void bench_rknn_install(void)
+{
+    static int sentinel;
+    g_rknn.handle = &sentinel;
+    g_rknn.init = bench_rknn_init;
+    g_rknn.query = bench_rknn_query;
+    g_rknn.create_mem = bench_rknn_create_mem;
+    g_rknn.set_io_mem = bench_rknn_set_io_mem;
+    g_rknn.run = bench_rknn_run;
+    g_rknn.destroy_mem = bench_rknn_destroy_mem;
+    g_rknn.destroy = bench_rknn_destroy;
+    g_rknn.create_mem_from_fd = bench_rknn_create_mem_from_fd;
+}
+
+/* ============================================================================
+ * Timing series
+ * ============================================================================ */
+
+#define BENCH_HIST_BUCKETS 20       /* log2 buckets from 1/16 ms to 32 s */
+
+typedef struct {
+    const char *name;
+    double *v;
+    int n, cap;
+} bench_series_t;
+
+static void bench_series_add(bench_series_t *s, double ms)
+{
+    if (s->n == s->cap) {
+        int cap = s->cap ? s->cap * 2 : 256;
+        double *v = (double *)realloc(s->v, cap * sizeof(double));
+        if (!v) return;
+        s->v = v;
+        s->cap = cap;
+    }
+    s->v[s->n++] = ms;
+}
+
+static int bench_cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static int bench_bucket(double ms)
+{
+    int b = 0;
+    double edge = 1.0 / 16.0;
+    while (ms >= edge && b < BENCH_HIST_BUCKETS - 1) {
+        edge *= 2.0;
+        b++;
+    }
+    return b;
+}
+
+/* Percentiles plus a log2 histogram. Sorts the samples in place. */
+static void bench_series_print(bench_series_t *s)
+{
+    if (s->n == 0) return;
+    qsort(s->v, s->n, sizeof(double), bench_cmp_double);
+
+    double sum = 0;
+    for (int i = 0; i < s->n; i++) sum += s->v[i];
+    printf("\n%s: n=%d mean=%.2f p50=%.2f p90=%.2f p99=%.2f max=%.2f ms\n",
+           s->name, s->n, sum / s->n,
+           s->v[(s->n - 1) * 50 / 100], s->v[(s->n - 1) * 90 / 100],
+           s->v[(s->n - 1) * 99 / 100], s->v[s->n - 1]);
+
+    int hist[BENCH_HIST_BUCKETS] = {0};
+    int lo = BENCH_HIST_BUCKETS, hi = 0, peak = 0;
+    for (int i = 0; i < s->n; i++) {
+        int b = bench_bucket(s->v[i]);
+        hist[b]++;
+        if (b < lo) lo = b;
+        if (b > hi) hi = b;
+    }
+    for (int b = lo; b <= hi; b++)
+        if (hist[b] > peak) peak = hist[b];
+
+    for (int b = lo; b <= hi; b++) {
+        double from = b == 0 ? 0.0 : ldexp(1.0, b - 5);
+        double to = ldexp(1.0, b - 4);
+        int bar = peak ? (hist[b] * 40 + peak - 1) / peak : 0;
+        printf("  %9.3f - %9.3f ms %6d |%.*s\n", from, to, hist[b],
+               bar, "########################################");
+    }
+}
+
+/* ============================================================================
+ * Configuration
+ * ============================================================================ */
+
+static const struct {
+    const char *name;
+    size_t off;
+    int is_int;
+} g_bench_thresholds[] = {
+#define TH_F(f) { #f, offsetof(fd_active_thresholds_t, f), 0 }
+    TH_F(cnn_threshold), TH_F(cnn_dynamic_threshold),
+    TH_F(proto_threshold), TH_F(proto_dynamic_trigger),
+    TH_F(multi_threshold), TH_F(heatmap_boost_threshold),
+    { "boost_min_cells", offsetof(fd_active_thresholds_t, boost_min_cells), 1 },
+    TH_F(boost_cell_threshold), TH_F(boost_lean_factor),
+    TH_F(boost_proto_lean), TH_F(boost_multi_lean),
+    TH_F(boost_proto_veto), TH_F(boost_proto_strong),
+    TH_F(boost_amplifier_cap), TH_F(boost_confidence_cap),
+    TH_F(ema_alpha), TH_F(heatmap_coarse_weight),
+    TH_F(cascade_cnn_ok), TH_F(cascade_proto_ok),
+#undef TH_F
+};
+
+#define BENCH_NUM_THRESHOLDS \
+    (int)(sizeof(g_bench_thresholds) / sizeof(g_bench_thresholds[0]))
+
+/* Parse "name=value" into cfg->thresholds. Returns 0 on success. */
+static int bench_set_threshold(fd_config_t *cfg, const char *arg)
+{
+    const char *eq = strchr(arg, '=');
+    if (!eq) return -1;
+    size_t len = (size_t)(eq - arg);
+    for (int i = 0; i < BENCH_NUM_THRESHOLDS; i++) {
+        if (strlen(g_bench_thresholds[i].name) != len ||
+            strncmp(g_bench_thresholds[i].name, arg, len) != 0)
+            continue;
+        char *p = (char *)&cfg->thresholds + g_bench_thresholds[i].off;
+        if (g_bench_thresholds[i].is_int)
+            *(int *)p = atoi(eq + 1);
+        else
+            *(float *)p = (float)atof(eq + 1);
+        return 0;
+    }
+    return -1;
+}
+
+static void bench_apply_profile(fd_config_t *cfg, const fd_threshold_profile_t *p)
+{
+    fd_active_thresholds_t *t = &cfg->thresholds;
+    snprintf(t->profile, sizeof(t->profile), "%s", p->name);
+    t->cnn_threshold = p->cnn_threshold;
+    t->cnn_dynamic_threshold = p->cnn_dynamic_threshold;
+    t->proto_threshold = p->proto_threshold;
+    t->proto_dynamic_trigger = p->proto_dynamic_trigger;
+    t->multi_threshold = p->multi_threshold;
+    t->heatmap_boost_threshold = p->heatmap_boost_threshold;
+    t->boost_min_cells = p->boost_min_cells;
+    t->boost_cell_threshold = p->boost_cell_threshold;
+    t->boost_lean_factor = p->boost_lean_factor;
+    t->boost_proto_lean = p->boost_proto_lean;
+    t->boost_multi_lean = p->boost_multi_lean;
+    t->boost_proto_veto = p->boost_proto_veto;
+    t->boost_proto_strong = p->boost_proto_strong;
+    t->boost_amplifier_cap = p->boost_amplifier_cap;
+    t->boost_confidence_cap = p->boost_confidence_cap;
+    t->ema_alpha = p->ema_alpha;
+    t->heatmap_coarse_weight = p->heatmap_coarse_weight;
+    t->cascade_cnn_ok = p->cascade_cnn_ok;
+    t->cascade_proto_ok = p->cascade_proto_ok;
+}
+
+static void bench_print_thresholds(const fd_config_t *cfg)
+{
+    fd_thresholds_t th;
+    fd_get_thresholds(cfg, cfg->strategy, &th);
+    printf("# thresholds: cnn=%.2f cnn_dyn=%.2f proto=%.2f proto_dyn=%.2f multi=%.2f\n",
+           th.cnn_th, th.cnn_dyn_th, th.proto_th, th.proto_dyn_trigger, th.multi_th);
+    printf("# boost: th=%.2f min_cells=%d cell=%.2f lean=%.2f proto_lean=%.2f "
+           "multi_lean=%.2f veto=%.2f strong=%.2f amp_cap=%.2f conf_cap=%.2f\n",
+           th.heatmap_boost_th, th.boost_min_cells, th.boost_cell_th,
+           th.boost_lean_factor, th.boost_proto_lean, th.boost_multi_lean,
+           th.boost_proto_veto, th.boost_proto_strong, th.boost_amp_cap,
+           th.boost_conf_cap);
+    printf("# ema_alpha=%.2f coarse_wt=%.2f cascade_cnn_ok=%.2f cascade_proto_ok=%.2f\n",
+           th.ema_alpha, th.heatmap_coarse_wt, th.cascade_cnn_ok, th.cascade_proto_ok);
+}
+
+/* ============================================================================
+ * Replay
+ * ============================================================================ */
+
+static uint8_t *bench_read_file(const char *path, size_t *size)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f) return NULL;
+    fseek(f, 0, SEEK_END);
+    long len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t *buf = len > 0 ? (uint8_t *)malloc(len) : NULL;
+    if (buf && fread(buf, 1, len, f) != (size_t)len) {
+        free(buf);
+        buf = NULL;
+    }
+    fclose(f);
+    *size = buf ? (size_t)len : 0;
+    return buf;
+}
+
+/* Append frames from a JPEG file or a directory of them (sorted) */
+static int bench_add_frames(const char *path, char ***list, int *count)
+{
+    struct stat st;
+    if (stat(path, &st) != 0) return -1;
+
+    int n = 0;
+    char **found = NULL;
+    if (S_ISDIR(st.st_mode)) {
+        found = fd_collect_jpegs(path, &n);
+    } else {
+        found = (char **)malloc(sizeof(char *));
+        if (found) {
+            found[0] = strdup(path);
+            n = 1;
+        }
+    }
+    if (n == 0) {
+        fd_free_jpeg_list(found, n);
+        return 0;
+    }
+
+    char **grown = (char **)realloc(*list, (*count + n) * sizeof(char *));
+    if (!grown) {
+        fd_free_jpeg_list(found, n);
+        return -1;
+    }
+    memcpy(grown + *count, found, n * sizeof(char *));
+    free(found);
+    *list = grown;
+    *count += n;
+    return n;
+}
+
+/* ============================================================================
+ * Dataset download (-G)
+ * ============================================================================ */
+
+static struct {
+    const char *url;
+    const char *dest;
+    char err[128];
+    int ret;
+    volatile int finished;
+} g_bench_dl;
+
+static void *bench_download_thread(void *arg)
+{
+    (void)arg;
+    g_bench_dl.ret = fd_dataset_install(g_bench_dl.url, g_bench_dl.dest,
+                                        g_bench_dl.err, sizeof(g_bench_dl.err));
+    g_bench_dl.finished = 1;
+    return NULL;
+}
+
+/* Ctrl-C cancels like the web UI's cancel button */
+static void bench_download_cancel(int sig)
+{
+    (void)sig;
+    fault_detect_cancel_download();
+}
+
+/* Stream a dataset archive through the downloader/extractor the printer
+ * uses, polling the same progress struct the web UI reads */
+static int bench_download(const char *url, const char *dest)
+{
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGINT, bench_download_cancel);
+    g_bench_dl.url = url;
+    g_bench_dl.dest = dest;
+
+    pthread_t th;
+    double t0 = fd_get_time_ms();
+    if (pthread_create(&th, NULL, bench_download_thread, NULL) != 0)
+        return 1;
+    fd_download_progress_t p;
+    while (!g_bench_dl.finished) {
+        usleep(500000);
+        p = fault_detect_get_download_progress();
+        printf("  %10zu / %10zu bytes %3d%%  files=%d retries=%d\n",
+               p.downloaded_bytes, p.total_bytes, p.progress_pct,
+               p.files, p.retries);
+    }
+    pthread_join(th, NULL);
+
+    p = fault_detect_get_download_progress();
+    double sec = (fd_get_time_ms() - t0) / 1000.0;
+    if (g_bench_dl.ret != 0) {
+        printf("download failed: %s\n",
+               g_bench_dl.ret == -2 ? "cancelled" : g_bench_dl.err);
+        return 1;
+    }
+    printf("download: %zu bytes, %d files, %d retries in %.1fs -> %s/%s\n",
+           p.downloaded_bytes, p.files, p.retries, sec, dest, FD_DL_MANIFEST);
+    return 0;
+}
+
+/* ============================================================================
+ * Self-checks (-V)
+ * ============================================================================ */
+
+static int g_check_failures;
+
+static void bench_check(int ok, const char *what)
+{
+    printf("  %-4s %s\n", ok ? "ok" : "FAIL", what);
+    if (!ok) g_check_failures++;
+}
+
+static uint32_t g_check_seed = 12345;
+
+/* Uniform in [-1, 1), reproducible across runs and hosts */
+static float bench_rand(void)
+{
+    g_check_seed = g_check_seed * 1664525u + 1013904223u;
+    return (float)(g_check_seed >> 8) / 8388608.0f - 1.0f;
+}
+
+/* The margin as fd_margin_eval computed it before folding and NEON: two
+ * plain scalar cosines, each with its own pass over x */
+static float bench_ref_cosine(const float *a, const float *b, int n)
+{
+    double dot = 0.0, na = 0.0, nb = 0.0;
+    for (int i = 0; i < n; i++) {
+        dot += (double)a[i] * b[i];
+        na += (double)a[i] * a[i];
+        nb += (double)b[i] * b[i];
+    }
+    if (na < 1e-24 || nb < 1e-24)
+        return 0.0f;
+    return (float)(dot / (sqrt(na) * sqrt(nb)));
+}
+
+static float bench_ref_margin(const float *x, const float *fail, const float *succ, int n)
+{
+    return bench_ref_cosine(x, fail, n) - bench_ref_cosine(x, succ, n);
+}
+
+static float bench_norm(const float *v, int n)
+{
+    float sq = 0.0f;
+    for (int i = 0; i < n; i++)
+        sq += v[i] * v[i];
+    return sqrtf(sq);
+}
+
+/* fd_margin_eval (NEON when built for ARM) and fd_margin_eval_q8 against the
+ * scalar reference, over dims that exercise the vector body and the tail,
+ * for prototypes exported pre-normalized and not */
+static void bench_check_margin(void)
+{
+    static const int dims[] = { 1, 7, 8, 9, 17, 232, 1024 };
+    static const float proto_norms[] = { 0.5f, 1.0f, 40.0f };
+    static float fail[FD_SPATIAL_EMB_MAX], succ[FD_SPATIAL_EMB_MAX];
+    static float x[FD_SPATIAL_EMB_MAX], xq[FD_SPATIAL_EMB_MAX];
+    static int8_t q[FD_SPATIAL_EMB_MAX];
+    static fd_margin_t m;
+    char what[96];
+
+    for (size_t d = 0; d < sizeof(dims) / sizeof(dims[0]); d++) {
+        int n = dims[d];
+        for (size_t k = 0; k < sizeof(proto_norms) / sizeof(proto_norms[0]); k++) {
+            for (int i = 0; i < n; i++) {
+                fail[i] = bench_rand();
+                succ[i] = bench_rand();
+            }
+            float nf = bench_norm(fail, n), ns = bench_norm(succ, n);
+            for (int i = 0; i < n; i++) {
+                fail[i] *= proto_norms[k] / nf;
+                succ[i] *= proto_norms[k] / ns;
+            }
+            fd_margin_prepare(&m, fail, succ, proto_norms[k], proto_norms[k], n);
+
+            float err = 0.0f, err_q = 0.0f;
+            for (int t = 0; t < 64; t++) {
+                /* Blend of the prototypes plus noise, so margins span [-1, 1] */
+                float a = (t % 9) / 8.0f;
+                int32_t zp = t % 3 - 1;
+                float scale = 4.0f / 127.0f;
+                for (int i = 0; i < n; i++) {
+                    x[i] = 3.0f * (a * fail[i] + (1.0f - a) * succ[i]) / proto_norms[k]
+                           + 0.2f * bench_rand();
+                    q[i] = bench_quant(x[i], scale) + zp;
+                    xq[i] = (q[i] - zp) * scale;
+                }
+                float e = fabsf(fd_margin_eval(&m, x) -
+                                bench_ref_margin(x, fail, succ, n));
+                float eq = fabsf(fd_margin_eval_q8(&m, q, zp) -
+                                 bench_ref_margin(xq, fail, succ, n));
+                if (e > err) err = e;
+                if (eq > err_q) err_q = eq;
+            }
+            snprintf(what, sizeof(what), "margin dim %4d |proto| %4.1f: "
+                     "f32 err %.1e, int8 err %.1e", n, proto_norms[k], err, err_q);
+            /* The int8 path also carries qdir's 15-bit rounding */
+            bench_check(err < 1e-4f && err_q < 2e-3f, what);
+        }
+    }
+}
+
+/* fd_compute_heatmap on an int8 affine output (fixed point on the raw
+ * tensor) against the same tensor declared unquantized (dequantize, then
+ * float margins), with the grid sizes and zero points the encoders use.
+ * Cell 0 sits exactly at the zero point, cell 1 is saturated. */
+static void bench_check_heatmap(void)
+{
+    static const struct { int h, w, dim; } grids[] = {
+        { 7, 14, 256 }, { 14, 28, 128 }, { FD_SPATIAL_H_MAX, FD_SPATIAL_W_MAX, FD_SPATIAL_EMB_MAX },
+    };
+    static const int32_t zps[] = { 0, -9, 37 };
+    static float fail[FD_SPATIAL_EMB_MAX], succ[FD_SPATIAL_EMB_MAX];
+    static float hm_q[FD_SPATIAL_H_MAX][FD_SPATIAL_W_MAX];
+    static float hm_f[FD_SPATIAL_H_MAX][FD_SPATIAL_W_MAX];
+    static float hm_m[FD_SPATIAL_H_MAX][FD_SPATIAL_W_MAX];
+    static fd_margin_t mg;
+    const size_t max = (size_t)FD_SPATIAL_H_MAX * FD_SPATIAL_W_MAX * FD_SPATIAL_EMB_MAX;
+    int8_t *raw = malloc(max);
+    char what[128];
+
+    if (!raw) {
+        bench_check(0, "heatmap: out of memory");
+        return;
+    }
+    rknn_tensor_mem mem = { .virt_addr = raw };
+    fd_rknn_model_t model;
+    memset(&model, 0, sizeof(model));
+    model.io_num.n_output = 1;
+    model.output_mems[0] = &mem;
+
+    for (size_t g = 0; g < sizeof(grids) / sizeof(grids[0]); g++) {
+        int h = grids[g].h, w = grids[g].w, n = grids[g].dim, cells = h * w;
+        for (int i = 0; i < n; i++) {
+            fail[i] = bench_rand();
+            succ[i] = bench_rand();
+        }
+        fd_margin_prepare(&mg, fail, succ, bench_norm(fail, n), bench_norm(succ, n), n);
+
+        int masked_ok = 1;
+        for (size_t z = 0; z < sizeof(zps) / sizeof(zps[0]); z++) {
+            int32_t zp = zps[z];
+            for (int c = 0; c < cells; c++) {
+                float a = (c % 11) / 10.0f;
+                for (int i = 0; i < n; i++) {
+                    int v = (c == 0) ? zp : (c == 1) ? ((i & 1) ? 127 : -128) :
+                            (int)lroundf(40.0f * (a * fail[i] + (1.0f - a) * succ[i]) +
+                                         8.0f * bench_rand()) + zp;
+                    raw[(size_t)c * n + i] = (int8_t)(v > 127 ? 127 : v < -128 ? -128 : v);
+                }
+            }
+            rknn_tensor_attr *attr = &model.output_attrs[0];
+            attr->n_elems = (uint32_t)(cells * n);
+            attr->type = RKNN_TENSOR_INT8;
+            attr->qnt_type = RKNN_TENSOR_QNT_AFFINE_ASYMMETRIC;
+            attr->zp = zp;
+            attr->scale = 0.05f;
+            int rq = fd_compute_heatmap(&model, h, w, n, &mg, NULL, hm_q);
+
+            /* Same bytes through the dequantizing fallback */
+            attr->qnt_type = RKNN_TENSOR_QNT_NONE;
+            int rf = fd_compute_heatmap(&model, h, w, n, &mg, NULL, hm_f);
+
+            float err = 0.0f;
+            int finite = 1;
+            for (int c = 0; c < cells; c++) {
+                float q = hm_q[c / w][c % w], f = hm_f[c / w][c % w];
+                if (!isfinite(q)) finite = 0;
+                if (fabsf(q - f) > err) err = fabsf(q - f);
+            }
+            snprintf(what, sizeof(what), "heatmap %2dx%2dx%4d zp %3d: int8 vs dequantized err %.1e",
+                     h, w, n, zp, err);
+            bench_check(rq == 0 && rf == 0 && finite && err < 2e-3f &&
+                        hm_q[0][0] == 0.0f && hm_f[0][0] == 0.0f, what);
+
+            /* A cell mask scores only its cells, with identical values */
+            fd_mask196_t mask;
+            fd_mask_clear(&mask);
+            for (int c = 0; c < cells; c += 3)
+                fd_mask_set_bit(&mask, c);
+            for (int c = 0; c < cells; c++)
+                hm_m[c / w][c % w] = 9.0f;
+            attr->qnt_type = RKNN_TENSOR_QNT_AFFINE_ASYMMETRIC;
+            if (fd_compute_heatmap(&model, h, w, n, &mg, &mask, hm_m) < 0)
+                masked_ok = 0;
+            for (int c = 0; c < cells; c++)
+                if (hm_m[c / w][c % w] != (c % 3 == 0 ? hm_q[c / w][c % w] : 9.0f))
+                    masked_ok = 0;
+        }
+        snprintf(what, sizeof(what), "heatmap %2dx%2dx%4d: cell mask scores only its cells",
+                 h, w, n);
+        bench_check(masked_ok, what);
+    }
+
+    /* A tensor smaller than the grid is refused, not read past */
+    model.output_attrs[0].n_elems = 7 * 14 * 256 - 1;
+    bench_check(fd_compute_heatmap(&model, 7, 14, 256, &mg, NULL, hm_q) < 0,
+                "heatmap refuses a short output tensor");
+    free(raw);
+}
+
+/* Time a full-size heatmap: reference scalar cosines vs the folded path */
+static void bench_margin_speed(void)
+{
+    const int cells = FD_SPATIAL_H_MAX * FD_SPATIAL_W_MAX, n = FD_SPATIAL_EMB_MAX;
+    float *fail = malloc(n * sizeof(float)), *succ = malloc(n * sizeof(float));
+    float *x = malloc((size_t)cells * n * sizeof(float));
+    int8_t *q = malloc((size_t)cells * n);
+    static fd_margin_t m;
+    if (!fail || !succ || !x || !q) {
+        free(fail); free(succ); free(x); free(q);
+        return;
+    }
+    for (int i = 0; i < n; i++) {
+        fail[i] = bench_rand();
+        succ[i] = bench_rand();
+    }
+    for (int i = 0; i < cells * n; i++) {
+        x[i] = bench_rand();
+        q[i] = bench_quant(x[i], 1.0f / 127.0f);
+    }
+    fd_margin_prepare(&m, fail, succ, bench_norm(fail, n), bench_norm(succ, n), n);
+
+    const int reps = 20;
+    volatile float sink = 0.0f;
+    double t0 = fd_get_time_ms();
+    for (int r = 0; r < reps; r++)
+        for (int c = 0; c < cells; c++)
+            sink += bench_ref_margin(x + (size_t)c * n, fail, succ, n);
+    double t1 = fd_get_time_ms();
+    for (int r = 0; r < reps; r++)
+        for (int c = 0; c < cells; c++)
+            sink += fd_margin_eval(&m, x + (size_t)c * n);
+    double t2 = fd_get_time_ms();
+    for (int r = 0; r < reps; r++)
+        for (int c = 0; c < cells; c++)
+            sink += fd_margin_eval_q8(&m, q + (size_t)c * n, 0);
+    double t3 = fd_get_time_ms();
+    (void)sink;
+
+    printf("  heatmap %dx%dx%d (%s): scalar cosines %.3f ms, "
+           "folded f32 %.3f ms, folded int8 %.3f ms\n",
+           FD_SPATIAL_H_MAX, FD_SPATIAL_W_MAX, n,
+#if defined(__ARM_NEON)
+           "NEON",
+#else
+           "scalar build",
+#endif
+           (t1 - t0) / reps, (t2 - t1) / reps, (t3 - t2) / reps);
+    free(fail); free(succ); free(x); free(q);
+}
+
+/* Stub contexts still alive; the cache must not leak any */
+static int bench_live_contexts(void)
+{
+    int n = 0;
+    for (int i = 0; i < BENCH_MAX_CTX; i++)
+        if (g_bench.ctx[i].used) n++;
+    return n;
+}
+
+/* acquire + put every path once, like one detection cycle */
+static int bench_cache_cycle(const char *const *paths, int n)
+{
+    for (int i = 0; i < n; i++) {
+        int err = 0;
+        fd_rknn_model_t *m = fd_model_acquire(paths[i], &err);
+        if (!m) return -1;
+        fd_model_put(m);
+    }
+    return 0;
+}
+
+static void bench_cache_reset(int budget_mb)
+{
+    fd_model_cache_set_budget(0);
+    fd_model_cache_set_budget(budget_mb);
+    memset(&g_fd_cache.stats, 0, sizeof(g_fd_cache.stats));
+    g_fd_cache.load_ms_total = 0.0;
+}
+
+/* Resident model cache against the stub runtime. The stub has no
+ * RKNN_QUERY_MEM_SIZE, so each context is charged its I/O tensors
+ * (~300 KB, the model files don't exist): three fit in 1 MB, four don't. */
+static void bench_check_model_cache(void)
+{
+    static const char *const paths[] = {
+        "/bench/cnn/model.rknn",
+        "/bench/multiclass/model.rknn",
+        "/bench/protonet/encoder.rknn",
+        "/bench/protonet/spatial_encoder.rknn",
+    };
+    fd_model_cache_stats_t st;
+    char what[128];
+
+    bench_rknn_install();
+
+    /* Budget 0: load per cycle, nothing resident, nothing "evicted" */
+    bench_cache_reset(0);
+    int ok = bench_cache_cycle(paths, 3) == 0 && bench_cache_cycle(paths, 3) == 0;
+    st = fault_detect_get_model_cache_stats();
+    snprintf(what, sizeof(what), "budget 0: %u misses, %u hits, %u evictions, %d resident",
+             st.misses, st.hits, st.evictions, st.resident);
+    bench_check(ok && st.misses == 6 && st.hits == 0 && st.evictions == 0 &&
+                st.resident == 0 && st.cma_kb == 0 && bench_live_contexts() == 0, what);
+
+    /* 1 MB: the three stay resident and the second cycle only hits */
+    bench_cache_reset(1);
+    ok = bench_cache_cycle(paths, 3) == 0 && bench_cache_cycle(paths, 3) == 0;
+    st = fault_detect_get_model_cache_stats();
+    snprintf(what, sizeof(what), "budget 1 MB: %u misses, %u hits, %u evictions, %d resident",
+             st.misses, st.hits, st.evictions, st.resident);
+    bench_check(ok && st.misses == 3 && st.hits == 3 && st.evictions == 0 &&
+                st.resident == 3 && bench_live_contexts() == 3, what);
+
+    /* A fourth model pushes out the least recently used one (the CNN) */
+    ok = bench_cache_cycle(paths + 3, 1) == 0 && bench_cache_cycle(paths + 1, 2) == 0;
+    st = fault_detect_get_model_cache_stats();
+    snprintf(what, sizeof(what), "over budget: %u evictions, %d resident, %u/%u KB",
+             st.evictions, st.resident, st.cma_kb, st.budget_kb);
+    bench_check(ok && st.evictions == 1 && st.resident == 3 && st.hits == 5 &&
+                st.cma_kb <= st.budget_kb, what);
+    ok = bench_cache_cycle(paths, 1) == 0;
+    st = fault_detect_get_model_cache_stats();
+    bench_check(ok && st.misses == 5 && st.evictions == 2, "evicted model reloads on a miss");
+
+    /* Lowering the budget to 0 drops the resident set: real evictions */
+    fd_model_cache_set_budget(0);
+    st = fault_detect_get_model_cache_stats();
+    bench_check(st.evictions == 5 && st.resident == 0 && st.cma_kb == 0 &&
+                bench_live_contexts() == 0, "budget lowered to 0 evicts the resident set");
+
+    /* A model larger than the whole budget is never cached either */
+    bench_cache_reset(1);
+    pthread_mutex_lock(&g_fd_cache.mutex);
+    g_fd_cache.budget = 64 * 1024;
+    pthread_mutex_unlock(&g_fd_cache.mutex);
+    ok = bench_cache_cycle(paths, 1) == 0 && bench_cache_cycle(paths, 1) == 0;
+    st = fault_detect_get_model_cache_stats();
+    bench_check(ok && st.misses == 2 && st.evictions == 0 && st.resident == 0 &&
+                bench_live_contexts() == 0, "model over the whole budget: not cached, not evicted");
+
+    bench_cache_reset(0);
+}
+
+/* Every model must read exactly the bytes fd_preprocess wrote, whether it
+ * is bound to the shared tensor (zero copy) or handed a packed buffer, and
+ * whether it stays resident or is reloaded each cycle. The reference is the
+ * same frame preprocessed into a private packed buffer. */
+static void bench_check_shared_input(void)
+{
+    static const char *const paths[] = {
+        "/bench/cnn/model.rknn",
+        "/bench/multiclass/model.rknn",
+        "/bench/protonet/encoder.rknn",
+        "/bench/protonet/spatial_encoder.rknn",
+    };
+    const int nmodels = (int)(sizeof(paths) / sizeof(paths[0]));
+    static const int budgets[] = { 0, 24 };
+    fd_image_t img = { NULL, 1280, 720 };
+    uint8_t *ref = (uint8_t *)malloc(FD_MODEL_INPUT_BYTES);
+    char what[128];
+
+    img.data = (uint8_t *)malloc((size_t)img.width * img.height * 3);
+    if (!img.data || !ref) {
+        bench_check(0, "shared input: out of memory");
+        free(img.data); free(ref);
+        return;
+    }
+
+    bench_rknn_install();
+    g_bench.record_inputs = 1;
+    for (int frame = 0; frame < 2; frame++) {
+        for (size_t i = 0; i < (size_t)img.width * img.height * 3; i++)
+            img.data[i] = (uint8_t)((bench_rand() + 1.0f) * 127.5f);
+        fd_preprocess(&img, ref);
+        uint64_t want = fd_fnv1a_update(FD_FNV1A_INIT, ref, FD_MODEL_INPUT_BYTES);
+
+        for (size_t b = 0; b < sizeof(budgets) / sizeof(budgets[0]); b++) {
+            bench_cache_reset(budgets[b]);
+
+            /* The first load allocates the shared tensor */
+            int err = 0, same = 0, shared = 0;
+            fd_rknn_model_t *m = fd_model_acquire(paths[0], &err);
+            if (m) fd_model_put(m);
+            if (!g_fd_input.virt) {
+                bench_check(0, "shared input tensor allocated");
+                break;
+            }
+            fd_preprocess(&img, g_fd_input.virt);
+
+            uint32_t zero_copy = g_fd_input.zero_copy_runs;
+            uint32_t copies = g_fd_input.input_copies;
+            for (int i = 0; i < nmodels; i++) {
+                m = fd_model_acquire(paths[i], &err);
+                if (!m) continue;
+                shared += m->shared_input;
+                g_bench.last_input_fnv = 0;
+                if (fd_model_run(m, g_fd_input.virt) == 0 &&
+                    g_bench.last_input_fnv == want)
+                    same++;
+                fd_model_put(m);
+            }
+            snprintf(what, sizeof(what),
+                     "frame %d, budget %2d MB: %d/%d models bound to the shared tensor "
+                     "read it unchanged",
+                     frame, budgets[b], same, nmodels);
+            bench_check(same == nmodels && shared == nmodels &&
+                        g_fd_input.zero_copy_runs - zero_copy == (uint32_t)nmodels &&
+                        g_fd_input.input_copies == copies, what);
+
+            /* A packed buffer is copied into the shared tensor first */
+            same = 0;
+            for (int i = 0; i < nmodels; i++) {
+                m = fd_model_acquire(paths[i], &err);
+                if (!m) continue;
+                g_bench.last_input_fnv = 0;
+                if (fd_model_run(m, ref) == 0 && g_bench.last_input_fnv == want)
+                    same++;
+                fd_model_put(m);
+            }
+            snprintf(what, sizeof(what),
+                     "frame %d, budget %2d MB: %d/%d models given a packed copy read it unchanged",
+                     frame, budgets[b], same, nmodels);
+            bench_check(same == nmodels &&
+                        g_fd_input.input_copies - copies == (uint32_t)nmodels, what);
+        }
+    }
+    g_bench.record_inputs = 0;
+    bench_cache_reset(0);
+    free(img.data);
+    free(ref);
+}
+
+static int bench_self_check(void)
+{
+    printf("# margin math\n");
+    bench_check_margin();
+    bench_check_heatmap();
+    bench_margin_speed();
+
+    printf("# model cache\n");
+    bench_check_model_cache();
+
+    printf("# shared input\n");
+    bench_check_shared_input();
+
+    printf("# %s\n", g_check_failures ? "FAILED" : "all checks passed");
+    return g_check_failures ? 1 : 0;
+}
+
+/* ============================================================================
+ * Prototype computation (-P)
+ * ============================================================================ */
+
+/* Compute prototypes from a dataset dir (failure/ and success/) into a
+ * scratch set, passes times over, with the real decode pipeline and cache */
+static int bench_protos(const char *models_dir, const char *set_name,
+                        const char *dataset, int passes)
+{
+    char parent[512];
+    snprintf(parent, sizeof(parent), "%s", dataset);
+    size_t len = strlen(parent);
+    while (len > 1 && parent[len - 1] == '/')
+        parent[--len] = '\0';
+    char *slash = strrchr(parent, '/');
+    const char *name = parent;
+    snprintf(g_bench_datasets_dir, sizeof(g_bench_datasets_dir), ".");
+    if (slash) {
+        *slash = '\0';
+        name = slash + 1;
+        snprintf(g_bench_datasets_dir, sizeof(g_bench_datasets_dir), "%s",
+                 parent[0] ? parent : "/");
+    }
+    snprintf(g_bench_sets_dir, sizeof(g_bench_sets_dir), "/tmp/fd_bench_sets.XXXXXX");
+    if (!mkdtemp(g_bench_sets_dir)) {
+        perror("mkdtemp");
+        return 1;
+    }
+
+    bench_rknn_install();
+    fault_detect_init(models_dir);
+    fd_model_set_t sets[FD_MAX_SETS];
+    int num_sets = fault_detect_scan_sets(sets, FD_MAX_SETS);
+    const fd_model_set_t *set = NULL;
+    for (int i = 0; i < num_sets && !set; i++)
+        if (!set_name || strcmp(sets[i].dir_name, set_name) == 0)
+            set = &sets[i];
+    if (!set) {
+        printf("fd_bench: model set %s not found in %s\n",
+               set_name ? set_name : "(any)", models_dir);
+        return 1;
+    }
+    pthread_mutex_lock(&g_fd.config_mutex);
+    snprintf(g_fd.config.model_set, sizeof(g_fd.config.model_set), "%s", set->dir_name);
+    pthread_mutex_unlock(&g_fd.config_mutex);
+
+    printf("# fd_bench: prototypes from %s/%s, set=%s npu_latency=%.1fms -> %s/bench\n",
+           g_bench_datasets_dir, name, set->dir_name, g_bench.npu_us / 1000.0,
+           g_bench_sets_dir);
+    for (int pass = 0; pass < passes; pass++) {
+        if (fault_detect_compute_prototypes(name, "bench") != 0)
+            return 1;
+        double t0 = fd_get_time_ms();
+        fd_do_proto_computation();
+        double sec = (fd_get_time_ms() - t0) / 1000.0;
+
+        fd_proto_compute_progress_t p = fault_detect_get_proto_progress();
+        if (p.state != PROTO_COMPUTE_DONE) {
+            printf("  run %d: failed: %s\n", pass + 1, p.error_msg);
+            return 1;
+        }
+        printf("  run %d: %d model passes in %.2fs = %.1f images/s, %d JPEG decodes\n",
+               pass + 1, p.total_images_all, sec,
+               sec > 0.0 ? p.total_images_all / sec : 0.0, p.jpeg_decodes);
+    }
+    return 0;
+}
+
+static void bench_usage(const char *prog)
+{
+    printf("Usage: %s -m MODELS_DIR [options] FRAMES...\n"
+           "       %s -G URL DEST_DIR\n"
+           "       %s -m MODELS_DIR [-s SET] [-n RUNS] -P DATASET_DIR\n"
+           "       %s -V\n"
+           "\n"
+           "Replays JPEG frames (files, or directories such as a timelapse\n"
+           "temp dir) through the fault detection pipeline with a stub NPU.\n"
+           "\n"
+           "Options:\n"
+           "  -m DIR       Models base dir (contains model set directories)\n"
+           "  -s SET       Model set directory name (default: first found)\n"
+           "  -S STRATEGY  Voting strategy (default: or)\n"
+           "  -p PROFILE   Threshold profile from the set's metadata.json\n"
+           "  -t KEY=VAL   Override a threshold, e.g. -t proto_threshold=0.7\n"
+           "  -H           Enable spatial heatmap + boost\n"
+           "  -C           Enable the cascade (cheapest model first, early exit)\n"
+           "  -n PASSES    Replay the frames PASSES times (default: 1)\n"
+           "  -l MS        Simulated NPU latency per inference (default: 0)\n"
+           "  -g GAIN      Gradient that maps to stub fault score 1.0 (default: 16)\n"
+           "  -b MB        Model cache budget (default: 24, 0 = load per inference)\n"
+           "  -q           Silence pipeline [FD] logging\n"
+           "  -T           Summary only, no per-frame trace\n"
+           "  -G URL       Download and extract a .tar.gz dataset into DEST_DIR\n"
+           "  -P DIR       Compute prototypes from dataset DIR (failure/, success/)\n"
+           "               RUNS times into a scratch set, reporting images/s\n"
+           "  -V           Run the self-checks and micro-benchmarks, then exit\n"
+           "\n"
+           "Thresholds:", prog, prog, prog, prog);
+    for (int i = 0; i < BENCH_NUM_THRESHOLDS; i++)
+        printf("%s%s", i % 4 ? " " : "\n  ", g_bench_thresholds[i].name);
+    printf("\n");
+}
+
+int main(int argc, char *argv[])
+{
+    const char *models_dir = NULL;
+    const char *set_name = NULL;
+    const char *profile = NULL;
+    const char *strategy = "or";
+    const char *overrides[32];
+    int num_overrides = 0;
+    const char *download_url = NULL;
+    const char *proto_dataset = NULL;
+    int heatmap = 0, cascade = 0, passes = 1, cache_mb = 24, quiet = 0, trace = 1;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "m:s:S:p:t:HCn:l:g:b:qTG:P:Vh")) != -1) {
+        switch (opt) {
+        case 'm': models_dir = optarg; break;
+        case 's': set_name = optarg; break;
+        case 'S': strategy = optarg; break;
+        case 'p': profile = optarg; break;
+        case 't':
+            if (num_overrides < 32) overrides[num_overrides++] = optarg;
+            break;
+        case 'H': heatmap = 1; break;
+        case 'C': cascade = 1; break;
+        case 'n': passes = atoi(optarg); break;
+        case 'l': g_bench.npu_us = (int)(atof(optarg) * 1000.0); break;
+        case 'g': g_bench.texture_gain = (float)atof(optarg); break;
+        case 'b': cache_mb = atoi(optarg); break;
+        case 'q': quiet = 1; break;
+        case 'T': trace = 0; break;
+        case 'G': download_url = optarg; break;
+        case 'P': proto_dataset = optarg; break;
+        case 'V': return bench_self_check();
+        default:
+            bench_usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (download_url) {
+        if (optind != argc - 1) {
+            bench_usage(argv[0]);
+            return 1;
+        }
+        return bench_download(download_url, argv[optind]);
+    }
+    if (proto_dataset) {
+        if (!models_dir || passes < 1) {
+            bench_usage(argv[0]);
+            return 1;
+        }
+        if (quiet && !freopen("/dev/null", "w", stderr))
+            return 1;
+        return bench_protos(models_dir, set_name, proto_dataset, passes);
+    }
+    if (!models_dir || optind >= argc || passes < 1 || g_bench.texture_gain <= 0.0f) {
+        bench_usage(argv[0]);
+        return 1;
+    }
+
+    char **frames = NULL;
+    int num_frames = 0;
+    for (int i = optind; i < argc; i++)
+        if (bench_add_frames(argv[i], &frames, &num_frames) < 0)
+            fprintf(stderr, "fd_bench: cannot read %s\n", argv[i]);
+    if (num_frames == 0) {
+        fprintf(stderr, "fd_bench: no JPEG frames found\n");
+        return 1;
+    }
+
+    /* Bench errors go to stdout from here on */
+    if (quiet && !freopen("/dev/null", "w", stderr))
+        return 1;
+
+    bench_rknn_install();
+    fault_detect_init(models_dir);
+
+    /* Pick the model set and enable whatever it ships */
+    fd_model_set_t sets[FD_MAX_SETS];
+    int num_sets = fault_detect_scan_sets(sets, FD_MAX_SETS);
+    const fd_model_set_t *set = NULL;
+    for (int i = 0; i < num_sets && !set; i++)
+        if (!set_name || strcmp(sets[i].dir_name, set_name) == 0)
+            set = &sets[i];
+    if (!set) {
+        printf("fd_bench: model set %s not found in %s\n",
+                set_name ? set_name : "(any)", models_dir);
+        return 1;
+    }
+
+    fd_config_t cfg;
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.enabled = 1;
+    cfg.cnn_enabled = set->has_cnn;
+    cfg.proto_enabled = set->has_protonet;
+    cfg.multi_enabled = set->has_multiclass;
+    cfg.strategy = fd_strategy_from_name(strategy);
+    cfg.heatmap_enabled = heatmap;
+    cfg.cascade_enabled = cascade;
+    cfg.model_cache_mb = cache_mb;
+    snprintf(cfg.model_set, sizeof(cfg.model_set), "%s", set->dir_name);
+    snprintf(cfg.cnn_file, sizeof(cfg.cnn_file), "%s", set->cnn_file);
+    snprintf(cfg.proto_file, sizeof(cfg.proto_file), "%s", set->proto_file);
+    snprintf(cfg.proto_prototypes, sizeof(cfg.proto_prototypes), "%s",
+             set->proto_prototypes);
+    snprintf(cfg.multi_file, sizeof(cfg.multi_file), "%s", set->multi_file);
+
+    if (profile) {
+        int found = 0;
+        for (int i = 0; i < set->num_profiles && !found; i++) {
+            if (strcmp(set->profiles[i].name, profile) == 0) {
+                bench_apply_profile(&cfg, &set->profiles[i]);
+                found = 1;
+            }
+        }
+        if (!found) {
+            printf("fd_bench: profile %s not in %s\n", profile, set->dir_name);
+            return 1;
+        }
+    }
+    for (int i = 0; i < num_overrides; i++) {
+        if (bench_set_threshold(&cfg, overrides[i]) < 0) {
+            printf("fd_bench: unknown threshold: %s\n", overrides[i]);
+            return 1;
+        }
+    }
+
+    printf("# fd_bench: %d frames x %d passes, set=%s strategy=%s%s models=%s%s%s%s\n",
+           num_frames, passes, cfg.model_set, fd_strategy_name(cfg.strategy),
+           cfg.cascade_enabled ? "+cascade" : "",
+           cfg.cnn_enabled ? "cnn " : "", cfg.proto_enabled ? "proto " : "",
+           cfg.multi_enabled ? "multi " : "", cfg.heatmap_enabled ? "heatmap" : "");
+    printf("# profile=%s stub_gain=%.1f npu_latency=%.1fms cache=%dMB\n",
+           cfg.thresholds.profile[0] ? cfg.thresholds.profile : "(defaults)",
+           g_bench.texture_gain, g_bench.npu_us / 1000.0, cfg.model_cache_mb);
+    bench_print_thresholds(&cfg);
+    if (trace)
+        printf("#\n# %-6s %-5s %5s %6s %6s %6s %-6s %6s %-5s %-15s %-5s %7s  %s\n",
+               "frame", "vote", "conf", "cnn", "proto", "multi", "c/p/m",
+               "hm_max", "boost", "class", "exit", "ms", "file");
+
+    bench_series_t s_read = { .name = "read" };
+    bench_series_t s_decode = { .name = "decode" };
+    bench_series_t s_pre = { .name = "preprocess" };
+    bench_series_t s_detect = { .name = "detect" };
+    bench_series_t s_cnn = { .name = "cnn" };
+    bench_series_t s_proto = { .name = "proto" };
+    bench_series_t s_multi = { .name = "multi" };
+    bench_series_t s_spatial = { .name = "spatial" };
+    bench_series_t s_frame = { .name = "frame total" };
+
+    int faults = 0, errors = 0, boosts = 0, overrides_ok = 0;
+    int votes[3] = {0};
+    uint8_t *preprocessed = (uint8_t *)malloc(FD_MODEL_INPUT_BYTES);
+    if (!preprocessed) return 1;
+
+    fd_model_cache_set_budget(cfg.model_cache_mb);
+
+    for (int pass = 0; pass < passes; pass++) {
+        for (int i = 0; i < num_frames; i++) {
+            int frame = pass * num_frames + i;
+            const char *base = strrchr(frames[i], '/');
+            base = base ? base + 1 : frames[i];
+
+            double t0 = fd_get_time_ms();
+            size_t jpeg_size;
+            uint8_t *jpeg = bench_read_file(frames[i], &jpeg_size);
+            double t1 = fd_get_time_ms();
+            if (!jpeg) {
+                printf("  %-6d ERROR read  %s\n", frame, base);
+                errors++;
+                continue;
+            }
+
+            fd_image_t img = {0};
+            int rc = fd_decode_jpeg(jpeg, jpeg_size, &img);
+            free(jpeg);
+            double t2 = fd_get_time_ms();
+            if (rc < 0) {
+                printf("  %-6d ERROR decode %s\n", frame, base);
+                errors++;
+                continue;
+            }
+
+            uint8_t *input = g_fd_input.virt ? g_fd_input.virt : preprocessed;
+            rc = fd_preprocess(&img, input);
+            free(img.data);
+            double t3 = fd_get_time_ms();
+            if (rc < 0) {
+                printf("  %-6d ERROR preprocess %s\n", frame, base);
+                errors++;
+                continue;
+            }
+
+            fd_result_t r;
+            rc = fd_run_detection(input, &r, &cfg);
+            double t4 = fd_get_time_ms();
+            if (rc < 0) {
+                printf("  %-6d ERROR detect(%d) %s\n", frame, rc, base);
+                errors++;
+                continue;
+            }
+
+            bench_series_add(&s_read, t1 - t0);
+            bench_series_add(&s_decode, t2 - t1);
+            bench_series_add(&s_pre, t3 - t2);
+            bench_series_add(&s_detect, r.total_ms);
+            if (r.cnn_ran) bench_series_add(&s_cnn, r.cnn_ms);
+            if (r.proto_ran) bench_series_add(&s_proto, r.proto_ms);
+            if (r.multi_ran) bench_series_add(&s_multi, r.multi_ms);
+            if (r.has_heatmap) bench_series_add(&s_spatial, r.spatial_ms);
+            bench_series_add(&s_frame, t4 - t0);
+
+            if (r.result == FD_CLASS_FAULT) faults++;
+            if (r.boost_active) boosts++;
+            if (r.boost_overrode) overrides_ok++;
+            votes[0] += r.cnn_ran && r.cnn_vote;
+            votes[1] += r.proto_ran && r.proto_vote;
+            votes[2] += r.multi_ran && r.multi_vote;
+
+            if (!trace) continue;
+
+            char cnn[8] = "-", proto[8] = "-", multi[8] = "-", hm[8] = "-";
+            if (r.cnn_ran) snprintf(cnn, sizeof(cnn), "%.3f", r.cnn_raw);
+            if (r.proto_ran) snprintf(proto, sizeof(proto), "%.3f", r.proto_raw);
+            if (r.multi_ran) snprintf(multi, sizeof(multi), "%.3f", r.multi_raw);
+            if (r.has_heatmap) snprintf(hm, sizeof(hm), "%.2f", r.heatmap_max);
+            char v[8];
+            snprintf(v, sizeof(v), "%c/%c/%c",
+                     r.cnn_ran ? '0' + r.cnn_vote : '-',
+                     r.proto_ran ? '0' + r.proto_vote : '-',
+                     r.multi_ran ? '0' + r.multi_vote : '-');
+            printf("  %-6d %-5s %5.2f %6s %6s %6s %-6s %6s %-5s %-15s %-5s %7.1f  %s\n",
+                   frame, r.result == FD_CLASS_FAULT ? "FAULT" : "OK",
+                   r.confidence, cnn, proto, multi, v, hm,
+                   r.boost_overrode ? "OVR" : r.boost_active ? "act" : "-",
+                   r.fault_class_name, r.cascade_exit, r.total_ms, base);
+        }
+    }
+
+    fd_model_cache_stats_t cs = fault_detect_get_model_cache_stats();
+    int done = passes * num_frames - errors;
+    printf("\n# decisions: %d frames, %d FAULT, %d OK, %d errors\n",
+           done, faults, done - faults, errors);
+    printf("# votes: cnn=%d proto=%d multi=%d, boost active=%d overrode=%d\n",
+           votes[0], votes[1], votes[2], boosts, overrides_ok);
+    printf("# ema: cnn=[%.3f,%.3f] init=%d/%d/%d\n",
+           g_fd.cnn_ema_logits[0], g_fd.cnn_ema_logits[1],
+           g_fd.cnn_ema_init, g_fd.multi_ema_init, g_fd.heatmap_ema_init);
+    printf("# npu: %u inits, %u runs; cache hits=%u misses=%u evictions=%u; "
+           "input zero-copy=%u copies=%u\n",
+           g_bench.inits, g_bench.runs, cs.hits, cs.misses, cs.evictions,
+           cs.zero_copy_runs, cs.input_copies);
+    fd_cascade_stats_t cc = fault_detect_get_cascade_stats();
+    printf("# cascade: exits cnn=%u proto=%u, skipped multi=%u spatial=%u; "
+           "inference expected=%.1fms actual=%.1fms\n",
+           cc.exits_cnn, cc.exits_proto, cc.skipped_multi, cc.skipped_spatial,
+           cc.expected_ms_total, cc.actual_ms_total);
+
+    bench_series_t *series[] = { &s_read, &s_decode, &s_pre, &s_detect, &s_cnn,
+                                 &s_proto, &s_multi, &s_spatial, &s_frame };
+    for (size_t i = 0; i < sizeof(series) / sizeof(series[0]); i++) {
+        bench_series_print(series[i]);
+        free(series[i]->v);
+    }
+
+    fd_cache_flush_idle();
+    fd_input_free();
+    free(g_fd.spatial_f32);
+    free(preprocessed);
+    fd_free_jpeg_list(frames, num_frames);
+    return errors ? 2 : 0;
+}
@@ -16,6 +16,7 @@
 #define FRAME_BUFFER_MAX_JPEG    (512 * 1024)   /* 512KB for camera JPEG */
 #define FRAME_BUFFER_MAX_H264    (256 * 1024)   /* 256KB for H.264 */
 #define FRAME_BUFFER_MAX_DISPLAY (512 * 1024)   /* 512KB for display JPEG */
+#define FRAME_BUFFER_MAX_DISPLAY_H264 (256 * 1024)  /* 256KB for display H.264 */
 
 /* Frame data structure */
 typedef struct {
@@ -41,6 +42,7 @@ typedef struct {
 extern FrameBuffer g_jpeg_buffer;
 extern FrameBuffer g_h264_buffer;
 extern FrameBuffer g_display_buffer;
+extern FrameBuffer g_display_h264_buffer;
 
 /* Initialization and cleanup */
 int frame_buffer_init(FrameBuffer *fb, size_t capacity);
@@ -364,6 +364,9 @@ static RequestType parse_http_request(const char *buf, size_t len, int port) {
         if (path_len >= 4 && strncmp(path, "/flv", 4) == 0) {
             return REQUEST_FLV_STREAM;
         }
+        if (path_len >= 8 && strncmp(path, "/display", 8) == 0) {
+            return REQUEST_DISPLAY_FLV;
+        }
     }
 
     return REQUEST_NONE;
@@ -815,6 +818,26 @@ static void http_handle_client_read(HttpServer *srv, HttpClient *client) {
                 log_info("HTTP[%d]: FLV stream started\n", srv->port);
                 break;
 
+            case REQUEST_DISPLAY_FLV:
+                if (!display_capture_is_running() || !display_is_enabled()) {
+                    http_send_503(client->fd, "Display capture is disabled");
+                    client->request = REQUEST_NONE;  /* Never counted as a client */
+                    client->state = CLIENT_STATE_CLOSING;
+                    break;
+                }
+                http_send_flv_headers(client->fd);
+                client->state = CLIENT_STATE_STREAMING;
+                client->header_sent = 1;
+                client->last_send_time = get_time_us();
+                /* 0 = FLV header/metadata not sent yet (see REQUEST_FLV_STREAM) */
+                client->last_frame_seq = 0;
+                client->send_buf = malloc(HTTP_SEND_BUF_SIZE);
+                client->send_buf_size = HTTP_SEND_BUF_SIZE;
+                client->send_buf_pos = 0;
+                display_h264_client_connect();
+                log_info("HTTP[%d]: Display FLV stream started\n", srv->port);
+                break;
+
             case REQUEST_HOMEPAGE:
                 http_send_homepage(client->fd, srv->port);
                 client->state = CLIENT_STATE_CLOSING;
@@ -835,6 +858,8 @@ static void http_close_client(HttpServer *srv, int slot) {
     /* Track display client disconnect */
     if (client->request == REQUEST_DISPLAY_STREAM) {
         display_client_disconnect();
+    } else if (client->request == REQUEST_DISPLAY_FLV) {
+        display_h264_client_disconnect();
     }
 
     if (client->fd > 0) {
@@ -1198,6 +1223,11 @@ static void *flv_server_thread(void *arg) {
         flv_muxer_init(&muxers[i], st->width, st->height, st->fps);
     }
 
+    /* Display clients: muxer holds display SPS/PPS and uses frame timestamps,
+     * since skipped (unchanged) frames leave gaps in the stream */
+    int mux_display[HTTP_MAX_CLIENTS] = {0};
+    uint64_t display_base_us[HTTP_MAX_CLIENTS] = {0};
+
     while (st->running && srv->running) {
 #ifdef ENCODER_TIMING
         HTTP_TIMING_START(total_iter);
@@ -1239,15 +1269,29 @@ static void *flv_server_thread(void *arg) {
                     http_handle_client_read(srv, &srv->clients[i]);
 
                     /* New FLV client - send header and metadata */
+                    int is_display = srv->clients[i].request == REQUEST_DISPLAY_FLV;
                     if (srv->clients[i].state == CLIENT_STATE_STREAMING &&
-                        srv->clients[i].request == REQUEST_FLV_STREAM &&
+                        (srv->clients[i].request == REQUEST_FLV_STREAM || is_display) &&
                         srv->clients[i].last_frame_seq == 0) {
 
                         /* Switch to blocking mode with send timeout + TCP keepalive */
                         make_streaming_socket(srv->clients[i].fd);
 
-                        /* Reset muxer for new connection */
-                        flv_muxer_reset(&muxers[i]);
+                        /* Reset muxer for new connection; re-init when the slot
+                         * switches between camera and display streams */
+                        if (is_display || mux_display[i]) {
+                            int w = st->width, h = st->height, fps = st->fps;
+                            if (is_display) {
+                                display_get_output_size(&w, &h);
+                                fps = display_get_fps();
+                            }
+                            flv_muxer_cleanup(&muxers[i]);
+                            flv_muxer_init(&muxers[i], w, h, fps);
+                            mux_display[i] = is_display;
+                            display_base_us[i] = 0;
+                        } else {
+                            flv_muxer_reset(&muxers[i]);
+                        }
 
                         /* Send FLV header */
                         size_t hdr_size = flv_create_header(flv_buf, FLV_MAX_TAG_SIZE);
@@ -1263,7 +1307,8 @@ static void *flv_server_thread(void *arg) {
 
                         /* Mark headers as sent by setting seq to current
                          * This also ensures we wait for fresh frames */
-                        srv->clients[i].last_frame_seq = frame_buffer_get_sequence(&g_h264_buffer);
+                        srv->clients[i].last_frame_seq = frame_buffer_get_sequence(
+                            is_display ? &g_display_h264_buffer : &g_h264_buffer);
                     }
                 }
             }
@@ -1271,6 +1316,7 @@ static void *flv_server_thread(void *arg) {
 
         /* Stream H.264 to connected FLV clients */
         uint64_t current_seq = frame_buffer_get_sequence(&g_h264_buffer);
+        uint64_t display_seq = frame_buffer_get_sequence(&g_display_h264_buffer);
         uint64_t now = get_time_us();
 
         for (int i = 0; i < HTTP_MAX_CLIENTS; i++) {
@@ -1297,6 +1343,57 @@ static void *flv_server_thread(void *arg) {
                 }
             }
 
+            if (client->state == CLIENT_STATE_STREAMING &&
+                client->request == REQUEST_DISPLAY_FLV) {
+
+                if (client_disconnected(client->fd)) {
+                    log_info("HTTP[%d]: Display FLV client disconnected (slot %d)\n", srv->port, i);
+                    http_close_client(srv, i);
+                    continue;
+                }
+
+                /* Display refreshes at least every few seconds even when idle */
+                if (client->last_send_time > 0 &&
+                    (now - client->last_send_time) / 1000000 >= HTTP_STALE_STREAM_TIMEOUT_SEC) {
+                    log_info("HTTP[%d]: Closing stale display FLV stream (slot %d)\n", srv->port, i);
+                    http_close_client(srv, i);
+                    continue;
+                }
+
+                if (display_seq > client->last_frame_seq) {
+                    uint64_t seq, ts;
+                    int is_keyframe;
+                    size_t h264_size = frame_buffer_copy(&g_display_h264_buffer, h264_buf,
+                                                         FRAME_BUFFER_MAX_H264, &seq, &ts, &is_keyframe);
+                    if (h264_size == 0) continue;
+
+                    /* Start each client on a keyframe; re-request in case the
+                     * IDR from connect landed before the headers were sent */
+                    if (client->frames_sent == 0 && !is_keyframe) {
+                        client->last_frame_seq = seq;
+                        display_h264_request_idr();
+                        continue;
+                    }
+                    if (display_base_us[i] == 0) {
+                        display_base_us[i] = ts;
+                    }
+                    muxers[i].timestamp = (uint32_t)((ts - display_base_us[i]) / 1000);
+
+                    size_t flv_size = flv_mux_h264(&muxers[i], h264_buf, h264_size,
+                                                   flv_buf, FLV_MAX_TAG_SIZE);
+                    if (flv_size > 0) {
+                        if (http_send(client->fd, flv_buf, flv_size) < 0) {
+                            client->state = CLIENT_STATE_CLOSING;
+                        } else {
+                            client->last_frame_seq = seq;
+                            client->last_send_time = now;
+                            client->frames_sent++;
+                        }
+                    }
+                }
+                continue;
+            }
+
             if (client->state == CLIENT_STATE_STREAMING &&
                 client->request == REQUEST_FLV_STREAM) {
 
@@ -3,7 +3,8 @@
  *
  * Provides two HTTP servers:
  * - MJPEG server on port 8080: /stream (multipart), /snapshot (single JPEG)
- * - FLV server on port 18088: /flv (H.264 in FLV container)
+ * - FLV server on port 18088: /flv (H.264 in FLV container),
+ *   /display (LCD as H.264 in FLV)
  *
  * Uses select() for non-blocking I/O with multiple clients.
  */
@@ -52,6 +53,7 @@ typedef enum {
     REQUEST_FLV_STREAM,         /* /flv */
     REQUEST_DISPLAY_STREAM,     /* /display */
     REQUEST_DISPLAY_SNAPSHOT,   /* /display/snapshot */
+    REQUEST_DISPLAY_FLV,        /* /display on FLV port */
     REQUEST_HOMEPAGE            /* / */
 } RequestType;
 
@@ -0,0 +1,618 @@
+/*
+ * JSON Writer Test
+ *
+ * Host-side check and microbenchmark for json_writer.c. Every case builds
+ * the same document twice, as a cJSON tree printed with
+ * cJSON_PrintUnformatted and through the streaming writer, and requires
+ * byte-identical output: string escaping (quotes, backslash, every control
+ * character, UTF-8 passed through), numbers (integers, the 15/17 digit
+ * rule, NaN/Inf as null, -0), nesting, empty containers and a batch of
+ * pseudo-random trees. It also covers buffer growth and release on reset,
+ * fixed buffers filled exactly and overflowed, the sticky error paths and
+ * the member spans used for diffing.
+ *
+ * -n N then times N builds of an /api/stats shaped document with cJSON
+ * (tree, print, free) and with a reused heap writer, and reports us/doc
+ * and allocations per document for both.
+ *
+ * Build on the host with `make json_test`; exits non-zero on any failure.
+ */
+
+#include "json_writer.h"
+#include "cJSON.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include <getopt.h>
+#include <time.h>
+
+static int g_check_failures;
+
+static void test_check(int ok, const char *what)
+{
+    printf("  %-4s %s\n", ok ? "ok" : "FAIL", what);
+    if (!ok) g_check_failures++;
+}
+
+static uint32_t g_seed = 12345;
+
+/* Reproducible across runs and hosts */
+static uint32_t test_rand(void)
+{
+    g_seed = g_seed * 1664525u + 1013904223u;
+    return g_seed >> 8;
+}
+
+/* Counting allocator for cJSON, so the benchmark can report mallocs/doc */
+static unsigned long g_allocs;
+
+static void *test_malloc(size_t sz)
+{
+    g_allocs++;
+    return malloc(sz);
+}
+
+/* ============================================================================
+ * cJSON tree -> writer
+ * ============================================================================ */
+
+/* Emit the same value sequence a handler would write by hand. Numbers that
+ * are exact integers go through jw_int, the rest through jw_num. */
+static void test_emit(JsonWriter *w, const cJSON *item)
+{
+    if (cJSON_IsObject(item) || cJSON_IsArray(item)) {
+        int obj = cJSON_IsObject(item);
+        if (obj) jw_obj_begin(w);
+        else     jw_arr_begin(w);
+        for (const cJSON *c = item->child; c; c = c->next) {
+            if (obj) jw_key(w, c->string);
+            test_emit(w, c);
+        }
+        if (obj) jw_obj_end(w);
+        else     jw_arr_end(w);
+    } else if (cJSON_IsString(item)) {
+        jw_str(w, item->valuestring);
+    } else if (cJSON_IsNumber(item)) {
+        double d = item->valuedouble;
+        if (d == floor(d) && fabs(d) < 1e15 && !(d == 0 && signbit(d)))
+            jw_int(w, (long long)d);
+        else
+            jw_num(w, d);
+    } else if (cJSON_IsBool(item)) {
+        jw_bool(w, cJSON_IsTrue(item));
+    } else {
+        jw_null(w);
+    }
+}
+
+/* Print the tree both ways, compare, and free it */
+static int test_same(cJSON *tree, const char *what)
+{
+    char *ref = cJSON_PrintUnformatted(tree);
+    JsonWriter w;
+    jw_init(&w);
+    test_emit(&w, tree);
+    const char *out = jw_finish(&w, NULL);
+    int ok = ref && out && strcmp(ref, out) == 0;
+    if (!ok)
+        printf("       cJSON:  %s\n       writer: %s\n",
+               ref ? ref : "(null)", out ? out : "(null)");
+    test_check(ok, what);
+    jw_free(&w);
+    free(ref);
+    cJSON_Delete(tree);
+    return ok;
+}
+
+/* ============================================================================
+ * Equivalence with cJSON
+ * ============================================================================ */
+
+static void test_strings(void)
+{
+    static const char *cases[] = {
+        "",
+        "plain ascii",
+        "quote \" backslash \\ slash /",
+        "\b\f\n\r\t",
+        "\x01\x02\x1e\x1f \x7f",
+        "caf\xc3\xa9 \xe2\x82\xac \xf0\x9f\x96\xa8",
+        "\"\"\\\\",
+        "trailing escape\n",
+    };
+    char what[64];
+
+    printf("# strings\n");
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        cJSON *o = cJSON_CreateObject();
+        cJSON_AddStringToObject(o, "k", cases[i]);
+        cJSON_AddStringToObject(o, cases[i], "key escaping");
+        snprintf(what, sizeof(what), "string case %zu", i);
+        test_same(o, what);
+    }
+
+    /* Every control character on its own and between text */
+    char all[2 * 31 + 1];
+    for (int c = 1; c < 32; c++) {
+        all[2 * (c - 1)] = (char)c;
+        all[2 * (c - 1) + 1] = 'x';
+    }
+    all[sizeof(all) - 1] = '\0';
+    cJSON *a = cJSON_CreateArray();
+    cJSON_AddItemToArray(a, cJSON_CreateString(all));
+    test_same(a, "all control characters 0x01-0x1f");
+
+    /* A long run with escapes spread through it crosses buffer growth */
+    char *big = malloc(20001);
+    for (int i = 0; i < 20000; i++)
+        big[i] = (i % 97 == 0) ? '"' : (i % 89 == 0) ? '\n' : (char)('a' + i % 26);
+    big[20000] = '\0';
+    a = cJSON_CreateArray();
+    cJSON_AddItemToArray(a, cJSON_CreateString(big));
+    test_same(a, "20000 byte string with escapes");
+    free(big);
+}
+
+static void test_numbers(void)
+{
+    static const long long ints[] = {
+        0, 1, -1, 42, 2147483647LL, -2147483647LL - 1, 4294967296LL,
+        1700000000000LL, 999999999999999LL, -999999999999999LL,
+    };
+    static const double nums[] = {
+        0.5, -0.5, 0.1, 1.0 / 3.0, 2.0 / 3.0, 123456.789, 1e-7, 1e21,
+        1e300, -1e-300, 5e-324, DBL_MAX, -DBL_MAX, 0.30000000000000004,
+        1e15, 1234567890123456.0, 9007199254740993.0, -0.0, 29.7, 0.2,
+    };
+    char what[64];
+
+    printf("# numbers\n");
+    cJSON *a = cJSON_CreateArray();
+    for (size_t i = 0; i < sizeof(ints) / sizeof(ints[0]); i++)
+        cJSON_AddItemToArray(a, cJSON_CreateNumber((double)ints[i]));
+    test_same(a, "integers below 1e15");
+
+    for (size_t i = 0; i < sizeof(nums) / sizeof(nums[0]); i++) {
+        a = cJSON_CreateArray();
+        cJSON_AddItemToArray(a, cJSON_CreateNumber(nums[i]));
+        snprintf(what, sizeof(what), "double %.17g", nums[i]);
+        test_same(a, what);
+    }
+
+    a = cJSON_CreateArray();
+    cJSON_AddItemToArray(a, cJSON_CreateNumber(NAN));
+    cJSON_AddItemToArray(a, cJSON_CreateNumber(INFINITY));
+    cJSON_AddItemToArray(a, cJSON_CreateNumber(-INFINITY));
+    test_same(a, "NaN and +/-Inf as null");
+
+    /* cJSON keeps numbers as doubles; jw_int prints the exact integer */
+    JsonWriter w;
+    jw_init(&w);
+    jw_arr_begin(&w);
+    jw_int(&w, 9223372036854775807LL);
+    jw_int(&w, -9223372036854775807LL - 1);
+    jw_arr_end(&w);
+    const char *out = jw_finish(&w, NULL);
+    test_check(out && strcmp(out, "[9223372036854775807,-9223372036854775808]") == 0,
+               "jw_int is exact over the full long long range");
+    jw_free(&w);
+}
+
+static void test_structure(void)
+{
+    printf("# structure\n");
+    test_same(cJSON_CreateObject(), "empty object");
+    test_same(cJSON_CreateArray(), "empty array");
+
+    cJSON *o = cJSON_CreateObject();
+    cJSON_AddItemToObject(o, "a", cJSON_CreateArray());
+    cJSON_AddItemToObject(o, "o", cJSON_CreateObject());
+    cJSON_AddBoolToObject(o, "t", 1);
+    cJSON_AddBoolToObject(o, "f", 0);
+    cJSON_AddNullToObject(o, "n");
+    cJSON *arr = cJSON_AddArrayToObject(o, "mixed");
+    cJSON_AddItemToArray(arr, cJSON_CreateObject());
+    cJSON_AddItemToArray(arr, cJSON_CreateArray());
+    cJSON_AddItemToArray(arr, cJSON_CreateString("s"));
+    cJSON_AddItemToArray(arr, cJSON_CreateNumber(1));
+    cJSON_AddItemToArray(arr, cJSON_CreateNull());
+    test_same(o, "empty containers, bools, null, mixed array");
+
+    /* Deepest nesting the writer accepts */
+    cJSON *root = cJSON_CreateArray(), *cur = root;
+    for (int d = 2; d < JW_MAX_DEPTH; d++) {
+        cJSON *next = (d & 1) ? cJSON_CreateArray() : cJSON_CreateObject();
+        if (cJSON_IsObject(cur)) cJSON_AddItemToObject(cur, "k", next);
+        else                     cJSON_AddItemToArray(cur, next);
+        cur = next;
+    }
+    test_same(root, "nesting to JW_MAX_DEPTH - 1");
+
+    /* jw_str(NULL) and the member shorthands */
+    JsonWriter w;
+    jw_init(&w);
+    jw_obj_begin(&w);
+    jw_kstr(&w, "s", NULL);
+    jw_kobj(&w, "o");
+    jw_kint(&w, "i", -3);
+    jw_knum(&w, "d", 2.5);
+    jw_obj_end(&w);
+    jw_karr(&w, "a");
+    jw_raw(&w, "{\"pre\":[1,2]}");
+    jw_bool(&w, 1);
+    jw_arr_end(&w);
+    jw_obj_end(&w);
+    const char *out = jw_finish(&w, NULL);
+    test_check(out && strcmp(out,
+               "{\"s\":null,\"o\":{\"i\":-3,\"d\":2.5},\"a\":[{\"pre\":[1,2]},true]}") == 0,
+               "NULL string, shorthands, jw_raw");
+    jw_free(&w);
+}
+
+/* Random tree of bounded depth and width */
+static cJSON *test_random_value(int depth)
+{
+    static const char *words[] = {
+        "", "a", "state", "x\"y", "tab\there", "nl\n", "\x01", "caf\xc3\xa9", "back\\slash",
+    };
+    const int nwords = (int)(sizeof(words) / sizeof(words[0]));
+    uint32_t kind = test_rand() % (depth > 0 ? 8 : 6);
+    switch (kind) {
+    case 0: return cJSON_CreateNull();
+    case 1: return cJSON_CreateBool(test_rand() & 1);
+    case 2: return cJSON_CreateNumber((double)((int32_t)test_rand() - (1 << 23)));
+    case 3: return cJSON_CreateNumber(((double)test_rand() - 8388608.0) / (double)(1 + test_rand() % 1000));
+    case 4:
+    case 5: return cJSON_CreateString(words[test_rand() % nwords]);
+    default: {
+        int obj = kind == 6;
+        cJSON *c = obj ? cJSON_CreateObject() : cJSON_CreateArray();
+        int n = (int)(test_rand() % 6);
+        for (int i = 0; i < n; i++) {
+            cJSON *v = test_random_value(depth - 1);
+            if (obj) cJSON_AddItemToObject(c, words[test_rand() % nwords], v);
+            else     cJSON_AddItemToArray(c, v);
+        }
+        return c;
+    }
+    }
+}
+
+static void test_random(void)
+{
+    const int trees = 2000;
+    int same = 0;
+
+    printf("# random trees\n");
+    for (int i = 0; i < trees; i++) {
+        cJSON *t = test_random_value(6);
+        char *ref = cJSON_PrintUnformatted(t);
+        JsonWriter w;
+        jw_init(&w);
+        test_emit(&w, t);
+        const char *out = jw_finish(&w, NULL);
+        if (ref && out && strcmp(ref, out) == 0) {
+            same++;
+        } else if (same == i) {
+            /* Show the first mismatch only */
+            printf("       cJSON:  %s\n       writer: %s\n",
+                   ref ? ref : "(null)", out ? out : "(null)");
+        }
+        jw_free(&w);
+        free(ref);
+        cJSON_Delete(t);
+    }
+    char what[64];
+    snprintf(what, sizeof(what), "%d/%d random trees identical", same, trees);
+    test_check(same == trees, what);
+}
+
+/* ============================================================================
+ * Buffers and errors
+ * ============================================================================ */
+
+static void test_buffers(void)
+{
+    JsonWriter w;
+    size_t len;
+
+    printf("# buffers\n");
+
+    /* Heap growth, then reuse: the buffer survives reset below JW_KEEP_CAP */
+    jw_init(&w);
+    jw_arr_begin(&w);
+    for (int i = 0; i < 1000; i++) jw_int(&w, i);
+    jw_arr_end(&w);
+    const char *out = jw_finish(&w, &len);
+    test_check(out && len == strlen(out) && len > JW_INITIAL_CAP &&
+               strncmp(out, "[0,1,2,", 7) == 0 && strcmp(out + len - 5, ",999]") == 0,
+               "heap buffer grows past JW_INITIAL_CAP");
+    char *kept = w.buf;
+    jw_reset(&w);
+    jw_obj_begin(&w);
+    jw_obj_end(&w);
+    out = jw_finish(&w, NULL);
+    test_check(out && strcmp(out, "{}") == 0 && w.buf == kept,
+               "reset keeps the buffer and starts a new document");
+
+    /* A document above JW_KEEP_CAP releases its buffer on reset */
+    jw_reset(&w);
+    jw_arr_begin(&w);
+    for (int i = 0; i < JW_KEEP_CAP / 8; i++) jw_int(&w, 1234567);
+    jw_arr_end(&w);
+    test_check(jw_finish(&w, NULL) && w.cap > JW_KEEP_CAP, "large document");
+    jw_reset(&w);
+    test_check(w.buf == NULL && w.cap == 0, "reset releases buffers above JW_KEEP_CAP");
+    jw_free(&w);
+
+    /* Fixed buffer: exact fit (len + NUL) succeeds, one byte less fails */
+    const char *expect = "{\"k\":\"v\\n\"}";
+    size_t need = strlen(expect) + 1;
+    char fixed[64];
+    for (size_t cap = need - 1; cap <= need; cap++) {
+        jw_init_fixed(&w, fixed, cap);
+        jw_obj_begin(&w);
+        jw_kstr(&w, "k", "v\n");
+        jw_obj_end(&w);
+        out = jw_finish(&w, NULL);
+        if (cap == need)
+            test_check(out == fixed && strcmp(out, expect) == 0, "fixed buffer exact fit");
+        else
+            test_check(out == NULL && w.err, "fixed buffer one byte short fails");
+    }
+    jw_reset(&w);
+    jw_null(&w);
+    test_check(jw_finish(&w, NULL) != NULL, "fixed writer recovers after reset");
+}
+
+static void test_errors(void)
+{
+    JsonWriter w;
+
+    printf("# errors\n");
+    jw_init(&w);
+    for (int d = 0; d < JW_MAX_DEPTH; d++) jw_arr_begin(&w);
+    test_check(w.err && jw_finish(&w, NULL) == NULL, "nesting JW_MAX_DEPTH deep fails");
+
+    jw_reset(&w);
+    jw_obj_begin(&w);
+    jw_kint(&w, "open", 1);
+    test_check(jw_finish(&w, NULL) == NULL, "unclosed container fails");
+
+    jw_reset(&w);
+    jw_arr_begin(&w);
+    jw_arr_end(&w);
+    jw_arr_end(&w);
+    test_check(w.err && jw_finish(&w, NULL) == NULL, "extra close fails");
+
+    /* Errors are sticky: nothing is written after the first one */
+    size_t len = w.len;
+    jw_str(&w, "ignored");
+    test_check(w.len == len, "writes after an error are no-ops");
+
+    jw_reset(&w);
+    jw_write(&w, "data: ", 6);
+    jw_obj_begin(&w);
+    jw_obj_end(&w);
+    jw_write(&w, "\n\n", 2);
+    const char *out = jw_finish(&w, NULL);
+    test_check(out && strcmp(out, "data: {}\n\n") == 0, "jw_write framing");
+    jw_free(&w);
+}
+
+static void test_spans(void)
+{
+    JsonWriter a, b;
+
+    printf("# member spans\n");
+    jw_init(&a);
+    jw_init(&b);
+    jw_track_spans(&a);
+    jw_track_spans(&b);
+
+    jw_obj_begin(&a);
+    jw_kint(&a, "same", 1);
+    jw_kobj(&a, "nested");
+    jw_kint(&a, "x", 2);
+    jw_obj_end(&a);
+    jw_kstr(&a, "changed", "old");
+    jw_kstr(&a, "k\"q", "v");
+    jw_obj_end(&a);
+
+    /* Same members, different order, one value changed */
+    jw_obj_begin(&b);
+    jw_kstr(&b, "k\"q", "v");
+    jw_kstr(&b, "changed", "new");
+    jw_kobj(&b, "nested");
+    jw_kint(&b, "x", 2);
+    jw_obj_end(&b);
+    jw_kint(&b, "same", 1);
+    jw_obj_end(&b);
+
+    test_check(jw_finish(&a, NULL) && jw_finish(&b, NULL) && a.nspans == 4 && b.nspans == 4,
+               "one span per root member");
+    test_check(jw_span_equal(&a, 0, &b), "unchanged scalar member found out of order");
+    test_check(jw_span_equal(&a, 1, &b), "unchanged nested object member");
+    test_check(!jw_span_equal(&a, 2, &b), "changed member differs");
+    test_check(jw_span_equal(&a, 3, &b), "member with an escaped key");
+    test_check(!jw_span_equal(&a, 4, &b), "out of range index");
+
+    jw_free(&a);
+    jw_free(&b);
+}
+
+/* ============================================================================
+ * Benchmark (-n)
+ * ============================================================================ */
+
+/* Roughly the shape and size of /api/stats */
+static void bench_doc_jw(JsonWriter *w, int i)
+{
+    jw_obj_begin(w);
+    jw_kobj(w, "cpu");
+    jw_kint(w, "total", 40 + i % 7);
+    jw_kint(w, "encoder_cpu", 12);
+    jw_kint(w, "streamer_cpu", 3);
+    jw_obj_end(w);
+    jw_kobj(w, "fps");
+    jw_knum(w, "mjpeg", 9.8);
+    jw_knum(w, "h264", 29.7);
+    jw_obj_end(w);
+    jw_kobj(w, "clients");
+    jw_kint(w, "mjpeg", 1);
+    jw_kint(w, "flv", i & 1);
+    jw_obj_end(w);
+    jw_kstr(w, "encoder_type", "rkmpi-yuyv");
+    jw_kbool(w, "h264_enabled", 1);
+    jw_kint(w, "skip_ratio", 2);
+    jw_kbool(w, "auto_skip", 1);
+    jw_kint(w, "target_cpu", 25);
+    jw_kstr(w, "session_id", "b6f1c0de9a4e4b7f");
+    jw_kint(w, "display_frames_encoded", 100000 + i);
+    jw_kstr(w, "mode", "go-klipper");
+    jw_karr(w, "temps");
+    for (int k = 0; k < 16; k++) jw_num(w, 20.0 + k * 0.25);
+    jw_arr_end(w);
+    jw_kobj(w, "fault_detect");
+    jw_kbool(w, "enabled", 1);
+    jw_kstr(w, "state", "monitoring");
+    jw_knum(w, "last_score", 0.125);
+    jw_kint(w, "last_check_ms", 1700000000000LL + i);
+    jw_obj_end(w);
+    jw_obj_end(w);
+}
+
+static cJSON *bench_doc_cjson(int i)
+{
+    cJSON *root = cJSON_CreateObject();
+    cJSON *o = cJSON_AddObjectToObject(root, "cpu");
+    cJSON_AddNumberToObject(o, "total", 40 + i % 7);
+    cJSON_AddNumberToObject(o, "encoder_cpu", 12);
+    cJSON_AddNumberToObject(o, "streamer_cpu", 3);
+    o = cJSON_AddObjectToObject(root, "fps");
+    cJSON_AddNumberToObject(o, "mjpeg", 9.8);
+    cJSON_AddNumberToObject(o, "h264", 29.7);
+    o = cJSON_AddObjectToObject(root, "clients");
+    cJSON_AddNumberToObject(o, "mjpeg", 1);
+    cJSON_AddNumberToObject(o, "flv", i & 1);
+    cJSON_AddStringToObject(root, "encoder_type", "rkmpi-yuyv");
+    cJSON_AddBoolToObject(root, "h264_enabled", 1);
+    cJSON_AddNumberToObject(root, "skip_ratio", 2);
+    cJSON_AddBoolToObject(root, "auto_skip", 1);
+    cJSON_AddNumberToObject(root, "target_cpu", 25);
+    cJSON_AddStringToObject(root, "session_id", "b6f1c0de9a4e4b7f");
+    cJSON_AddNumberToObject(root, "display_frames_encoded", 100000 + i);
+    cJSON_AddStringToObject(root, "mode", "go-klipper");
+    cJSON *a = cJSON_AddArrayToObject(root, "temps");
+    for (int k = 0; k < 16; k++) cJSON_AddItemToArray(a, cJSON_CreateNumber(20.0 + k * 0.25));
+    o = cJSON_AddObjectToObject(root, "fault_detect");
+    cJSON_AddBoolToObject(o, "enabled", 1);
+    cJSON_AddStringToObject(o, "state", "monitoring");
+    cJSON_AddNumberToObject(o, "last_score", 0.125);
+    cJSON_AddNumberToObject(o, "last_check_ms", (double)(1700000000000LL + i));
+    return root;
+}
+
+static double now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static void bench(int iters)
+{
+    JsonWriter w;
+    size_t bytes = 0;
+    volatile size_t sink = 0;
+
+    /* The two builders must agree before their timings mean anything */
+    cJSON *t = bench_doc_cjson(1);
+    char *ref = cJSON_PrintUnformatted(t);
+    cJSON_Delete(t);
+    jw_init(&w);
+    bench_doc_jw(&w, 1);
+    const char *out = jw_finish(&w, &bytes);
+    printf("# benchmark (%zu byte document)\n", bytes);
+    test_check(ref && out && strcmp(ref, out) == 0, "benchmark documents identical");
+    free(ref);
+
+    g_allocs = 0;
+    double t0 = now_us();
+    for (int i = 0; i < iters; i++) {
+        cJSON *doc = bench_doc_cjson(i);
+        char *s = cJSON_PrintUnformatted(doc);
+        sink += strlen(s);
+        free(s);
+        cJSON_Delete(doc);
+    }
+    double cjson_us = (now_us() - t0) / iters;
+    double cjson_allocs = (double)g_allocs / iters;
+
+    /* The writer's buffer is not allocated through cJSON's hooks: count
+     * its growth by watching the buffer pointer instead */
+    unsigned long grows = 0;
+    t0 = now_us();
+    for (int i = 0; i < iters; i++) {
+        char *before = w.buf;
+        jw_reset(&w);
+        bench_doc_jw(&w, i);
+        sink += strlen(jw_finish(&w, NULL));
+        if (w.buf != before) grows++;
+    }
+    double jw_us = (now_us() - t0) / iters;
+    jw_free(&w);
+
+    printf("  cJSON tree+print  %8.3f us/doc  %6.1f allocs/doc\n", cjson_us, cjson_allocs);
+    printf("  json_writer       %8.3f us/doc  %6.1f allocs/doc (%lu total)\n",
+           jw_us, (double)grows / iters, grows);
+    printf("  speedup           %8.1fx\n", jw_us > 0 ? cjson_us / jw_us : 0.0);
+    (void)sink;
+}
+
+/* ============================================================================
+ * Main
+ * ============================================================================ */
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [-n ITERS]\n"
+            "  Checks json_writer output against cJSON_PrintUnformatted.\n"
+            "  -n ITERS  also time ITERS builds of a stats document with each\n",
+            prog);
+}
+
+int main(int argc, char *argv[])
+{
+    int iters = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:h")) != -1) {
+        switch (opt) {
+        case 'n': iters = atoi(optarg); break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    cJSON_Hooks hooks = { test_malloc, free };
+    cJSON_InitHooks(&hooks);
+
+    test_strings();
+    test_numbers();
+    test_structure();
+    test_random();
+    test_buffers();
+    test_errors();
+    test_spans();
+    if (iters > 0)
+        bench(iters);
+
+    printf("# %s\n", g_check_failures ? "FAILED" : "all checks passed");
+    return g_check_failures ? 1 : 0;
+}
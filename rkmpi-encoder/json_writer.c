@@ -0,0 +1,319 @@
+/*
+ * Streaming JSON Writer
+ *
+ * Replaces cJSON trees on the polled API endpoints: one reusable buffer
+ * per writer instead of a malloc per node plus a print pass.
+ */
+
+#include "json_writer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+
+/* ============================================================================
+ * Buffer
+ * ============================================================================ */
+
+/* Make room for n more bytes plus the terminating NUL */
+static int jw_reserve(JsonWriter *w, size_t n) {
+    if (w->err) return -1;
+    if (w->len + n + 1 <= w->cap) return 0;
+    if (w->fixed) {
+        w->err = 1;
+        return -1;
+    }
+
+    size_t cap = w->cap ? w->cap : JW_INITIAL_CAP;
+    while (cap < w->len + n + 1) cap *= 2;
+    char *p = realloc(w->buf, cap);
+    if (!p) {
+        w->err = 1;
+        return -1;
+    }
+    w->buf = p;
+    w->cap = cap;
+    return 0;
+}
+
+static void jw_put(JsonWriter *w, const char *s, size_t n) {
+    if (jw_reserve(w, n) < 0) return;
+    memcpy(w->buf + w->len, s, n);
+    w->len += n;
+}
+
+static void jw_putc(JsonWriter *w, char c) {
+    if (jw_reserve(w, 1) < 0) return;
+    w->buf[w->len++] = c;
+}
+
+void jw_init(JsonWriter *w) {
+    memset(w, 0, sizeof(*w));
+}
+
+void jw_init_fixed(JsonWriter *w, char *buf, size_t cap) {
+    memset(w, 0, sizeof(*w));
+    w->buf = buf;
+    w->cap = cap;
+    w->fixed = 1;
+}
+
+void jw_reset(JsonWriter *w) {
+    if (!w->fixed && w->cap > JW_KEEP_CAP) {
+        free(w->buf);
+        w->buf = NULL;
+        w->cap = 0;
+    }
+    w->len = 0;
+    w->err = 0;
+    w->depth = 0;
+    w->need_comma = 0;
+    w->after_key = 0;
+    w->track_spans = 0;
+    w->span_open = 0;
+    w->spans_overflow = 0;
+    w->nspans = 0;
+}
+
+void jw_free(JsonWriter *w) {
+    if (!w->fixed) free(w->buf);
+    memset(w, 0, sizeof(*w));
+}
+
+void jw_track_spans(JsonWriter *w) {
+    w->track_spans = 1;
+}
+
+const char *jw_finish(JsonWriter *w, size_t *len) {
+    if (w->err || w->depth != 0 || jw_reserve(w, 0) < 0)
+        return NULL;
+    w->buf[w->len] = '\0';
+    if (len) *len = w->len;
+    return w->buf;
+}
+
+/* ============================================================================
+ * Structure
+ * ============================================================================ */
+
+/* Separator before a value or key at the current depth */
+static void jw_before_value(JsonWriter *w) {
+    if (w->after_key) {
+        w->after_key = 0;
+        return;
+    }
+    uint32_t bit = 1u << w->depth;
+    if (w->need_comma & bit)
+        jw_putc(w, ',');
+    w->need_comma |= bit;
+}
+
+/* A value finished at the current depth: close the member span */
+static void jw_after_value(JsonWriter *w) {
+    if (w->span_open && w->depth == 1) {
+        w->spans[w->nspans - 1].len = (uint32_t)(w->len - w->spans[w->nspans - 1].off);
+        w->span_open = 0;
+    }
+}
+
+static void jw_open(JsonWriter *w, char c) {
+    jw_before_value(w);
+    if (w->depth + 1 >= JW_MAX_DEPTH) {
+        w->err = 1;
+        return;
+    }
+    jw_putc(w, c);
+    w->depth++;
+    w->need_comma &= ~(1u << w->depth);
+}
+
+static void jw_close(JsonWriter *w, char c) {
+    if (w->depth <= 0) {
+        w->err = 1;
+        return;
+    }
+    jw_putc(w, c);
+    w->depth--;
+    jw_after_value(w);
+}
+
+void jw_obj_begin(JsonWriter *w) { jw_open(w, '{'); }
+void jw_obj_end(JsonWriter *w)   { jw_close(w, '}'); }
+void jw_arr_begin(JsonWriter *w) { jw_open(w, '['); }
+void jw_arr_end(JsonWriter *w)   { jw_close(w, ']'); }
+
+static void jw_put_string(JsonWriter *w, const char *s) {
+    static const char hex[] = "0123456789abcdef";
+
+    jw_putc(w, '"');
+    const char *run = s;
+    for (; *s; s++) {
+        unsigned char c = (unsigned char)*s;
+        char esc;
+        switch (c) {
+        case '"':  esc = '"';  break;
+        case '\\': esc = '\\'; break;
+        case '\b': esc = 'b';  break;
+        case '\f': esc = 'f';  break;
+        case '\n': esc = 'n';  break;
+        case '\r': esc = 'r';  break;
+        case '\t': esc = 't';  break;
+        default:
+            if (c >= 0x20) continue;
+            esc = 'u';
+            break;
+        }
+        jw_put(w, run, (size_t)(s - run));
+        run = s + 1;
+        if (esc == 'u') {
+            char u[6] = { '\\', 'u', '0', '0', hex[c >> 4], hex[c & 15] };
+            jw_put(w, u, sizeof(u));
+        } else {
+            char e[2] = { '\\', esc };
+            jw_put(w, e, sizeof(e));
+        }
+    }
+    jw_put(w, run, (size_t)(s - run));
+    jw_putc(w, '"');
+}
+
+void jw_key(JsonWriter *w, const char *key) {
+    jw_before_value(w);
+    if (w->track_spans && w->depth == 1) {
+        if (w->nspans < JW_MAX_SPANS) {
+            w->spans[w->nspans].off = (uint32_t)w->len;
+            w->spans[w->nspans].len = 0;
+            w->nspans++;
+            w->span_open = 1;
+        } else {
+            w->spans_overflow = 1;
+        }
+    }
+    jw_put_string(w, key);
+    jw_putc(w, ':');
+    w->after_key = 1;
+}
+
+/* ============================================================================
+ * Values
+ * ============================================================================ */
+
+void jw_str(JsonWriter *w, const char *s) {
+    if (!s) {
+        jw_null(w);
+        return;
+    }
+    jw_before_value(w);
+    jw_put_string(w, s);
+    jw_after_value(w);
+}
+
+void jw_int(JsonWriter *w, long long v) {
+    char tmp[24];
+    int n = snprintf(tmp, sizeof(tmp), "%lld", v);
+    jw_before_value(w);
+    jw_put(w, tmp, (size_t)n);
+    jw_after_value(w);
+}
+
+void jw_num(JsonWriter *w, double v) {
+    char tmp[32];
+    int n;
+    if (isnan(v) || isinf(v)) {
+        n = snprintf(tmp, sizeof(tmp), "null");
+    } else {
+        /* Same precision rule as cJSON: 15 digits unless that loses the value */
+        n = snprintf(tmp, sizeof(tmp), "%1.15g", v);
+        double back = strtod(tmp, NULL);
+        double mag = fabs(back) > fabs(v) ? fabs(back) : fabs(v);
+        if (fabs(back - v) > mag * DBL_EPSILON)
+            n = snprintf(tmp, sizeof(tmp), "%1.17g", v);
+    }
+    jw_before_value(w);
+    jw_put(w, tmp, (size_t)n);
+    jw_after_value(w);
+}
+
+void jw_bool(JsonWriter *w, int v) {
+    jw_before_value(w);
+    if (v) jw_put(w, "true", 4);
+    else   jw_put(w, "false", 5);
+    jw_after_value(w);
+}
+
+void jw_null(JsonWriter *w) {
+    jw_before_value(w);
+    jw_put(w, "null", 4);
+    jw_after_value(w);
+}
+
+void jw_raw(JsonWriter *w, const char *json) {
+    jw_before_value(w);
+    jw_put(w, json, strlen(json));
+    jw_after_value(w);
+}
+
+void jw_write(JsonWriter *w, const char *data, size_t len) {
+    jw_put(w, data, len);
+}
+
+void jw_kstr(JsonWriter *w, const char *key, const char *s) {
+    jw_key(w, key);
+    jw_str(w, s);
+}
+
+void jw_kint(JsonWriter *w, const char *key, long long v) {
+    jw_key(w, key);
+    jw_int(w, v);
+}
+
+void jw_knum(JsonWriter *w, const char *key, double v) {
+    jw_key(w, key);
+    jw_num(w, v);
+}
+
+void jw_kbool(JsonWriter *w, const char *key, int v) {
+    jw_key(w, key);
+    jw_bool(w, v);
+}
+
+void jw_kobj(JsonWriter *w, const char *key) {
+    jw_key(w, key);
+    jw_obj_begin(w);
+}
+
+void jw_karr(JsonWriter *w, const char *key) {
+    jw_key(w, key);
+    jw_arr_begin(w);
+}
+
+/* ============================================================================
+ * Member diff
+ * ============================================================================ */
+
+/* Length of the quoted key at the start of a span, including the quotes */
+static size_t jw_span_key_len(const char *p, size_t len) {
+    for (size_t i = 1; i < len; i++) {
+        if (p[i] == '\\') i++;
+        else if (p[i] == '"') return i + 1;
+    }
+    return len;
+}
+
+int jw_span_equal(const JsonWriter *a, int i, const JsonWriter *b) {
+    if (i < 0 || i >= a->nspans) return 0;
+    const char *ap = a->buf + a->spans[i].off;
+    size_t alen = a->spans[i].len;
+    size_t klen = jw_span_key_len(ap, alen);
+
+    /* Members are usually written in the same order: try index i first */
+    for (int n = 0; n < b->nspans; n++) {
+        int j = (i + n) % b->nspans;
+        const char *bp = b->buf + b->spans[j].off;
+        size_t blen = b->spans[j].len;
+        if (blen < klen || memcmp(ap, bp, klen) != 0) continue;
+        return blen == alen && memcmp(ap, bp, alen) == 0;
+    }
+    return 0;
+}
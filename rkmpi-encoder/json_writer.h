@@ -0,0 +1,111 @@
+/*
+ * Streaming JSON Writer
+ *
+ * Push-style serializer for API responses: values are appended straight
+ * into a byte buffer instead of building a cJSON tree and printing it.
+ * A heap writer keeps its buffer across jw_reset(), so a handler that
+ * answers the same shape every poll does no allocation after warm-up.
+ * A fixed writer serializes into caller-owned storage (e.g. a stack
+ * buffer) and never allocates at all.
+ *
+ * Output matches cJSON_PrintUnformatted for the same sequence of values
+ * (same escaping, "%.15g" numbers, null for NaN/Inf), checked on the host
+ * by json_test.c. The one difference: jw_int() prints the exact integer,
+ * where cJSON goes through a double (1e+15 and up).
+ *
+ * Errors are sticky: overflowing a fixed buffer, running out of memory or
+ * nesting deeper than JW_MAX_DEPTH sets w->err, later calls become no-ops
+ * and jw_finish() returns NULL.
+ *
+ * Not thread-safe: each writer belongs to one thread.
+ */
+
+#ifndef JSON_WRITER_H
+#define JSON_WRITER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define JW_MAX_DEPTH     16
+#define JW_MAX_SPANS     32             /* tracked top-level members */
+#define JW_INITIAL_CAP   1024
+#define JW_KEEP_CAP      (256 * 1024)   /* larger heap buffers are released on reset */
+
+/* Byte range of one top-level "key":value member (no separators) */
+typedef struct {
+    uint32_t off;
+    uint32_t len;
+} JsonSpan;
+
+typedef struct {
+    char *buf;
+    size_t len;
+    size_t cap;
+    int fixed;              /* buf is caller-owned and never grown */
+    int err;
+    int depth;
+    uint32_t need_comma;    /* bit per depth: container already has a value */
+    int after_key;          /* next value completes a "key": pair */
+
+    /* Optional member tracking for the root object, see jw_track_spans() */
+    int track_spans;
+    int span_open;
+    int spans_overflow;     /* more than JW_MAX_SPANS members */
+    int nspans;
+    JsonSpan spans[JW_MAX_SPANS];
+} JsonWriter;
+
+/* Heap-backed writer; the buffer is allocated on first write */
+void jw_init(JsonWriter *w);
+
+/* Writer over caller storage of cap bytes (one byte is kept for the NUL) */
+void jw_init_fixed(JsonWriter *w, char *buf, size_t cap);
+
+/* Start a new document, keeping the buffer */
+void jw_reset(JsonWriter *w);
+
+/* Release a heap writer's buffer */
+void jw_free(JsonWriter *w);
+
+/* Record the byte range of each member of the root object, so two
+ * documents can be diffed member-by-member (jw_span_equal). Call after
+ * jw_reset(), before writing. */
+void jw_track_spans(JsonWriter *w);
+
+/* NUL-terminate and return the document, or NULL on error or if a
+ * container is still open. len may be NULL. */
+const char *jw_finish(JsonWriter *w, size_t *len);
+
+/* Structure */
+void jw_obj_begin(JsonWriter *w);
+void jw_obj_end(JsonWriter *w);
+void jw_arr_begin(JsonWriter *w);
+void jw_arr_end(JsonWriter *w);
+void jw_key(JsonWriter *w, const char *key);
+
+/* Values (as array elements, or after jw_key) */
+void jw_str(JsonWriter *w, const char *s);     /* NULL writes null */
+void jw_int(JsonWriter *w, long long v);
+void jw_num(JsonWriter *w, double v);
+void jw_bool(JsonWriter *w, int v);
+void jw_null(JsonWriter *w);
+
+/* Pre-serialized JSON value, copied verbatim (caller guarantees validity) */
+void jw_raw(JsonWriter *w, const char *json);
+
+/* Plain bytes with no separators, for framing around a document */
+void jw_write(JsonWriter *w, const char *data, size_t len);
+
+/* Object member shorthands */
+void jw_kstr(JsonWriter *w, const char *key, const char *s);
+void jw_kint(JsonWriter *w, const char *key, long long v);
+void jw_knum(JsonWriter *w, const char *key, double v);
+void jw_kbool(JsonWriter *w, const char *key, int v);
+void jw_kobj(JsonWriter *w, const char *key);  /* key + jw_obj_begin */
+void jw_karr(JsonWriter *w, const char *key);  /* key + jw_arr_begin */
+
+/* Does b's root object contain member i of a with identical bytes?
+ * Both writers must have tracked spans. */
+int jw_span_equal(const JsonWriter *a, int i, const JsonWriter *b);
+
+#endif /* JSON_WRITER_H */
@@ -446,6 +446,7 @@ static void configure_timelapse(MoonrakerClient *mc) {
 
     /* Use hardware VENC encoding */
     timelapse_set_use_venc(1);
+    timelapse_set_streaming(cfg->timelapse_streaming);
 }
 
 /* Capture a frame with stream delay */
@@ -706,6 +707,8 @@ static void handle_status_update(MoonrakerClient *mc, cJSON *params_obj) {
                 on_print_cancel(mc, mc->filename, new_state);
             }
 
+            fault_detect_notify_print_state(is_printing);
+
             /* Update stored state */
             strncpy(mc->print_state, new_state,
                     sizeof(mc->print_state) - 1);
@@ -751,6 +754,7 @@ static void handle_status_update(MoonrakerClient *mc, cJSON *params_obj) {
             on_layer_change(mc, layer, total >= 0 ? total : mc->total_layers);
         }
 
+        fault_detect_notify_layer(layer);
         mc->current_layer = layer;
     }
 }
@@ -10,6 +10,7 @@
 #define _GNU_SOURCE
 #include "mqtt_client.h"
 #include "cJSON.h"
+#include "json_writer.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
@@ -308,6 +309,30 @@ static int mqtt_is_msgid_handled(MQTTClient *client, const char *msgid) {
     return 0;
 }
 
+/* Serialize a video/report reply into payload (stack buffer, no allocation).
+ * action is echoed from the request, so it goes through the escaping writer.
+ * Returns 0 on success, -1 if it does not fit. */
+static int mqtt_video_report(char *payload, size_t size,
+                             const char *action, const char *state) {
+    char msgid[17];
+    snprintf(msgid, sizeof(msgid), "%08x%08x", (unsigned)rand(), (unsigned)rand());
+
+    JsonWriter w;
+    jw_init_fixed(&w, payload, size);
+    jw_obj_begin(&w);
+    jw_kstr(&w, "type", "video");
+    jw_kstr(&w, "action", action);
+    jw_kint(&w, "timestamp", (long long)get_time_ms());
+    jw_kstr(&w, "msgid", msgid);
+    jw_kstr(&w, "state", state);
+    jw_kint(&w, "code", 200);
+    jw_kstr(&w, "msg", "");
+    jw_key(&w, "data");
+    jw_null(&w);
+    jw_obj_end(&w);
+    return jw_finish(&w, NULL) ? 0 : -1;
+}
+
 /* Send video response report */
 static void mqtt_send_video_response(MQTTClient *client, const char *action, const char *msgid) {
     char topic[256];
@@ -319,11 +344,8 @@ static void mqtt_send_video_response(MQTTClient *client, const char *action, con
     const char *state = (strcmp(action, "stopCapture") == 0) ? "pushStopped" : "initSuccess";
 
     char payload[512];
-    snprintf(payload, sizeof(payload),
-             "{\"type\":\"video\",\"action\":\"%s\",\"timestamp\":%llu,"
-             "\"msgid\":\"%08x%08x\",\"state\":\"%s\",\"code\":200,\"msg\":\"\",\"data\":null}",
-             action, (unsigned long long)get_time_ms(),
-             (unsigned)rand(), (unsigned)rand(), state);
+    if (mqtt_video_report(payload, sizeof(payload), action, state) < 0)
+        return;
 
     uint8_t buf[1024];
     size_t len = mqtt_build_publish(buf, sizeof(buf), topic, payload, 0, 0);
@@ -340,11 +362,8 @@ static void mqtt_send_counter_report(MQTTClient *client) {
              client->config.model_id, client->creds.device_id);
 
     char payload[512];
-    snprintf(payload, sizeof(payload),
-             "{\"type\":\"video\",\"action\":\"startCapture\",\"timestamp\":%llu,"
-             "\"msgid\":\"%08x%08x\",\"state\":\"initSuccess\",\"code\":200,\"msg\":\"\",\"data\":null}",
-             (unsigned long long)get_time_ms(),
-             (unsigned)rand(), (unsigned)rand());
+    if (mqtt_video_report(payload, sizeof(payload), "startCapture", "initSuccess") < 0)
+        return;
 
     uint8_t buf[1024];
     size_t len = mqtt_build_publish(buf, sizeof(buf), topic, payload, 0, 0);
@@ -722,6 +722,9 @@ static void read_cmd_file(void) {
         } else if (sscanf(line, "timelapse_use_venc:%d", &val) == 1) {
             /* Enable/disable hardware VENC encoding (1=VENC, 0=ffmpeg) */
             timelapse_set_use_venc(val);
+        } else if (sscanf(line, "timelapse_streaming:%d", &val) == 1) {
+            /* Encode during the print (1) or save JPEGs for finalize (0) */
+            timelapse_set_streaming(val);
         }
     }
     fclose(f);
@@ -759,6 +762,8 @@ static void write_ctrl_file(void) {
     fprintf(f, "mjpeg_clients=%d\n", g_stats.mjpeg_clients);
     fprintf(f, "flv_clients=%d\n", g_stats.flv_clients);
     fprintf(f, "display_clients=%d\n", display_get_client_count());
+    fprintf(f, "display_encoded=%u\n", display_get_frames_encoded());
+    fprintf(f, "display_skipped=%u\n", display_get_frames_skipped());
     /* Detected camera max FPS (for control server to update slider limits) */
     if (g_mjpeg_ctrl.camera_fps_detected && g_mjpeg_ctrl.camera_interval > 0) {
         int camera_max_fps = 1000000 / g_mjpeg_ctrl.camera_interval;
@@ -1864,6 +1869,10 @@ static void apply_fd_thresholds(fd_config_t *fd_cfg, const AppConfig *cfg)
         if (v && cJSON_IsNumber(v)) fd_cfg->thresholds.ema_alpha = (float)v->valuedouble;
         v = cJSON_GetObjectItemCaseSensitive(entry, "heatmap_coarse_weight");
         if (v && cJSON_IsNumber(v)) fd_cfg->thresholds.heatmap_coarse_weight = (float)v->valuedouble;
+        v = cJSON_GetObjectItemCaseSensitive(entry, "cascade_cnn_ok");
+        if (v && cJSON_IsNumber(v)) fd_cfg->thresholds.cascade_cnn_ok = (float)v->valuedouble;
+        v = cJSON_GetObjectItemCaseSensitive(entry, "cascade_proto_ok");
+        if (v && cJSON_IsNumber(v)) fd_cfg->thresholds.cascade_proto_ok = (float)v->valuedouble;
     }
     cJSON_Delete(root);
 }
@@ -1991,6 +2000,11 @@ static void on_config_changed(AppConfig *cfg) {
                  cfg->fault_detect_model_set);
         fd_cfg.min_free_mem_mb = cfg->fault_detect_min_free_mem;
         fd_cfg.pace_ms = cfg->fault_detect_pace_ms;
+        fd_cfg.model_cache_mb = cfg->fault_detect_model_cache_mb;
+        fd_cfg.sched_enabled = cfg->fault_detect_sched_enabled;
+        fd_cfg.max_skip_s = cfg->fault_detect_max_skip_s;
+        fd_cfg.cascade_enabled = cfg->fault_detect_cascade;
+        fd_cfg.roi_crop = cfg->fault_detect_roi_crop;
         fd_cfg.heatmap_enabled = cfg->heatmap_enabled;
         fd_cfg.debug_logging = cfg->fd_debug_logging;
         fd_cfg.beep_pattern = cfg->fd_beep_pattern;
@@ -2378,6 +2392,11 @@ int main(int argc, char *argv[]) {
                      app_config.fault_detect_model_set);
             fd_cfg.min_free_mem_mb = app_config.fault_detect_min_free_mem;
             fd_cfg.pace_ms = app_config.fault_detect_pace_ms;
+            fd_cfg.model_cache_mb = app_config.fault_detect_model_cache_mb;
+            fd_cfg.sched_enabled = app_config.fault_detect_sched_enabled;
+            fd_cfg.max_skip_s = app_config.fault_detect_max_skip_s;
+            fd_cfg.cascade_enabled = app_config.fault_detect_cascade;
+            fd_cfg.roi_crop = app_config.fault_detect_roi_crop;
             fd_cfg.heatmap_enabled = app_config.heatmap_enabled;
             fd_cfg.debug_logging = app_config.fd_debug_logging;
             fd_cfg.beep_pattern = app_config.fd_beep_pattern;
@@ -2786,6 +2805,9 @@ int main(int argc, char *argv[]) {
             if (display_capture_start(cfg.display_fps) == 0) {
                 log_info("  Display capture: http://0.0.0.0:%d/display (%d fps)\n",
                          mjpeg_port, cfg.display_fps);
+                if (flv_server_initialized) {
+                    log_info("  Display H.264: http://0.0.0.0:%d/display\n", HTTP_FLV_PORT);
+                }
             } else {
                 log_error("  Display capture: failed to start\n");
             }
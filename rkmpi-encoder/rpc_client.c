@@ -7,6 +7,7 @@
 #define _GNU_SOURCE
 #include "rpc_client.h"
 #include "timelapse.h"
+#include "fault_detect.h"
 #include "cJSON.h"
 #include <stdio.h>
 #include <stdlib.h>
@@ -157,6 +158,9 @@ static void handle_video_request(RPCClient *client, cJSON *video_request) {
         rpc_log("Received startLanCapture\n");
         rpc_send_video_reply(client, id, m);
 
+        /* Firmware captures once per layer: a layer hint for fault detection */
+        fault_detect_notify_layer(-1);
+
         /* If custom timelapse mode is enabled, ignore RPC capture commands */
         if (timelapse_is_custom_mode()) {
             /* Don't log - this gets called frequently during print */
@@ -178,6 +182,14 @@ static void handle_video_request(RPCClient *client, cJSON *video_request) {
     }
 }
 
+/* Forward print_stats.state to the fault detection scheduler */
+static void notify_print_state(cJSON *status) {
+    cJSON *print_stats = cJSON_GetObjectItem(status, "print_stats");
+    cJSON *state = print_stats ? cJSON_GetObjectItem(print_stats, "state") : NULL;
+    if (cJSON_IsString(state))
+        fault_detect_notify_print_state(strcmp(state->valuestring, "printing") == 0);
+}
+
 /* Check for print completion to finalize timelapse */
 static void check_print_completion(cJSON *status) {
     /* If custom timelapse mode is enabled, h264_server handles finalization */
@@ -237,6 +249,8 @@ static void rpc_handle_message(RPCClient *client, const char *msg) {
                 handle_video_request(client, video_request);
             }
 
+            notify_print_state(status);
+
             /* Check for print completion (to finalize timelapse) */
             check_print_completion(status);
         }
@@ -0,0 +1,75 @@
+#!/usr/bin/env python3
+# Local HTTP server for testing the fault detection dataset downloader.
+# Serves files from a directory, with knobs for the failure modes the
+# downloader has to survive:
+#   DROP=N     close the connection after N body bytes of every response
+#   CHUNKED=1  send Transfer-Encoding: chunked instead of Content-Length
+#   NORANGE=1  ignore Range requests (always 200 from byte 0)
+# GET /redir answers 302 to /ds.tar.gz. Each request is logged to stderr.
+#
+# Usage: fd_dataset_server.py PORT DIR
+
+import http.server
+import os
+import re
+import sys
+
+DROP = int(os.environ.get('DROP', '0'))
+CHUNKED = os.environ.get('CHUNKED') == '1'
+NORANGE = os.environ.get('NORANGE') == '1'
+ROOT = sys.argv[2]
+
+
+class Handler(http.server.BaseHTTPRequestHandler):
+    protocol_version = 'HTTP/1.1'
+
+    def log_message(self, *args):
+        sys.stderr.write('REQ %s range=%s\n' % (self.path, self.headers.get('Range')))
+
+    def do_GET(self):
+        if self.path == '/redir':
+            self.send_response(302)
+            self.send_header('Location', '/ds.tar.gz')
+            self.send_header('Content-Length', '0')
+            self.end_headers()
+            return
+        path = os.path.join(ROOT, self.path.lstrip('/'))
+        if not os.path.isfile(path):
+            self.send_response(404)
+            self.send_header('Content-Length', '0')
+            self.end_headers()
+            return
+
+        with open(path, 'rb') as f:
+            data = f.read()
+        start = 0
+        m = re.match(r'bytes=(\d+)-', self.headers.get('Range') or '')
+        if m and not NORANGE:
+            start = int(m.group(1))
+            self.send_response(206)
+            self.send_header('Content-Range',
+                             'bytes %d-%d/%d' % (start, len(data) - 1, len(data)))
+        else:
+            self.send_response(200)
+        body = data[start:]
+        if CHUNKED:
+            self.send_header('Transfer-Encoding', 'chunked')
+        else:
+            self.send_header('Content-Length', str(len(body)))
+        self.send_header('Connection', 'close')
+        self.end_headers()
+
+        limit = min(DROP, len(body)) if DROP else len(body)
+        for i in range(0, limit, 7000):
+            piece = body[i:min(i + 7000, limit)]
+            if CHUNKED:
+                self.wfile.write(b'%x\r\n' % len(piece) + piece + b'\r\n')
+            else:
+                self.wfile.write(piece)
+        if limit == len(body) and CHUNKED:
+            self.wfile.write(b'0\r\n\r\n')
+        self.wfile.flush()
+        self.close_connection = True
+
+
+http.server.ThreadingHTTPServer(('127.0.0.1', int(sys.argv[1])), Handler).serve_forever()
@@ -0,0 +1,96 @@
+#!/bin/sh
+# Fault detection dataset downloader test, run on the host:
+#   make fd_bench && scripts/fd_download_test.sh
+# Builds a fixture dataset archive, serves it with fd_dataset_server.py and
+# runs `fd_bench -G` against it in every failure mode the server can play.
+# A download must either reproduce the fixture exactly or leave nothing
+# behind (no dataset dir, no .part dir).
+
+FD_BENCH=${FD_BENCH:-./fd_bench}
+PORT=${PORT:-18080}
+SCRIPTS=$(cd "$(dirname "$0")" && pwd)
+WORK=$(mktemp -d /tmp/fd_download_test.XXXXXX)
+FAILED=0
+
+# Fixture: one top-level dir, like the published archives, with
+# incompressible images so the stream is big enough to drop mid-way
+mkdir -p "$WORK/fx/ds1/failure" "$WORK/fx/ds1/success"
+for i in 1 2 3 4 5 6 7 8 9 10; do
+    head -c 120000 /dev/urandom > "$WORK/fx/ds1/failure/img_$i.jpg"
+    head -c 120000 /dev/urandom > "$WORK/fx/ds1/success/img_$i.jpg"
+done
+echo '{"source": "fd_download_test"}' > "$WORK/fx/ds1/metadata.json"
+mkdir -p "$WORK/srv"
+tar -czf "$WORK/srv/ds.tar.gz" -C "$WORK/fx" ds1
+SIZE=$(wc -c < "$WORK/srv/ds.tar.gz")
+head -c $((SIZE / 2)) "$WORK/srv/ds.tar.gz" > "$WORK/srv/trunc.tar.gz"
+head -c 5000 /dev/urandom > "$WORK/srv/junk.tar.gz"
+
+# run NAME EXPECT URL_PATH [VAR=VALUE...]: EXPECT is ok or fail, the
+# variables go to the server. With CANCEL=SECONDS set, fd_bench gets a
+# SIGINT (the web UI's cancel) that long after it starts.
+run() {
+    name=$1 expect=$2 url=$3
+    shift 3
+    env "$@" python3 "$SCRIPTS/fd_dataset_server.py" "$PORT" "$WORK/srv" \
+        2> "$WORK/srv_$name.log" &
+    srv=$!
+    sleep 0.5
+    timeout 120 "$FD_BENCH" -G "http://127.0.0.1:$PORT/$url" "$WORK/out/$name" \
+        > "$WORK/bench_$name.log" 2>&1 &
+    bench=$!
+    if [ -n "$CANCEL" ]; then
+        sleep "$CANCEL"
+        kill -INT $bench
+    fi
+    wait $bench
+    rc=$?
+    kill $srv
+    wait $srv 2>/dev/null
+
+    result=FAIL
+    if [ -d "$WORK/out/.$name.part" ]; then
+        detail="partial dir left behind"
+    elif [ "$expect" = ok ]; then
+        if [ $rc -eq 0 ] && diff -r "$WORK/fx/ds1" "$WORK/out/$name" \
+                -x .fnv1a > /dev/null 2>&1; then
+            result=ok
+            detail="matches fixture"
+        else
+            detail="rc=$rc, output differs from fixture"
+        fi
+    elif [ $rc -ne 0 ] && [ ! -e "$WORK/out/$name" ]; then
+        result=ok
+        detail="failed cleanly"
+    else
+        detail="rc=$rc, dataset dir left behind"
+    fi
+    printf '  %-4s %-10s %s (%s requests)\n' "$result" "$name" "$detail" \
+        "$(grep -c REQ "$WORK/srv_$name.log")"
+    [ $result = ok ] || FAILED=1
+}
+
+mkdir -p "$WORK/out"
+echo "# fixture: $SIZE bytes in $WORK"
+run plain    ok   ds.tar.gz
+run chunked  ok   ds.tar.gz    CHUNKED=1
+run drop     ok   ds.tar.gz    DROP=700000
+run redir    ok   redir
+run missing  fail nothing.tar.gz
+run trunc    fail trunc.tar.gz
+run junk     fail junk.tar.gz
+CANCEL=3
+run cancel   fail ds.tar.gz    DROP=700000 NORANGE=1
+CANCEL=
+
+# A new download replaces a dataset of the same name
+echo stale > "$WORK/out/plain/stale.jpg"
+run plain    ok   ds.tar.gz
+
+if [ $FAILED -eq 0 ]; then
+    echo "# all downloads passed"
+    rm -rf "$WORK"
+else
+    echo "# FAILED, logs kept in $WORK"
+fi
+exit $FAILED
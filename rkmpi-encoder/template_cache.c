@@ -0,0 +1,525 @@
+/*
+ * HTML Template Cache
+ *
+ * control.html alone is ~180KB; re-reading and re-scanning it for every
+ * page view (and sending it uncompressed over Wi-Fi) dominated the cost of
+ * opening the control UI. Templates are now parsed once, rendered output is
+ * reused while the substituted values are unchanged, and a gzip copy is
+ * produced on first demand.
+ */
+
+#pragma GCC diagnostic ignored "-Wformat-truncation"
+
+#include "template_cache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+
+/* ============================================================================
+ * Cache state
+ * ============================================================================ */
+
+typedef struct {
+    size_t off;             /* offset into text */
+    size_t len;
+    int is_var;             /* text[off..off+len) is a variable name (no '$') */
+} TmplSegment;
+
+typedef struct {
+    char filename[64];
+    int loaded;
+    int stale;              /* set by inotify, reload on next render */
+    time_t mtime;
+    off_t size;
+    uint64_t content_hash;  /* FNV-1a of the template bytes, seeds the ETag */
+
+    char *text;
+    TmplSegment *segs;
+    int nsegs;
+
+    /* Last render, reused while the variable values hash the same */
+    int has_render;
+    uint64_t render_hash;
+    char *render;
+    size_t render_len;
+    unsigned char *gz;      /* lazily compressed copy of render */
+    size_t gz_len;
+    char etag[24];
+} TmplEntry;
+
+static struct {
+    char dir[256];
+    int inotify_fd;         /* -1 = unavailable, fall back to stat() */
+    TmplEntry files[TMPL_CACHE_MAX_FILES];
+} g_tmpl = { .inotify_fd = -1 };
+
+static void entry_free(TmplEntry *e) {
+    free(e->text);
+    free(e->segs);
+    free(e->render);
+    free(e->gz);
+    memset(e, 0, sizeof(*e));
+}
+
+/* ============================================================================
+ * Parsing
+ * ============================================================================ */
+
+static int is_ident_start(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+}
+
+static int is_ident_char(char c) {
+    return is_ident_start(c) || (c >= '0' && c <= '9');
+}
+
+/* Split text into static chunks and $identifier slots. Identifiers that
+ * turn out not to be template variables are emitted verbatim at render. */
+static int template_parse(TmplEntry *e, size_t text_len) {
+    int cap = 64;
+    TmplSegment *segs = malloc(cap * sizeof(TmplSegment));
+    if (!segs) return -1;
+
+    int n = 0;
+    size_t start = 0, i = 0;
+    while (i < text_len) {
+        if (e->text[i] != '$' || i + 1 >= text_len || !is_ident_start(e->text[i + 1])) {
+            i++;
+            continue;
+        }
+
+        size_t name_end = i + 1;
+        while (name_end < text_len && is_ident_char(e->text[name_end]))
+            name_end++;
+
+        if (n + 2 > cap) {
+            cap *= 2;
+            TmplSegment *grown = realloc(segs, cap * sizeof(TmplSegment));
+            if (!grown) { free(segs); return -1; }
+            segs = grown;
+        }
+        if (i > start)
+            segs[n++] = (TmplSegment){ start, i - start, 0 };
+        segs[n++] = (TmplSegment){ i + 1, name_end - i - 1, 1 };
+        start = i = name_end;
+    }
+
+    if (text_len > start) {
+        if (n + 1 > cap) {
+            TmplSegment *grown = realloc(segs, (cap + 1) * sizeof(TmplSegment));
+            if (!grown) { free(segs); return -1; }
+            segs = grown;
+        }
+        segs[n++] = (TmplSegment){ start, text_len - start, 0 };
+    }
+
+    e->segs = segs;
+    e->nsegs = n;
+    return 0;
+}
+
+/* FNV-1a 64-bit, chained across calls */
+static uint64_t fnv1a64(uint64_t h, const void *data, size_t len) {
+    const unsigned char *p = data;
+    for (size_t i = 0; i < len; i++) {
+        h ^= p[i];
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+static int template_load(TmplEntry *e) {
+    char path[384];
+    snprintf(path, sizeof(path), "%s/%s", g_tmpl.dir, e->filename);
+
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        fprintf(stderr, "Control: Cannot open template %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fileno(f), &st) != 0 || st.st_size <= 0 || st.st_size > TMPL_CACHE_MAX_SIZE) {
+        fclose(f);
+        return -1;
+    }
+
+    char *text = malloc(st.st_size + 1);
+    if (!text) {
+        fclose(f);
+        return -1;
+    }
+    size_t nread = fread(text, 1, st.st_size, f);
+    fclose(f);
+    text[nread] = '\0';
+
+    char filename[64];
+    snprintf(filename, sizeof(filename), "%s", e->filename);
+    entry_free(e);
+    snprintf(e->filename, sizeof(e->filename), "%s", filename);
+
+    e->text = text;
+    if (template_parse(e, nread) < 0) {
+        entry_free(e);
+        return -1;
+    }
+
+    e->mtime = st.st_mtime;
+    e->size = st.st_size;
+    e->content_hash = fnv1a64(0xcbf29ce484222325ULL, text, nread);
+    e->loaded = 1;
+    e->stale = 0;
+    fprintf(stderr, "Control: Loaded template %s (%d segments)\n", e->filename, e->nsegs);
+    return 0;
+}
+
+/* Drain pending inotify events and mark changed templates stale */
+static void template_poll_changes(void) {
+    if (g_tmpl.inotify_fd < 0) return;
+
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t len;
+    while ((len = read(g_tmpl.inotify_fd, buf, sizeof(buf))) > 0) {
+        for (char *p = buf; p < buf + len; ) {
+            struct inotify_event *ev = (struct inotify_event *)p;
+            for (int i = 0; i < TMPL_CACHE_MAX_FILES; i++) {
+                TmplEntry *e = &g_tmpl.files[i];
+                if (!e->loaded) continue;
+                if ((ev->mask & IN_Q_OVERFLOW) ||
+                    (ev->len > 0 && strcmp(ev->name, e->filename) == 0))
+                    e->stale = 1;
+            }
+            p += sizeof(struct inotify_event) + ev->len;
+        }
+    }
+}
+
+/* Find (loading or reloading if needed) the cache entry for filename */
+static TmplEntry *template_get(const char *filename) {
+    template_poll_changes();
+
+    TmplEntry *e = NULL, *free_slot = NULL;
+    for (int i = 0; i < TMPL_CACHE_MAX_FILES; i++) {
+        TmplEntry *cand = &g_tmpl.files[i];
+        if (cand->loaded && strcmp(cand->filename, filename) == 0) {
+            e = cand;
+            break;
+        }
+        if (!cand->loaded && !free_slot) free_slot = cand;
+    }
+
+    if (e && !e->stale && g_tmpl.inotify_fd < 0) {
+        /* No inotify: cheap stat check instead */
+        char path[384];
+        struct stat st;
+        snprintf(path, sizeof(path), "%s/%s", g_tmpl.dir, filename);
+        if (stat(path, &st) != 0 || st.st_mtime != e->mtime || st.st_size != e->size)
+            e->stale = 1;
+    }
+
+    if (e && !e->stale) return e;
+
+    if (!e) {
+        if (!free_slot) return NULL;
+        e = free_slot;
+        snprintf(e->filename, sizeof(e->filename), "%s", filename);
+    }
+    return template_load(e) == 0 ? e : NULL;
+}
+
+/* ============================================================================
+ * Rendering
+ * ============================================================================ */
+
+static const char *resolve_var(const TmplEntry *e, const TmplSegment *s,
+                               const TemplateVar *vars, int nvars) {
+    for (int i = 0; i < nvars; i++) {
+        if (strlen(vars[i].name) == s->len &&
+            memcmp(vars[i].name, e->text + s->off, s->len) == 0)
+            return vars[i].value;
+    }
+    return NULL;
+}
+
+int template_render(const char *filename, const TemplateVar *vars, int nvars,
+                    int accept_gzip, TemplateOutput *out) {
+    TmplEntry *e = template_get(filename);
+    if (!e) return -1;
+
+    /* Chain every substituted value onto the template content hash, so the
+     * ETag changes when either does, also across restarts and updates */
+    uint64_t h = e->content_hash;
+    for (int i = 0; i < e->nsegs; i++) {
+        if (!e->segs[i].is_var) continue;
+        const char *val = resolve_var(e, &e->segs[i], vars, nvars);
+        if (val) h = fnv1a64(h, val, strlen(val) + 1);
+        else h = fnv1a64(h, "", 1);
+    }
+
+    if (!e->has_render || e->render_hash != h) {
+        size_t total = 0;
+        for (int i = 0; i < e->nsegs; i++) {
+            const TmplSegment *s = &e->segs[i];
+            const char *val = s->is_var ? resolve_var(e, s, vars, nvars) : NULL;
+            total += val ? strlen(val) : s->len + (s->is_var ? 1 : 0);
+        }
+
+        char *render = malloc(total + 1);
+        if (!render) return -1;
+
+        size_t pos = 0;
+        for (int i = 0; i < e->nsegs; i++) {
+            const TmplSegment *s = &e->segs[i];
+            const char *val = s->is_var ? resolve_var(e, s, vars, nvars) : NULL;
+            if (val) {
+                size_t vlen = strlen(val);
+                memcpy(render + pos, val, vlen);
+                pos += vlen;
+            } else {
+                /* Static text, or unknown $name kept verbatim */
+                if (s->is_var) render[pos++] = '$';
+                memcpy(render + pos, e->text + s->off, s->len);
+                pos += s->len;
+            }
+        }
+        render[pos] = '\0';
+
+        free(e->render);
+        free(e->gz);
+        e->render = render;
+        e->render_len = pos;
+        e->gz = NULL;
+        e->gz_len = 0;
+        e->render_hash = h;
+        e->has_render = 1;
+        snprintf(e->etag, sizeof(e->etag), "\"%016llx\"", (unsigned long long)h);
+    }
+
+    if (accept_gzip && !e->gz && e->render_len > 1024)
+        e->gz = gzip_compress((const unsigned char *)e->render, e->render_len, &e->gz_len);
+
+    if (accept_gzip && e->gz) {
+        out->body = (const char *)e->gz;
+        out->len = e->gz_len;
+        out->gzipped = 1;
+    } else {
+        out->body = e->render;
+        out->len = e->render_len;
+        out->gzipped = 0;
+    }
+    snprintf(out->etag, sizeof(out->etag), "%s", e->etag);
+    return 0;
+}
+
+void template_cache_init(const char *dir) {
+    template_cache_cleanup();
+    snprintf(g_tmpl.dir, sizeof(g_tmpl.dir), "%s", dir);
+
+    g_tmpl.inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (g_tmpl.inotify_fd >= 0 &&
+        inotify_add_watch(g_tmpl.inotify_fd, dir,
+                          IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_DELETE) < 0) {
+        close(g_tmpl.inotify_fd);
+        g_tmpl.inotify_fd = -1;
+    }
+    if (g_tmpl.inotify_fd < 0)
+        fprintf(stderr, "Control: inotify unavailable for %s, using mtime checks\n", dir);
+}
+
+void template_cache_cleanup(void) {
+    for (int i = 0; i < TMPL_CACHE_MAX_FILES; i++)
+        entry_free(&g_tmpl.files[i]);
+    if (g_tmpl.inotify_fd >= 0) {
+        close(g_tmpl.inotify_fd);
+        g_tmpl.inotify_fd = -1;
+    }
+}
+
+/* ============================================================================
+ * Minimal gzip encoder
+ *
+ * Single fixed-Huffman deflate block with hash-chain LZ77. Compresses the
+ * HTML templates ~4x; runs once per template change so speed is secondary.
+ * ============================================================================ */
+
+#define GZ_WINDOW       32768
+#define GZ_HASH_BITS    15
+#define GZ_MAX_CHAIN    64
+#define GZ_MIN_MATCH    3
+#define GZ_MAX_MATCH    258
+#define GZ_TOO_FAR      4096    /* 3-byte matches further than this cost more than literals */
+
+static const uint16_t gz_len_base[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static const uint8_t gz_len_extra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+static const uint16_t gz_dist_base[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+};
+static const uint8_t gz_dist_extra[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+typedef struct {
+    unsigned char *out;
+    size_t pos;
+    uint32_t bitbuf;
+    int bitcnt;
+} GzBits;
+
+static void gz_put_bits(GzBits *bw, uint32_t bits, int n) {
+    bw->bitbuf |= bits << bw->bitcnt;
+    bw->bitcnt += n;
+    while (bw->bitcnt >= 8) {
+        bw->out[bw->pos++] = bw->bitbuf & 0xFF;
+        bw->bitbuf >>= 8;
+        bw->bitcnt -= 8;
+    }
+}
+
+/* Huffman codes are stored MSB-first, the bit stream is LSB-first */
+static void gz_put_code(GzBits *bw, uint32_t code, int n) {
+    uint32_t rev = 0;
+    for (int i = 0; i < n; i++)
+        rev |= ((code >> i) & 1) << (n - 1 - i);
+    gz_put_bits(bw, rev, n);
+}
+
+static void gz_put_litlen(GzBits *bw, int sym) {
+    if (sym < 144)      gz_put_code(bw, 0x30 + sym, 8);
+    else if (sym < 256) gz_put_code(bw, 0x190 + sym - 144, 9);
+    else if (sym < 280) gz_put_code(bw, sym - 256, 7);
+    else                gz_put_code(bw, 0xC0 + sym - 280, 8);
+}
+
+static void gz_put_match(GzBits *bw, int len, int dist) {
+    int lc = 28;
+    while (gz_len_base[lc] > len) lc--;
+    gz_put_litlen(bw, 257 + lc);
+    if (gz_len_extra[lc])
+        gz_put_bits(bw, len - gz_len_base[lc], gz_len_extra[lc]);
+
+    int dc = 29;
+    while (gz_dist_base[dc] > dist) dc--;
+    gz_put_code(bw, dc, 5);
+    if (gz_dist_extra[dc])
+        gz_put_bits(bw, dist - gz_dist_base[dc], gz_dist_extra[dc]);
+}
+
+static uint32_t gz_crc32(const unsigned char *data, size_t len) {
+    static uint32_t table[256];
+    static int table_ready;
+    if (!table_ready) {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++)
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            table[i] = c;
+        }
+        table_ready = 1;
+    }
+
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < len; i++)
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return crc ^ 0xFFFFFFFFu;
+}
+
+static inline uint32_t gz_hash(const unsigned char *p) {
+    return ((p[0] << 10) ^ (p[1] << 5) ^ p[2]) & ((1u << GZ_HASH_BITS) - 1);
+}
+
+unsigned char *gzip_compress(const unsigned char *src, size_t len, size_t *out_len) {
+    /* Fixed-Huffman output never exceeds 9 bits per input byte */
+    size_t cap = len + len / 8 + 64;
+    unsigned char *out = malloc(cap);
+    int32_t *head = malloc((1u << GZ_HASH_BITS) * sizeof(int32_t));
+    int32_t *prev = malloc(GZ_WINDOW * sizeof(int32_t));
+    if (!out || !head || !prev) {
+        free(out); free(head); free(prev);
+        return NULL;
+    }
+    memset(head, 0xFF, (1u << GZ_HASH_BITS) * sizeof(int32_t));
+
+    /* gzip header: magic, deflate, no flags, no mtime, unix */
+    static const unsigned char hdr[10] = { 0x1F, 0x8B, 8, 0, 0, 0, 0, 0, 0, 3 };
+    memcpy(out, hdr, sizeof(hdr));
+
+    GzBits bw = { out, sizeof(hdr), 0, 0 };
+    gz_put_bits(&bw, 1, 1);     /* BFINAL */
+    gz_put_bits(&bw, 1, 2);     /* BTYPE = fixed Huffman */
+
+    size_t i = 0;
+    while (i < len) {
+        int best_len = 0, best_dist = 0;
+
+        if (i + GZ_MIN_MATCH <= len) {
+            uint32_t h = gz_hash(src + i);
+            int32_t cand = head[h];
+            size_t max_len = len - i < GZ_MAX_MATCH ? len - i : GZ_MAX_MATCH;
+
+            for (int chain = 0; cand >= 0 && chain < GZ_MAX_CHAIN; chain++) {
+                size_t dist = i - (size_t)cand;
+                if (dist == 0 || dist > GZ_WINDOW) break;
+                if (src[cand + best_len] == src[i + best_len]) {
+                    size_t l = 0;
+                    while (l < max_len && src[cand + l] == src[i + l]) l++;
+                    if ((int)l > best_len) {
+                        best_len = (int)l;
+                        best_dist = (int)dist;
+                        if (l == max_len) break;
+                    }
+                }
+                int32_t next = prev[cand & (GZ_WINDOW - 1)];
+                if (next >= cand) break;
+                cand = next;
+            }
+
+            prev[i & (GZ_WINDOW - 1)] = head[h];
+            head[h] = (int32_t)i;
+        }
+
+        if (best_len == GZ_MIN_MATCH && best_dist > GZ_TOO_FAR)
+            best_len = 0;
+
+        if (best_len >= GZ_MIN_MATCH) {
+            gz_put_match(&bw, best_len, best_dist);
+            /* Index the positions covered by the match */
+            for (size_t k = i + 1; k < i + best_len && k + GZ_MIN_MATCH <= len; k++) {
+                uint32_t h = gz_hash(src + k);
+                prev[k & (GZ_WINDOW - 1)] = head[h];
+                head[h] = (int32_t)k;
+            }
+            i += best_len;
+        } else {
+            gz_put_litlen(&bw, src[i]);
+            i++;
+        }
+    }
+
+    gz_put_litlen(&bw, 256);    /* end of block */
+    if (bw.bitcnt > 0) gz_put_bits(&bw, 0, 8 - bw.bitcnt);
+
+    /* Trailer: CRC32 + ISIZE, little-endian */
+    uint32_t crc = gz_crc32(src, len);
+    uint32_t isize = (uint32_t)len;
+    for (int k = 0; k < 4; k++) out[bw.pos++] = (crc >> (8 * k)) & 0xFF;
+    for (int k = 0; k < 4; k++) out[bw.pos++] = (isize >> (8 * k)) & 0xFF;
+
+    free(head);
+    free(prev);
+    *out_len = bw.pos;
+    return out;
+}
@@ -0,0 +1,54 @@
+/*
+ * HTML Template Cache
+ *
+ * Templates are parsed once into a segment list (static text chunks and
+ * $variable slots) and re-parsed only when inotify reports a change in the
+ * template directory. Rendered pages are cached per template together with
+ * a gzip copy and an ETag derived from the template content and the
+ * substituted values, so repeat page views cost a 304 or a memcpy-free
+ * send of a pre-compressed blob.
+ *
+ * Not thread-safe: owned by the control server thread.
+ */
+
+#ifndef TEMPLATE_CACHE_H
+#define TEMPLATE_CACHE_H
+
+#include <stddef.h>
+
+#define TMPL_CACHE_MAX_FILES  8
+#define TMPL_CACHE_MAX_SIZE   (512 * 1024)    /* per template file */
+
+/* Template substitution variable: $name in the template is replaced by value */
+typedef struct {
+    const char *name;   /* variable name (without $) */
+    const char *value;  /* replacement value */
+} TemplateVar;
+
+/* Rendered page. Buffers are owned by the cache and stay valid until the
+ * next render of the same template. */
+typedef struct {
+    const char *body;
+    size_t len;
+    int gzipped;            /* body is gzip-encoded */
+    char etag[24];          /* quoted, ready for the ETag header */
+} TemplateOutput;
+
+/* Set the template directory and start watching it.
+ * Falls back to mtime checks per render if inotify is unavailable. */
+void template_cache_init(const char *dir);
+
+/* Drop all cached templates and stop watching */
+void template_cache_cleanup(void);
+
+/* Render filename with vars. accept_gzip selects the compressed body when
+ * the client advertised it. Returns 0 on success, -1 if the template is
+ * missing or unreadable. */
+int template_render(const char *filename, const TemplateVar *vars, int nvars,
+                    int accept_gzip, TemplateOutput *out);
+
+/* Compress src into a single gzip member (fixed-Huffman deflate).
+ * Returns malloc'd buffer (caller must free) or NULL. */
+unsigned char *gzip_compress(const unsigned char *src, size_t len, size_t *out_len);
+
+#endif /* TEMPLATE_CACHE_H */
@@ -10,6 +10,8 @@
 
 #include "timelapse.h"
 #include "timelapse_venc.h"
+#include "timelapse_index.h"
+#include "timelapse_stage.h"
 #include "fault_detect.h"
 #include "frame_buffer.h"
 #include "turbojpeg.h"
@@ -283,7 +285,7 @@ static int validate_jpeg_full(const uint8_t *data, size_t size) {
 }
 
 /*
- * Clean up temporary frame JPEGs after encoding.
+ * Clean up temporary frame JPEGs and staging segments after encoding.
  */
 static void cleanup_temp_frames(void) {
     if (g_timelapse.temp_dir[0] == '\0') {
@@ -301,8 +303,10 @@ static void cleanup_temp_frames(void) {
     char filepath[TIMELAPSE_PATH_MAX];
 
     while ((entry = readdir(dir)) != NULL) {
-        if (strncmp(entry->d_name, "frame_", 6) == 0 &&
-            strstr(entry->d_name, ".jpg") != NULL) {
+        if ((strncmp(entry->d_name, "frame_", 6) == 0 &&
+             strstr(entry->d_name, ".jpg") != NULL) ||
+            (strncmp(entry->d_name, TL_STAGE_SEG_PREFIX, strlen(TL_STAGE_SEG_PREFIX)) == 0 &&
+             strstr(entry->d_name, TL_STAGE_SEG_EXT) != NULL)) {
             snprintf(filepath, sizeof(filepath), "%s/%s",
                      g_timelapse.temp_dir, entry->d_name);
             unlink(filepath);
@@ -328,6 +332,7 @@ void timelapse_reset_config(void) {
     g_timelapse.config.duplicate_last_frame = 0;
     g_timelapse.config.flip_x = 0;
     g_timelapse.config.flip_y = 0;
+    g_timelapse.config.streaming = 1;
     g_timelapse.config.output_dir[0] = '\0';
     g_timelapse.use_venc = 1;  /* Default to hardware VENC encoding */
 }
@@ -337,6 +342,11 @@ void timelapse_set_use_venc(int enabled) {
     timelapse_log("Set use_venc: %d\n", g_timelapse.use_venc);
 }
 
+void timelapse_set_streaming(int enabled) {
+    g_timelapse.config.streaming = enabled ? 1 : 0;
+    timelapse_log("Set streaming: %d\n", g_timelapse.config.streaming);
+}
+
 /*
  * Configuration setters.
  */
@@ -520,6 +530,78 @@ static void cleanup_temp_dir(const char *path) {
     rmdir(path);
 }
 
+/*
+ * Decide whether this recording encodes at capture time.
+ * Streaming needs VENC and a fixed output FPS: the frame durations are
+ * written into each MP4 fragment as it is produced, while variable FPS
+ * depends on the final frame count.
+ */
+static void select_streaming(void) {
+    g_timelapse.streaming = g_timelapse.config.streaming &&
+                            g_timelapse.use_venc &&
+                            !g_timelapse.config.variable_fps;
+    free(g_timelapse.last_jpeg);
+    g_timelapse.last_jpeg = NULL;
+    g_timelapse.last_jpeg_size = 0;
+}
+
+/*
+ * Streaming capture: encode one validated JPEG into the open MP4.
+ * Opens the encoder on the first frame. Takes ownership of jpeg_buf.
+ * Returns 0 if encoded, 1 if streaming is unavailable and the caller
+ * should save the JPEG instead (jpeg_buf untouched), -1 on a dropped frame.
+ */
+static int stream_frame(uint8_t *jpeg_buf, size_t jpeg_size) {
+    if (!g_timelapse.venc_initialized) {
+        tjhandle tj = tjInitDecompress();
+        int width = 0, height = 0, subsamp, colorspace;
+        int ok = tj && tjDecompressHeader3(tj, jpeg_buf, jpeg_size, &width, &height,
+                                           &subsamp, &colorspace) == 0;
+        if (tj) tjDestroy(tj);
+
+        char output_mp4[TIMELAPSE_PATH_MAX];
+        snprintf(output_mp4, sizeof(output_mp4), "%s/%s_%02d.mp4",
+                 get_output_dir(), g_timelapse.gcode_name,
+                 g_timelapse.sequence_num);
+
+        int ret = ok ? timelapse_venc_init(width, height, g_timelapse.config.output_fps,
+                                           g_timelapse.config.flip_x, g_timelapse.config.flip_y,
+                                           output_mp4) : -1;
+        if (ret != 0 && ok) {
+            /* Most likely CMA: resident detection models are the one
+             * large consumer we can give back */
+            timelapse_log("Streaming: VENC init failed, retrying without resident models\n");
+            fault_detect_release_models();
+            ret = timelapse_venc_init(width, height, g_timelapse.config.output_fps,
+                                      g_timelapse.config.flip_x, g_timelapse.config.flip_y,
+                                      output_mp4);
+        }
+        if (ret != 0) {
+            timelapse_log("Streaming: VENC unavailable, saving JPEG frames instead\n");
+            g_timelapse.streaming = 0;
+            return 1;
+        }
+        g_timelapse.venc_initialized = 1;
+        g_timelapse.frame_width = width;
+        g_timelapse.frame_height = height;
+        timelapse_log("Streaming: encoding %dx%d @ %dfps during capture\n",
+                      width, height, g_timelapse.config.output_fps);
+    }
+
+    if (timelapse_venc_add_frame(jpeg_buf, jpeg_size) != 0) {
+        timelapse_log("Frame %d: streaming encode failed, dropped\n",
+                      g_timelapse.frame_count);
+        free(jpeg_buf);
+        return -1;
+    }
+
+    /* Keep the newest frame for the thumbnail and last-frame hold */
+    free(g_timelapse.last_jpeg);
+    g_timelapse.last_jpeg = jpeg_buf;
+    g_timelapse.last_jpeg_size = jpeg_size;
+    return 0;
+}
+
 int timelapse_init(const char *gcode_name, const char *output_dir) {
     if (!gcode_name || strlen(gcode_name) == 0) {
         timelapse_log("Init failed: no gcode name\n");
@@ -594,15 +676,16 @@ int timelapse_init(const char *gcode_name, const char *output_dir) {
     if (g_timelapse.use_venc == 0) {
         g_timelapse.use_venc = 1;  /* Enable VENC by default */
     }
+    select_streaming();
 
     timelapse_log("Started: %s (seq %02d), frames -> %s, output -> %s\n",
                   g_timelapse.gcode_name, g_timelapse.sequence_num,
                   g_timelapse.temp_dir, get_output_dir());
-    timelapse_log("Config: fps=%d, crf=%d, variable=%d, flip=%d/%d, use_venc=%d\n",
+    timelapse_log("Config: fps=%d, crf=%d, variable=%d, flip=%d/%d, use_venc=%d, streaming=%d\n",
                   g_timelapse.config.output_fps, g_timelapse.config.crf,
                   g_timelapse.config.variable_fps,
                   g_timelapse.config.flip_x, g_timelapse.config.flip_y,
-                  g_timelapse.use_venc);
+                  g_timelapse.use_venc, g_timelapse.streaming);
 
     return 0;
 }
@@ -666,6 +749,10 @@ int timelapse_init_legacy(const char *gcode_filepath) {
     g_timelapse.frame_count = 0;
     g_timelapse.active = 1;
     g_timelapse.custom_mode = 0;  /* RPC mode, not custom */
+    g_timelapse.venc_initialized = 0;
+    g_timelapse.frame_width = 0;
+    g_timelapse.frame_height = 0;
+    select_streaming();
 
     timelapse_log("Started (RPC): %s (seq %02d), frames -> %s, output -> %s\n",
                   g_timelapse.gcode_name, g_timelapse.sequence_num,
@@ -680,12 +767,16 @@ int timelapse_capture_frame(void) {
     }
 
     /*
-     * DEFERRED ENCODING: Always save JPEGs to disk during print.
-     * Both VENC and FFmpeg paths use the same capture flow.
-     * Encoding happens at finalize time, not during print.
+     * STREAMING ENCODING (default with VENC): each frame is decoded and
+     * encoded right away into a fragmented MP4, one hardware encode per
+     * capture. Nothing is left to do at finalize and a crash leaves a
+     * playable partial video.
      *
-     * This avoids CPU spikes during print (JPEG decode is expensive).
-     * Frame capture is just a memory copy + disk write (~1% CPU).
+     * DEFERRED ENCODING (fallback): save JPEGs to disk during print and
+     * encode them all at finalize time. Frame capture is just a memory
+     * copy into the staging ring, which is written to segment files in
+     * large batches (~1% CPU). Used for ffmpeg, variable FPS, or when
+     * the streaming encoder cannot be opened.
      */
 
     /* Allocate buffer for JPEG data */
@@ -726,7 +817,43 @@ int timelapse_capture_frame(void) {
         return -1;  /* Skip corrupt frame */
     }
 
-    /* Build frame filename */
+    if (g_timelapse.streaming) {
+        int sret = stream_frame(jpeg_buf, jpeg_size);
+        if (sret < 0) {
+            return -1;
+        }
+        if (sret == 0) {
+            g_timelapse.frame_count++;
+            if (g_timelapse.frame_count % 10 == 0 || g_timelapse.frame_count == 1) {
+                timelapse_log("Streamed frame %d (%zu bytes)\n",
+                              g_timelapse.frame_count, jpeg_size);
+            }
+            return 0;
+        }
+        /* sret == 1: streaming unavailable, save the JPEG below */
+    }
+
+    /* Stage in RAM; the writer thread batches frames into segment files */
+    if (!tl_stage_is_open()) {
+        tl_stage_open(g_timelapse.temp_dir);
+    }
+    if (tl_stage_is_open()) {
+        int sret = tl_stage_append(g_timelapse.frame_count, jpeg_buf, jpeg_size);
+        free(jpeg_buf);
+        if (sret != 0) {
+            timelapse_log("Frame %d: staging failed (%zu bytes)\n",
+                          g_timelapse.frame_count, jpeg_size);
+            return -1;
+        }
+        g_timelapse.frame_count++;
+        if (g_timelapse.frame_count % 10 == 0 || g_timelapse.frame_count == 1) {
+            timelapse_log("Captured frame %d (%zu bytes)\n",
+                          g_timelapse.frame_count, jpeg_size);
+        }
+        return 0;
+    }
+
+    /* No staging ring (out of memory): one file per frame */
     char filename[TIMELAPSE_PATH_MAX];
     snprintf(filename, sizeof(filename), "%s/frame_%04d.jpg",
              g_timelapse.temp_dir, g_timelapse.frame_count);
@@ -811,6 +938,180 @@ static void build_video_filter(char *filter, size_t filter_size) {
     (void)has_filter;  /* Suppress unused warning */
 }
 
+/*
+ * Write a memory buffer to a file.
+ * Returns 0 on success, -1 on error.
+ */
+static int write_file(const char *path, const uint8_t *data, size_t size) {
+    FILE *f = fopen(path, "wb");
+    if (!f) {
+        timelapse_log("write_file: cannot open %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    size_t written = fwrite(data, 1, size, f);
+    if (fclose(f) != 0 || written != size) {
+        timelapse_log("write_file: write error on %s\n", path);
+        unlink(path);
+        return -1;
+    }
+    return 0;
+}
+
+/* Remove the .part a failed timelapse_venc_finish() keeps, when the frames
+ * it was encoded from are still available to try again */
+static void discard_partial_mp4(const char *output_mp4) {
+    char partial[TIMELAPSE_PATH_MAX + 8];
+    snprintf(partial, sizeof(partial), "%s" TIMELAPSE_VENC_PART_EXT, output_mp4);
+    unlink(partial);
+}
+
+/* Frame source for timelapse_venc_encode_frames() */
+static const uint8_t *stage_frame_cb(int n, size_t *size, void *arg) {
+    return tl_stage_reader_frame((TLStageReader *)arg, n, size);
+}
+
+/*
+ * Read the frame size from the first stored JPEG's header.
+ * Returns 0 on success, -1 if it cannot be read or parsed.
+ */
+static int first_frame_dimensions(TLStageReader *frames, int *width, int *height) {
+    size_t size;
+    const uint8_t *jpeg = tl_stage_reader_frame(frames, 0, &size);
+    if (!jpeg) {
+        timelapse_log("VENC: cannot read first frame\n");
+        return -1;
+    }
+
+    tjhandle tj = tjInitDecompress();
+    if (!tj) {
+        return -1;
+    }
+
+    int subsamp, colorspace;
+    int ret = tjDecompressHeader3(tj, jpeg, size, width, height, &subsamp, &colorspace);
+    if (ret != 0) {
+        timelapse_log("VENC: failed to parse JPEG header: %s\n", tjGetErrorStr());
+    }
+    tjDestroy(tj);
+    return ret == 0 ? 0 : -1;
+}
+
+/* Write a stored frame (e.g. the last one, as thumbnail) to path */
+static int write_stored_frame(TLStageReader *frames, int n, const char *path) {
+    size_t size;
+    const uint8_t *jpeg = tl_stage_reader_frame(frames, n, &size);
+    return jpeg ? write_file(path, jpeg, size) : -1;
+}
+
+/* Progress state for timelapse_venc_encode_frames() */
+typedef struct {
+    const char *label;          /* Log prefix, e.g. "Recovery: " */
+    struct timespec start;
+    int last_logged;
+} EncodeProgress;
+
+static void encode_progress_init(EncodeProgress *ep, const char *label) {
+    ep->label = label;
+    ep->last_logged = 0;
+    clock_gettime(CLOCK_MONOTONIC, &ep->start);
+}
+
+/* Publish "Encoding N/M frames, ETA m:ss" to encode_detail and log every 50 */
+static void encode_progress_cb(int done, int total, int errors, void *arg) {
+    EncodeProgress *ep = (EncodeProgress *)arg;
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double elapsed = (now.tv_sec - ep->start.tv_sec) +
+                     (now.tv_nsec - ep->start.tv_nsec) / 1e9;
+
+    if (done > 0 && done < total) {
+        int eta = (int)(elapsed * (total - done) / done + 0.5);
+        snprintf(g_timelapse.encode_detail, sizeof(g_timelapse.encode_detail),
+                 "Encoding %d/%d frames, ETA %d:%02d", done, total, eta / 60, eta % 60);
+    } else {
+        snprintf(g_timelapse.encode_detail, sizeof(g_timelapse.encode_detail),
+                 "Encoding %d/%d frames", done, total);
+    }
+
+    if (done - ep->last_logged >= 50 || (done == total && ep->last_logged != total)) {
+        timelapse_log("%sVENC: encoded %d/%d frames (%d errors, %.1fs)\n",
+                      ep->label, done, total, errors, elapsed);
+        ep->last_logged = done;
+    }
+}
+
+/*
+ * Finalize a streaming recording: every frame is already in the MP4,
+ * so this only appends the last-frame hold and renames the file into place.
+ */
+static int finalize_streaming(void) {
+    const char *output_dir = get_output_dir();
+    char output_mp4[TIMELAPSE_PATH_MAX];
+    char output_thumb[TIMELAPSE_PATH_MAX];
+
+    /* Hold the last frame: finish stretches its sample, nothing is re-encoded */
+    int hold = g_timelapse.config.duplicate_last_frame;
+    if (hold > 0) {
+        g_timelapse.frame_count += hold;
+        timelapse_log("Holding last frame for %d frames (total: %d frames)\n",
+                      hold, g_timelapse.frame_count);
+    }
+
+    snprintf(output_mp4, sizeof(output_mp4), "%s/%s_%02d.mp4",
+             output_dir, g_timelapse.gcode_name,
+             g_timelapse.sequence_num);
+    snprintf(output_thumb, sizeof(output_thumb), "%s/%s_%02d_%d.jpg",
+             output_dir, g_timelapse.gcode_name,
+             g_timelapse.sequence_num, g_timelapse.frame_count);
+
+    int ret = timelapse_venc_finish(hold);
+    g_timelapse.venc_initialized = 0;
+
+    if (ret == 0) {
+        timelapse_log("Encoder: VENC streamed %s (%d frames)\n",
+                      output_mp4, g_timelapse.frame_count);
+        tl_index_add(output_mp4);
+
+        if (g_timelapse.last_jpeg &&
+            write_file(output_thumb, g_timelapse.last_jpeg,
+                       g_timelapse.last_jpeg_size) == 0) {
+            timelapse_log("Created thumbnail: %s\n", output_thumb);
+            tl_thumb_create(output_thumb);
+        } else {
+            timelapse_log("Failed to create thumbnail: %s\n", output_thumb);
+        }
+
+        g_timelapse.encode_status = TL_ENCODE_SUCCESS;
+        snprintf(g_timelapse.encode_detail, sizeof(g_timelapse.encode_detail),
+                 "VENC stream OK (%d frames)", g_timelapse.frame_count);
+    } else {
+        /* No JPEGs on disk to fall back to in this mode: the .part is the
+         * recording, so keep the temp dir and its link for orphan recovery */
+        timelapse_log("Streaming finalize failed for %s, kept for recovery in %s\n",
+                      output_mp4, g_timelapse.temp_dir);
+        g_timelapse.encode_status = TL_ENCODE_FAILED;
+        snprintf(g_timelapse.encode_detail, sizeof(g_timelapse.encode_detail),
+                 "Stream finalize failed (%d frames)", g_timelapse.frame_count);
+    }
+
+    if (ret == 0) {
+        cleanup_temp_dir(g_timelapse.temp_dir);
+    }
+
+    /* Reset state but keep config for next recording */
+    g_timelapse.active = 0;
+    g_timelapse.frame_count = 0;
+    g_timelapse.streaming = 0;
+    free(g_timelapse.last_jpeg);
+    g_timelapse.last_jpeg = NULL;
+    g_timelapse.last_jpeg_size = 0;
+    memset(g_timelapse.gcode_name, 0, sizeof(g_timelapse.gcode_name));
+    memset(g_timelapse.temp_dir, 0, sizeof(g_timelapse.temp_dir));
+
+    return ret == 0 ? 0 : -1;
+}
+
 int timelapse_finalize(void) {
     if (!g_timelapse.active) {
         timelapse_log("Finalize: not active\n");
@@ -823,8 +1124,34 @@ int timelapse_finalize(void) {
         return -1;
     }
 
+    if (g_timelapse.streaming && g_timelapse.venc_initialized) {
+        timelapse_log("Finalizing %d streamed frames...\n", g_timelapse.frame_count);
+        return finalize_streaming();
+    }
+
     timelapse_log("Finalizing %d frames...\n", g_timelapse.frame_count);
+
+    /* Push whatever is still in the staging ring out to its segment */
+    tl_stage_close(NULL);
+
+    TLStageReader frames;
+    int stored = tl_stage_reader_open(&frames, g_timelapse.temp_dir);
+    if (stored <= 0) {
+        timelapse_log("Finalize: no readable frames in %s\n", g_timelapse.temp_dir);
+        tl_stage_reader_close(&frames);
+        timelapse_cancel();
+        return -1;
+    }
+    if (stored < g_timelapse.frame_count) {
+        timelapse_log("Finalize: only %d of %d frames readable\n",
+                      stored, g_timelapse.frame_count);
+        g_timelapse.frame_count = stored;
+    }
+
     g_timelapse.encode_status = TL_ENCODE_RUNNING;
+
+    /* VENC needs CMA: drop fault detection's resident models */
+    fault_detect_release_models();
     snprintf(g_timelapse.encode_detail, sizeof(g_timelapse.encode_detail),
              "Encoding %d frames", g_timelapse.frame_count);
 
@@ -857,59 +1184,25 @@ int timelapse_finalize(void) {
         timelapse_log("Encoder: using VENC hardware encoder, %d frames -> %s\n", g_timelapse.frame_count, output_mp4);
 
         /* Read first frame to get dimensions */
-        char first_frame_path[TIMELAPSE_PATH_MAX];
-        snprintf(first_frame_path, sizeof(first_frame_path), "%s/frame_%04d.jpg",
-                 g_timelapse.temp_dir, 0);
-
-        FILE *ff = fopen(first_frame_path, "rb");
-        if (!ff) {
-            timelapse_log("VENC: cannot read first frame, falling back to ffmpeg\n");
-            g_timelapse.use_venc = 0;
-            goto ffmpeg_path;
-        }
-
-        fseek(ff, 0, SEEK_END);
-        size_t first_size = ftell(ff);
-        fseek(ff, 0, SEEK_SET);
-
-        uint8_t *first_jpeg = malloc(first_size);
-        if (!first_jpeg) {
-            fclose(ff);
+        int width, height;
+        if (first_frame_dimensions(&frames, &width, &height) != 0) {
+            timelapse_log("VENC: falling back to ffmpeg\n");
             g_timelapse.use_venc = 0;
             goto ffmpeg_path;
         }
 
-        fread(first_jpeg, 1, first_size, ff);
-        fclose(ff);
-
-        /* Parse header for dimensions */
-        tjhandle tj = tjInitDecompress();
-        if (!tj) {
-            free(first_jpeg);
-            g_timelapse.use_venc = 0;
-            goto ffmpeg_path;
-        }
-
-        int width, height, subsamp, colorspace;
-        if (tjDecompressHeader3(tj, first_jpeg, first_size, &width, &height,
-                                &subsamp, &colorspace) != 0) {
-            timelapse_log("VENC: failed to parse JPEG header: %s\n", tjGetErrorStr());
-            tjDestroy(tj);
-            free(first_jpeg);
-            g_timelapse.use_venc = 0;
-            goto ffmpeg_path;
-        }
-        tjDestroy(tj);
-        free(first_jpeg);
-
         g_timelapse.frame_width = width;
         g_timelapse.frame_height = height;
 
-        /* Calculate output FPS */
-        int output_fps = calculate_output_fps(g_timelapse.frame_count);
+        /* Calculate output FPS (the held frames count towards the length,
+         * as the duplicated files do for ffmpeg) */
+        int hold = g_timelapse.config.duplicate_last_frame;
+        int output_fps = calculate_output_fps(g_timelapse.frame_count + hold);
 
         /* Initialize VENC */
-        if (timelapse_venc_init(width, height, output_fps) != 0) {
+        if (timelapse_venc_init(width, height, output_fps,
+                                g_timelapse.config.flip_x, g_timelapse.config.flip_y,
+                                output_mp4) != 0) {
             timelapse_log("VENC init failed, falling back to ffmpeg\n");
             g_timelapse.use_venc = 0;
             goto ffmpeg_path;
@@ -919,90 +1212,36 @@ int timelapse_finalize(void) {
         timelapse_log("VENC encoding %d frames at %dx%d @ %dfps...\n",
                       g_timelapse.frame_count, width, height, output_fps);
 
-        /* Encode all frames */
-        int venc_errors = 0;
-        uint8_t *jpeg_buf = malloc(FRAME_BUFFER_MAX_JPEG);
-        if (!jpeg_buf) {
-            timelapse_venc_finish(NULL);  /* Cleanup */
-            g_timelapse.venc_initialized = 0;
-            g_timelapse.use_venc = 0;
-            goto ffmpeg_path;
-        }
-
-        for (int i = 0; i < g_timelapse.frame_count; i++) {
-            char frame_path[TIMELAPSE_PATH_MAX];
-            snprintf(frame_path, sizeof(frame_path), "%s/frame_%04d.jpg",
-                     g_timelapse.temp_dir, i);
-
-            FILE *f = fopen(frame_path, "rb");
-            if (!f) {
-                timelapse_log("VENC: cannot read frame %d\n", i);
-                venc_errors++;
-                continue;
-            }
+        /* Encode all frames, decoding the next one while VENC has the current */
+        EncodeProgress progress;
+        encode_progress_init(&progress, "");
+        int venc_errors = timelapse_venc_encode_frames(g_timelapse.frame_count,
+                                                       stage_frame_cb, &frames,
+                                                       encode_progress_cb, &progress);
 
-            fseek(f, 0, SEEK_END);
-            size_t jpeg_size = ftell(f);
-            fseek(f, 0, SEEK_SET);
-
-            if (jpeg_size > FRAME_BUFFER_MAX_JPEG) {
-                timelapse_log("VENC: frame %d too large (%zu bytes)\n", i, jpeg_size);
-                fclose(f);
-                venc_errors++;
-                continue;
-            }
-
-            size_t bytes_read = fread(jpeg_buf, 1, jpeg_size, f);
-            fclose(f);
-
-            if (bytes_read != jpeg_size) {
-                timelapse_log("VENC: frame %d read incomplete (%zu/%zu)\n",
-                              i, bytes_read, jpeg_size);
-                venc_errors++;
-                continue;
-            }
-
-            /* Validate JPEG before encoding */
-            if (!validate_jpeg_full(jpeg_buf, jpeg_size)) {
-                timelapse_log("VENC: frame %d on disk is corrupt (%zu bytes, SOI=%02x%02x, EOI=%02x%02x)\n",
-                              i, jpeg_size, jpeg_buf[0], jpeg_buf[1],
-                              jpeg_buf[jpeg_size-2], jpeg_buf[jpeg_size-1]);
-                venc_errors++;
-                continue;
-            }
-
-            if (timelapse_venc_add_frame(jpeg_buf, jpeg_size) != 0) {
-                venc_errors++;
-            }
-
-            /* Progress logging */
-            if ((i + 1) % 50 == 0 || i == g_timelapse.frame_count - 1) {
-                timelapse_log("VENC: encoded %d/%d frames (%d errors)\n",
-                              i + 1, g_timelapse.frame_count, venc_errors);
-            }
-        }
-
-        free(jpeg_buf);
-
-        /* Finalize MP4 */
-        int ret = timelapse_venc_finish(output_mp4);
+        /* Finalize MP4, holding the last frame */
+        int ret = timelapse_venc_finish(hold);
         g_timelapse.venc_initialized = 0;
 
         if (ret == 0) {
             timelapse_log("Encoder: VENC created %s (%d errors during encode)\n", output_mp4, venc_errors);
+            tl_index_add(output_mp4);
 
-            /* Use last saved JPEG as thumbnail */
-            char last_frame_path[TIMELAPSE_PATH_MAX];
-            snprintf(last_frame_path, sizeof(last_frame_path), "%s/frame_%04d.jpg",
-                     g_timelapse.temp_dir, g_timelapse.frame_count - 1);
+            /* Thumbnail name counts the held frames, as in the other paths */
+            snprintf(output_thumb, sizeof(output_thumb), "%s/%s_%02d_%d.jpg",
+                     output_dir, g_timelapse.gcode_name,
+                     g_timelapse.sequence_num, g_timelapse.frame_count + hold);
 
-            if (copy_file(last_frame_path, output_thumb) == 0) {
+            /* Use last saved JPEG as thumbnail */
+            if (write_stored_frame(&frames, g_timelapse.frame_count - 1, output_thumb) == 0) {
                 timelapse_log("Created thumbnail: %s\n", output_thumb);
+                tl_thumb_create(output_thumb);
             } else {
                 timelapse_log("Failed to create thumbnail: %s\n", output_thumb);
             }
 
             /* Clean up frame JPEGs */
+            tl_stage_reader_close(&frames);
             cleanup_temp_frames();
 
             /* Set success status */
@@ -1019,12 +1258,17 @@ int timelapse_finalize(void) {
         } else {
             timelapse_log("VENC finalize failed, falling back to ffmpeg\n");
             g_timelapse.use_venc = 0;
+            discard_partial_mp4(output_mp4);
             /* Fall through to ffmpeg path - frames are still on disk */
         }
     }
 
 ffmpeg_path:
-    /* FFmpeg path: assemble JPEGs from disk */
+    /* FFmpeg path: assemble JPEGs from disk, so segments become files */
+    if (tl_stage_export(&frames, g_timelapse.temp_dir) < g_timelapse.frame_count) {
+        timelapse_log("Some frames could not be written out for ffmpeg\n");
+    }
+    tl_stage_reader_close(&frames);
 
     /* Duplicate last frame if configured */
     if (g_timelapse.config.duplicate_last_frame > 0) {
@@ -1092,10 +1336,12 @@ ffmpeg_path:
 
     if (ret == 0) {
         timelapse_log("Encoder: ffmpeg created %s\n", output_mp4);
+        tl_index_add(output_mp4);
 
         /* Copy last frame as thumbnail */
         if (copy_file(last_frame, output_thumb) == 0) {
             timelapse_log("Created thumbnail %s\n", output_thumb);
+            tl_thumb_create(output_thumb);
         } else {
             timelapse_log("Failed to create thumbnail %s\n", output_thumb);
         }
@@ -1136,6 +1382,9 @@ void timelapse_cancel(void) {
         g_timelapse.venc_initialized = 0;
     }
 
+    /* Stop the staging writer before its segments are removed */
+    tl_stage_close(NULL);
+
     /* Cleanup temp directory if it exists */
     if (strlen(g_timelapse.temp_dir) > 0) {
         cleanup_temp_dir(g_timelapse.temp_dir);
@@ -1146,6 +1395,10 @@ void timelapse_cancel(void) {
     g_timelapse.frame_count = 0;
     g_timelapse.frame_width = 0;
     g_timelapse.frame_height = 0;
+    g_timelapse.streaming = 0;
+    free(g_timelapse.last_jpeg);
+    g_timelapse.last_jpeg = NULL;
+    g_timelapse.last_jpeg_size = 0;
     memset(g_timelapse.gcode_name, 0, sizeof(g_timelapse.gcode_name));
     memset(g_timelapse.temp_dir, 0, sizeof(g_timelapse.temp_dir));
 }
@@ -1171,25 +1424,23 @@ TimelapseEncodeStatus timelapse_get_encode_status(void) {
     return g_timelapse.encode_status;
 }
 
+int timelapse_streaming_encoder_open(void) {
+    return g_timelapse.active && g_timelapse.streaming && g_timelapse.venc_initialized;
+}
+
 const char *timelapse_get_encode_detail(void) {
     return g_timelapse.encode_detail;
 }
 
 /*
- * Count sequential frame_NNNN.jpg files in a directory.
- * Returns the count (0 if none found).
+ * Count the frames (staging segments or frame_NNNN.jpg files)
+ * in a directory. Returns the count (0 if none found).
  */
 static int count_frames_in_dir(const char *dir_path) {
-    int count = 0;
-    char path[TIMELAPSE_PATH_MAX];
-
-    while (1) {
-        snprintf(path, sizeof(path), "%s/frame_%04d.jpg", dir_path, count);
-        if (access(path, F_OK) != 0) break;
-        count++;
-    }
-
-    return count;
+    TLStageReader frames;
+    int count = tl_stage_reader_open(&frames, dir_path);
+    tl_stage_reader_close(&frames);
+    return count > 0 ? count : 0;
 }
 
 /*
@@ -1197,7 +1448,7 @@ static int count_frames_in_dir(const char *dir_path) {
  * Creates a timestamped subdirectory in TIMELAPSE_USB_RECOVERY_DIR.
  * Returns 0 on success, -1 on failure.
  */
-static int copy_frames_to_usb(const char *orphan_dir, int frame_count) {
+static int copy_frames_to_usb(TLStageReader *frames, int frame_count) {
     /* Check if USB is mounted */
     struct stat st;
     if (stat("/mnt/udisk", &st) != 0 || !S_ISDIR(st.st_mode)) {
@@ -1225,22 +1476,9 @@ static int copy_frames_to_usb(const char *orphan_dir, int frame_count) {
         return -1;
     }
 
-    /* Copy all frame files */
-    int copied = 0;
-    for (int i = 0; i < frame_count; i++) {
-        char src[TIMELAPSE_PATH_MAX], dst[TIMELAPSE_PATH_MAX];
-        snprintf(src, sizeof(src), "%s/frame_%04d.jpg", orphan_dir, i);
-        snprintf(dst, sizeof(dst), "%s/frame_%04d.jpg", dest_dir, i);
-
-        if (copy_file(src, dst) == 0) {
-            copied++;
-        }
-
-        /* Progress logging every 100 frames */
-        if ((i + 1) % 100 == 0 || i == frame_count - 1) {
-            timelapse_log("Recovery: copied %d/%d frames to USB\n", copied, frame_count);
-        }
-    }
+    /* Write every frame out as a plain JPEG file */
+    int copied = tl_stage_export(frames, dest_dir);
+    timelapse_log("Recovery: copied %d/%d frames to USB\n", copied, frame_count);
 
     if (copied > 0) {
         timelapse_log("Recovery: preserved %d frames in %s\n", copied, dest_dir);
@@ -1287,55 +1525,27 @@ static int recover_orphaned_frames(const char *orphan_dir, int frame_count) {
     timelapse_log("Recovery: encoding %d frames -> %s (fps=%d, crf=%d)\n",
                   frame_count, output_mp4, fps, crf);
 
+    TLStageReader frames;
+    if (tl_stage_reader_open(&frames, orphan_dir) < frame_count) {
+        timelapse_log("Recovery: cannot read frames in %s\n", orphan_dir);
+        tl_stage_reader_close(&frames);
+        return -1;
+    }
+
     /* === Try VENC hardware encoder first === */
     timelapse_log("Recovery: trying VENC hardware encoder...\n");
     snprintf(g_timelapse.encode_detail, sizeof(g_timelapse.encode_detail),
              "VENC recovery %d frames", frame_count);
     do {
         /* Read first frame to get dimensions */
-        char first_frame_path[TIMELAPSE_PATH_MAX];
-        snprintf(first_frame_path, sizeof(first_frame_path), "%s/frame_%04d.jpg",
-                 orphan_dir, 0);
-
-        FILE *ff = fopen(first_frame_path, "rb");
-        if (!ff) {
-            timelapse_log("Recovery: VENC: cannot read first frame, skipping VENC\n");
-            break;
-        }
-
-        fseek(ff, 0, SEEK_END);
-        size_t first_size = ftell(ff);
-        fseek(ff, 0, SEEK_SET);
-
-        uint8_t *first_jpeg = malloc(first_size);
-        if (!first_jpeg) {
-            fclose(ff);
-            break;
-        }
-
-        fread(first_jpeg, 1, first_size, ff);
-        fclose(ff);
-
-        /* Parse header for dimensions */
-        tjhandle tj = tjInitDecompress();
-        if (!tj) {
-            free(first_jpeg);
+        int width, height;
+        if (first_frame_dimensions(&frames, &width, &height) != 0) {
+            timelapse_log("Recovery: VENC: skipping VENC\n");
             break;
         }
 
-        int width, height, subsamp, colorspace;
-        if (tjDecompressHeader3(tj, first_jpeg, first_size, &width, &height,
-                                &subsamp, &colorspace) != 0) {
-            timelapse_log("Recovery: VENC: failed to parse JPEG header: %s\n", tjGetErrorStr());
-            tjDestroy(tj);
-            free(first_jpeg);
-            break;
-        }
-        tjDestroy(tj);
-        free(first_jpeg);
-
         /* Initialize VENC */
-        if (timelapse_venc_init(width, height, fps) != 0) {
+        if (timelapse_venc_init(width, height, fps, 0, 0, output_mp4) != 0) {
             timelapse_log("Recovery: VENC init failed (%dx%d), falling back to ffmpeg\n",
                           width, height);
             break;
@@ -1344,64 +1554,27 @@ static int recover_orphaned_frames(const char *orphan_dir, int frame_count) {
         timelapse_log("Recovery: VENC encoding %d frames at %dx%d @ %dfps...\n",
                       frame_count, width, height, fps);
 
-        /* Encode all frames */
-        int venc_errors = 0;
-        uint8_t *jpeg_buf = malloc(FRAME_BUFFER_MAX_JPEG);
-        if (!jpeg_buf) {
-            timelapse_venc_finish(NULL);
-            break;
-        }
-
-        for (int i = 0; i < frame_count; i++) {
-            char frame_path[TIMELAPSE_PATH_MAX];
-            snprintf(frame_path, sizeof(frame_path), "%s/frame_%04d.jpg",
-                     orphan_dir, i);
-
-            FILE *f = fopen(frame_path, "rb");
-            if (!f) { venc_errors++; continue; }
-
-            fseek(f, 0, SEEK_END);
-            size_t jpeg_size = ftell(f);
-            fseek(f, 0, SEEK_SET);
-
-            if (jpeg_size > FRAME_BUFFER_MAX_JPEG) {
-                fclose(f);
-                venc_errors++;
-                continue;
-            }
-
-            size_t bytes_read = fread(jpeg_buf, 1, jpeg_size, f);
-            fclose(f);
-
-            if (bytes_read != jpeg_size) { venc_errors++; continue; }
-
-            if (!validate_jpeg_full(jpeg_buf, jpeg_size)) {
-                venc_errors++;
-                continue;
-            }
-
-            if (timelapse_venc_add_frame(jpeg_buf, jpeg_size) != 0) {
-                venc_errors++;
-            }
-
-            if ((i + 1) % 50 == 0 || i == frame_count - 1) {
-                timelapse_log("Recovery: VENC encoded %d/%d frames (%d errors)\n",
-                              i + 1, frame_count, venc_errors);
-            }
-        }
-
-        free(jpeg_buf);
+        /* Encode all frames, decoding the next one while VENC has the current */
+        EncodeProgress progress;
+        encode_progress_init(&progress, "Recovery: ");
+        int venc_errors = timelapse_venc_encode_frames(frame_count,
+                                                       stage_frame_cb, &frames,
+                                                       encode_progress_cb, &progress);
 
-        ret = timelapse_venc_finish(output_mp4);
+        ret = timelapse_venc_finish(0);
         if (ret == 0) {
             timelapse_log("Recovery: VENC created %s (%d errors)\n", output_mp4, venc_errors);
         } else {
             timelapse_log("Recovery: VENC finalize failed, falling back to ffmpeg\n");
+            discard_partial_mp4(output_mp4);
         }
     } while (0);
 
     /* === FFmpeg fallback === */
     if (ret != 0) {
+        /* ffmpeg reads frame_NNNN.jpg, so unpack any segments first */
+        tl_stage_export(&frames, orphan_dir);
+
         char input_pattern[TIMELAPSE_PATH_MAX];
         snprintf(input_pattern, sizeof(input_pattern), "%s/frame_%%04d.jpg", orphan_dir);
 
@@ -1433,29 +1606,88 @@ static int recover_orphaned_frames(const char *orphan_dir, int frame_count) {
 
     if (ret == 0) {
         timelapse_log("Recovery: created %s\n", output_mp4);
+        tl_index_add(output_mp4);
 
         /* Copy last frame as thumbnail */
-        char last_frame[TIMELAPSE_PATH_MAX];
-        snprintf(last_frame, sizeof(last_frame), "%s/frame_%04d.jpg",
-                 orphan_dir, frame_count - 1);
-        if (copy_file(last_frame, output_thumb) == 0) {
+        if (write_stored_frame(&frames, frame_count - 1, output_thumb) == 0) {
             timelapse_log("Recovery: created thumbnail %s\n", output_thumb);
+            tl_thumb_create(output_thumb);
         }
     } else {
         timelapse_log("Recovery: all encoding methods failed for %d frames\n", frame_count);
 
         /* Preserve frames on USB instead of deleting */
         timelapse_log("Recovery: copying frames to USB for manual recovery...\n");
-        if (copy_frames_to_usb(orphan_dir, frame_count) == 0) {
+        if (copy_frames_to_usb(&frames, frame_count) == 0) {
             timelapse_log("Recovery: frames preserved on USB\n");
         } else {
             timelapse_log("Recovery: WARNING - could not preserve frames, they will be lost!\n");
         }
     }
 
+    tl_stage_reader_close(&frames);
     return ret == 0 ? 0 : -1;
 }
 
+/*
+ * Handle the <output>.mp4.part an orphaned recording was writing, found
+ * through the link file in its temp dir. Fragments are playable as they
+ * are, so with keep set the part is renamed to its intended name (this is
+ * how streaming recordings are recovered). Without keep (JPEG frames are
+ * present and will be re-encoded) the stale part is removed.
+ * Returns 0 if a video was salvaged, 1 if there was nothing to salvage,
+ * -1 on failure.
+ */
+static int recover_partial_mp4(const char *orphan_dir, int keep) {
+    char link[TIMELAPSE_PATH_MAX];
+    char partial[TIMELAPSE_PATH_MAX];
+    snprintf(link, sizeof(link), "%s/%s", orphan_dir, TIMELAPSE_VENC_PART_LINK);
+
+    FILE *f = fopen(link, "r");
+    if (!f) {
+        return 1;
+    }
+    if (!fgets(partial, sizeof(partial), f)) {
+        fclose(f);
+        return 1;
+    }
+    fclose(f);
+    partial[strcspn(partial, "\n")] = '\0';
+
+    size_t len = strlen(partial);
+    size_t ext_len = strlen(TIMELAPSE_VENC_PART_EXT);
+    if (len <= ext_len ||
+        strcmp(partial + len - ext_len, TIMELAPSE_VENC_PART_EXT) != 0 ||
+        sanitize_path(partial) != 0) {
+        timelapse_log("Recovery: ignoring bad part link in %s\n", orphan_dir);
+        return 1;
+    }
+
+    struct stat st;
+    if (stat(partial, &st) != 0) {
+        return 1;  /* Already renamed into place or removed */
+    }
+
+    /* ftyp+moov alone is well under 4 KB; anything smaller has no frames */
+    if (!keep || st.st_size < 4096) {
+        unlink(partial);
+        return 1;
+    }
+
+    char output_mp4[TIMELAPSE_PATH_MAX];
+    snprintf(output_mp4, sizeof(output_mp4), "%.*s", (int)(len - ext_len), partial);
+
+    if (rename(partial, output_mp4) != 0) {
+        timelapse_log("Recovery: cannot rename %s: %s\n", partial, strerror(errno));
+        return -1;
+    }
+
+    timelapse_log("Recovery: salvaged streamed video %s (%lld bytes)\n",
+                  output_mp4, (long long)st.st_size);
+    tl_index_add(output_mp4);
+    return 0;
+}
+
 /*
  * Background thread for orphaned timelapse recovery.
  * Runs at low priority to avoid impacting normal operation.
@@ -1501,6 +1733,7 @@ static void *recovery_thread_func(void *arg) {
     pid_t my_pid = getpid();
     struct dirent *entry;
     int recovered = 0;
+    int salvaged = 0;
     int failed = 0;
 
     while ((entry = readdir(dir)) != NULL) {
@@ -1530,7 +1763,15 @@ static void *recovery_thread_func(void *arg) {
         int frame_count = count_frames_in_dir(orphan_dir);
 
         if (frame_count == 0) {
-            timelapse_log("Recovery: removing empty orphaned dir %s\n", orphan_dir);
+            /* Streaming recordings leave a partial MP4 instead of frames */
+            int sret = recover_partial_mp4(orphan_dir, 1);
+            if (sret == 0) {
+                salvaged++;
+            } else if (sret < 0) {
+                failed++;
+            } else {
+                timelapse_log("Recovery: removing empty orphaned dir %s\n", orphan_dir);
+            }
             cleanup_temp_dir(orphan_dir);
             continue;
         }
@@ -1538,6 +1779,9 @@ static void *recovery_thread_func(void *arg) {
         timelapse_log("Recovery: found %d orphaned frames in %s\n",
                       frame_count, orphan_dir);
 
+        /* A crash during finalize leaves an incomplete part; frames win */
+        recover_partial_mp4(orphan_dir, 0);
+
         /* Update status to running */
         g_timelapse.encode_status = TL_ENCODE_RUNNING;
 
@@ -1556,9 +1800,9 @@ static void *recovery_thread_func(void *arg) {
 
     closedir(dir);
 
-    if (recovered > 0 || failed > 0) {
-        timelapse_log("Recovery: processed %d dir(s): %d recovered, %d failed\n",
-                      recovered + failed, recovered, failed);
+    if (recovered > 0 || salvaged > 0 || failed > 0) {
+        timelapse_log("Recovery: processed %d dir(s): %d recovered, %d salvaged, %d failed\n",
+                      recovered + salvaged + failed, recovered, salvaged, failed);
     }
 
     /* Request RKMPI reinit to force release lazy-deallocated CMA buffers.
@@ -1576,11 +1820,11 @@ static void *recovery_thread_func(void *arg) {
     if (failed > 0) {
         g_timelapse.encode_status = TL_ENCODE_FAILED;
         snprintf(g_timelapse.encode_detail, sizeof(g_timelapse.encode_detail),
-                 "Recovery failed (%d/%d)", failed, recovered + failed);
-    } else if (recovered > 0) {
+                 "Recovery failed (%d/%d)", failed, recovered + salvaged + failed);
+    } else if (recovered > 0 || salvaged > 0) {
         g_timelapse.encode_status = TL_ENCODE_SUCCESS;
         snprintf(g_timelapse.encode_detail, sizeof(g_timelapse.encode_detail),
-                 "Recovery OK (%d)", recovered);
+                 "Recovery OK (%d)", recovered + salvaged);
     } else {
         g_timelapse.encode_status = TL_ENCODE_IDLE;
         g_timelapse.encode_detail[0] = '\0';
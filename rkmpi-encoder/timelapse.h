@@ -40,6 +40,7 @@ typedef struct {
     int duplicate_last_frame;       /* Number of times to repeat final frame */
     int flip_x;                     /* Horizontal flip (mirror) */
     int flip_y;                     /* Vertical flip */
+    int streaming;                  /* Encode each frame at capture time (VENC only) */
     char output_dir[TIMELAPSE_PATH_MAX];  /* Custom output directory */
     char temp_dir_base[TIMELAPSE_PATH_MAX]; /* Base directory for temp frames */
 } TimelapseConfig;
@@ -69,6 +70,11 @@ typedef struct {
     int frame_width;                        /* Frame width (from first frame) */
     int frame_height;                       /* Frame height (from first frame) */
 
+    /* Streaming encode: frames go straight into a fragmented MP4 */
+    int streaming;                          /* 1 if this recording encodes at capture */
+    uint8_t *last_jpeg;                     /* Latest frame, kept for thumbnail/hold */
+    size_t last_jpeg_size;
+
     /* Encoding status (for API/UI reporting) */
     TimelapseEncodeStatus encode_status;    /* Current encoding status */
     char encode_detail[256];                /* Status detail (e.g. "VENC 381 frames") */
@@ -98,6 +104,17 @@ void timelapse_set_temp_dir(const char *dir);
  */
 void timelapse_set_use_venc(int enabled);
 
+/*
+ * Enable or disable streaming encode.
+ * When enabled, each captured frame is encoded straight into a fragmented
+ * MP4 instead of being saved as a JPEG and encoded at finalize time.
+ * Only applies with VENC and a fixed output FPS (variable FPS needs the
+ * final frame count). Must be called before timelapse_init().
+ *
+ * @param enabled 1 to encode during the print, 0 to save JPEGs
+ */
+void timelapse_set_streaming(int enabled);
+
 /*
  * Reset configuration to defaults.
  */
@@ -183,6 +200,12 @@ int timelapse_get_frame_count(void);
  */
 TimelapseEncodeStatus timelapse_get_encode_status(void);
 
+/*
+ * Check whether a streaming recording has its encoder open. It holds the
+ * VENC channel and its DMA blocks until the print ends.
+ */
+int timelapse_streaming_encoder_open(void);
+
 /*
  * Get encoding status detail string (for API/UI).
  */
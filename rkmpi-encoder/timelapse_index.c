@@ -0,0 +1,1114 @@
+/*
+ * Timelapse Recording Index
+ *
+ * Replaces the per-file ffprobe popen in the recordings list with a direct
+ * read of the MP4 movie header plus a small on-disk cache, so the listing
+ * cost no longer scales with the number of recordings.
+ */
+
+#pragma GCC diagnostic ignored "-Wformat-truncation"
+
+#include "timelapse_index.h"
+#include "timelapse.h"
+#include "timelapse_venc.h"
+#include "turbojpeg.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+extern char **environ;
+
+/* ============================================================================
+ * MP4 box parser
+ * ============================================================================ */
+
+#define MP4_BOX(a, b, c, d) \
+    (((uint32_t)(a) << 24) | ((uint32_t)(b) << 16) | ((uint32_t)(c) << 8) | (uint32_t)(d))
+
+static uint32_t rd_be32(const uint8_t *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+           ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+static uint64_t rd_be64(const uint8_t *p) {
+    return ((uint64_t)rd_be32(p) << 32) | rd_be32(p + 4);
+}
+
+/* Read the header of the box at *pos within [pos, end).
+ * On success returns 0, sets *type and *payload / *payload_end to the box
+ * body and advances *pos past the box. */
+static int mp4_next_box(FILE *f, uint64_t *pos, uint64_t end, uint32_t *type,
+                        uint64_t *payload, uint64_t *payload_end) {
+    uint8_t hdr[16];
+
+    if (*pos + 8 > end) return -1;
+    if (fseeko(f, (off_t)*pos, SEEK_SET) != 0) return -1;
+    if (fread(hdr, 1, 8, f) != 8) return -1;
+
+    uint64_t box_size = rd_be32(hdr);
+    uint64_t hdr_len = 8;
+
+    if (box_size == 1) {
+        /* 64-bit largesize follows the type */
+        if (fread(hdr + 8, 1, 8, f) != 8) return -1;
+        box_size = rd_be64(hdr + 8);
+        hdr_len = 16;
+    } else if (box_size == 0) {
+        /* Box extends to end of enclosing container */
+        box_size = end - *pos;
+    }
+    if (box_size < hdr_len || *pos + box_size > end) return -1;
+
+    *type = rd_be32(hdr + 4);
+    *payload = *pos + hdr_len;
+    *payload_end = *pos + box_size;
+    *pos += box_size;
+    return 0;
+}
+
+/* Find a child box of the given type within [start, end).
+ * On success returns 0 and sets *payload / *payload_end to the box body. */
+static int mp4_find_box(FILE *f, uint64_t start, uint64_t end, uint32_t type,
+                        uint64_t *payload, uint64_t *payload_end) {
+    uint64_t pos = start;
+    uint32_t box_type;
+
+    while (mp4_next_box(f, &pos, end, &box_type, payload, payload_end) == 0) {
+        if (box_type == type) return 0;
+    }
+    return -1;
+}
+
+/* Parse a mvhd/mdhd full box: version-dependent timescale + duration
+ * (duration 0 if the header does not know it) */
+static int mp4_read_header(FILE *f, uint64_t payload, uint64_t payload_end,
+                           uint32_t *timescale, uint64_t *duration) {
+    uint8_t buf[32];
+    if (payload_end - payload < 24) return -1;
+    size_t want = (payload_end - payload >= 32) ? 32 : 24;
+    if (fseeko(f, (off_t)payload, SEEK_SET) != 0) return -1;
+    if (fread(buf, 1, want, f) != want) return -1;
+
+    if (buf[0] == 1) {
+        /* v1: flags(4) ctime(8) mtime(8) timescale(4) duration(8) */
+        if (want < 32) return -1;
+        *timescale = rd_be32(buf + 20);
+        *duration = rd_be64(buf + 24);
+    } else {
+        /* v0: flags(4) ctime(4) mtime(4) timescale(4) duration(4) */
+        *timescale = rd_be32(buf + 12);
+        *duration = rd_be32(buf + 16);
+        if (*duration == 0xFFFFFFFFu) *duration = 0;  /* unknown */
+    }
+    return *timescale ? 0 : -1;
+}
+
+static int mp4_read_header_duration(FILE *f, uint64_t payload, uint64_t payload_end,
+                                    double *duration_s) {
+    uint32_t timescale;
+    uint64_t duration;
+    if (mp4_read_header(f, payload, payload_end, &timescale, &duration) != 0 ||
+        duration == 0)
+        return -1;
+    *duration_s = (double)duration / (double)timescale;
+    return 0;
+}
+
+/* Sum of the sample durations in one traf (tfhd default + trun entries) */
+static int mp4_traf_duration(FILE *f, uint64_t traf, uint64_t traf_end, uint64_t *total) {
+    uint8_t buf[16];
+    uint32_t default_duration = 0;
+    uint64_t pos = traf, box, box_end;
+    uint32_t type;
+
+    if (mp4_find_box(f, traf, traf_end, MP4_BOX('t','f','h','d'), &box, &box_end) == 0) {
+        /* flags(4) track_ID(4) [base_data_offset(8)] [sample_description_index(4)]
+         * [default_sample_duration(4)] */
+        if (box_end - box < 8) return -1;
+        if (fseeko(f, (off_t)box, SEEK_SET) != 0 || fread(buf, 1, 4, f) != 4) return -1;
+        uint32_t flags = rd_be32(buf) & 0xFFFFFF;
+        if (flags & 0x08) {
+            uint64_t off = 8 + ((flags & 0x01) ? 8 : 0) + ((flags & 0x02) ? 4 : 0);
+            if (box_end - box < off + 4) return -1;
+            if (fseeko(f, (off_t)(box + off), SEEK_SET) != 0 || fread(buf, 1, 4, f) != 4)
+                return -1;
+            default_duration = rd_be32(buf);
+        }
+    }
+
+    while (mp4_next_box(f, &pos, traf_end, &type, &box, &box_end) == 0) {
+        if (type != MP4_BOX('t','r','u','n')) continue;
+
+        /* flags(4) sample_count(4) [data_offset(4)] [first_sample_flags(4)]
+         * then per sample: [duration] [size] [flags] [composition offset] */
+        if (box_end - box < 8) return -1;
+        if (fseeko(f, (off_t)box, SEEK_SET) != 0 || fread(buf, 1, 8, f) != 8) return -1;
+        uint32_t flags = rd_be32(buf) & 0xFFFFFF;
+        uint32_t count = rd_be32(buf + 4);
+
+        if (!(flags & 0x100)) {
+            *total += (uint64_t)count * default_duration;
+            continue;
+        }
+
+        uint64_t entry = 4 * (1 + !!(flags & 0x200) + !!(flags & 0x400) + !!(flags & 0x800));
+        uint64_t first = box + 8 + ((flags & 0x01) ? 4 : 0) + ((flags & 0x04) ? 4 : 0);
+        if (first + (uint64_t)count * entry > box_end) return -1;
+        for (uint32_t i = 0; i < count; i++) {
+            if (fseeko(f, (off_t)(first + i * entry), SEEK_SET) != 0 ||
+                fread(buf, 1, 4, f) != 4)
+                return -1;
+            *total += rd_be32(buf);
+        }
+    }
+    return 0;
+}
+
+/* Fragmented MP4 (moov written before any sample, durations left at 0):
+ * add up the sample durations of every movie fragment. Single-track files
+ * only, which is what the recorders here write. */
+static int mp4_fragments_duration(FILE *f, uint64_t file_end, uint32_t timescale,
+                                  double *duration_s) {
+    uint64_t pos = 0, moof, moof_end, traf, traf_end;
+    uint64_t total = 0;
+    uint32_t type;
+    int fragments = 0;
+
+    while (mp4_next_box(f, &pos, file_end, &type, &moof, &moof_end) == 0) {
+        if (type != MP4_BOX('m','o','o','f')) continue;
+        uint64_t child = moof;
+        while (mp4_next_box(f, &child, moof_end, &type, &traf, &traf_end) == 0) {
+            if (type == MP4_BOX('t','r','a','f') &&
+                mp4_traf_duration(f, traf, traf_end, &total) != 0)
+                return -1;
+        }
+        fragments++;
+    }
+    /* A truncated last fragment (recovered .part) still counts what was read */
+
+    if (fragments == 0 || total == 0) return -1;
+    *duration_s = (double)total / (double)timescale;
+    return 0;
+}
+
+int mp4_probe_duration(const char *path, double *duration_s) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return -1;
+
+    int ret = -1;
+    uint64_t file_end;
+    uint64_t moov, moov_end, box, box_end;
+
+    if (fseeko(f, 0, SEEK_END) != 0) goto out;
+    file_end = (uint64_t)ftello(f);
+
+    /* moov may sit at either end of the file (minimp4 writes it last) */
+    if (mp4_find_box(f, 0, file_end, MP4_BOX('m','o','o','v'), &moov, &moov_end) != 0)
+        goto out;
+
+    if (mp4_find_box(f, moov, moov_end, MP4_BOX('m','v','h','d'), &box, &box_end) == 0 &&
+        mp4_read_header_duration(f, box, box_end, duration_s) == 0) {
+        ret = 0;
+        goto out;
+    }
+
+    /* Movie header without a duration: fall back to the first track's mdhd */
+    uint64_t trak, trak_end, mdia, mdia_end;
+    if (mp4_find_box(f, moov, moov_end, MP4_BOX('t','r','a','k'), &trak, &trak_end) != 0 ||
+        mp4_find_box(f, trak, trak_end, MP4_BOX('m','d','i','a'), &mdia, &mdia_end) != 0 ||
+        mp4_find_box(f, mdia, mdia_end, MP4_BOX('m','d','h','d'), &box, &box_end) != 0)
+        goto out;
+
+    uint32_t timescale;
+    uint64_t duration;
+    if (mp4_read_header(f, box, box_end, &timescale, &duration) != 0)
+        goto out;
+    if (duration > 0) {
+        *duration_s = (double)duration / (double)timescale;
+        ret = 0;
+        goto out;
+    }
+
+    /* Fragmented recording: the samples are in moof boxes after the moov */
+    ret = mp4_fragments_duration(f, file_end, timescale, duration_s);
+
+out:
+    fclose(f);
+    return ret;
+}
+
+/* ============================================================================
+ * First IDR extraction
+ * ============================================================================ */
+
+#define MP4_IDR_MAX_SIZE    (4 * 1024 * 1024)
+
+/* Read [off, off + len) into buf */
+static int mp4_read_at(FILE *f, uint64_t off, void *buf, size_t len) {
+    return fseeko(f, (off_t)off, SEEK_SET) == 0 && fread(buf, 1, len, f) == len ? 0 : -1;
+}
+
+/* Find the video track's stbl, and the avc1/avc3 sample entry within it */
+static int mp4_find_video_stbl(FILE *f, uint64_t moov, uint64_t moov_end,
+                               uint64_t *stbl, uint64_t *stbl_end,
+                               uint64_t *entry, uint64_t *entry_end) {
+    uint64_t pos = moov, trak, trak_end, mdia, mdia_end, box, box_end, minf, minf_end;
+    uint32_t type;
+    uint8_t buf[16];
+
+    while (mp4_next_box(f, &pos, moov_end, &type, &trak, &trak_end) == 0) {
+        if (type != MP4_BOX('t','r','a','k')) continue;
+        if (mp4_find_box(f, trak, trak_end, MP4_BOX('m','d','i','a'), &mdia, &mdia_end) != 0 ||
+            mp4_find_box(f, mdia, mdia_end, MP4_BOX('h','d','l','r'), &box, &box_end) != 0 ||
+            box_end - box < 12 || mp4_read_at(f, box, buf, 12) != 0 ||
+            rd_be32(buf + 8) != MP4_BOX('v','i','d','e'))
+            continue;
+        if (mp4_find_box(f, mdia, mdia_end, MP4_BOX('m','i','n','f'), &minf, &minf_end) != 0 ||
+            mp4_find_box(f, minf, minf_end, MP4_BOX('s','t','b','l'), stbl, stbl_end) != 0 ||
+            mp4_find_box(f, *stbl, *stbl_end, MP4_BOX('s','t','s','d'), &box, &box_end) != 0)
+            return -1;
+
+        /* flags(4) entry_count(4), then the first sample entry */
+        uint64_t epos = box + 8;
+        if (mp4_next_box(f, &epos, box_end, &type, entry, entry_end) != 0 ||
+            (type != MP4_BOX('a','v','c','1') && type != MP4_BOX('a','v','c','3')))
+            return -1;
+        return 0;
+    }
+    return -1;
+}
+
+/* First sample of a regular file: stsz size, first chunk offset */
+static int mp4_first_sample(FILE *f, uint64_t stbl, uint64_t stbl_end,
+                            uint64_t *offset, uint32_t *size) {
+    uint64_t box, box_end;
+    uint8_t buf[16];
+
+    /* flags(4) sample_size(4) sample_count(4) [entry_size(4) ...] */
+    if (mp4_find_box(f, stbl, stbl_end, MP4_BOX('s','t','s','z'), &box, &box_end) != 0 ||
+        box_end - box < 12 || mp4_read_at(f, box, buf, 12) != 0)
+        return -1;
+    if (rd_be32(buf + 8) == 0) return -1;           /* no samples: fragmented */
+    *size = rd_be32(buf + 4);
+    if (*size == 0) {
+        if (box_end - box < 16 || mp4_read_at(f, box + 12, buf, 4) != 0) return -1;
+        *size = rd_be32(buf);
+    }
+
+    /* flags(4) entry_count(4) chunk_offset(4 or 8) ... */
+    if (mp4_find_box(f, stbl, stbl_end, MP4_BOX('s','t','c','o'), &box, &box_end) == 0) {
+        if (box_end - box < 12 || mp4_read_at(f, box, buf, 12) != 0) return -1;
+        *offset = rd_be32(buf + 8);
+    } else if (mp4_find_box(f, stbl, stbl_end, MP4_BOX('c','o','6','4'), &box, &box_end) == 0) {
+        if (box_end - box < 16 || mp4_read_at(f, box, buf, 16) != 0) return -1;
+        *offset = rd_be64(buf + 8);
+    } else {
+        return -1;
+    }
+    return rd_be32(buf + 4) > 0 ? 0 : -1;
+}
+
+/* First sample of a fragmented file: the first trun of the first moof */
+static int mp4_first_fragment_sample(FILE *f, uint64_t file_end,
+                                     uint64_t *offset, uint32_t *size) {
+    uint64_t pos = 0, moof, moof_end, traf, traf_end, box, box_end;
+    uint32_t type;
+    uint8_t buf[16];
+
+    for (;;) {
+        uint64_t moof_start = pos;
+        if (mp4_next_box(f, &pos, file_end, &type, &moof, &moof_end) != 0) return -1;
+        if (type != MP4_BOX('m','o','o','f')) continue;
+        if (mp4_find_box(f, moof, moof_end, MP4_BOX('t','r','a','f'), &traf, &traf_end) != 0 ||
+            mp4_find_box(f, traf, traf_end, MP4_BOX('t','f','h','d'), &box, &box_end) != 0)
+            return -1;
+
+        /* flags(4) track_ID(4) [base_data_offset(8)] [sample_description_index(4)]
+         * [default_sample_duration(4)] [default_sample_size(4)] */
+        uint64_t base = moof_start;
+        uint32_t default_size = 0;
+        if (box_end - box < 8 || mp4_read_at(f, box, buf, 4) != 0) return -1;
+        uint32_t flags = rd_be32(buf) & 0xFFFFFF;
+        uint64_t off = 8;
+        if (flags & 0x01) {
+            if (box_end - box < off + 8 || mp4_read_at(f, box + off, buf, 8) != 0) return -1;
+            base = rd_be64(buf);
+            off += 8;
+        }
+        if (flags & 0x02) off += 4;
+        if (flags & 0x08) off += 4;
+        if (flags & 0x10) {
+            if (box_end - box < off + 4 || mp4_read_at(f, box + off, buf, 4) != 0) return -1;
+            default_size = rd_be32(buf);
+        }
+
+        /* flags(4) sample_count(4) data_offset(4) [first_sample_flags(4)]
+         * then [duration] [size] ... of the first sample */
+        if (mp4_find_box(f, traf, traf_end, MP4_BOX('t','r','u','n'), &box, &box_end) != 0 ||
+            box_end - box < 12 || mp4_read_at(f, box, buf, 12) != 0)
+            return -1;
+        flags = rd_be32(buf) & 0xFFFFFF;
+        if (rd_be32(buf + 4) == 0 || !(flags & 0x01)) return -1;
+        *offset = base + (uint64_t)(int64_t)(int32_t)rd_be32(buf + 8);
+        *size = default_size;
+        if (flags & 0x200) {
+            off = 12 + ((flags & 0x04) ? 4 : 0) + ((flags & 0x100) ? 4 : 0);
+            if (box_end - box < off + 4 || mp4_read_at(f, box + off, buf, 4) != 0) return -1;
+            *size = rd_be32(buf);
+        }
+        return 0;
+    }
+}
+
+/* Append a start code and one NAL unit to the Annex B buffer */
+static void annexb_put(uint8_t *dst, size_t *len, const uint8_t *nal, size_t nal_len) {
+    static const uint8_t start_code[4] = { 0, 0, 0, 1 };
+    memcpy(dst + *len, start_code, sizeof(start_code));
+    memcpy(dst + *len + sizeof(start_code), nal, nal_len);
+    *len += sizeof(start_code) + nal_len;
+}
+
+/* Extract the first sample of an H.264 MP4 (regular or fragmented) as an
+ * Annex B access unit with the avcC SPS/PPS in front, found through the
+ * sample tables without reading the rest of the file. Returns a malloc'd
+ * buffer and the coded size, or NULL if the sample is not an IDR. */
+static uint8_t *mp4_first_idr(const char *path, size_t *au_len, int *width, int *height) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return NULL;
+
+    uint8_t *cfg = NULL, *sample = NULL, *au = NULL;
+    uint64_t file_end, moov, moov_end, stbl, stbl_end, entry, entry_end, box, box_end;
+    uint64_t offset = 0;
+    uint32_t size = 0;
+    uint8_t hdr[32];
+
+    if (fseeko(f, 0, SEEK_END) != 0) goto out;
+    file_end = (uint64_t)ftello(f);
+    if (mp4_find_box(f, 0, file_end, MP4_BOX('m','o','o','v'), &moov, &moov_end) != 0 ||
+        mp4_find_video_stbl(f, moov, moov_end, &stbl, &stbl_end, &entry, &entry_end) != 0)
+        goto out;
+
+    /* Visual sample entry: reserved(6) dref(2) pre_defined/reserved(16)
+     * width(2) height(2) ... 78 bytes before the child boxes */
+    if (entry_end - entry < 78 || mp4_read_at(f, entry, hdr, 28) != 0) goto out;
+    *width = (hdr[24] << 8) | hdr[25];
+    *height = (hdr[26] << 8) | hdr[27];
+
+    if (mp4_find_box(f, entry + 78, entry_end, MP4_BOX('a','v','c','C'), &box, &box_end) != 0 ||
+        box_end - box < 7 || box_end - box > 4096)
+        goto out;
+    size_t cfg_len = box_end - box;
+    cfg = malloc(cfg_len);
+    if (!cfg || mp4_read_at(f, box, cfg, cfg_len) != 0) goto out;
+
+    if (mp4_first_sample(f, stbl, stbl_end, &offset, &size) != 0 &&
+        mp4_first_fragment_sample(f, file_end, &offset, &size) != 0)
+        goto out;
+    if (size == 0 || size > MP4_IDR_MAX_SIZE || offset + size > file_end) goto out;
+    sample = malloc(size);
+    if (!sample || mp4_read_at(f, offset, sample, size) != 0) goto out;
+
+    /* Length prefixes become 4-byte start codes: a NAL of n >= 1 bytes grows
+     * from n + prefix to n + 4, and each parameter set at most doubles */
+    int nal_len_size = (cfg[4] & 3) + 1;
+    au = malloc((size_t)size * 5 / (nal_len_size + 1) + 2 * cfg_len);
+    if (!au) goto out;
+    size_t len = 0;
+
+    /* avcC: version profile compat level lengthSize numSPS {len sps} numPPS {len pps} */
+    size_t p = 5;
+    for (int set = 0; set < 2; set++) {
+        if (p >= cfg_len) goto fail;
+        int count = set == 0 ? (cfg[p] & 0x1F) : cfg[p];
+        p++;
+        for (int i = 0; i < count; i++) {
+            if (p + 2 > cfg_len) goto fail;
+            size_t n = ((size_t)cfg[p] << 8) | cfg[p + 1];
+            if (p + 2 + n > cfg_len) goto fail;
+            annexb_put(au, &len, cfg + p + 2, n);
+            p += 2 + n;
+        }
+    }
+
+    int idr = 0;
+    for (size_t q = 0; q + nal_len_size <= size; ) {
+        size_t n = 0;
+        for (int i = 0; i < nal_len_size; i++)
+            n = (n << 8) | sample[q + i];
+        q += nal_len_size;
+        if (n == 0 || n > size - q) goto fail;
+        if ((sample[q] & 0x1F) == 5) idr = 1;
+        annexb_put(au, &len, sample + q, n);
+        q += n;
+    }
+    if (!idr) goto fail;
+    *au_len = len;
+    goto out;
+
+fail:
+    free(au);
+    au = NULL;
+out:
+    free(cfg);
+    free(sample);
+    fclose(f);
+    return au;
+}
+
+/* ============================================================================
+ * Per-directory index cache
+ * ============================================================================ */
+
+typedef struct {
+    char name[128];
+    uint64_t size;
+    time_t mtime;
+    double duration;        /* < 0 = probe failed (still cached to avoid retries) */
+    int seen;               /* touched since last commit */
+} TlIndexEntry;
+
+typedef struct {
+    char dir[256];
+    int loaded;
+    int dirty;
+    int count;
+    TlIndexEntry entries[TL_INDEX_MAX_ENTRIES];
+} TlIndexDir;
+
+static TlIndexDir g_index[TL_INDEX_MAX_DIRS];
+static int g_index_next;    /* round-robin slot for replacing directories */
+static pthread_mutex_t g_index_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void index_load(TlIndexDir *d) {
+    char path[384];
+    snprintf(path, sizeof(path), "%s/%s", d->dir, TL_INDEX_FILENAME);
+
+    d->count = 0;
+    d->loaded = 1;
+    d->dirty = 0;
+
+    FILE *f = fopen(path, "r");
+    if (!f) return;
+
+    char line[256];
+    while (fgets(line, sizeof(line), f) && d->count < TL_INDEX_MAX_ENTRIES) {
+        char *tab = strchr(line, '\t');
+        if (!tab || tab == line) continue;
+        *tab = '\0';
+
+        unsigned long long size;
+        long long mtime;
+        double duration;
+        if (sscanf(tab + 1, "%llu\t%lld\t%lf", &size, &mtime, &duration) != 3)
+            continue;
+
+        TlIndexEntry *e = &d->entries[d->count++];
+        snprintf(e->name, sizeof(e->name), "%s", line);
+        e->size = size;
+        e->mtime = (time_t)mtime;
+        e->duration = duration;
+        e->seen = 0;
+    }
+    fclose(f);
+}
+
+static void index_save(TlIndexDir *d) {
+    char path[384], tmp_path[400];
+    snprintf(path, sizeof(path), "%s/%s", d->dir, TL_INDEX_FILENAME);
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+
+    FILE *f = fopen(tmp_path, "w");
+    if (!f) return;  /* read-only media: keep in-memory cache only */
+
+    for (int i = 0; i < d->count; i++) {
+        const TlIndexEntry *e = &d->entries[i];
+        fprintf(f, "%s\t%llu\t%lld\t%.3f\n", e->name,
+                (unsigned long long)e->size, (long long)e->mtime, e->duration);
+    }
+
+    if (fclose(f) == 0 && rename(tmp_path, path) == 0)
+        d->dirty = 0;
+    else
+        unlink(tmp_path);
+}
+
+/* Names and directories too long for the fixed fields are not cached at
+ * all (probed directly instead): a truncated key could match another
+ * recording. Logged once per process. */
+static int index_key_fits(const char *s, size_t field_size) {
+    static int logged;
+    if (strlen(s) < field_size) return 1;
+    if (!logged) {
+        fprintf(stderr, "Timelapse index: not caching, longer than %zu bytes: %s\n",
+                field_size - 1, s);
+        logged = 1;
+    }
+    return 0;
+}
+
+/* Get (loading if needed) the cache slot for dir_path, NULL if the path is
+ * too long to key a slot. Caller holds mutex. */
+static TlIndexDir *index_get_dir(const char *dir_path) {
+    if (!index_key_fits(dir_path, sizeof(g_index[0].dir)))
+        return NULL;
+    for (int i = 0; i < TL_INDEX_MAX_DIRS; i++) {
+        if (g_index[i].loaded && strcmp(g_index[i].dir, dir_path) == 0)
+            return &g_index[i];
+    }
+
+    /* Not cached: take an empty slot, else recycle round-robin */
+    TlIndexDir *d = NULL;
+    for (int i = 0; i < TL_INDEX_MAX_DIRS; i++) {
+        if (!g_index[i].loaded) { d = &g_index[i]; break; }
+    }
+    if (!d) {
+        d = &g_index[g_index_next];
+        g_index_next = (g_index_next + 1) % TL_INDEX_MAX_DIRS;
+        if (d->dirty) index_save(d);
+    }
+
+    snprintf(d->dir, sizeof(d->dir), "%s", dir_path);
+    index_load(d);
+    return d;
+}
+
+static TlIndexEntry *index_find(TlIndexDir *d, const char *name) {
+    for (int i = 0; i < d->count; i++) {
+        if (strcmp(d->entries[i].name, name) == 0)
+            return &d->entries[i];
+    }
+    return NULL;
+}
+
+static TlIndexEntry *index_update(TlIndexDir *d, const char *name,
+                                  uint64_t size, time_t mtime) {
+    TlIndexEntry *e = index_find(d, name);
+    if (e && e->size == size && e->mtime == mtime)
+        return e;
+
+    if (!e) {
+        if (d->count >= TL_INDEX_MAX_ENTRIES || !index_key_fits(name, sizeof(e->name)))
+            return NULL;
+        e = &d->entries[d->count++];
+        snprintf(e->name, sizeof(e->name), "%s", name);
+    }
+
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", d->dir, name);
+    e->size = size;
+    e->mtime = mtime;
+    if (mp4_probe_duration(path, &e->duration) != 0)
+        e->duration = -1.0;
+    d->dirty = 1;
+    return e;
+}
+
+int tl_index_lookup(const char *dir_path, const char *name,
+                    uint64_t size, time_t mtime, double *duration_s) {
+    int ret = -1;
+    pthread_mutex_lock(&g_index_mutex);
+
+    TlIndexDir *d = index_get_dir(dir_path);
+    TlIndexEntry *e = d ? index_update(d, name, size, mtime) : NULL;
+    if (e) {
+        e->seen = 1;
+        if (e->duration >= 0.0) {
+            *duration_s = e->duration;
+            ret = 0;
+        }
+    } else {
+        /* Index full or name too long: probe directly, uncached */
+        char path[TIMELAPSE_PATH_MAX];
+        int n = snprintf(path, sizeof(path), "%s/%s", dir_path, name);
+        if (n > 0 && (size_t)n < sizeof(path))
+            ret = mp4_probe_duration(path, duration_s);
+    }
+
+    pthread_mutex_unlock(&g_index_mutex);
+    return ret;
+}
+
+void tl_index_commit(const char *dir_path) {
+    pthread_mutex_lock(&g_index_mutex);
+
+    TlIndexDir *d = index_get_dir(dir_path);
+    if (!d) {
+        pthread_mutex_unlock(&g_index_mutex);
+        return;
+    }
+    int out = 0;
+    for (int i = 0; i < d->count; i++) {
+        if (!d->entries[i].seen) {
+            d->dirty = 1;
+            continue;
+        }
+        d->entries[i].seen = 0;
+        if (out != i) d->entries[out] = d->entries[i];
+        out++;
+    }
+    d->count = out;
+
+    if (d->dirty) index_save(d);
+
+    pthread_mutex_unlock(&g_index_mutex);
+}
+
+void tl_index_add(const char *mp4_path) {
+    char dir_path[256];
+    const char *slash = strrchr(mp4_path, '/');
+    if (!slash || slash == mp4_path) return;
+    if ((size_t)(slash - mp4_path) >= sizeof(dir_path)) return;  /* not indexable */
+    snprintf(dir_path, sizeof(dir_path), "%.*s", (int)(slash - mp4_path), mp4_path);
+
+    struct stat st;
+    if (stat(mp4_path, &st) != 0) return;
+
+    pthread_mutex_lock(&g_index_mutex);
+    TlIndexDir *d = index_get_dir(dir_path);
+    if (d && index_update(d, slash + 1, (uint64_t)st.st_size, st.st_mtime) && d->dirty)
+        index_save(d);
+    pthread_mutex_unlock(&g_index_mutex);
+}
+
+void tl_index_remove(const char *dir_path, const char *name) {
+    pthread_mutex_lock(&g_index_mutex);
+
+    TlIndexDir *d = index_get_dir(dir_path);
+    TlIndexEntry *e = d ? index_find(d, name) : NULL;
+    if (e) {
+        int idx = (int)(e - d->entries);
+        memmove(&d->entries[idx], &d->entries[idx + 1],
+                (d->count - idx - 1) * sizeof(TlIndexEntry));
+        d->count--;
+        index_save(d);
+    }
+
+    pthread_mutex_unlock(&g_index_mutex);
+}
+
+/* ============================================================================
+ * Thumbnail cache
+ * ============================================================================ */
+
+static int thumb_is_video(const char *name) {
+    size_t nlen = strlen(name);
+    return nlen > 4 && strcasecmp(name + nlen - 4, ".mp4") == 0;
+}
+
+/* A sidecar's thumbnail keeps its name, a video's gets ".jpg" appended */
+static int thumb_cache_path(const char *dir_path, const char *name,
+                            char *out_path, size_t out_len) {
+    int n = snprintf(out_path, out_len, "%s/%s/%s%s", dir_path, TL_THUMB_DIRNAME, name,
+                     thumb_is_video(name) ? ".jpg" : "");
+    return (n > 0 && (size_t)n < out_len) ? 0 : -1;
+}
+
+/* Read a whole file into a malloc'd buffer (max 2MB) */
+static uint8_t *thumb_read_file(const char *path, size_t *size) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return NULL;
+
+    uint8_t *buf = NULL;
+    struct stat st;
+    if (fstat(fileno(f), &st) == 0 && st.st_size > 0 && st.st_size <= 2 * 1024 * 1024) {
+        buf = malloc(st.st_size);
+        if (buf && fread(buf, 1, st.st_size, f) != (size_t)st.st_size) {
+            free(buf);
+            buf = NULL;
+        }
+        *size = st.st_size;
+    }
+    fclose(f);
+    return buf;
+}
+
+/* Write a finished thumbnail atomically via <dst>.tmp + rename */
+static int thumb_write(const unsigned char *jpeg, unsigned long size, const char *dst_path) {
+    char tmp_path[600];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", dst_path);
+    FILE *f = fopen(tmp_path, "wb");
+    if (!f) return -1;
+    size_t written = fwrite(jpeg, 1, size, f);
+    if (fclose(f) == 0 && written == size && rename(tmp_path, dst_path) == 0)
+        return 0;
+    unlink(tmp_path);
+    return -1;
+}
+
+/* Decode at the smallest DCT scale that still covers TL_THUMB_MAX_WIDTH,
+ * re-encode, and write atomically. */
+static int thumb_encode(const uint8_t *jpeg, size_t jpeg_size, const char *dst_path) {
+    tjhandle tj = tjInitDecompress();
+    if (!tj) return -1;
+
+    int ret = -1;
+    int width, height, subsamp, colorspace;
+    uint8_t *rgb = NULL;
+    unsigned char *out = NULL;
+    unsigned long out_size = 0;
+    tjhandle tjc = NULL;
+
+    if (tjDecompressHeader3(tj, jpeg, jpeg_size, &width, &height,
+                            &subsamp, &colorspace) != 0)
+        goto out;
+
+    /* Scaling factors are ordered largest first; keep the last one that
+     * does not drop below the target width. */
+    int n_factors = 0;
+    tjscalingfactor *factors = tjGetScalingFactors(&n_factors);
+    tjscalingfactor sf = {1, 1};
+    for (int i = 0; factors && i < n_factors; i++) {
+        int sw = TJSCALED(width, factors[i]);
+        if (sw >= TL_THUMB_MAX_WIDTH && sw <= TJSCALED(width, sf))
+            sf = factors[i];
+    }
+    int sw = TJSCALED(width, sf);
+    int sh = TJSCALED(height, sf);
+
+    rgb = malloc((size_t)sw * sh * 3);
+    if (!rgb) goto out;
+    if (tjDecompress2(tj, jpeg, jpeg_size, rgb, sw, 0, sh, TJPF_RGB,
+                      TJFLAG_FASTDCT | TJFLAG_FASTUPSAMPLE) != 0)
+        goto out;
+
+    tjc = tjInitCompress();
+    if (!tjc) goto out;
+    if (tjCompress2(tjc, rgb, sw, 0, sh, TJPF_RGB, &out, &out_size,
+                    TJSAMP_420, TL_THUMB_QUALITY, TJFLAG_FASTDCT) != 0)
+        goto out;
+    ret = thumb_write(out, out_size, dst_path);
+
+out:
+    if (out) tjFree(out);
+    if (tjc) tjDestroy(tjc);
+    free(rgb);
+    tjDestroy(tj);
+    return ret;
+}
+
+/* Compress an already downscaled I420 frame (hardware decode output) */
+static int thumb_encode_i420(const uint8_t *yuv, int width, int height, const char *dst_path) {
+    tjhandle tjc = tjInitCompress();
+    if (!tjc) return -1;
+
+    int ret = -1;
+    unsigned char *out = NULL;
+    unsigned long out_size = 0;
+    if (tjCompressFromYUV(tjc, yuv, width, 1, height, TJSAMP_420, &out, &out_size,
+                          TL_THUMB_QUALITY, TJFLAG_FASTDCT) == 0)
+        ret = thumb_write(out, out_size, dst_path);
+
+    if (out) tjFree(out);
+    tjDestroy(tjc);
+    return ret;
+}
+
+/* Run ffmpeg to write one scaled frame of src to dst (fork/execve, no
+ * shell); raw_h264 reads src as an Annex B stream instead of a container.
+ * Its process group is killed after TL_THUMB_FFMPEG_TIMEOUT_S.
+ * Returns 0 on success, -2 on timeout, -1 on any other failure. */
+static int thumb_run_ffmpeg(const char *ffmpeg, const char *ld_library_path,
+                            const char *src, const char *dst, int raw_h264) {
+    if (access(ffmpeg, X_OK) != 0) return -1;
+
+    /* Everything the child needs is built here: after fork in a threaded
+     * process it must not allocate */
+    char scale[32];
+    snprintf(scale, sizeof(scale), "scale=%d:-2", TL_THUMB_MAX_WIDTH);
+    const char *argv[24];
+    int argc = 0;
+    argv[argc++] = ffmpeg;
+    argv[argc++] = "-y";
+    argv[argc++] = "-loglevel";
+    argv[argc++] = "error";
+    if (raw_h264) {
+        argv[argc++] = "-f";
+        argv[argc++] = "h264";
+    }
+    argv[argc++] = "-i";
+    argv[argc++] = src;
+    argv[argc++] = "-frames:v";
+    argv[argc++] = "1";
+    argv[argc++] = "-vf";
+    argv[argc++] = scale;
+    argv[argc++] = "-q:v";
+    argv[argc++] = "5";
+    argv[argc++] = "-f";
+    argv[argc++] = "image2";
+    argv[argc++] = dst;
+    argv[argc] = NULL;
+
+    char ld_env[512];
+    const char *envp[64];
+    int envc = 0;
+    if (ld_library_path) {
+        snprintf(ld_env, sizeof(ld_env), "LD_LIBRARY_PATH=%s", ld_library_path);
+        envp[envc++] = ld_env;
+    }
+    for (char **e = environ; *e && envc < 63; e++) {
+        if (!ld_library_path || strncmp(*e, "LD_LIBRARY_PATH=", 16) != 0)
+            envp[envc++] = *e;
+    }
+    envp[envc] = NULL;
+
+    pid_t pid = fork();
+    if (pid < 0) return -1;
+
+    if (pid == 0) {
+        setpgid(0, 0);
+        int devnull = open("/dev/null", O_RDWR);
+        if (devnull >= 0) {
+            dup2(devnull, STDIN_FILENO);
+            dup2(devnull, STDOUT_FILENO);
+            dup2(devnull, STDERR_FILENO);
+            close(devnull);
+        }
+        execve(ffmpeg, (char *const *)argv, (char *const *)envp);
+        _exit(127);
+    }
+
+    int status = 0;
+    for (int waited_ms = 0; ; waited_ms += 50) {
+        pid_t r = waitpid(pid, &status, WNOHANG);
+        if (r == pid) break;
+        if (r < 0 && errno != EINTR) return -1;
+        if (waited_ms >= TL_THUMB_FFMPEG_TIMEOUT_S * 1000) {
+            kill(-pid, SIGKILL);
+            while (waitpid(pid, &status, 0) < 0 && errno == EINTR)
+                ;
+            return -2;
+        }
+        usleep(50000);
+    }
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0 ? 0 : -1;
+}
+
+/* Software fallback for thumb_from_video: ffmpeg decodes the extracted IDR
+ * (or, if the sample tables could not be read, the MP4's first frame) */
+static int thumb_ffmpeg_fallback(const char *src_path, const uint8_t *au, size_t au_len,
+                                 const char *dst_path) {
+    char h264_path[600], tmp_path[600];
+    snprintf(h264_path, sizeof(h264_path), "%s.tmp.h264", dst_path);
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp.jpg", dst_path);
+
+    const char *input = src_path;
+    if (au) {
+        FILE *f = fopen(h264_path, "wb");
+        if (f) {
+            size_t written = fwrite(au, 1, au_len, f);
+            if (fclose(f) == 0 && written == au_len)
+                input = h264_path;
+        }
+    }
+
+    static const struct { const char *path, *libs; } ffmpegs[] = {
+        { TIMELAPSE_FFMPEG_PATH, NULL },
+        { TIMELAPSE_FFMPEG_STOCK, TIMELAPSE_FFMPEG_LIBS },
+    };
+    /* A timeout ends the attempt: the other binary would hang the same way */
+    int ret = -1;
+    for (size_t i = 0; ret == -1 && i < sizeof(ffmpegs) / sizeof(ffmpegs[0]); i++) {
+        struct stat st;
+        ret = thumb_run_ffmpeg(ffmpegs[i].path, ffmpegs[i].libs, input, tmp_path,
+                               input == h264_path);
+        if (ret == 0 && (stat(tmp_path, &st) != 0 || st.st_size <= 0 ||
+                         rename(tmp_path, dst_path) != 0))
+            ret = -1;
+    }
+    unlink(h264_path);
+    if (ret != 0) unlink(tmp_path);
+    return ret == 0 ? 0 : -1;
+}
+
+/* Thumbnail for an MP4 without a .jpg sidecar (recordings from before
+ * sidecars, or whose sidecar was lost): its first IDR, taken through the
+ * sample tables and decoded by VDEC, with ffmpeg as the fallback where
+ * the SoC has no H.264 decoder. Runs on the thumbnail worker. A failure
+ * leaves an empty file behind so it is not retried on every page load,
+ * until the MP4 changes. */
+static int thumb_from_video(const char *src_path, const char *dst_path) {
+    size_t au_len = 0;
+    int width = 0, height = 0;
+    uint8_t *au = mp4_first_idr(src_path, &au_len, &width, &height);
+
+    int ret = -1;
+    if (au) {
+        int tw, th;
+        uint8_t *yuv = timelapse_venc_decode_idr(au, au_len, width, height,
+                                                 TL_THUMB_MAX_WIDTH, &tw, &th);
+        if (yuv) {
+            ret = thumb_encode_i420(yuv, tw, th, dst_path);
+            free(yuv);
+        }
+    }
+    if (ret != 0)
+        ret = thumb_ffmpeg_fallback(src_path, au, au_len, dst_path);
+    free(au);
+
+    if (ret != 0) {
+        int fd = open(dst_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+    return 0;
+}
+
+static int thumb_make_dir(const char *dir_path) {
+    char thumb_dir[512];
+    snprintf(thumb_dir, sizeof(thumb_dir), "%s/%s", dir_path, TL_THUMB_DIRNAME);
+    return mkdir(thumb_dir, 0755) == 0 || errno == EEXIST ? 0 : -1;
+}
+
+/* Cached thumbnail (or failure marker) at least as new as its source */
+static int thumb_is_fresh(const char *src_path, const char *thumb_path, struct stat *thumb_st) {
+    struct stat src_st;
+    return stat(src_path, &src_st) == 0 && stat(thumb_path, thumb_st) == 0 &&
+           thumb_st->st_mtime >= src_st.st_mtime;
+}
+
+/* ============================================================================
+ * Thumbnail worker
+ *
+ * MP4 thumbnails can take seconds (VDEC setup, or the ffmpeg fallback), so
+ * they are made on a worker thread started on first use, never on the
+ * control server thread that asks for them.
+ * ============================================================================ */
+
+#define TL_THUMB_QUEUE_MAX  8
+
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int running;
+    int count;
+    char dir[TL_THUMB_QUEUE_MAX][256];
+    char name[TL_THUMB_QUEUE_MAX][256];
+    char dst[TL_THUMB_QUEUE_MAX][512];
+    char active[512];       /* dst of the job being worked on */
+} g_thumb_queue = { .lock = PTHREAD_MUTEX_INITIALIZER, .cond = PTHREAD_COND_INITIALIZER };
+
+static void *thumb_worker(void *arg) {
+    (void)arg;
+    char dir[256], name[256], src[512], dst[512];
+
+    pthread_mutex_lock(&g_thumb_queue.lock);
+    for (;;) {
+        while (g_thumb_queue.count == 0)
+            pthread_cond_wait(&g_thumb_queue.cond, &g_thumb_queue.lock);
+
+        snprintf(dir, sizeof(dir), "%s", g_thumb_queue.dir[0]);
+        snprintf(name, sizeof(name), "%s", g_thumb_queue.name[0]);
+        snprintf(dst, sizeof(dst), "%s", g_thumb_queue.dst[0]);
+        g_thumb_queue.count--;
+        memmove(g_thumb_queue.dir[0], g_thumb_queue.dir[1],
+                g_thumb_queue.count * sizeof(g_thumb_queue.dir[0]));
+        memmove(g_thumb_queue.name[0], g_thumb_queue.name[1],
+                g_thumb_queue.count * sizeof(g_thumb_queue.name[0]));
+        memmove(g_thumb_queue.dst[0], g_thumb_queue.dst[1],
+                g_thumb_queue.count * sizeof(g_thumb_queue.dst[0]));
+        snprintf(g_thumb_queue.active, sizeof(g_thumb_queue.active), "%s", dst);
+        pthread_mutex_unlock(&g_thumb_queue.lock);
+
+        /* Requeued while the previous run was finishing: nothing to do */
+        struct stat st;
+        snprintf(src, sizeof(src), "%s/%s", dir, name);
+        if (!thumb_is_fresh(src, dst, &st) && thumb_make_dir(dir) == 0)
+            thumb_from_video(src, dst);
+
+        pthread_mutex_lock(&g_thumb_queue.lock);
+        g_thumb_queue.active[0] = '\0';
+    }
+    return NULL;
+}
+
+/* Hand an MP4 to the worker unless it is already queued or in progress.
+ * A full queue is not an error: the page asks again and gets a slot then.
+ * Returns -1 only if the worker cannot be started. */
+static int thumb_queue_video(const char *dir_path, const char *name, const char *dst_path) {
+    int ret = 0;
+    pthread_mutex_lock(&g_thumb_queue.lock);
+
+    int queued = strcmp(g_thumb_queue.active, dst_path) == 0;
+    for (int i = 0; !queued && i < g_thumb_queue.count; i++)
+        queued = strcmp(g_thumb_queue.dst[i], dst_path) == 0;
+
+    if (!queued && !g_thumb_queue.running) {
+        pthread_t tid;
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        if (pthread_create(&tid, &attr, thumb_worker, NULL) == 0)
+            g_thumb_queue.running = 1;
+        else
+            ret = -1;
+        pthread_attr_destroy(&attr);
+    }
+
+    if (!queued && ret == 0 && g_thumb_queue.count < TL_THUMB_QUEUE_MAX &&
+        strlen(dir_path) < sizeof(g_thumb_queue.dir[0]) &&
+        strlen(name) < sizeof(g_thumb_queue.name[0])) {
+        int n = g_thumb_queue.count++;
+        snprintf(g_thumb_queue.dir[n], sizeof(g_thumb_queue.dir[n]), "%s", dir_path);
+        snprintf(g_thumb_queue.name[n], sizeof(g_thumb_queue.name[n]), "%s", name);
+        snprintf(g_thumb_queue.dst[n], sizeof(g_thumb_queue.dst[n]), "%s", dst_path);
+        pthread_cond_signal(&g_thumb_queue.cond);
+    }
+
+    pthread_mutex_unlock(&g_thumb_queue.lock);
+    return ret;
+}
+
+int tl_thumb_create(const char *jpg_path) {
+    char dir_path[256];
+    const char *slash = strrchr(jpg_path, '/');
+    if (!slash || slash == jpg_path) return -1;
+    snprintf(dir_path, sizeof(dir_path), "%.*s", (int)(slash - jpg_path), jpg_path);
+
+    char dst_path[512];
+    if (thumb_is_video(slash + 1) ||
+        thumb_cache_path(dir_path, slash + 1, dst_path, sizeof(dst_path)) != 0 ||
+        thumb_make_dir(dir_path) != 0)
+        return -1;
+
+    size_t size = 0;
+    uint8_t *jpeg = thumb_read_file(jpg_path, &size);
+    if (!jpeg) return -1;
+    int ret = thumb_encode(jpeg, size, dst_path);
+    free(jpeg);
+    return ret;
+}
+
+int tl_thumb_get(const char *dir_path, const char *name,
+                 char *out_path, size_t out_len) {
+    size_t nlen = strlen(name);
+    if (nlen < 5 || (strcasecmp(name + nlen - 4, ".jpg") != 0 && !thumb_is_video(name)))
+        return -1;
+    if (thumb_cache_path(dir_path, name, out_path, out_len) != 0) return -1;
+
+    char src_path[512];
+    snprintf(src_path, sizeof(src_path), "%s/%s", dir_path, name);
+
+    /* Up to date: a thumbnail, or the empty marker of a failed extraction */
+    struct stat src_st, thumb_st;
+    if (stat(src_path, &src_st) != 0) return -1;
+    if (stat(out_path, &thumb_st) == 0 && thumb_st.st_mtime >= src_st.st_mtime)
+        return thumb_st.st_size > 0 ? 0 : -1;
+
+    if (thumb_is_video(name))
+        return thumb_queue_video(dir_path, name, out_path) == 0 ? 1 : -1;
+    return tl_thumb_create(src_path);
+}
+
+void tl_thumb_remove(const char *dir_path, const char *name) {
+    char path[512];
+    if (thumb_cache_path(dir_path, name, path, sizeof(path)) == 0)
+        unlink(path);
+}
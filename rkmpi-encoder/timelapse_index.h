@@ -0,0 +1,74 @@
+/*
+ * Timelapse Recording Index
+ *
+ * Native MP4 duration probe (moov/mvhd, falling back to trak/mdia/mdhd,
+ * then to the sample durations of a fragmented file's moof boxes) and a
+ * persistent per-directory metadata cache, so listing recordings never
+ * has to fork ffprobe.
+ *
+ * The cache lives in <dir>/.tl_index as one line per recording:
+ *   <name>\t<size>\t<mtime>\t<duration>
+ * Entries are keyed by (name, size, mtime) and re-probed when either changes.
+ *
+ * Also owns the thumbnail cache: small JPEGs derived from the recording's
+ * last frame (its .jpg sidecar) or, for an MP4 without one, its first IDR,
+ * served to the timelapse page instead of the full-size frame.
+ */
+
+#ifndef TIMELAPSE_INDEX_H
+#define TIMELAPSE_INDEX_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+
+#define TL_INDEX_FILENAME   ".tl_index"
+#define TL_INDEX_MAX_DIRS   4       /* internal + USB (+ spare for path changes) */
+#define TL_INDEX_MAX_ENTRIES 256    /* per directory, >= TL_MAX_ENTRIES in listing */
+
+/* Downscaled thumbnails are cached in <dir>/.thumbs/<thumbnail name> */
+#define TL_THUMB_DIRNAME    ".thumbs"
+#define TL_THUMB_MAX_WIDTH  320     /* smallest DCT scale still >= this width */
+#define TL_THUMB_QUALITY    75
+#define TL_THUMB_FFMPEG_TIMEOUT_S 10    /* ffmpeg fallback, on the thumbnail worker */
+
+/* Read MP4 duration from the moov box without decoding anything.
+ * Returns 0 on success (duration in seconds), -1 if not a parseable MP4. */
+int mp4_probe_duration(const char *path, double *duration_s);
+
+/* Look up a recording's duration in the index for dir_path.
+ * On miss or stale entry (size/mtime changed) the file is probed and the
+ * entry updated in memory. Marks the entry as seen for tl_index_commit().
+ * Returns 0 with *duration_s set, -1 if the duration is unknown. */
+int tl_index_lookup(const char *dir_path, const char *name,
+                    uint64_t size, time_t mtime, double *duration_s);
+
+/* Finish a listing pass: drop entries not seen since the previous commit
+ * (files removed behind our back) and persist the index if it changed. */
+void tl_index_commit(const char *dir_path);
+
+/* Probe a newly written MP4 and add it to its directory's index.
+ * mp4_path is the full path; the directory is derived from it. */
+void tl_index_add(const char *mp4_path);
+
+/* Remove a recording (name including .mp4) from the index and persist. */
+void tl_index_remove(const char *dir_path, const char *name);
+
+/* Create the cached thumbnail for a recording's full-size JPEG
+ * (<dir>/<name>.jpg -> <dir>/.thumbs/<name>.jpg) using TurboJPEG DCT scaling.
+ * Returns 0 on success, -1 on failure. */
+int tl_thumb_create(const char *jpg_path);
+
+/* Resolve the cached thumbnail for <dir_path>/<name>, generating it if
+ * missing or older than the source. <name> is a .jpg sidecar (downscaled
+ * in the call), or an .mp4 without one: its first IDR is decoded once on a
+ * background worker (VDEC, else ffmpeg) and a failure is remembered until
+ * the MP4 changes. Returns 0 with out_path set, 1 while the worker has not
+ * produced the MP4's thumbnail yet, -1 if no thumbnail can be produced. */
+int tl_thumb_get(const char *dir_path, const char *name,
+                 char *out_path, size_t out_len);
+
+/* Remove the cached thumbnail for <dir_path>/<name> (.jpg or .mp4), if any */
+void tl_thumb_remove(const char *dir_path, const char *name);
+
+#endif /* TIMELAPSE_INDEX_H */
@@ -0,0 +1,675 @@
+/*
+ * Timelapse Frame Staging
+ *
+ * RAM ring + append-only segment files for deferred-mode frames.
+ * See timelapse_stage.h for the file format.
+ */
+
+#include "timelapse_stage.h"
+#include "frame_buffer.h"   /* FRAME_BUFFER_MAX_JPEG */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define STAGE_LOG(fmt, ...) fprintf(stderr, "[TL_STAGE] " fmt, ##__VA_ARGS__)
+
+/* Where a frame lives for the reader */
+#define FRAME_MISSING   -2
+#define FRAME_FILE      -1
+
+struct TLStageFrame {
+    int seg;                /* Segment number, FRAME_FILE or FRAME_MISSING */
+    int number;             /* Frame number it was captured as */
+    uint32_t offset;
+    uint32_t size;
+};
+
+/* One half of the RAM ring */
+typedef struct {
+    uint8_t *data;
+    size_t used;
+    int seg;                /* Segment every record in this half belongs to */
+    int frames;
+    uint64_t first_ms;      /* When the oldest record was staged */
+} StageHalf;
+
+static struct {
+    int open;
+    char dir[TIMELAPSE_PATH_MAX];
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    StageHalf half[2];
+    int active;             /* Half being filled by captures */
+    int pending;            /* Half handed to the writer, -1 if none */
+    int stop;
+
+    /* Writer thread only (read by close after the join) */
+    int fd;
+    int seg;
+    uint32_t seg_offset;
+    TLStageIndexEntry index[TL_STAGE_SEG_FRAMES];
+    int index_count;
+
+    TLStageStats stats;     /* frames/payload under lock, the rest writer-only */
+} g_stage = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .cond = PTHREAD_COND_INITIALIZER,
+    .fd = -1,
+};
+
+static uint64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000ULL + ts.tv_nsec / 1000000;
+}
+
+/* Returns 0 on success, -1 if the path does not fit */
+static int segment_path(char *path, size_t size, const char *dir, int seg) {
+    int len = snprintf(path, size, "%s/" TL_STAGE_SEG_PREFIX "%04d" TL_STAGE_SEG_EXT,
+                       dir, seg);
+    return (len < 0 || (size_t)len >= size) ? -1 : 0;
+}
+
+static int frame_path(char *path, size_t size, const char *dir, int frame) {
+    int len = snprintf(path, size, "%s/frame_%04d.jpg", dir, frame);
+    return (len < 0 || (size_t)len >= size) ? -1 : 0;
+}
+
+/* write() all of buf, counting the calls. Returns 0 on success. */
+static int write_all(int fd, const uint8_t *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        g_stage.stats.writes++;
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        buf += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+/* Append the index and footer and close the open segment */
+static void finish_segment(void) {
+    if (g_stage.fd < 0) {
+        return;
+    }
+
+    uint8_t tail[sizeof(g_stage.index) + sizeof(TLStageFooter)];
+    size_t index_size = g_stage.index_count * sizeof(TLStageIndexEntry);
+    TLStageFooter footer = {
+        .magic = TL_STAGE_INDEX_MAGIC,
+        .count = g_stage.index_count,
+        .index_offset = g_stage.seg_offset,
+        .version = TL_STAGE_VERSION,
+    };
+    memcpy(tail, g_stage.index, index_size);
+    memcpy(tail + index_size, &footer, sizeof(footer));
+
+    /* Without the footer the reader walks the records, so a failure
+     * here costs nothing but the shortcut */
+    if (write_all(g_stage.fd, tail, index_size + sizeof(footer)) == 0) {
+        g_stage.stats.file_bytes += index_size + sizeof(footer);
+    } else {
+        STAGE_LOG("Index write failed for segment %d: %s\n", g_stage.seg, strerror(errno));
+    }
+
+    close(g_stage.fd);
+    g_stage.fd = -1;
+}
+
+static int open_segment(int seg) {
+    char path[TIMELAPSE_PATH_MAX];
+    if (segment_path(path, sizeof(path), g_stage.dir, seg) != 0) {
+        STAGE_LOG("Segment path too long in %s\n", g_stage.dir);
+        return -1;
+    }
+
+    g_stage.fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (g_stage.fd < 0) {
+        STAGE_LOG("Cannot create %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    g_stage.seg = seg;
+    g_stage.seg_offset = 0;
+    g_stage.index_count = 0;
+    g_stage.stats.segments++;
+    return 0;
+}
+
+/* Write one half of the ring to its segment with a single write.
+ * Returns 0 on success, -1 if its frames were lost. */
+static int write_half(const StageHalf *h) {
+    if (g_stage.fd < 0 || h->seg != g_stage.seg) {
+        finish_segment();
+        if (open_segment(h->seg) != 0) {
+            return -1;
+        }
+    }
+
+    /* Index entries follow from the current file offset */
+    int index_start = g_stage.index_count;
+    for (size_t pos = 0; pos < h->used; ) {
+        TLStageRecord rec;
+        memcpy(&rec, h->data + pos, sizeof(rec));
+        if (g_stage.index_count < TL_STAGE_SEG_FRAMES) {
+            TLStageIndexEntry *e = &g_stage.index[g_stage.index_count++];
+            e->frame = rec.frame;
+            e->offset = g_stage.seg_offset + pos + sizeof(rec);
+            e->size = rec.size;
+        }
+        pos += sizeof(rec) + rec.size;
+    }
+
+    if (write_all(g_stage.fd, h->data, h->used) != 0) {
+        STAGE_LOG("Write to segment %d failed: %s (%d frames lost)\n",
+                  g_stage.seg, strerror(errno), h->frames);
+        /* Cut any partial record so the segment stays walkable */
+        if (ftruncate(g_stage.fd, g_stage.seg_offset) != 0) {
+            close(g_stage.fd);
+            g_stage.fd = -1;
+        }
+        g_stage.index_count = index_start;
+        return -1;
+    }
+
+    g_stage.seg_offset += h->used;
+    g_stage.stats.file_bytes += h->used;
+    return 0;
+}
+
+/* Hand the active half to the writer (lock held) */
+static void hand_over(void) {
+    while (g_stage.pending >= 0) {
+        pthread_cond_wait(&g_stage.cond, &g_stage.lock);
+    }
+    g_stage.pending = g_stage.active;
+    g_stage.active ^= 1;
+    pthread_cond_broadcast(&g_stage.cond);
+}
+
+static void *stage_writer_func(void *arg) {
+    (void)arg;
+
+    pthread_mutex_lock(&g_stage.lock);
+    for (;;) {
+        if (g_stage.pending < 0) {
+            /* Nothing handed over: flush a half that is old enough, or
+             * everything once closing */
+            StageHalf *h = &g_stage.half[g_stage.active];
+            if (h->used > 0 &&
+                (g_stage.stop || now_ms() - h->first_ms >= TL_STAGE_MAX_AGE_MS)) {
+                g_stage.pending = g_stage.active;
+                g_stage.active ^= 1;
+            } else if (g_stage.stop) {
+                break;
+            } else {
+                struct timespec ts;
+                clock_gettime(CLOCK_REALTIME, &ts);
+                ts.tv_sec += 1;
+                pthread_cond_timedwait(&g_stage.cond, &g_stage.lock, &ts);
+                continue;
+            }
+        }
+
+        StageHalf *h = &g_stage.half[g_stage.pending];
+        pthread_mutex_unlock(&g_stage.lock);
+
+        int ret = write_half(h);
+
+        pthread_mutex_lock(&g_stage.lock);
+        if (ret != 0) {
+            g_stage.stats.lost += h->frames;
+        }
+        h->used = 0;
+        h->frames = 0;
+        g_stage.pending = -1;
+        pthread_cond_broadcast(&g_stage.cond);
+    }
+    pthread_mutex_unlock(&g_stage.lock);
+
+    finish_segment();
+    return NULL;
+}
+
+int tl_stage_open(const char *dir) {
+    if (g_stage.open) {
+        return -1;
+    }
+
+    snprintf(g_stage.dir, sizeof(g_stage.dir), "%s", dir);
+    memset(&g_stage.stats, 0, sizeof(g_stage.stats));
+    for (int i = 0; i < 2; i++) {
+        memset(&g_stage.half[i], 0, sizeof(g_stage.half[i]));
+        g_stage.half[i].data = malloc(TL_STAGE_BUF_SIZE);
+        if (!g_stage.half[i].data) {
+            STAGE_LOG("Cannot allocate %d KB ring\n", 2 * TL_STAGE_BUF_SIZE / 1024);
+            free(g_stage.half[0].data);
+            g_stage.half[0].data = NULL;
+            return -1;
+        }
+    }
+    g_stage.active = 0;
+    g_stage.pending = -1;
+    g_stage.stop = 0;
+    g_stage.fd = -1;
+    g_stage.seg = -1;
+
+    if (pthread_create(&g_stage.thread, NULL, stage_writer_func, NULL) != 0) {
+        STAGE_LOG("Cannot start writer thread: %s\n", strerror(errno));
+        free(g_stage.half[0].data);
+        free(g_stage.half[1].data);
+        g_stage.half[0].data = g_stage.half[1].data = NULL;
+        return -1;
+    }
+
+    g_stage.open = 1;
+    STAGE_LOG("Staging frames in %s (%d KB ring, %d frames/segment)\n",
+              dir, 2 * TL_STAGE_BUF_SIZE / 1024, TL_STAGE_SEG_FRAMES);
+    return 0;
+}
+
+int tl_stage_is_open(void) {
+    return g_stage.open;
+}
+
+int tl_stage_append(int frame, const uint8_t *jpeg, size_t size) {
+    size_t rec_size = sizeof(TLStageRecord) + size;
+    if (!g_stage.open || frame < 0 || size == 0 || rec_size > TL_STAGE_BUF_SIZE) {
+        return -1;
+    }
+    int seg = frame / TL_STAGE_SEG_FRAMES;
+
+    pthread_mutex_lock(&g_stage.lock);
+
+    StageHalf *h = &g_stage.half[g_stage.active];
+    if (h->used > 0 && (h->seg != seg || h->used + rec_size > TL_STAGE_BUF_SIZE)) {
+        hand_over();
+        h = &g_stage.half[g_stage.active];
+    }
+    if (h->used == 0) {
+        h->seg = seg;
+        h->first_ms = now_ms();
+    }
+
+    TLStageRecord rec = {
+        .magic = TL_STAGE_RECORD_MAGIC,
+        .frame = (uint32_t)frame,
+        .size = (uint32_t)size,
+        .reserved = 0,
+    };
+    memcpy(h->data + h->used, &rec, sizeof(rec));
+    memcpy(h->data + h->used + sizeof(rec), jpeg, size);
+    h->used += rec_size;
+    h->frames++;
+
+    g_stage.stats.frames++;
+    g_stage.stats.payload_bytes += size;
+
+    pthread_mutex_unlock(&g_stage.lock);
+    return 0;
+}
+
+int tl_stage_close(TLStageStats *stats) {
+    if (!g_stage.open) {
+        if (stats) memset(stats, 0, sizeof(*stats));
+        return 0;
+    }
+
+    pthread_mutex_lock(&g_stage.lock);
+    g_stage.stop = 1;
+    pthread_cond_broadcast(&g_stage.cond);
+    pthread_mutex_unlock(&g_stage.lock);
+    pthread_join(g_stage.thread, NULL);
+
+    free(g_stage.half[0].data);
+    free(g_stage.half[1].data);
+    g_stage.half[0].data = g_stage.half[1].data = NULL;
+    g_stage.open = 0;
+
+    TLStageStats *st = &g_stage.stats;
+    STAGE_LOG("Staged %d frames in %d segments, %d writes, "
+              "%llu payload -> %llu file bytes (%.4fx), %d lost\n",
+              st->frames, st->segments, st->writes,
+              (unsigned long long)st->payload_bytes, (unsigned long long)st->file_bytes,
+              st->payload_bytes ? (double)st->file_bytes / st->payload_bytes : 0.0,
+              st->lost);
+    if (stats) *stats = *st;
+
+    return st->lost > 0 ? -1 : 0;
+}
+
+/* ============================================================================
+ * Reader
+ * ============================================================================ */
+
+static int reader_grow(TLStageReader *r, int *cap, int n) {
+    if (n < *cap) {
+        return 0;
+    }
+    int new_cap = *cap ? *cap : 256;
+    while (new_cap <= n) new_cap *= 2;
+    struct TLStageFrame *f = realloc(r->frames, new_cap * sizeof(*f));
+    if (!f) {
+        return -1;
+    }
+    for (int i = *cap; i < new_cap; i++) {
+        f[i].seg = FRAME_MISSING;
+    }
+    r->frames = f;
+    *cap = new_cap;
+    return 0;
+}
+
+static int reader_add(TLStageReader *r, int *cap, int seg,
+                      uint32_t frame, uint32_t offset, uint32_t size) {
+    if (frame >= (1u << 24) || reader_grow(r, cap, (int)frame) != 0) {
+        return -1;
+    }
+    r->frames[frame].seg = seg;
+    r->frames[frame].offset = offset;
+    r->frames[frame].size = size;
+    if ((int)frame >= r->count) {
+        r->count = frame + 1;
+    }
+    return 0;
+}
+
+/* Add one segment's frames: from its index if it was closed, otherwise by
+ * walking the records up to the first damaged one */
+static void reader_index_segment(TLStageReader *r, int *cap, int seg) {
+    char path[TIMELAPSE_PATH_MAX];
+    if (segment_path(path, sizeof(path), r->dir, seg) != 0) {
+        return;
+    }
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(TLStageRecord)) {
+        close(fd);
+        return;
+    }
+    size_t size = (size_t)st.st_size;
+    uint8_t *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        STAGE_LOG("Cannot map %s: %s\n", path, strerror(errno));
+        return;
+    }
+
+    TLStageFooter footer;
+    memcpy(&footer, map + size - sizeof(footer), sizeof(footer));
+    int indexed = 0;
+    if (footer.magic == TL_STAGE_INDEX_MAGIC &&
+        footer.version == TL_STAGE_VERSION &&
+        footer.count <= TL_STAGE_SEG_FRAMES &&
+        (size_t)footer.index_offset + footer.count * sizeof(TLStageIndexEntry) +
+            sizeof(footer) == size) {
+        indexed = 1;
+        for (uint32_t i = 0; i < footer.count; i++) {
+            TLStageIndexEntry e;
+            memcpy(&e, map + footer.index_offset + i * sizeof(e), sizeof(e));
+            if (e.offset < sizeof(TLStageRecord) ||
+                e.size == 0 || e.size > FRAME_BUFFER_MAX_JPEG ||
+                (size_t)e.offset + e.size > footer.index_offset) {
+                indexed = 0;
+                break;
+            }
+            reader_add(r, cap, seg, e.frame, e.offset, e.size);
+        }
+    }
+
+    if (!indexed) {
+        size_t pos = 0;
+        int found = 0;
+        while (pos + sizeof(TLStageRecord) <= size) {
+            TLStageRecord rec;
+            memcpy(&rec, map + pos, sizeof(rec));
+            if (rec.magic != TL_STAGE_RECORD_MAGIC || rec.size == 0 ||
+                rec.size > FRAME_BUFFER_MAX_JPEG ||
+                pos + sizeof(rec) + rec.size > size) {
+                break;
+            }
+            reader_add(r, cap, seg, rec.frame, pos + sizeof(rec), rec.size);
+            pos += sizeof(rec) + rec.size;
+            found++;
+        }
+        STAGE_LOG("Segment %d has no index, recovered %d frames by scan\n", seg, found);
+    }
+
+    munmap(map, size);
+}
+
+/* Add dir/frame_NNNN.jpg for any frame no segment has */
+static void reader_add_file(TLStageReader *r, int *cap, const char *name) {
+    int frame;
+    const char *ext = strchr(name, '.');
+    if (sscanf(name, "frame_%d", &frame) != 1 || frame < 0 ||
+        !ext || strcmp(ext, ".jpg") != 0) {
+        return;
+    }
+    if (frame < r->count && r->frames[frame].seg != FRAME_MISSING) {
+        return;
+    }
+    char path[TIMELAPSE_PATH_MAX];
+    struct stat st;
+    if (frame_path(path, sizeof(path), r->dir, frame) != 0 ||
+        stat(path, &st) != 0 || st.st_size <= 0 ||
+        st.st_size > FRAME_BUFFER_MAX_JPEG) {
+        return;
+    }
+    reader_add(r, cap, FRAME_FILE, frame, 0, (uint32_t)st.st_size);
+}
+
+int tl_stage_reader_open(TLStageReader *r, const char *dir) {
+    memset(r, 0, sizeof(*r));
+    snprintf(r->dir, sizeof(r->dir), "%s", dir);
+    r->mapped_seg = -1;
+    r->mapped_file = -1;
+    int cap = 0;
+
+    DIR *d = opendir(dir);
+    if (!d) {
+        return -1;
+    }
+    size_t prefix_len = strlen(TL_STAGE_SEG_PREFIX);
+    struct dirent *entry;
+    while ((entry = readdir(d)) != NULL) {
+        if (strncmp(entry->d_name, "frame_", 6) == 0) {
+            reader_add_file(r, &cap, entry->d_name);
+            continue;
+        }
+        const char *ext = strstr(entry->d_name, TL_STAGE_SEG_EXT);
+        if (strncmp(entry->d_name, TL_STAGE_SEG_PREFIX, prefix_len) != 0 ||
+            !ext || ext[strlen(TL_STAGE_SEG_EXT)] != '\0') {
+            continue;
+        }
+        int seg = atoi(entry->d_name + prefix_len);
+        if (seg >= 0) {
+            reader_index_segment(r, &cap, seg);
+        }
+    }
+    closedir(d);
+
+    /* Close the gaps left by failed writes or deleted files so every frame
+     * that exists is encoded, in capture order */
+    int n = 0;
+    for (int i = 0; i < r->count; i++) {
+        if (r->frames[i].seg == FRAME_MISSING) {
+            continue;
+        }
+        r->frames[n] = r->frames[i];
+        r->frames[n].number = i;
+        n++;
+    }
+    if (n < r->count) {
+        STAGE_LOG("Skipping %d missing frames of %d in %s\n", r->count - n, r->count, dir);
+    }
+    r->count = n;
+    return n;
+}
+
+static void reader_unmap(TLStageReader *r) {
+    if (r->map) {
+        munmap(r->map, r->map_size);
+        r->map = NULL;
+        r->map_size = 0;
+    }
+    r->mapped_seg = -1;
+    r->mapped_file = -1;
+}
+
+static int reader_map(TLStageReader *r, const char *path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        STAGE_LOG("Cannot open %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        close(fd);
+        return -1;
+    }
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        STAGE_LOG("Cannot map %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+    r->map = map;
+    r->map_size = st.st_size;
+    return 0;
+}
+
+const uint8_t *tl_stage_reader_frame(TLStageReader *r, int n, size_t *size) {
+    if (n < 0 || n >= r->count) {
+        return NULL;
+    }
+    const struct TLStageFrame *f = &r->frames[n];
+    char path[TIMELAPSE_PATH_MAX];
+
+    if (f->seg >= 0) {
+        if (r->mapped_seg != f->seg) {
+            reader_unmap(r);
+            if (segment_path(path, sizeof(path), r->dir, f->seg) != 0 ||
+                reader_map(r, path) != 0) {
+                return NULL;
+            }
+            r->mapped_seg = f->seg;
+        }
+        if ((size_t)f->offset + f->size > r->map_size) {
+            return NULL;
+        }
+        *size = f->size;
+        return r->map + f->offset;
+    }
+
+    if (r->mapped_file != f->number) {
+        reader_unmap(r);
+        if (frame_path(path, sizeof(path), r->dir, f->number) != 0 ||
+            reader_map(r, path) != 0) {
+            return NULL;
+        }
+        r->mapped_file = f->number;
+    }
+    *size = r->map_size;
+    return r->map;
+}
+
+void tl_stage_reader_close(TLStageReader *r) {
+    reader_unmap(r);
+    free(r->frames);
+    r->frames = NULL;
+    r->count = 0;
+}
+
+static void remove_segments(const char *dir) {
+    DIR *d = opendir(dir);
+    if (!d) {
+        return;
+    }
+    char path[TIMELAPSE_PATH_MAX];
+    size_t prefix_len = strlen(TL_STAGE_SEG_PREFIX);
+    struct dirent *entry;
+    while ((entry = readdir(d)) != NULL) {
+        if (strncmp(entry->d_name, TL_STAGE_SEG_PREFIX, prefix_len) != 0) {
+            continue;
+        }
+        int len = snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+        if (len > 0 && (size_t)len < sizeof(path)) {
+            unlink(path);
+        }
+    }
+    closedir(d);
+}
+
+int tl_stage_export(TLStageReader *r, const char *dest_dir) {
+    int same_dir = strcmp(r->dir, dest_dir) == 0;
+    int written = 0;
+    char path[TIMELAPSE_PATH_MAX];
+
+    for (int i = 0; i < r->count; i++) {
+        struct TLStageFrame *fr = &r->frames[i];
+        if (same_dir && fr->seg == FRAME_FILE) {
+            /* Already a file: only move it down over a gap */
+            if (fr->number == i) {
+                written++;
+                continue;
+            }
+            char from[TIMELAPSE_PATH_MAX];
+            if (frame_path(from, sizeof(from), dest_dir, fr->number) == 0 &&
+                frame_path(path, sizeof(path), dest_dir, i) == 0 &&
+                rename(from, path) == 0) {
+                if (r->mapped_file == fr->number) {
+                    reader_unmap(r);
+                }
+                fr->number = i;
+                written++;
+                continue;
+            }
+        }
+
+        size_t size;
+        const uint8_t *data = tl_stage_reader_frame(r, i, &size);
+        if (!data) {
+            continue;
+        }
+
+        if (frame_path(path, sizeof(path), dest_dir, i) != 0) {
+            continue;
+        }
+        FILE *f = fopen(path, "wb");
+        if (!f) {
+            STAGE_LOG("Cannot create %s: %s\n", path, strerror(errno));
+            continue;
+        }
+        size_t n = fwrite(data, 1, size, f);
+        if (fclose(f) != 0 || n != size) {
+            unlink(path);
+            continue;
+        }
+        written++;
+    }
+
+    /* Every frame is a file now. The segments would hold them a second
+     * time under their old numbers, so a later reader must not see them. */
+    if (same_dir && written == r->count) {
+        reader_unmap(r);
+        remove_segments(dest_dir);
+    }
+    return written;
+}
@@ -0,0 +1,129 @@
+/*
+ * Timelapse Frame Staging
+ *
+ * Deferred-mode frames are batched in RAM and written to append-only
+ * segment files in the recording's temp dir, instead of one JPEG file per
+ * capture. A capture is a memcpy into a two-half ring; a writer thread
+ * empties the other half with one large sequential write, so flash sees
+ * no per-frame create/close and the capture path never waits on it.
+ *
+ * Segment <temp_dir>/seg_NNNN.tls holds TL_STAGE_SEG_FRAMES frames:
+ *   record*   { 'TLFR', frame, size, 0 } + JPEG bytes
+ *   index     { frame, offset, size } per record      (written on close)
+ *   footer    { 'TLIX', count, index_offset, version } (written on close)
+ * A segment without a footer (crash) is recovered by walking the records.
+ *
+ * The reader also accepts a directory of frame_NNNN.jpg files, as left by
+ * older builds, so finalize and orphan recovery have a single frame source.
+ */
+
+#ifndef TIMELAPSE_STAGE_H
+#define TIMELAPSE_STAGE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "timelapse.h"  /* TIMELAPSE_PATH_MAX */
+
+#define TL_STAGE_SEG_FRAMES     64                  /* Frames per segment file */
+#define TL_STAGE_BUF_SIZE       (1024 * 1024)       /* Each half of the RAM ring */
+#define TL_STAGE_MAX_AGE_MS     10000               /* Staged frames hit flash within this */
+#define TL_STAGE_SEG_PREFIX     "seg_"
+#define TL_STAGE_SEG_EXT        ".tls"
+
+#define TL_STAGE_RECORD_MAGIC   0x52464c54u         /* "TLFR" */
+#define TL_STAGE_INDEX_MAGIC    0x58494c54u         /* "TLIX" */
+#define TL_STAGE_VERSION        1
+
+/* On-disk layout, native byte order (written and read on the same device) */
+typedef struct {
+    uint32_t magic;
+    uint32_t frame;
+    uint32_t size;
+    uint32_t reserved;
+} TLStageRecord;
+
+typedef struct {
+    uint32_t frame;
+    uint32_t offset;        /* JPEG data, past the record header */
+    uint32_t size;
+} TLStageIndexEntry;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t count;
+    uint32_t index_offset;
+    uint32_t version;
+} TLStageFooter;
+
+/* Writer statistics since tl_stage_open() */
+typedef struct {
+    int frames;             /* Frames accepted */
+    int lost;               /* Frames dropped by failed writes */
+    int segments;
+    int writes;             /* write() calls issued */
+    uint64_t payload_bytes; /* JPEG bytes accepted */
+    uint64_t file_bytes;    /* Bytes written to segment files */
+} TLStageStats;
+
+/*
+ * Start staging frames into segment files under dir.
+ * Returns 0 on success, -1 on error.
+ */
+int tl_stage_open(const char *dir);
+
+/* 1 if tl_stage_open() succeeded and tl_stage_close() has not been called */
+int tl_stage_is_open(void);
+
+/*
+ * Copy a validated JPEG into the staging ring as frame number frame.
+ * Frames must be appended in increasing order. Only blocks if the writer
+ * still has the other half of the ring in flight.
+ * Returns 0 on success, -1 if the frame cannot be staged.
+ */
+int tl_stage_append(int frame, const uint8_t *jpeg, size_t size);
+
+/*
+ * Write out everything staged, finish the open segment and stop the
+ * writer. Safe to call when not open. stats may be NULL.
+ * Returns 0 if every frame reached its segment, -1 otherwise.
+ */
+int tl_stage_close(TLStageStats *stats);
+
+/* Frame lookup over a temp dir's segments (or legacy frame files) */
+typedef struct {
+    char dir[TIMELAPSE_PATH_MAX];
+    int count;              /* Frames 0..count-1 available (renumbered) */
+    struct TLStageFrame *frames;
+    int mapped_seg;         /* Segment currently mapped, -1 if none */
+    int mapped_file;        /* Or frame_NNNN.jpg currently mapped, -1 if none */
+    uint8_t *map;
+    size_t map_size;
+} TLStageReader;
+
+/*
+ * Index the frames in dir: segments first, frame_NNNN.jpg files for any
+ * frame no segment has. Gaps (frames a failed write lost) are skipped and
+ * the rest renumbered densely in capture order, so frame n is the n-th
+ * frame that exists. Returns the number of frames (0 if none), -1 on error.
+ */
+int tl_stage_reader_open(TLStageReader *r, const char *dir);
+
+/*
+ * Get frame n. The pointer stays valid until the next call on this reader
+ * or tl_stage_reader_close(). Returns NULL if the frame cannot be read.
+ */
+const uint8_t *tl_stage_reader_frame(TLStageReader *r, int n, size_t *size);
+
+void tl_stage_reader_close(TLStageReader *r);
+
+/*
+ * Write frames 0..count-1 as dest_dir/frame_NNNN.jpg (for ffmpeg or a
+ * manual copy). Frames that already are files in dest_dir are renamed
+ * into place if a gap moved them, otherwise left alone. Exporting into
+ * the reader's own dir removes the segments once every frame is a file.
+ * The reader is only good for tl_stage_reader_close() afterwards.
+ * Returns the number of frames written.
+ */
+int tl_stage_export(TLStageReader *r, const char *dest_dir);
+
+#endif /* TIMELAPSE_STAGE_H */
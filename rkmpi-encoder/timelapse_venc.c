@@ -2,22 +2,36 @@
  * Hardware VENC-based Timelapse Encoding
  *
  * Uses RV1106 hardware H.264 encoder directly for timelapse videos.
- * Flow: JPEG -> NV12 (TurboJPEG) -> H.264 (VENC) -> MP4 (minimp4)
+ * Flow: JPEG -> NV12 (TurboJPEG) -> H.264 (VENC) -> fragmented MP4 (minimp4)
+ *
+ * Assembly of stored frames (timelapse_venc_encode_frames) decodes with the
+ * hardware JPEG decoder (VDEC) instead, handing its NV12 output block to
+ * VENC as-is. TurboJPEG remains the fallback if VDEC is unavailable or
+ * rejects a frame.
+ *
+ * Mirror/flip is done by VENC (enMirror) and the last-frame hold is one
+ * long final MP4 sample, so neither needs extra pixel work or encodes.
  */
 
 #include "timelapse_venc.h"
 #include "timelapse.h"   /* For g_timelapse.temp_dir */
+#include "frame_buffer.h" /* For FRAME_BUFFER_MAX_JPEG */
 #include "turbojpeg.h"
 #include "rk_mpi_sys.h"
 #include "rk_mpi_venc.h"
+#include "rk_mpi_vdec.h"
 #include "rk_mpi_mb.h"
 #include "rk_comm_venc.h"
+#include "rk_comm_vdec.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
 
 /* Enable minimp4 implementation - suppress warnings in third-party header */
 #define MINIMP4_IMPLEMENTATION
@@ -30,6 +44,18 @@
 /* VENC channel for timelapse - use channel 2 to avoid conflicts */
 #define VENC_CHN_TIMELAPSE  3  /* Channel 0=H.264, 1=JPEG, 2=Display, 3=Timelapse */
 
+/* VDEC channel for hardware JPEG decode during assembly (no other users) */
+#define VDEC_CHN_TIMELAPSE  0
+
+/* VDEC channel for recording thumbnails (H.264, may overlap an assembly) */
+#define VDEC_CHN_THUMB      1
+
+/* VENC input blocks: one being encoded while the next is decoded */
+#define TL_VENC_SLOTS       2
+
+/* Hardware codecs work on 16-aligned planes (1080 -> 1088 rows) */
+#define TL_ALIGN16(x)       (((x) + 15) & ~15)
+
 /* Logging */
 #define TL_LOG(fmt, ...) fprintf(stderr, "[TIMELAPSE_VENC] " fmt, ##__VA_ARGS__)
 
@@ -138,23 +164,50 @@ typedef struct {
     int initialized;
     int width;
     int height;
+    int vir_width;              /* NV12 plane stride */
+    int vir_height;             /* Rows before the chroma plane */
     int fps;
     int frame_count;
 
     /* TurboJPEG decoder */
     tjhandle tj_handle;
 
-    /* NV12 buffer for decoded frames */
-    uint8_t *nv12_buffer;
+    /* Hardware JPEG decoder. Opened on first use by encode_frames; a slot
+     * holding a VDEC frame is encoded from that frame's block instead of
+     * its own, and the frame is released once VENC is done with it. */
+    int hw_decode;              /* VDEC open and trusted */
+    int hw_decode_tried;
+    MB_POOL jpeg_pool;          /* One DMA block for the compressed input */
+    MB_BLK jpeg_blk;
+    uint8_t *jpeg_vaddr;
+    VIDEO_FRAME_INFO_S hw_frame[TL_VENC_SLOTS];
+    int hw_held[TL_VENC_SLOTS];
+    int hw_frames;              /* Decoded by VDEC */
+    int sw_frames;              /* Decoded by TurboJPEG */
+
+    /* Chroma scratch for the planar decode (Y goes straight into the MB
+     * block). Sized on the first frame, only grows if subsampling does. */
+    uint8_t *yuv_buf;
+    size_t yuv_buf_size;
     size_t nv12_size;
 
-    /* RKMPI memory pool and block for VENC input */
-    MB_POOL mb_pool;
-    MB_BLK mb_blk;
+    /* RKMPI memory pools and blocks for VENC input (NV12 written in place).
+     * One pool per slot: streaming only ever uses slot 0, the rest are
+     * allocated when encode_frames starts the pipeline. */
+    MB_POOL mb_pool[TL_VENC_SLOTS];
+    MB_BLK mb_blk[TL_VENC_SLOTS];
+    uint8_t *mb_vaddr[TL_VENC_SLOTS];
+    int slots;                  /* Slots allocated, from 0 */
+
+    /* VENC output pack descriptor, reused for every GetStream */
+    VENC_PACK_S pack;
 
-    /* Temp file for MP4 during encoding */
+    /* In-progress MP4, renamed to output_path by finish */
     FILE *temp_file;
-    char temp_path[1088];  /* TIMELAPSE_PATH_MAX (1024) + "/timelapse.mp4.tmp" + padding */
+    char temp_path[TIMELAPSE_PATH_MAX + 8];     /* output_path + ".part" */
+    char output_path[TIMELAPSE_PATH_MAX];
+    char link_path[TIMELAPSE_PATH_MAX + 16];    /* <temp_dir>/mp4_part */
+    uint64_t last_sync_us;
 
     /* minimp4 muxer */
     MP4E_mux_t *mp4_mux;
@@ -164,10 +217,68 @@ typedef struct {
     uint32_t timestamp;
     uint32_t frame_duration;
 
+    /* Newest encoded access unit (Annex B). It goes into the MP4 when the
+     * next frame arrives, or at finish with the last-frame hold added to
+     * its duration: samples are final once written in fragmented mode. */
+    uint8_t *held_au;
+    size_t held_size;
+    size_t held_cap;
+
 } TimelapseVENCState;
 
 static TimelapseVENCState g_state = {0};
 
+static uint64_t get_time_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+/* fsync the directory holding path so a create/rename survives power loss */
+static void sync_parent_dir(const char *path) {
+    char dir[TIMELAPSE_PATH_MAX];
+    const char *slash = strrchr(path, '/');
+    if (!slash || slash == path) return;
+    snprintf(dir, sizeof(dir), "%.*s", (int)(slash - path), path);
+
+    int fd = open(dir, O_RDONLY | O_DIRECTORY);
+    if (fd >= 0) {
+        fsync(fd);
+        close(fd);
+    }
+}
+
+/* Flush stdio and fsync the .part file */
+static void sync_temp_file(void) {
+    fflush(g_state.temp_file);
+    fsync(fileno(g_state.temp_file));
+    g_state.last_sync_us = get_time_us();
+}
+
+/*
+ * Record the .part path in the timelapse temp dir for orphan recovery.
+ * Skipped when no recording temp dir exists (e.g. recovery encodes).
+ */
+static void write_part_link(void) {
+    if (g_timelapse.temp_dir[0] == '\0') return;
+
+    snprintf(g_state.link_path, sizeof(g_state.link_path), "%s/%s",
+             g_timelapse.temp_dir, TIMELAPSE_VENC_PART_LINK);
+    FILE *f = fopen(g_state.link_path, "w");
+    if (!f) {
+        g_state.link_path[0] = '\0';
+        return;
+    }
+    fprintf(f, "%s\n", g_state.temp_path);
+    fclose(f);
+}
+
+static void remove_part_link(void) {
+    if (g_state.link_path[0]) {
+        unlink(g_state.link_path);
+    }
+}
+
 /* File write callback for minimp4 */
 static int mp4_write_callback(int64_t offset, const void *buffer, size_t size, void *token) {
     FILE *f = (FILE *)token;
@@ -177,8 +288,59 @@ static int mp4_write_callback(int64_t offset, const void *buffer, size_t size, v
     return fwrite(buffer, 1, size, f) != size;
 }
 
+static void release_slot(int i) {
+    if (g_state.mb_blk[i] != MB_INVALID_HANDLE) {
+        RK_MPI_MB_ReleaseMB(g_state.mb_blk[i]);
+        g_state.mb_blk[i] = MB_INVALID_HANDLE;
+    }
+    g_state.mb_vaddr[i] = NULL;
+    if (g_state.mb_pool[i] != MB_INVALID_POOLID) {
+        RK_MPI_MB_DestroyPool(g_state.mb_pool[i]);
+        g_state.mb_pool[i] = MB_INVALID_POOLID;
+    }
+}
+
+/* Create the DMA pool of the next slot and map its NV12 block */
+static int alloc_slot(void) {
+    int i = g_state.slots;
+    MB_POOL_CONFIG_S pool_cfg;
+    memset(&pool_cfg, 0, sizeof(pool_cfg));
+    pool_cfg.u64MBSize = g_state.nv12_size;
+    pool_cfg.u32MBCnt = 1;
+    pool_cfg.enAllocType = MB_ALLOC_TYPE_DMA;
+    pool_cfg.bPreAlloc = RK_TRUE;
+
+    g_state.mb_pool[i] = RK_MPI_MB_CreatePool(&pool_cfg);
+    if (g_state.mb_pool[i] == MB_INVALID_POOLID) {
+        TL_LOG("RK_MPI_MB_CreatePool failed (slot %d)\n", i);
+        return -1;
+    }
+
+    g_state.mb_blk[i] = RK_MPI_MB_GetMB(g_state.mb_pool[i], g_state.nv12_size, RK_TRUE);
+    if (g_state.mb_blk[i] == MB_INVALID_HANDLE) {
+        TL_LOG("RK_MPI_MB_GetMB failed (slot %d)\n", i);
+        release_slot(i);
+        return -1;
+    }
+    g_state.mb_vaddr[i] = (uint8_t *)RK_MPI_MB_Handle2VirAddr(g_state.mb_blk[i]);
+    if (!g_state.mb_vaddr[i]) {
+        TL_LOG("RK_MPI_MB_Handle2VirAddr returned NULL (slot %d)\n", i);
+        release_slot(i);
+        return -1;
+    }
+    g_state.slots++;
+    return 0;
+}
+
+static void release_slots(void) {
+    for (int i = 0; i < TL_VENC_SLOTS; i++) {
+        release_slot(i);
+    }
+    g_state.slots = 0;
+}
+
 /* Initialize VENC channel for timelapse H.264 encoding */
-static int init_venc_timelapse(int width, int height, int fps) {
+static int init_venc_timelapse(int width, int height, int fps, MIRROR_E mirror) {
     RK_S32 ret;
     VENC_CHN_ATTR_S attr;
     VENC_RECV_PIC_PARAM_S recv_param;
@@ -191,10 +353,11 @@ static int init_venc_timelapse(int width, int height, int fps) {
     attr.stVencAttr.u32Profile = H264E_PROFILE_HIGH;
     attr.stVencAttr.u32PicWidth = width;
     attr.stVencAttr.u32PicHeight = height;
-    attr.stVencAttr.u32VirWidth = width;
-    attr.stVencAttr.u32VirHeight = height;
+    attr.stVencAttr.u32VirWidth = g_state.vir_width;
+    attr.stVencAttr.u32VirHeight = g_state.vir_height;
     attr.stVencAttr.u32StreamBufCnt = 2;
     attr.stVencAttr.u32BufSize = width * height * 3 / 2;
+    attr.stVencAttr.enMirror = mirror;  /* Applied by the encoder's input stage */
 
     /* VBR rate control - good quality for timelapse */
     attr.stRcAttr.enRcMode = VENC_RC_MODE_H264VBR;
@@ -211,6 +374,12 @@ static int init_venc_timelapse(int width, int height, int fps) {
     attr.stGopAttr.s32VirIdrLen = 0;
 
     ret = RK_MPI_VENC_CreateChn(VENC_CHN_TIMELAPSE, &attr);
+    if (ret != RK_SUCCESS && mirror != MIRROR_NONE) {
+        TL_LOG("RK_MPI_VENC_CreateChn with mirror %d failed: 0x%x, encoding unflipped\n",
+               mirror, ret);
+        attr.stVencAttr.enMirror = MIRROR_NONE;
+        ret = RK_MPI_VENC_CreateChn(VENC_CHN_TIMELAPSE, &attr);
+    }
     if (ret != RK_SUCCESS) {
         TL_LOG("RK_MPI_VENC_CreateChn failed: 0x%x\n", ret);
         return -1;
@@ -226,7 +395,8 @@ static int init_venc_timelapse(int width, int height, int fps) {
         return -1;
     }
 
-    TL_LOG("VENC initialized: %dx%d @ %dfps\n", width, height, fps);
+    TL_LOG("VENC initialized: %dx%d @ %dfps, mirror %d\n",
+           width, height, fps, attr.stVencAttr.enMirror);
     return 0;
 }
 
@@ -235,15 +405,191 @@ static void cleanup_venc_timelapse(void) {
     RK_MPI_VENC_DestroyChn(VENC_CHN_TIMELAPSE);
 }
 
-int timelapse_venc_init(int width, int height, int fps) {
+/*
+ * Open the VDEC channel for JPEG -> NV12 decode.
+ * Returns 0 on success, -1 if hardware decode is unavailable.
+ */
+static int init_vdec_timelapse(void) {
+    RK_S32 ret;
+
+    /* Compressed input has to be in DMA memory for the decoder */
+    MB_POOL_CONFIG_S pool_cfg;
+    memset(&pool_cfg, 0, sizeof(pool_cfg));
+    pool_cfg.u64MBSize = FRAME_BUFFER_MAX_JPEG;
+    pool_cfg.u32MBCnt = 1;
+    pool_cfg.enAllocType = MB_ALLOC_TYPE_DMA;
+    pool_cfg.bPreAlloc = RK_TRUE;
+
+    g_state.jpeg_pool = RK_MPI_MB_CreatePool(&pool_cfg);
+    if (g_state.jpeg_pool == MB_INVALID_POOLID) {
+        TL_LOG("VDEC: input pool failed\n");
+        return -1;
+    }
+    g_state.jpeg_blk = RK_MPI_MB_GetMB(g_state.jpeg_pool, FRAME_BUFFER_MAX_JPEG, RK_TRUE);
+    g_state.jpeg_vaddr = g_state.jpeg_blk != MB_INVALID_HANDLE ?
+        (uint8_t *)RK_MPI_MB_Handle2VirAddr(g_state.jpeg_blk) : NULL;
+    if (!g_state.jpeg_vaddr) {
+        TL_LOG("VDEC: input block failed\n");
+        goto fail_pool;
+    }
+
+    VDEC_CHN_ATTR_S attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.enMode = VIDEO_MODE_FRAME;
+    attr.enType = RK_VIDEO_ID_MJPEG;
+    attr.u32PicWidth = g_state.width;
+    attr.u32PicHeight = g_state.height;
+    attr.u32PicVirWidth = g_state.vir_width;
+    attr.u32PicVirHeight = g_state.vir_height;
+    attr.u32StreamBufCnt = 1;
+    attr.u32StreamBufSize = FRAME_BUFFER_MAX_JPEG;
+    /* One frame per VENC slot plus the one being decoded */
+    attr.u32FrameBufCnt = TL_VENC_SLOTS + 1;
+    /* Room for 4:2:2 output in case the decoder converts after writing */
+    attr.u32FrameBufSize = g_state.vir_width * g_state.vir_height * 2;
+
+    ret = RK_MPI_VDEC_CreateChn(VDEC_CHN_TIMELAPSE, &attr);
+    if (ret != RK_SUCCESS) {
+        TL_LOG("VDEC: RK_MPI_VDEC_CreateChn failed: 0x%x\n", ret);
+        goto fail_pool;
+    }
+
+    VDEC_CHN_PARAM_S param;
+    memset(&param, 0, sizeof(param));
+    ret = RK_MPI_VDEC_GetChnParam(VDEC_CHN_TIMELAPSE, &param);
+    if (ret == RK_SUCCESS) {
+        param.stVdecPictureParam.enPixelFormat = RK_FMT_YUV420SP;
+        ret = RK_MPI_VDEC_SetChnParam(VDEC_CHN_TIMELAPSE, &param);
+    }
+    if (ret != RK_SUCCESS) {
+        TL_LOG("VDEC: cannot select NV12 output: 0x%x\n", ret);
+        goto fail_chn;
+    }
+
+    /* Playback mode: wait for a free frame buffer instead of dropping */
+    RK_MPI_VDEC_SetDisplayMode(VDEC_CHN_TIMELAPSE, VIDEO_DISPLAY_MODE_PLAYBACK);
+
+    ret = RK_MPI_VDEC_StartRecvStream(VDEC_CHN_TIMELAPSE);
+    if (ret != RK_SUCCESS) {
+        TL_LOG("VDEC: RK_MPI_VDEC_StartRecvStream failed: 0x%x\n", ret);
+        goto fail_chn;
+    }
+
+    TL_LOG("VDEC initialized: hardware JPEG decode %dx%d\n", g_state.width, g_state.height);
+    return 0;
+
+fail_chn:
+    RK_MPI_VDEC_DestroyChn(VDEC_CHN_TIMELAPSE);
+fail_pool:
+    if (g_state.jpeg_blk != MB_INVALID_HANDLE) {
+        RK_MPI_MB_ReleaseMB(g_state.jpeg_blk);
+        g_state.jpeg_blk = MB_INVALID_HANDLE;
+    }
+    g_state.jpeg_vaddr = NULL;
+    RK_MPI_MB_DestroyPool(g_state.jpeg_pool);
+    g_state.jpeg_pool = MB_INVALID_POOLID;
+    return -1;
+}
+
+static void cleanup_vdec_timelapse(void) {
+    if (!g_state.hw_decode_tried) {
+        return;
+    }
+    for (int i = 0; i < TL_VENC_SLOTS; i++) {
+        if (g_state.hw_held[i]) {
+            RK_MPI_VDEC_ReleaseFrame(VDEC_CHN_TIMELAPSE, &g_state.hw_frame[i]);
+            g_state.hw_held[i] = 0;
+        }
+    }
+    if (g_state.jpeg_vaddr) {
+        RK_MPI_VDEC_StopRecvStream(VDEC_CHN_TIMELAPSE);
+        RK_MPI_VDEC_DestroyChn(VDEC_CHN_TIMELAPSE);
+        RK_MPI_MB_ReleaseMB(g_state.jpeg_blk);
+        RK_MPI_MB_DestroyPool(g_state.jpeg_pool);
+        g_state.jpeg_vaddr = NULL;
+    }
+    g_state.hw_decode = 0;
+}
+
+/* Stop using VDEC for the rest of this timelapse (TurboJPEG from here on).
+ * The channel stays open until cleanup: the encode thread may still be
+ * releasing frames into it. */
+static void disable_hw_decode(const char *why) {
+    TL_LOG("VDEC: %s, using TurboJPEG for the remaining frames\n", why);
+    g_state.hw_decode = 0;
+}
+
+/*
+ * Decode a JPEG with VDEC and park the NV12 frame in the slot.
+ * Returns 0 on success, -1 if the frame needs the software decoder.
+ */
+static int hw_decode_to_slot(const uint8_t *jpeg_data, size_t jpeg_size, int slot) {
+    memcpy(g_state.jpeg_vaddr, jpeg_data, jpeg_size);
+    RK_MPI_SYS_MmzFlushCache(g_state.jpeg_blk, RK_FALSE);
+
+    VDEC_STREAM_S stream;
+    memset(&stream, 0, sizeof(stream));
+    stream.pMbBlk = g_state.jpeg_blk;
+    stream.u32Len = jpeg_size;
+    stream.u64PTS = g_state.hw_frames;
+    stream.bEndOfFrame = RK_TRUE;
+    stream.bBypassMbBlk = RK_FALSE;
+
+    RK_S32 ret = RK_MPI_VDEC_SendStream(VDEC_CHN_TIMELAPSE, &stream, 1000);
+    if (ret != RK_SUCCESS) {
+        TL_LOG("RK_MPI_VDEC_SendStream failed: 0x%x\n", ret);
+        disable_hw_decode("send failed");
+        return -1;
+    }
+
+    VIDEO_FRAME_INFO_S *frame = &g_state.hw_frame[slot];
+    memset(frame, 0, sizeof(*frame));
+    ret = RK_MPI_VDEC_GetFrame(VDEC_CHN_TIMELAPSE, frame, 1000);
+    if (ret != RK_SUCCESS) {
+        /* A late frame would come out paired with the next JPEG, so
+         * don't try again on this channel */
+        TL_LOG("RK_MPI_VDEC_GetFrame failed: 0x%x\n", ret);
+        disable_hw_decode("no frame");
+        return -1;
+    }
+
+    /* VENC is set up for NV12 at our stride; anything else goes to software */
+    if (frame->stVFrame.enPixelFormat != RK_FMT_YUV420SP ||
+        (int)frame->stVFrame.u32Width != g_state.width ||
+        (int)frame->stVFrame.u32Height != g_state.height ||
+        (int)frame->stVFrame.u32VirWidth != g_state.vir_width ||
+        (int)frame->stVFrame.u32VirHeight != g_state.vir_height) {
+        TL_LOG("VDEC frame fmt=%d %ux%u (vir %ux%u), expected NV12 %dx%d (vir %dx%d)\n",
+               frame->stVFrame.enPixelFormat,
+               frame->stVFrame.u32Width, frame->stVFrame.u32Height,
+               frame->stVFrame.u32VirWidth, frame->stVFrame.u32VirHeight,
+               g_state.width, g_state.height, g_state.vir_width, g_state.vir_height);
+        RK_MPI_VDEC_ReleaseFrame(VDEC_CHN_TIMELAPSE, frame);
+        disable_hw_decode("unexpected output format");
+        return -1;
+    }
+
+    g_state.hw_held[slot] = 1;
+    g_state.hw_frames++;
+    return 0;
+}
+
+int timelapse_venc_init(int width, int height, int fps, int flip_x, int flip_y,
+                        const char *output_path) {
     if (g_state.initialized) {
         TL_LOG("Already initialized\n");
         return -1;
     }
+    if (!output_path || strlen(output_path) >= TIMELAPSE_PATH_MAX) {
+        TL_LOG("Invalid output path\n");
+        return -1;
+    }
 
     memset(&g_state, 0, sizeof(g_state));
     g_state.width = width;
     g_state.height = height;
+    g_state.vir_width = TL_ALIGN16(width);
+    g_state.vir_height = TL_ALIGN16(height);
     g_state.fps = fps;
 
     /* Calculate frame duration in 90kHz timescale */
@@ -256,74 +602,48 @@ int timelapse_venc_init(int width, int height, int fps) {
         return -1;
     }
 
-    /* Allocate NV12 buffer */
-    g_state.nv12_size = width * height * 3 / 2;
-    g_state.nv12_buffer = (uint8_t *)malloc(g_state.nv12_size);
-    if (!g_state.nv12_buffer) {
-        TL_LOG("Failed to allocate NV12 buffer\n");
-        tjDestroy(g_state.tj_handle);
-        return -1;
-    }
-
-    /* Create RKMPI memory pool for VENC input */
-    MB_POOL_CONFIG_S pool_cfg;
-    memset(&pool_cfg, 0, sizeof(pool_cfg));
-    pool_cfg.u64MBSize = g_state.nv12_size;
-    pool_cfg.u32MBCnt = 2;  /* Double buffer */
-    pool_cfg.enAllocType = MB_ALLOC_TYPE_DMA;
-    pool_cfg.bPreAlloc = RK_TRUE;
+    g_state.nv12_size = g_state.vir_width * g_state.vir_height * 3 / 2;
 
-    g_state.mb_pool = RK_MPI_MB_CreatePool(&pool_cfg);
-    if (g_state.mb_pool == MB_INVALID_POOLID) {
-        TL_LOG("RK_MPI_MB_CreatePool failed\n");
-        free(g_state.nv12_buffer);
-        tjDestroy(g_state.tj_handle);
-        return -1;
+    /* Create the first VENC input slot; encode_frames adds the rest */
+    for (int i = 0; i < TL_VENC_SLOTS; i++) {
+        g_state.mb_pool[i] = MB_INVALID_POOLID;
     }
-
-    /* Get a memory block from the pool */
-    g_state.mb_blk = RK_MPI_MB_GetMB(g_state.mb_pool, g_state.nv12_size, RK_TRUE);
-    if (g_state.mb_blk == MB_INVALID_HANDLE) {
-        TL_LOG("RK_MPI_MB_GetMB failed\n");
-        RK_MPI_MB_DestroyPool(g_state.mb_pool);
-        free(g_state.nv12_buffer);
+    if (alloc_slot() != 0) {
         tjDestroy(g_state.tj_handle);
         return -1;
     }
 
     /* Initialize VENC */
-    if (init_venc_timelapse(width, height, fps) != 0) {
-        RK_MPI_MB_ReleaseMB(g_state.mb_blk);
-        RK_MPI_MB_DestroyPool(g_state.mb_pool);
-        free(g_state.nv12_buffer);
+    MIRROR_E mirror = flip_x ? (flip_y ? MIRROR_BOTH : MIRROR_HORIZONTAL)
+                             : (flip_y ? MIRROR_VERTICAL : MIRROR_NONE);
+    if (init_venc_timelapse(width, height, fps, mirror) != 0) {
+        release_slots();
         tjDestroy(g_state.tj_handle);
         return -1;
     }
 
-    /* Create temp file for MP4 in the same directory as frames
-     * (avoids /tmp which may be in RAM and run out of space for long timelapses) */
-    const char *temp_dir = g_timelapse.temp_dir[0] ? g_timelapse.temp_dir : "/tmp";
+    /* Write next to the final file so finish is a same-filesystem rename
+     * (output may be on USB; /tmp is RAM and too small for long timelapses) */
+    snprintf(g_state.output_path, sizeof(g_state.output_path), "%s", output_path);
     snprintf(g_state.temp_path, sizeof(g_state.temp_path),
-             "%s/timelapse.mp4.tmp", temp_dir);
+             "%s" TIMELAPSE_VENC_PART_EXT, output_path);
     g_state.temp_file = fopen(g_state.temp_path, "wb+");
     if (!g_state.temp_file) {
         TL_LOG("Failed to create temp file: %s\n", strerror(errno));
         cleanup_venc_timelapse();
-        RK_MPI_MB_ReleaseMB(g_state.mb_blk); RK_MPI_MB_DestroyPool(g_state.mb_pool);
-        free(g_state.nv12_buffer);
+        release_slots();
         tjDestroy(g_state.tj_handle);
         return -1;
     }
 
     /* Initialize minimp4 muxer */
-    g_state.mp4_mux = MP4E_open(0, 0, g_state.temp_file, mp4_write_callback);
+    g_state.mp4_mux = MP4E_open(0, 1, g_state.temp_file, mp4_write_callback);
     if (!g_state.mp4_mux) {
         TL_LOG("MP4E_open failed\n");
         fclose(g_state.temp_file);
         unlink(g_state.temp_path);
         cleanup_venc_timelapse();
-        RK_MPI_MB_ReleaseMB(g_state.mb_blk); RK_MPI_MB_DestroyPool(g_state.mb_pool);
-        free(g_state.nv12_buffer);
+        release_slots();
         tjDestroy(g_state.tj_handle);
         return -1;
     }
@@ -335,14 +655,17 @@ int timelapse_venc_init(int width, int height, int fps) {
         fclose(g_state.temp_file);
         unlink(g_state.temp_path);
         cleanup_venc_timelapse();
-        RK_MPI_MB_ReleaseMB(g_state.mb_blk); RK_MPI_MB_DestroyPool(g_state.mb_pool);
-        free(g_state.nv12_buffer);
+        release_slots();
         tjDestroy(g_state.tj_handle);
         return -1;
     }
 
-    TL_LOG("MP4 writer initialized, temp file: %s\n", g_state.temp_path);
+    write_part_link();
+    sync_parent_dir(g_state.temp_path);
+
+    TL_LOG("MP4 writer initialized (fragmented), temp file: %s\n", g_state.temp_path);
     g_state.initialized = 1;
+    g_state.last_sync_us = get_time_us();
     g_state.frame_count = 0;
     g_state.timestamp = 0;
 
@@ -350,12 +673,11 @@ int timelapse_venc_init(int width, int height, int fps) {
     return 0;
 }
 
-int timelapse_venc_add_frame(const uint8_t *jpeg_data, size_t jpeg_size) {
-    if (!g_state.initialized) {
-        TL_LOG("Not initialized\n");
-        return -1;
-    }
-
+/*
+ * Decode a JPEG into a slot: VDEC when open, otherwise TurboJPEG into the
+ * slot's NV12 block. Returns 0 on success, -1 if the frame is unusable.
+ */
+static int decode_to_slot(const uint8_t *jpeg_data, size_t jpeg_size, int slot) {
     /* Validate JPEG data before processing */
     if (!validate_jpeg(jpeg_data, jpeg_size)) {
         TL_LOG("Invalid JPEG data (size=%zu, starts=%02x%02x)\n",
@@ -388,9 +710,16 @@ int timelapse_venc_add_frame(const uint8_t *jpeg_data, size_t jpeg_size) {
         return -1;
     }
 
+    /* VDEC input goes through the one FRAME_BUFFER_MAX_JPEG block */
+    if (g_state.hw_decode && jpeg_size <= FRAME_BUFFER_MAX_JPEG &&
+        hw_decode_to_slot(jpeg_data, jpeg_size, slot) == 0) {
+        return 0;
+    }
+    g_state.sw_frames++;
+
     /* Calculate buffer sizes based on ACTUAL subsampling
      * Bug fix: 4:2:2 JPEG has double the UV data compared to 4:2:0/NV12 */
-    int y_size = g_state.width * g_state.height;
+    int y_size = g_state.vir_width * g_state.vir_height;
     int uv_height, uv_stride;
 
     switch (tj_subsamp) {
@@ -413,23 +742,27 @@ int timelapse_venc_add_frame(const uint8_t *jpeg_data, size_t jpeg_size) {
     }
 
     int uv_plane_size = uv_stride * uv_height;
-    size_t yuv_buf_size = y_size + 2 * uv_plane_size;
+    size_t chroma_size = 2 * (size_t)uv_plane_size;
 
-    /* Allocate buffer for decoded YUV (may be larger than NV12 for 4:2:2) */
-    uint8_t *yuv_buf = (uint8_t *)malloc(yuv_buf_size);
-    if (!yuv_buf) {
-        TL_LOG("Failed to allocate YUV buffer (%zu bytes)\n", yuv_buf_size);
-        return -1;
+    /* Chroma scratch (may be larger than NV12 chroma for 4:2:2/4:4:4) */
+    if (chroma_size > g_state.yuv_buf_size) {
+        uint8_t *buf = (uint8_t *)realloc(g_state.yuv_buf, chroma_size);
+        if (!buf) {
+            TL_LOG("Failed to allocate chroma buffer (%zu bytes)\n", chroma_size);
+            return -1;
+        }
+        g_state.yuv_buf = buf;
+        g_state.yuv_buf_size = chroma_size;
     }
 
-    /* Set up planes based on actual subsampling */
+    /* Y decodes straight into the VENC input block; U/V go to scratch */
     uint8_t *planes[3] = {
-        yuv_buf,                          /* Y */
-        yuv_buf + y_size,                 /* U */
-        yuv_buf + y_size + uv_plane_size  /* V */
+        g_state.mb_vaddr[slot],                 /* Y */
+        g_state.yuv_buf,                        /* U */
+        g_state.yuv_buf + uv_plane_size         /* V */
     };
     int strides[3] = {
-        g_state.width,   /* Y stride */
+        g_state.vir_width,  /* Y stride */
         uv_stride,       /* U stride */
         uv_stride        /* V stride */
     };
@@ -445,29 +778,30 @@ int timelapse_venc_add_frame(const uint8_t *jpeg_data, size_t jpeg_size) {
                jpeg_size > 1001 ? jpeg_data[1001] : 0,
                jpeg_size > 1002 ? jpeg_data[1002] : 0,
                jpeg_size > 1003 ? jpeg_data[1003] : 0);
-        free(yuv_buf);
         return -1;
     }
 
-    /* Convert YUV to NV12 (4:2:0 with interleaved UV) */
-    /* Y plane: copy directly */
-    memcpy(g_state.nv12_buffer, yuv_buf, y_size);
-
-    /* UV plane: convert to NV12 format
+    /* UV plane: convert to NV12 format in the MB block
      * For 4:2:0: just interleave U and V
      * For 4:2:2: subsample vertically by 2, then interleave */
-    uint8_t *nv12_uv = g_state.nv12_buffer + y_size;
-    uint8_t *src_u = yuv_buf + y_size;
-    uint8_t *src_v = yuv_buf + y_size + uv_plane_size;
+    uint8_t *nv12_uv = g_state.mb_vaddr[slot] + y_size;
+    uint8_t *src_u = g_state.yuv_buf;
+    uint8_t *src_v = g_state.yuv_buf + uv_plane_size;
 
     int nv12_uv_width = g_state.width / 2;
     int nv12_uv_height = g_state.height / 2;
 
     if (tj_subsamp == TJSAMP_420) {
         /* 4:2:0: direct interleave */
-        for (int i = 0; i < nv12_uv_width * nv12_uv_height; i++) {
-            nv12_uv[i * 2] = src_u[i];
-            nv12_uv[i * 2 + 1] = src_v[i];
+        for (int y = 0; y < nv12_uv_height; y++) {
+            uint8_t *u_row = src_u + y * uv_stride;
+            uint8_t *v_row = src_v + y * uv_stride;
+            uint8_t *nv12_row = nv12_uv + y * g_state.vir_width;
+
+            for (int x = 0; x < nv12_uv_width; x++) {
+                nv12_row[x * 2] = u_row[x];
+                nv12_row[x * 2 + 1] = v_row[x];
+            }
         }
     } else if (tj_subsamp == TJSAMP_422) {
         /* 4:2:2: vertically subsample by 2 (average two rows), then interleave */
@@ -476,7 +810,7 @@ int timelapse_venc_add_frame(const uint8_t *jpeg_data, size_t jpeg_size) {
             uint8_t *u_row1 = src_u + (y * 2 + 1) * uv_stride;
             uint8_t *v_row0 = src_v + (y * 2) * uv_stride;
             uint8_t *v_row1 = src_v + (y * 2 + 1) * uv_stride;
-            uint8_t *nv12_row = nv12_uv + y * g_state.width;
+            uint8_t *nv12_row = nv12_uv + y * g_state.vir_width;
 
             for (int x = 0; x < nv12_uv_width; x++) {
                 /* Average two vertical samples */
@@ -491,7 +825,7 @@ int timelapse_venc_add_frame(const uint8_t *jpeg_data, size_t jpeg_size) {
             uint8_t *u_row1 = src_u + (y * 2 + 1) * g_state.width;
             uint8_t *v_row0 = src_v + (y * 2) * g_state.width;
             uint8_t *v_row1 = src_v + (y * 2 + 1) * g_state.width;
-            uint8_t *nv12_row = nv12_uv + y * g_state.width;
+            uint8_t *nv12_row = nv12_uv + y * g_state.vir_width;
 
             for (int x = 0; x < nv12_uv_width; x++) {
                 /* Average 2x2 block */
@@ -503,54 +837,95 @@ int timelapse_venc_add_frame(const uint8_t *jpeg_data, size_t jpeg_size) {
         }
     }
 
-    free(yuv_buf);
+    /* Sync memory for hardware access */
+    RK_MPI_SYS_MmzFlushCache(g_state.mb_blk[slot], RK_FALSE);
 
-    /* Copy NV12 to RKMPI memory block */
-    void *mb_vaddr = RK_MPI_MB_Handle2VirAddr(g_state.mb_blk);
-    if (!mb_vaddr) {
-        TL_LOG("RK_MPI_MB_Handle2VirAddr returned NULL\n");
-        return -1;
+    return 0;
+}
+
+/* Hand a slot's VDEC frame back once VENC has consumed it */
+static void release_hw_frame(int slot) {
+    if (g_state.hw_held[slot]) {
+        RK_MPI_VDEC_ReleaseFrame(VDEC_CHN_TIMELAPSE, &g_state.hw_frame[slot]);
+        g_state.hw_held[slot] = 0;
     }
-    memcpy(mb_vaddr, g_state.nv12_buffer, g_state.nv12_size);
+}
 
-    /* Sync memory for hardware access */
-    RK_MPI_SYS_MmzFlushCache(g_state.mb_blk, RK_FALSE);
+/* Append NAL units to the held access unit. Returns 0 on success. */
+static int hold_nal(const uint8_t *data, size_t size) {
+    if (g_state.held_size + size > g_state.held_cap) {
+        size_t cap = g_state.held_cap ? g_state.held_cap : 64 * 1024;
+        while (cap < g_state.held_size + size) cap *= 2;
+        uint8_t *buf = (uint8_t *)realloc(g_state.held_au, cap);
+        if (!buf) {
+            return -1;
+        }
+        g_state.held_au = buf;
+        g_state.held_cap = cap;
+    }
+    memcpy(g_state.held_au + g_state.held_size, data, size);
+    g_state.held_size += size;
+    return 0;
+}
 
+/* Write the held access unit to the MP4 as one sample of duration */
+static void write_held_au(uint32_t duration) {
+    if (g_state.held_size == 0) {
+        return;
+    }
+    int mp4_ret = mp4_h26x_write_nal(&g_state.mp4_writer, g_state.held_au,
+                                     (int)g_state.held_size, duration);
+    if (mp4_ret != MP4E_STATUS_OK) {
+        TL_LOG("mp4_h26x_write_nal failed: %d\n", mp4_ret);
+    }
+    g_state.held_size = 0;
+}
+
+/*
+ * Encode the NV12 block of a slot and append it to the MP4 (VENC stage).
+ * Returns 0 on success, -1 on failure.
+ */
+static int encode_slot(int slot) {
     /* Create video frame for VENC */
     VIDEO_FRAME_INFO_S frame;
     memset(&frame, 0, sizeof(frame));
     frame.stVFrame.u32Width = g_state.width;
     frame.stVFrame.u32Height = g_state.height;
-    frame.stVFrame.u32VirWidth = g_state.width;
-    frame.stVFrame.u32VirHeight = g_state.height;
+    frame.stVFrame.u32VirWidth = g_state.vir_width;
+    frame.stVFrame.u32VirHeight = g_state.vir_height;
     frame.stVFrame.enPixelFormat = RK_FMT_YUV420SP;
     frame.stVFrame.enCompressMode = COMPRESS_MODE_NONE;
-    frame.stVFrame.pMbBlk = g_state.mb_blk;
+    frame.stVFrame.pMbBlk = g_state.mb_blk[slot];
+
+    /* VDEC output is already NV12 in DMA memory: encode from it directly */
+    if (g_state.hw_held[slot]) {
+        frame.stVFrame.pMbBlk = g_state.hw_frame[slot].stVFrame.pMbBlk;
+    }
 
     /* Send frame to VENC */
     RK_S32 ret = RK_MPI_VENC_SendFrame(VENC_CHN_TIMELAPSE, &frame, 1000);
     if (ret != RK_SUCCESS) {
         TL_LOG("RK_MPI_VENC_SendFrame failed: 0x%x\n", ret);
+        release_hw_frame(slot);
         return -1;
     }
 
-    /* Get encoded H.264 stream - MUST allocate pstPack before calling GetStream */
+    /* Get encoded H.264 stream - pstPack MUST point at a pack before GetStream */
     VENC_STREAM_S stream;
     memset(&stream, 0, sizeof(stream));
-    stream.pstPack = malloc(sizeof(VENC_PACK_S));
-    if (!stream.pstPack) {
-        TL_LOG("Failed to allocate stream pack\n");
-        return -1;
-    }
+    stream.pstPack = &g_state.pack;
 
     ret = RK_MPI_VENC_GetStream(VENC_CHN_TIMELAPSE, &stream, 1000);
+    release_hw_frame(slot);
     if (ret != RK_SUCCESS) {
         TL_LOG("RK_MPI_VENC_GetStream failed: 0x%x\n", ret);
-        free(stream.pstPack);
         return -1;
     }
 
-    /* Write H.264 NAL units to MP4 */
+    /* The previous frame now has its final duration */
+    write_held_au(g_state.frame_duration);
+
+    /* Hold this frame's H.264 NAL units until the next one */
     if (stream.pstPack && stream.u32PackCount > 0) {
         for (RK_U32 i = 0; i < stream.u32PackCount; i++) {
             VENC_PACK_S *pack = &stream.pstPack[i];
@@ -569,18 +944,27 @@ int timelapse_venc_add_frame(const uint8_t *jpeg_data, size_t jpeg_size) {
                 TL_LOG("First frame: size=%d bytes (keyframe)\n", size);
             }
 
-            /* Write NAL to MP4 with constant frame duration (not accumulating timestamp) */
-            int mp4_ret = mp4_h26x_write_nal(&g_state.mp4_writer, data, size,
-                                              g_state.frame_duration);
-            if (mp4_ret != MP4E_STATUS_OK) {
-                TL_LOG("mp4_h26x_write_nal failed: %d\n", mp4_ret);
+            if (hold_nal(data, size) != 0) {
+                /* No room to hold it: write now (in order) with the normal duration */
+                write_held_au(g_state.frame_duration);
+                int mp4_ret = mp4_h26x_write_nal(&g_state.mp4_writer, data, size,
+                                                  g_state.frame_duration);
+                if (mp4_ret != MP4E_STATUS_OK) {
+                    TL_LOG("mp4_h26x_write_nal failed: %d\n", mp4_ret);
+                }
             }
         }
     }
 
     /* Release stream buffer */
     RK_MPI_VENC_ReleaseStream(VENC_CHN_TIMELAPSE, &stream);
-    free(stream.pstPack);
+
+    /* Push the fragment out of stdio so a process crash loses at most this
+     * frame; fsync periodically to bound the loss on power failure */
+    fflush(g_state.temp_file);
+    if (get_time_us() - g_state.last_sync_us >= TIMELAPSE_VENC_SYNC_US) {
+        sync_temp_file();
+    }
 
     g_state.frame_count++;
 
@@ -591,84 +975,234 @@ int timelapse_venc_add_frame(const uint8_t *jpeg_data, size_t jpeg_size) {
     return 0;
 }
 
-int timelapse_venc_finish(const char *output_path) {
+int timelapse_venc_add_frame(const uint8_t *jpeg_data, size_t jpeg_size) {
     if (!g_state.initialized) {
         TL_LOG("Not initialized\n");
         return -1;
     }
 
-    TL_LOG("Finishing timelapse: %d frames, output=%s\n", g_state.frame_count, output_path);
+    if (decode_to_slot(jpeg_data, jpeg_size, 0) != 0) {
+        return -1;
+    }
+    return encode_slot(0);
+}
 
-    /* Check temp file size before close */
-    long temp_size = 0;
-    if (g_state.temp_file) {
-        fflush(g_state.temp_file);
-        fseek(g_state.temp_file, 0, SEEK_END);
-        temp_size = ftell(g_state.temp_file);
-        TL_LOG("Temp file size before close: %ld bytes\n", temp_size);
+/*
+ * Decode/encode pipeline for timelapse_venc_encode_frames().
+ * The caller's thread fetches and decodes frame N+1 into a free slot while
+ * the encode thread has frame N in the hardware encoder. Slots are handed
+ * over in frame order through a small FIFO.
+ */
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int queue[TL_VENC_SLOTS];   /* Decoded slots waiting for VENC, in order */
+    int head;
+    int count;
+    int busy[TL_VENC_SLOTS];    /* Slot is queued or being encoded */
+    int done;                   /* Producer finished queueing */
+    int encoded;                /* Frames through the encode stage */
+    int errors;
+} TLPipeline;
+
+static void *encode_thread_func(void *arg) {
+    TLPipeline *p = (TLPipeline *)arg;
+
+    pthread_mutex_lock(&p->lock);
+    for (;;) {
+        while (p->count == 0 && !p->done) {
+            pthread_cond_wait(&p->cond, &p->lock);
+        }
+        if (p->count == 0) {
+            break;
+        }
+        int slot = p->queue[p->head];
+        pthread_mutex_unlock(&p->lock);
+
+        int ret = encode_slot(slot);
+
+        pthread_mutex_lock(&p->lock);
+        p->head = (p->head + 1) % TL_VENC_SLOTS;
+        p->count--;
+        p->busy[slot] = 0;
+        p->encoded++;
+        if (ret != 0) {
+            p->errors++;
+        }
+        pthread_cond_broadcast(&p->cond);
     }
+    pthread_mutex_unlock(&p->lock);
+    return NULL;
+}
 
-    /* Close MP4 writer and muxer */
-    TL_LOG("Closing MP4 writer...\n");
-    mp4_h26x_write_close(&g_state.mp4_writer);
+int timelapse_venc_encode_frames(int count, timelapse_venc_frame_cb get_frame,
+                                 void *frame_arg,
+                                 timelapse_venc_progress_cb progress, void *arg) {
+    if (!g_state.initialized) {
+        TL_LOG("Not initialized\n");
+        return -1;
+    }
 
-    TL_LOG("Closing MP4 muxer...\n");
-    int mp4_ret = MP4E_close(g_state.mp4_mux);
-    if (mp4_ret != MP4E_STATUS_OK) {
-        TL_LOG("MP4E_close failed: %d\n", mp4_ret);
+    /* Hardware decode only for assembly: during a print the CPU cost of one
+     * decode per capture is small and CMA is needed by fault detection */
+    if (!g_state.hw_decode_tried) {
+        g_state.hw_decode_tried = 1;
+        g_state.hw_decode = init_vdec_timelapse() == 0;
+        if (!g_state.hw_decode) {
+            TL_LOG("Hardware JPEG decode unavailable, using TurboJPEG\n");
+        }
     }
-    g_state.mp4_mux = NULL;
 
-    /* Check temp file size after MP4 close */
-    if (g_state.temp_file) {
-        fflush(g_state.temp_file);
-        fseek(g_state.temp_file, 0, SEEK_END);
-        long final_size = ftell(g_state.temp_file);
-        TL_LOG("Temp file size after MP4 close: %ld bytes\n", final_size);
+    /* Decode can only run ahead of the encoder with a second slot. Without
+     * one the pipeline still works, a frame at a time */
+    while (g_state.slots < TL_VENC_SLOTS) {
+        if (alloc_slot() != 0) {
+            TL_LOG("Using %d of %d encode slots\n", g_state.slots, TL_VENC_SLOTS);
+            break;
+        }
     }
 
-    /* Close temp file */
-    TL_LOG("Closing temp file...\n");
-    fclose(g_state.temp_file);
-    g_state.temp_file = NULL;
+    TLPipeline p;
+    memset(&p, 0, sizeof(p));
+    pthread_mutex_init(&p.lock, NULL);
+    pthread_cond_init(&p.cond, NULL);
+
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, encode_thread_func, &p) != 0) {
+        /* No thread: same work, one frame at a time */
+        TL_LOG("Encode thread failed: %s, encoding sequentially\n", strerror(errno));
+        int errors = 0;
+        for (int i = 0; i < count; i++) {
+            size_t size;
+            const uint8_t *data = get_frame(i, &size, frame_arg);
+            if (!data || timelapse_venc_add_frame(data, size) != 0) {
+                errors++;
+            }
+            if (progress) progress(i + 1, count, errors, arg);
+        }
+        pthread_cond_destroy(&p.cond);
+        pthread_mutex_destroy(&p.lock);
+        return errors;
+    }
 
-    /* Move temp file to final location */
-    if (rename(g_state.temp_path, output_path) != 0) {
-        /* rename() may fail across filesystems, try copy */
-        TL_LOG("rename failed, trying copy: %s\n", strerror(errno));
-
-        FILE *src = fopen(g_state.temp_path, "rb");
-        FILE *dst = fopen(output_path, "wb");
-        if (src && dst) {
-            char buf[8192];
-            size_t n;
-            while ((n = fread(buf, 1, sizeof(buf), src)) > 0) {
-                fwrite(buf, 1, n, dst);
+    int decode_errors = 0;
+    for (int i = 0; i < count; i++) {
+        /* Wait for a slot the encoder is not holding */
+        pthread_mutex_lock(&p.lock);
+        int slot = -1;
+        for (;;) {
+            for (int s = 0; s < g_state.slots; s++) {
+                if (!p.busy[s]) {
+                    slot = s;
+                    break;
+                }
             }
-            fclose(src);
-            fclose(dst);
-            unlink(g_state.temp_path);
-            TL_LOG("Copied to %s\n", output_path);
+            if (slot >= 0) break;
+            pthread_cond_wait(&p.cond, &p.lock);
+        }
+        p.busy[slot] = 1;
+        int encoded = p.encoded;
+        int errors = p.errors + decode_errors;
+        pthread_mutex_unlock(&p.lock);
+
+        /* Report what the encoder has finished so far */
+        if (progress) progress(encoded, count, errors, arg);
+
+        size_t size;
+        const uint8_t *data = get_frame(i, &size, frame_arg);
+        int ok = data && decode_to_slot(data, size, slot) == 0;
+
+        pthread_mutex_lock(&p.lock);
+        if (ok) {
+            p.queue[(p.head + p.count) % TL_VENC_SLOTS] = slot;
+            p.count++;
         } else {
-            if (src) fclose(src);
-            if (dst) fclose(dst);
-            TL_LOG("Copy failed\n");
-            timelapse_venc_cancel();
-            return -1;
+            p.busy[slot] = 0;
+            decode_errors++;
         }
-    } else {
-        TL_LOG("Created %s\n", output_path);
+        pthread_cond_broadcast(&p.cond);
+        pthread_mutex_unlock(&p.lock);
     }
 
-    /* Cleanup */
+    pthread_mutex_lock(&p.lock);
+    p.done = 1;
+    pthread_cond_broadcast(&p.cond);
+    pthread_mutex_unlock(&p.lock);
+    pthread_join(thread, NULL);
+
+    int errors = p.errors + decode_errors;
+    if (progress) progress(count, count, errors, arg);
+
+    pthread_cond_destroy(&p.cond);
+    pthread_mutex_destroy(&p.lock);
+    return errors;
+}
+
+/* Tear down VDEC/VENC and free everything; the output files are untouched */
+static void release_encoder(void) {
+    cleanup_vdec_timelapse();
     cleanup_venc_timelapse();
-    RK_MPI_MB_ReleaseMB(g_state.mb_blk);
-    RK_MPI_MB_DestroyPool(g_state.mb_pool);
-    free(g_state.nv12_buffer);
-    tjDestroy(g_state.tj_handle);
+    release_slots();
+    free(g_state.yuv_buf);
+    free(g_state.held_au);
+    if (g_state.tj_handle) {
+        tjDestroy(g_state.tj_handle);
+    }
 
     memset(&g_state, 0, sizeof(g_state));
+}
 
+int timelapse_venc_finish(int hold_frames) {
+    if (!g_state.initialized) {
+        TL_LOG("Not initialized\n");
+        return -1;
+    }
+
+    TL_LOG("Finishing timelapse: %d frames, output=%s\n",
+           g_state.frame_count, g_state.output_path);
+
+    /* Last frame: its own duration plus the hold, as a single sample */
+    if (hold_frames < 0) hold_frames = 0;
+    if (hold_frames > 0 && g_state.held_size > 0) {
+        TL_LOG("Holding last frame for %d extra frames\n", hold_frames);
+    }
+    write_held_au(g_state.frame_duration * (uint32_t)(1 + hold_frames));
+
+    /* Close MP4 writer and muxer. In fragmented mode every frame is
+     * already on disk; there is no index left to write. */
+    mp4_h26x_write_close(&g_state.mp4_writer);
+    int mp4_ret = MP4E_close(g_state.mp4_mux);
+    if (mp4_ret != MP4E_STATUS_OK) {
+        TL_LOG("MP4E_close failed: %d\n", mp4_ret);
+    }
+    g_state.mp4_mux = NULL;
+
+    /* Make the contents durable before the rename publishes them */
+    sync_temp_file();
+    long final_size = ftell(g_state.temp_file);
+    fclose(g_state.temp_file);
+    g_state.temp_file = NULL;
+
+    /* Same directory, so rename is atomic: readers see either no file
+     * or the complete one */
+    if (rename(g_state.temp_path, g_state.output_path) != 0) {
+        /* The .part may be the only copy of the recording (streaming):
+         * leave it and its link for orphan recovery */
+        TL_LOG("rename %s -> %s failed: %s, keeping the .part\n",
+               g_state.temp_path, g_state.output_path, strerror(errno));
+        release_encoder();
+        return -1;
+    }
+    sync_parent_dir(g_state.output_path);
+    remove_part_link();
+
+    TL_LOG("Created %s (%ld bytes)\n", g_state.output_path, final_size);
+    if (g_state.hw_frames > 0) {
+        TL_LOG("Decoded %d frames with VDEC, %d with TurboJPEG\n",
+               g_state.hw_frames, g_state.sw_frames);
+    }
+
+    release_encoder();
     return 0;
 }
 
@@ -694,25 +1228,9 @@ void timelapse_venc_cancel(void) {
     if (g_state.temp_path[0]) {
         unlink(g_state.temp_path);
     }
+    remove_part_link();
 
-    /* Cleanup VENC */
-    cleanup_venc_timelapse();
-
-    /* Free resources */
-    if (g_state.mb_blk != MB_INVALID_HANDLE) {
-        RK_MPI_MB_ReleaseMB(g_state.mb_blk);
-    }
-    if (g_state.mb_pool != MB_INVALID_POOLID) {
-        RK_MPI_MB_DestroyPool(g_state.mb_pool);
-    }
-    if (g_state.nv12_buffer) {
-        free(g_state.nv12_buffer);
-    }
-    if (g_state.tj_handle) {
-        tjDestroy(g_state.tj_handle);
-    }
-
-    memset(&g_state, 0, sizeof(g_state));
+    release_encoder();
 }
 
 int timelapse_venc_is_active(void) {
@@ -722,3 +1240,178 @@ int timelapse_venc_is_active(void) {
 int timelapse_venc_get_frame_count(void) {
     return g_state.frame_count;
 }
+
+/*
+ * Thumbnail decode
+ *
+ * Not part of the encoder state: called from the thumbnail worker in
+ * timelapse_index.c, possibly while an assembly holds VDEC_CHN_TIMELAPSE.
+ */
+
+/* Set once the decoder refused an H.264 channel; not retried until restart */
+static int g_thumb_decode_unavailable = 0;
+
+/* Box-filter an NV12 frame down by an integer factor into planar I420 */
+static uint8_t *nv12_to_i420_scaled(const uint8_t *nv12, int width, int height,
+                                    int stride, int rows, int min_width,
+                                    int *out_width, int *out_height) {
+    int f = min_width > 0 ? width / min_width : 1;
+    if (f < 1) f = 1;
+    int ow = (width / f) & ~1;
+    int oh = (height / f) & ~1;
+    if (ow < 2 || oh < 2) return NULL;
+
+    uint8_t *out = malloc((size_t)ow * oh * 3 / 2);
+    if (!out) return NULL;
+    uint8_t *oy = out;
+    uint8_t *ou = oy + (size_t)ow * oh;
+    uint8_t *ov = ou + (size_t)(ow / 2) * (oh / 2);
+    int area = f * f;
+
+    for (int y = 0; y < oh; y++) {
+        for (int x = 0; x < ow; x++) {
+            const uint8_t *src = nv12 + (size_t)y * f * stride + (size_t)x * f;
+            int sum = 0;
+            for (int j = 0; j < f; j++, src += stride)
+                for (int i = 0; i < f; i++)
+                    sum += src[i];
+            *oy++ = (uint8_t)(sum / area);
+        }
+    }
+
+    const uint8_t *uv = nv12 + (size_t)stride * rows;
+    for (int y = 0; y < oh / 2; y++) {
+        for (int x = 0; x < ow / 2; x++) {
+            const uint8_t *src = uv + (size_t)y * f * stride + (size_t)x * f * 2;
+            int su = 0, sv = 0;
+            for (int j = 0; j < f; j++, src += stride) {
+                for (int i = 0; i < f; i++) {
+                    su += src[2 * i];
+                    sv += src[2 * i + 1];
+                }
+            }
+            *ou++ = (uint8_t)(su / area);
+            *ov++ = (uint8_t)(sv / area);
+        }
+    }
+
+    *out_width = ow;
+    *out_height = oh;
+    return out;
+}
+
+uint8_t *timelapse_venc_decode_idr(const uint8_t *au, size_t au_size, int width, int height,
+                                   int min_width, int *out_width, int *out_height) {
+    if (g_thumb_decode_unavailable || !au || au_size == 0 || width <= 0 || height <= 0)
+        return NULL;
+
+    int vir_width = TL_ALIGN16(width);
+    int vir_height = TL_ALIGN16(height);
+    uint8_t *out = NULL;
+    RK_S32 ret;
+
+    MB_POOL_CONFIG_S pool_cfg;
+    memset(&pool_cfg, 0, sizeof(pool_cfg));
+    pool_cfg.u64MBSize = au_size;
+    pool_cfg.u32MBCnt = 1;
+    pool_cfg.enAllocType = MB_ALLOC_TYPE_DMA;
+    pool_cfg.bPreAlloc = RK_TRUE;
+
+    MB_POOL pool = RK_MPI_MB_CreatePool(&pool_cfg);
+    if (pool == MB_INVALID_POOLID) return NULL;
+    MB_BLK blk = RK_MPI_MB_GetMB(pool, au_size, RK_TRUE);
+    uint8_t *vaddr = blk != MB_INVALID_HANDLE ?
+        (uint8_t *)RK_MPI_MB_Handle2VirAddr(blk) : NULL;
+    if (!vaddr) goto out_blk;
+    memcpy(vaddr, au, au_size);
+    RK_MPI_SYS_MmzFlushCache(blk, RK_FALSE);
+
+    VDEC_CHN_ATTR_S attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.enMode = VIDEO_MODE_FRAME;
+    attr.enType = RK_VIDEO_ID_AVC;
+    attr.u32PicWidth = width;
+    attr.u32PicHeight = height;
+    attr.u32PicVirWidth = vir_width;
+    attr.u32PicVirHeight = vir_height;
+    attr.u32StreamBufCnt = 1;
+    attr.u32StreamBufSize = au_size;
+    /* The IDR plus a spare; nothing references it afterwards */
+    attr.u32FrameBufCnt = 2;
+    attr.u32FrameBufSize = vir_width * vir_height * 3 / 2;
+    attr.stVdecVideoAttr.u32RefFrameNum = 1;
+
+    ret = RK_MPI_VDEC_CreateChn(VDEC_CHN_THUMB, &attr);
+    if (ret != RK_SUCCESS) {
+        TL_LOG("VDEC: no H.264 decode (0x%x), thumbnails use the fallback\n", ret);
+        g_thumb_decode_unavailable = 1;
+        goto out_blk;
+    }
+
+    /* Decoder order, I frames only: the IDR comes out without reordering */
+    VDEC_CHN_PARAM_S param;
+    memset(&param, 0, sizeof(param));
+    if (RK_MPI_VDEC_GetChnParam(VDEC_CHN_THUMB, &param) == RK_SUCCESS) {
+        param.stVdecVideoParam.enDecMode = VIDEO_DEC_MODE_I;
+        param.stVdecVideoParam.enOutputOrder = VIDEO_OUTPUT_ORDER_DEC;
+        param.stVdecVideoParam.enCompressMode = COMPRESS_MODE_NONE;
+        RK_MPI_VDEC_SetChnParam(VDEC_CHN_THUMB, &param);
+    }
+    RK_MPI_VDEC_SetDisplayMode(VDEC_CHN_THUMB, VIDEO_DISPLAY_MODE_PLAYBACK);
+
+    ret = RK_MPI_VDEC_StartRecvStream(VDEC_CHN_THUMB);
+    if (ret != RK_SUCCESS) {
+        TL_LOG("VDEC: thumbnail RK_MPI_VDEC_StartRecvStream failed: 0x%x\n", ret);
+        goto out_chn;
+    }
+
+    VDEC_STREAM_S stream;
+    memset(&stream, 0, sizeof(stream));
+    stream.pMbBlk = blk;
+    stream.u32Len = au_size;
+    stream.bEndOfFrame = RK_TRUE;
+    stream.bEndOfStream = RK_TRUE;      /* flush: no more frames follow */
+    stream.bBypassMbBlk = RK_FALSE;
+
+    ret = RK_MPI_VDEC_SendStream(VDEC_CHN_THUMB, &stream, 1000);
+    if (ret != RK_SUCCESS) {
+        TL_LOG("VDEC: thumbnail RK_MPI_VDEC_SendStream failed: 0x%x\n", ret);
+        goto out_recv;
+    }
+
+    VIDEO_FRAME_INFO_S frame;
+    memset(&frame, 0, sizeof(frame));
+    ret = RK_MPI_VDEC_GetFrame(VDEC_CHN_THUMB, &frame, 2000);
+    if (ret != RK_SUCCESS) {
+        TL_LOG("VDEC: thumbnail RK_MPI_VDEC_GetFrame failed: 0x%x\n", ret);
+        goto out_recv;
+    }
+
+    uint8_t *nv12 = (uint8_t *)RK_MPI_MB_Handle2VirAddr(frame.stVFrame.pMbBlk);
+    if (nv12 && frame.stVFrame.enPixelFormat == RK_FMT_YUV420SP &&
+        frame.stVFrame.u32Width > 0 && frame.stVFrame.u32Height > 0 &&
+        frame.stVFrame.u32VirWidth >= frame.stVFrame.u32Width &&
+        frame.stVFrame.u32VirHeight >= frame.stVFrame.u32Height) {
+        /* Written by the decoder: drop stale cache lines before reading */
+        RK_MPI_SYS_MmzFlushCache(frame.stVFrame.pMbBlk, RK_TRUE);
+        out = nv12_to_i420_scaled(nv12, frame.stVFrame.u32Width, frame.stVFrame.u32Height,
+                                  frame.stVFrame.u32VirWidth, frame.stVFrame.u32VirHeight,
+                                  min_width, out_width, out_height);
+    } else {
+        TL_LOG("VDEC: thumbnail frame fmt=%d %ux%u (vir %ux%u) not usable\n",
+               frame.stVFrame.enPixelFormat,
+               frame.stVFrame.u32Width, frame.stVFrame.u32Height,
+               frame.stVFrame.u32VirWidth, frame.stVFrame.u32VirHeight);
+    }
+    RK_MPI_VDEC_ReleaseFrame(VDEC_CHN_THUMB, &frame);
+
+out_recv:
+    RK_MPI_VDEC_StopRecvStream(VDEC_CHN_THUMB);
+out_chn:
+    RK_MPI_VDEC_DestroyChn(VDEC_CHN_THUMB);
+out_blk:
+    if (blk != MB_INVALID_HANDLE)
+        RK_MPI_MB_ReleaseMB(blk);
+    RK_MPI_MB_DestroyPool(pool);
+    return out;
+}
@@ -11,10 +11,25 @@
 #include <stdint.h>
 #include <stddef.h>
 
+/* The MP4 is written as <output_path>.part next to its final name and
+ * renamed into place by finish. The timelapse temp dir gets a small link
+ * file holding the .part path so orphan recovery can find it. */
+#define TIMELAPSE_VENC_PART_EXT     ".part"
+#define TIMELAPSE_VENC_PART_LINK    "mp4_part"
+
+/* fsync the .part file at most this often while frames are added */
+#define TIMELAPSE_VENC_SYNC_US      (2 * 1000000ULL)
+
 /* Initialize VENC timelapse encoder
+ * flip_x/flip_y: Mirror horizontally/vertically in the encoder
+ * output_path: Full path of the final MP4 file
+ * Output is a fragmented MP4 (moov up front, one moof+mdat per frame),
+ * so everything synced before a crash stays playable. Each frame is
+ * written when the next one is encoded, so a crash also loses the newest.
  * Returns 0 on success, -1 on failure
  */
-int timelapse_venc_init(int width, int height, int fps);
+int timelapse_venc_init(int width, int height, int fps, int flip_x, int flip_y,
+                        const char *output_path);
 
 /* Add a JPEG frame to the timelapse
  * Decodes JPEG, encodes to H.264, writes to MP4
@@ -22,14 +37,37 @@ int timelapse_venc_init(int width, int height, int fps);
  */
 int timelapse_venc_add_frame(const uint8_t *jpeg_data, size_t jpeg_size);
 
-/* Finish timelapse and write final MP4 file
- * output_path: Full path for the output MP4 file
+/* Progress callback for timelapse_venc_encode_frames()
+ * done: frames through the encoder so far (including failed ones)
+ */
+typedef void (*timelapse_venc_progress_cb)(int done, int total, int errors, void *arg);
+
+/* Frame source for timelapse_venc_encode_frames(): returns frame n (0-based,
+ * requested in order) and its size, or NULL if it cannot be read. The data
+ * only has to stay valid until the next call.
+ */
+typedef const uint8_t *(*timelapse_venc_frame_cb)(int n, size_t *size, void *arg);
+
+/* Encode frames 0..count-1 from get_frame
+ * Decoding of the next frame overlaps hardware encoding of the current
+ * one (encode thread + two VENC input blocks). progress may be NULL.
+ * Returns the number of frames that failed, or -1 if not initialized
+ */
+int timelapse_venc_encode_frames(int count, timelapse_venc_frame_cb get_frame,
+                                 void *frame_arg,
+                                 timelapse_venc_progress_cb progress, void *arg);
+
+/* Finish timelapse: write the last frame, shown for hold_frames extra
+ * frame durations (one MP4 sample, not re-encoded), sync the .part file
+ * and rename it to the output path given to timelapse_venc_init
+ * If the rename fails the .part and its link file are kept, so orphan
+ * recovery can still salvage the recording.
  * Returns 0 on success, -1 on failure
  */
-int timelapse_venc_finish(const char *output_path);
+int timelapse_venc_finish(int hold_frames);
 
 /* Cancel timelapse without creating output file
- * Cleans up all resources
+ * Cleans up all resources and removes the .part file
  */
 void timelapse_venc_cancel(void);
 
@@ -39,4 +77,16 @@ int timelapse_venc_is_active(void);
 /* Get current frame count */
 int timelapse_venc_get_frame_count(void);
 
+/* Decode one H.264 access unit (Annex B: SPS, PPS and an IDR slice) of a
+ * width x height stream with the hardware decoder, for recording thumbnails.
+ * The frame is box-filtered down by the largest integer factor that keeps
+ * it at least min_width wide. Independent of the encoder above, so it can
+ * run during an assembly.
+ * Returns a malloc'd I420 image (caller frees) with *out_width and
+ * *out_height set, or NULL if the frame does not decode or there is no
+ * H.264 decoder.
+ */
+uint8_t *timelapse_venc_decode_idr(const uint8_t *au, size_t au_size, int width, int height,
+                                   int min_width, int *out_width, int *out_height);
+
 #endif /* TIMELAPSE_VENC_H */
@@ -0,0 +1,556 @@
+/*
+ * Timelapse Encode Bench
+ *
+ * Host-side throughput benchmark for the VENC timelapse assembly path.
+ * Feeds a timelapse temp dir (staging segments or frame_NNNN.jpg files)
+ * through timelapse_venc_add_frame() one frame at a time, or with -p
+ * through the decode/encode pipeline that timelapse_finalize() and orphan
+ * recovery use, and reports frames/s, per-frame latency and peak RSS.
+ *
+ * timelapse_venc.c is compiled into this file so the file read, TurboJPEG
+ * decode, NV12 repack and fragmented MP4 muxing run unmodified. The RKMPI
+ * memory blocks are plain heap memory and the VENC is a stub that returns
+ * a fixed SPS/PPS/IDR packet for the first frame and a small P slice for
+ * every other frame, so the numbers cover everything except the hardware
+ * encode itself. -e adds a fixed sleep per frame in the stub GetStream to
+ * stand in for the VENC encode time when comparing the two paths.
+ *
+ * The VDEC stub fails to open unless -H is given, so the default run
+ * measures the TurboJPEG fallback. With -H it returns a blank NV12 frame
+ * per JPEG, which exercises the hardware decode hand-off (frame held by a
+ * slot, released after encode) without any pixel work.
+ *
+ * -w DIR benchmarks the capture side instead: every input frame is stored
+ * once as its own file, the way deferred capture used to, and once through
+ * the staging ring (timelapse_stage.c). It reports per-capture latency,
+ * write calls and bytes on disk for both, reads the staged frames back and
+ * compares them with the input. DIR/segments can then be fed to -i.
+ *
+ * The finished MP4 is read back with mp4_probe_duration() (timelapse_index.c,
+ * linked alongside) and must report exactly the encoded frames plus the
+ * -l hold, which checks the fragment duration fallback of the list index.
+ *
+ * Build on the host with `make tl_bench`.
+ */
+
+#include "timelapse_venc.c"
+#include "timelapse_stage.c"
+#include "timelapse_index.h"
+
+#include <getopt.h>
+#include <math.h>
+#include <sys/resource.h>
+
+/* timelapse_venc.c reads the recording temp dir from here */
+TimelapseState g_timelapse;
+
+/* ============================================================================
+ * Stub RKMPI memory blocks
+ * ============================================================================ */
+
+MB_POOL RK_MPI_MB_CreatePool(MB_POOL_CONFIG_S *pstMbPoolCfg)
+{
+    (void)pstMbPoolCfg;
+    return 1;
+}
+
+RK_S32 RK_MPI_MB_DestroyPool(MB_POOL pool)
+{
+    (void)pool;
+    return RK_SUCCESS;
+}
+
+MB_BLK RK_MPI_MB_GetMB(MB_POOL pool, RK_U64 u64Size, RK_BOOL block)
+{
+    (void)pool; (void)block;
+    void *p = NULL;
+    if (posix_memalign(&p, 4096, (size_t)u64Size) != 0)
+        return MB_INVALID_HANDLE;
+    return p;
+}
+
+RK_S32 RK_MPI_MB_ReleaseMB(MB_BLK mb)
+{
+    free(mb);
+    return RK_SUCCESS;
+}
+
+RK_VOID *RK_MPI_MB_Handle2VirAddr(MB_BLK mb) { return mb; }
+
+RK_S32 RK_MPI_SYS_MmzFlushCache(MB_BLK blk, RK_BOOL bReadOnly)
+{
+    (void)blk; (void)bReadOnly;
+    return RK_SUCCESS;
+}
+
+/* ============================================================================
+ * Stub VENC
+ * ============================================================================ */
+
+/* 1280x720 High profile SPS + PPS + start of an IDR slice */
+static uint8_t bench_idr[] = {
+    0x00, 0x00, 0x00, 0x01, 0x67, 0x64, 0x00, 0x1f, 0xac, 0xd9, 0x40, 0x50,
+    0x05, 0xbb, 0x01, 0x10, 0x00, 0x00, 0x03, 0x00, 0x10, 0x00, 0x00, 0x03,
+    0x03, 0x20, 0xf1, 0x83, 0x19, 0x60,
+    0x00, 0x00, 0x00, 0x01, 0x68, 0xeb, 0xe3, 0xcb, 0x22, 0xc0,
+    0x00, 0x00, 0x00, 0x01, 0x65, 0x88, 0x84, 0x00, 0x33, 0xff, 0xfe, 0xf6,
+    0xf0, 0xfe, 0x05, 0x36, 0x56, 0x04, 0x50, 0x96, 0x7b, 0x3f, 0x53, 0xe1
+};
+
+static uint8_t bench_p[] = {
+    0x00, 0x00, 0x00, 0x01, 0x41, 0x9a, 0x21, 0x6c, 0x42, 0xbf, 0xfe, 0x38,
+    0x40, 0x00, 0x11, 0x6f, 0x7e, 0x1c, 0x2d, 0x05, 0x36, 0x56, 0x04, 0x50
+};
+
+static int bench_sent;
+static uint64_t bench_nv12_sum;
+static int bench_encode_us;
+
+RK_S32 RK_MPI_VENC_CreateChn(VENC_CHN VeChn, const VENC_CHN_ATTR_S *pstAttr)
+{
+    (void)VeChn; (void)pstAttr;
+    bench_sent = 0;
+    return RK_SUCCESS;
+}
+
+RK_S32 RK_MPI_VENC_DestroyChn(VENC_CHN VeChn) { (void)VeChn; return RK_SUCCESS; }
+
+RK_S32 RK_MPI_VENC_StartRecvFrame(VENC_CHN VeChn, const VENC_RECV_PIC_PARAM_S *pstRecvParam)
+{
+    (void)VeChn; (void)pstRecvParam;
+    return RK_SUCCESS;
+}
+
+RK_S32 RK_MPI_VENC_StopRecvFrame(VENC_CHN VeChn) { (void)VeChn; return RK_SUCCESS; }
+
+RK_S32 RK_MPI_VENC_SendFrame(VENC_CHN VeChn, const VIDEO_FRAME_INFO_S *pstFrame,
+                             RK_S32 s32MilliSec)
+{
+    (void)VeChn; (void)s32MilliSec;
+    /* Touch the input like the DMA engine would, so the repack isn't dead */
+    const uint8_t *p = pstFrame->stVFrame.pMbBlk;
+    bench_nv12_sum += p[0] + p[pstFrame->stVFrame.u32Width * pstFrame->stVFrame.u32Height];
+    bench_sent++;
+    return RK_SUCCESS;
+}
+
+RK_S32 RK_MPI_VENC_GetStream(VENC_CHN VeChn, VENC_STREAM_S *pstStream, RK_S32 s32MilliSec)
+{
+    (void)VeChn; (void)s32MilliSec;
+    if (!pstStream->pstPack)
+        return -1;
+    if (bench_encode_us > 0)
+        usleep(bench_encode_us);
+    int idr = (bench_sent == 1);
+    pstStream->u32PackCount = 1;
+    pstStream->pstPack[0].pMbBlk = idr ? bench_idr : bench_p;
+    pstStream->pstPack[0].u32Len = idr ? sizeof(bench_idr) : sizeof(bench_p);
+    return RK_SUCCESS;
+}
+
+RK_S32 RK_MPI_VENC_ReleaseStream(VENC_CHN VeChn, VENC_STREAM_S *pstStream)
+{
+    (void)VeChn; (void)pstStream;
+    return RK_SUCCESS;
+}
+
+/* ============================================================================
+ * Stub VDEC
+ * ============================================================================ */
+
+#define BENCH_VDEC_FRAMES (TL_VENC_SLOTS + 1)
+
+static int bench_hw_decode;
+static VDEC_CHN_ATTR_S bench_vdec_attr;
+static uint8_t *bench_vdec_buf[BENCH_VDEC_FRAMES];
+static int bench_vdec_busy[BENCH_VDEC_FRAMES];
+static int bench_vdec_pending;
+static int bench_vdec_decoded;
+
+RK_S32 RK_MPI_VDEC_CreateChn(VDEC_CHN VdChn, const VDEC_CHN_ATTR_S *pstAttr)
+{
+    (void)VdChn;
+    if (!bench_hw_decode)
+        return -1;
+    bench_vdec_attr = *pstAttr;
+    size_t size = (size_t)pstAttr->u32PicVirWidth * pstAttr->u32PicVirHeight * 3 / 2;
+    for (int i = 0; i < BENCH_VDEC_FRAMES; i++) {
+        bench_vdec_buf[i] = calloc(1, size);
+        if (!bench_vdec_buf[i])
+            return -1;
+    }
+    return RK_SUCCESS;
+}
+
+RK_S32 RK_MPI_VDEC_DestroyChn(VDEC_CHN VdChn)
+{
+    (void)VdChn;
+    for (int i = 0; i < BENCH_VDEC_FRAMES; i++) {
+        free(bench_vdec_buf[i]);
+        bench_vdec_buf[i] = NULL;
+    }
+    return RK_SUCCESS;
+}
+
+RK_S32 RK_MPI_VDEC_GetChnParam(VDEC_CHN VdChn, VDEC_CHN_PARAM_S *pstParam)
+{
+    (void)VdChn;
+    memset(pstParam, 0, sizeof(*pstParam));
+    return RK_SUCCESS;
+}
+
+RK_S32 RK_MPI_VDEC_SetChnParam(VDEC_CHN VdChn, const VDEC_CHN_PARAM_S *pstParam)
+{
+    (void)VdChn; (void)pstParam;
+    return RK_SUCCESS;
+}
+
+RK_S32 RK_MPI_VDEC_SetDisplayMode(VDEC_CHN VdChn, VIDEO_DISPLAY_MODE_E enDisplayMode)
+{
+    (void)VdChn; (void)enDisplayMode;
+    return RK_SUCCESS;
+}
+
+RK_S32 RK_MPI_VDEC_StartRecvStream(VDEC_CHN VdChn) { (void)VdChn; return RK_SUCCESS; }
+RK_S32 RK_MPI_VDEC_StopRecvStream(VDEC_CHN VdChn) { (void)VdChn; return RK_SUCCESS; }
+
+RK_S32 RK_MPI_VDEC_SendStream(VDEC_CHN VdChn, const VDEC_STREAM_S *pstStream,
+                              RK_S32 s32MilliSec)
+{
+    (void)VdChn; (void)s32MilliSec;
+    const uint8_t *p = pstStream->pMbBlk;
+    if (pstStream->u32Len < 2 || p[0] != 0xFF || p[1] != 0xD8)
+        return -1;
+    bench_vdec_pending++;
+    return RK_SUCCESS;
+}
+
+RK_S32 RK_MPI_VDEC_GetFrame(VDEC_CHN VdChn, VIDEO_FRAME_INFO_S *pstFrameInfo,
+                            RK_S32 s32MilliSec)
+{
+    (void)VdChn; (void)s32MilliSec;
+    if (bench_vdec_pending == 0)
+        return -1;
+    /* Playback mode would block here; a stub has nobody to wait for */
+    for (int i = 0; i < BENCH_VDEC_FRAMES; i++) {
+        if (bench_vdec_busy[i])
+            continue;
+        bench_vdec_busy[i] = 1;
+        bench_vdec_pending--;
+        bench_vdec_decoded++;
+        memset(pstFrameInfo, 0, sizeof(*pstFrameInfo));
+        pstFrameInfo->stVFrame.pMbBlk = bench_vdec_buf[i];
+        pstFrameInfo->stVFrame.u32Width = bench_vdec_attr.u32PicWidth;
+        pstFrameInfo->stVFrame.u32Height = bench_vdec_attr.u32PicHeight;
+        pstFrameInfo->stVFrame.u32VirWidth = bench_vdec_attr.u32PicVirWidth;
+        pstFrameInfo->stVFrame.u32VirHeight = bench_vdec_attr.u32PicVirHeight;
+        pstFrameInfo->stVFrame.enPixelFormat = RK_FMT_YUV420SP;
+        return RK_SUCCESS;
+    }
+    fprintf(stderr, "tl_bench: all VDEC frames held, release path leaks\n");
+    return -1;
+}
+
+RK_S32 RK_MPI_VDEC_ReleaseFrame(VDEC_CHN VdChn, const VIDEO_FRAME_INFO_S *pstFrameInfo)
+{
+    (void)VdChn;
+    for (int i = 0; i < BENCH_VDEC_FRAMES; i++) {
+        if (bench_vdec_buf[i] == pstFrameInfo->stVFrame.pMbBlk) {
+            bench_vdec_busy[i] = 0;
+            return RK_SUCCESS;
+        }
+    }
+    return -1;
+}
+
+/* ============================================================================
+ * Capture bench
+ * ============================================================================ */
+
+static int cmp_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+/* Apparent and allocated bytes of the regular files in dir */
+static void dir_usage(const char *dir, uint64_t *bytes, uint64_t *blocks, int *files)
+{
+    *bytes = *blocks = 0;
+    *files = 0;
+    DIR *d = opendir(dir);
+    if (!d)
+        return;
+    struct dirent *e;
+    char path[TIMELAPSE_PATH_MAX];
+    while ((e = readdir(d)) != NULL) {
+        struct stat st;
+        snprintf(path, sizeof(path), "%s/%s", dir, e->d_name);
+        if (stat(path, &st) != 0 || !S_ISREG(st.st_mode))
+            continue;
+        *bytes += st.st_size;
+        *blocks += (uint64_t)st.st_blocks * 512;
+        (*files)++;
+    }
+    closedir(d);
+}
+
+static void print_capture(const char *name, uint64_t *lat, int count, const char *dir,
+                          uint64_t payload, int writes, uint64_t flush_us)
+{
+    uint64_t sum = 0, bytes, blocks;
+    int files;
+    for (int i = 0; i < count; i++)
+        sum += lat[i];
+    qsort(lat, count, sizeof(*lat), cmp_u64);
+    dir_usage(dir, &bytes, &blocks, &files);
+
+    printf("%-9s capture %.3f ms avg, %.3f ms p99, %.3f ms max",
+           name, sum / 1000.0 / count, lat[count * 99 / 100] / 1000.0,
+           lat[count - 1] / 1000.0);
+    if (flush_us)
+        printf(" (+%.1f ms final flush)", flush_us / 1000.0);
+    printf("\n          %d files, %d writes, %llu bytes (%.4fx payload), "
+           "%llu allocated (%.4fx)\n",
+           files, writes, (unsigned long long)bytes, (double)bytes / payload,
+           (unsigned long long)blocks, (double)blocks / payload);
+}
+
+static int bench_capture(TLStageReader *in, int count, const char *out)
+{
+    char files_dir[TIMELAPSE_PATH_MAX], seg_dir[TIMELAPSE_PATH_MAX];
+    char path[TIMELAPSE_PATH_MAX];
+    snprintf(files_dir, sizeof(files_dir), "%s/files", out);
+    snprintf(seg_dir, sizeof(seg_dir), "%s/segments", out);
+    mkdir(out, 0755);
+    if (mkdir(files_dir, 0755) != 0 && errno != EEXIST) {
+        perror(files_dir);
+        return 1;
+    }
+    if (mkdir(seg_dir, 0755) != 0 && errno != EEXIST) {
+        perror(seg_dir);
+        return 1;
+    }
+
+    /* Capture hands over a JPEG already in memory */
+    uint8_t **jpeg = calloc(count, sizeof(*jpeg));
+    size_t *size = calloc(count, sizeof(*size));
+    uint64_t *lat = calloc(count, sizeof(*lat));
+    uint64_t payload = 0;
+    if (!jpeg || !size || !lat)
+        return 1;
+    for (int i = 0; i < count; i++) {
+        const uint8_t *p = tl_stage_reader_frame(in, i, &size[i]);
+        jpeg[i] = p ? malloc(size[i]) : NULL;
+        if (!jpeg[i]) {
+            fprintf(stderr, "Cannot load frame %d\n", i);
+            return 1;
+        }
+        memcpy(jpeg[i], p, size[i]);
+        payload += size[i];
+    }
+
+    /* Old path: one file per frame, written from the capture thread */
+    for (int i = 0; i < count; i++) {
+        int len = snprintf(path, sizeof(path), "%s/frame_%04d.jpg", files_dir, i);
+        if (len < 0 || (size_t)len >= sizeof(path)) {
+            fprintf(stderr, "Path too long: %s\n", files_dir);
+            return 1;
+        }
+        uint64_t t0 = get_time_us();
+        FILE *f = fopen(path, "wb");
+        if (!f || fwrite(jpeg[i], 1, size[i], f) != size[i]) {
+            perror(path);
+            return 1;
+        }
+        fclose(f);
+        lat[i] = get_time_us() - t0;
+    }
+    print_capture("files:", lat, count, files_dir, payload, count, 0);
+
+    /* New path: staging ring, segments written by its own thread */
+    if (tl_stage_open(seg_dir) != 0)
+        return 1;
+    for (int i = 0; i < count; i++) {
+        uint64_t t0 = get_time_us();
+        if (tl_stage_append(i, jpeg[i], size[i]) != 0) {
+            fprintf(stderr, "tl_stage_append failed at frame %d\n", i);
+            return 1;
+        }
+        lat[i] = get_time_us() - t0;
+    }
+    TLStageStats stats;
+    uint64_t t0 = get_time_us();
+    int lost = tl_stage_close(&stats);
+    uint64_t flush_us = get_time_us() - t0;
+    print_capture("segments:", lat, count, seg_dir, payload, stats.writes, flush_us);
+
+    /* Round trip: everything staged must read back unchanged */
+    TLStageReader back;
+    int n = tl_stage_reader_open(&back, seg_dir);
+    int bad = 0;
+    for (int i = 0; i < count; i++) {
+        size_t sz;
+        const uint8_t *p = i < n ? tl_stage_reader_frame(&back, i, &sz) : NULL;
+        if (!p || sz != size[i] || memcmp(p, jpeg[i], sz) != 0)
+            bad++;
+    }
+    tl_stage_reader_close(&back);
+    printf("readback:  %d/%d frames identical%s\n", count - bad, count,
+           lost ? ", writer lost frames" : "");
+
+    for (int i = 0; i < count; i++)
+        free(jpeg[i]);
+    free(jpeg);
+    free(size);
+    free(lat);
+    return bad || lost ? 1 : 0;
+}
+
+/* ============================================================================
+ * Bench driver
+ * ============================================================================ */
+
+static const uint8_t *bench_frame(int n, size_t *size, void *arg)
+{
+    return tl_stage_reader_frame(arg, n, size);
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s -i <frames_dir> [options]\n"
+            "  -i DIR   Temp dir with staging segments or frame_NNNN.jpg files\n"
+            "  -n N     Encode at most N frames (default: all)\n"
+            "  -r N     Repeat the whole set N times (default: 1)\n"
+            "  -o FILE  Output MP4 (default: /tmp/tl_bench.mp4)\n"
+            "  -p       Pipelined decode/encode (timelapse_venc_encode_frames)\n"
+            "  -e MS    Simulated VENC encode time per frame (default: 0)\n"
+            "  -H       Stub hardware JPEG decode (hand-off only, no pixels)\n"
+            "  -l N     Hold the last frame for N extra frames\n"
+            "  -w DIR   Capture bench: per-frame files vs staging into DIR\n",
+            prog);
+}
+
+int main(int argc, char **argv)
+{
+    const char *dir = NULL;
+    const char *output = "/tmp/tl_bench.mp4";
+    const char *capture_dir = NULL;
+    int max_frames = 0;
+    int repeat = 1;
+    int pipelined = 0;
+    int hold = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "i:n:r:o:pe:Hl:w:h")) != -1) {
+        switch (opt) {
+        case 'i': dir = optarg; break;
+        case 'n': max_frames = atoi(optarg); break;
+        case 'r': repeat = atoi(optarg) > 0 ? atoi(optarg) : 1; break;
+        case 'o': output = optarg; break;
+        case 'p': pipelined = 1; break;
+        case 'H': bench_hw_decode = 1; break;
+        case 'e': bench_encode_us = (int)(atof(optarg) * 1000); break;
+        case 'l': hold = atoi(optarg); break;
+        case 'w': capture_dir = optarg; break;
+        default: usage(argv[0]); return 1;
+        }
+    }
+    if (!dir) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    /* Same frame source as timelapse_finalize() and orphan recovery */
+    TLStageReader frames;
+    int count = tl_stage_reader_open(&frames, dir);
+    if (count <= 0) {
+        fprintf(stderr, "No frames in %s\n", dir);
+        return 1;
+    }
+    if (max_frames > 0 && count > max_frames)
+        count = max_frames;
+
+    if (capture_dir) {
+        int cret = bench_capture(&frames, count, capture_dir);
+        tl_stage_reader_close(&frames);
+        return cret;
+    }
+
+    /* Dimensions from the first frame, as timelapse_finalize() does */
+    size_t hdr_size;
+    const uint8_t *hdr = tl_stage_reader_frame(&frames, 0, &hdr_size);
+    tjhandle tj = tjInitDecompress();
+    int width, height, subsamp, colorspace;
+    if (!hdr || !tj || tjDecompressHeader3(tj, hdr, hdr_size, &width, &height,
+                                           &subsamp, &colorspace) != 0) {
+        fprintf(stderr, "Cannot parse the first frame in %s\n", dir);
+        return 1;
+    }
+    tjDestroy(tj);
+
+    if (timelapse_venc_init(width, height, 30, 0, 0, output) != 0) {
+        fprintf(stderr, "timelapse_venc_init failed\n");
+        return 1;
+    }
+
+    int total = count * repeat;
+    int errors = 0;
+    uint64_t worst_us = 0;
+    uint64_t t0 = get_time_us();
+
+    if (pipelined) {
+        /* Whole set per call; worst is the slowest pass, not one frame */
+        for (int r = 0; r < repeat; r++) {
+            uint64_t f0 = get_time_us();
+            int e = timelapse_venc_encode_frames(count, bench_frame, &frames, NULL, NULL);
+            errors += e < 0 ? count : e;
+            uint64_t dt = (get_time_us() - f0) / count;
+            if (dt > worst_us) worst_us = dt;
+        }
+    } else {
+        for (int i = 0; i < total; i++) {
+            uint64_t f0 = get_time_us();
+            size_t size;
+            const uint8_t *jpeg = tl_stage_reader_frame(&frames, i % count, &size);
+            if (!jpeg || timelapse_venc_add_frame(jpeg, size) != 0)
+                errors++;
+            uint64_t dt = get_time_us() - f0;
+            if (dt > worst_us) worst_us = dt;
+        }
+    }
+
+    uint64_t elapsed = get_time_us() - t0;
+    int encoded = timelapse_venc_get_frame_count();
+    int ret = timelapse_venc_finish(hold);
+
+    /* What the recordings list will show for this file */
+    double duration = 0.0;
+    double expected = (encoded + hold) * (double)(90000 / 30) / 90000.0;
+    int duration_ok = ret == 0 && mp4_probe_duration(output, &duration) == 0 &&
+                      fabs(duration - expected) < 0.0005;
+    tl_stage_reader_close(&frames);
+
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+
+    printf("mode:       %s, %.1f ms simulated encode\n",
+           pipelined ? "pipelined" : "sequential", bench_encode_us / 1000.0);
+    printf("frames:     %d (%dx%d, %d errors)\n", total, width, height, errors);
+    if (bench_hw_decode)
+        printf("vdec:       %d frames decoded by the stub\n", bench_vdec_decoded);
+    printf("elapsed:    %.1f ms\n", elapsed / 1000.0);
+    printf("throughput: %.1f frames/s\n", total * 1e6 / (double)elapsed);
+    printf("per frame:  %.2f ms avg, %.2f ms worst\n",
+           elapsed / 1000.0 / total, worst_us / 1000.0);
+    printf("cpu:        %.2f ms/frame (user+sys)\n",
+           ((ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1e3 +
+            (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e3) / total);
+    printf("peak RSS:   %ld KB\n", ru.ru_maxrss);
+    printf("output:     %s (%s)\n", output, ret == 0 ? "ok" : "FAILED");
+    printf("duration:   %.3f s from tl_index, expected %.3f (%s)\n",
+           duration, expected, duration_ok ? "ok" : "FAILED");
+
+    return ret == 0 && errors == 0 && duration_ok ? 0 : 1;
+}